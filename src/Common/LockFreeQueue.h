@@ -0,0 +1,106 @@
+/* Copyright (C) 2006 - 2014 Jan Kundrát <jkt@flaska.net>
+
+   This file is part of the Trojita Qt IMAP e-mail client,
+   http://trojita.flaska.net/
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2 of
+   the License or (at your option) version 3 or any later version
+   accepted by the membership of KDE e.V. (or its successor approved
+   by the membership of KDE e.V.), which shall act as a proxy
+   defined in Section 14 of version 3 of the license.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#ifndef TROJITA_LOCKFREEQUEUE_H
+#define TROJITA_LOCKFREEQUEUE_H
+
+#include <atomic>
+
+namespace Common
+{
+
+/** @short Unbounded FIFO queue for passing items between exactly two threads
+
+This is a lock-free queue for the single-producer, single-consumer case. One thread is allowed to call push(), another
+one is allowed to call pop() and isEmpty(). Neither of these operations ever blocks, so the queue is suitable for passing
+data from and to the GUI thread.
+
+The queue is implemented as a singly linked list with a dummy head node. The producer only ever touches the tail, the
+consumer only ever touches the head, and the only shared state is the "next" pointer of the most recent node.
+*/
+template<typename T>
+class LockFreeQueue
+{
+public:
+    LockFreeQueue(): head_(new Node()), tail_(head_)
+    {
+    }
+
+    ~LockFreeQueue()
+    {
+        while (head_) {
+            Node *next = head_->next.load(std::memory_order_relaxed);
+            delete head_;
+            head_ = next;
+        }
+    }
+
+    /** @short Append an item to the end of the queue; only to be called from the producer thread */
+    void push(const T &what)
+    {
+        Node *node = new Node();
+        node->value = what;
+        tail_->next.store(node, std::memory_order_release);
+        tail_ = node;
+    }
+
+    /** @short Remove the oldest item from the queue; only to be called from the consumer thread
+
+    Returns false when there was nothing to dequeue.
+    */
+    bool pop(T &out)
+    {
+        Node *next = head_->next.load(std::memory_order_acquire);
+        if (!next)
+            return false;
+        out = next->value;
+        // The node becomes the new dummy head, so make sure that it does not keep its payload alive for no reason
+        next->value = T();
+        delete head_;
+        head_ = next;
+        return true;
+    }
+
+    /** @short Is there anything to dequeue? Only to be called from the consumer thread */
+    bool isEmpty() const
+    {
+        return !head_->next.load(std::memory_order_acquire);
+    }
+
+private:
+    struct Node {
+        std::atomic<Node *> next;
+        T value;
+        Node(): next(0) {}
+    };
+
+    LockFreeQueue(const LockFreeQueue &); // don't implement
+    LockFreeQueue &operator=(const LockFreeQueue &); // don't implement
+
+    /** @short Dummy node preceding the oldest item, owned by the consumer */
+    Node *head_;
+    /** @short The most recently added node, owned by the producer */
+    Node *tail_;
+};
+
+}
+
+#endif // TROJITA_LOCKFREEQUEUE_H
@@ -0,0 +1,229 @@
+/* Copyright (C) 2006 - 2014 Jan Kundrát <jkt@flaska.net>
+
+   This file is part of the Trojita Qt IMAP e-mail client,
+   http://trojita.flaska.net/
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2 of
+   the License or (at your option) version 3 or any later version
+   accepted by the membership of KDE e.V. (or its successor approved
+   by the membership of KDE e.V.), which shall act as a proxy
+   defined in Section 14 of version 3 of the license.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <cstring>
+#include "MimeCodecs.h"
+
+namespace Common
+{
+
+namespace
+{
+
+/** @short Number of raw bytes which make up one line of MIME-wrapped base64 */
+const int base64LineInput = 76 * 6 / 8;
+
+const char base64Alphabet[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+/** @short Value of each character in the base64 alphabet, or 0x80 for characters which are not a part of it */
+const uchar base64Values[256] = {
+    0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80,
+    0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80,
+    0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x3e, 0x80, 0x80, 0x80, 0x3f,
+    0x34, 0x35, 0x36, 0x37, 0x38, 0x39, 0x3a, 0x3b, 0x3c, 0x3d, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80,
+    0x80, 0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09, 0x0a, 0x0b, 0x0c, 0x0d, 0x0e,
+    0x0f, 0x10, 0x11, 0x12, 0x13, 0x14, 0x15, 0x16, 0x17, 0x18, 0x19, 0x80, 0x80, 0x80, 0x80, 0x80,
+    0x80, 0x1a, 0x1b, 0x1c, 0x1d, 0x1e, 0x1f, 0x20, 0x21, 0x22, 0x23, 0x24, 0x25, 0x26, 0x27, 0x28,
+    0x29, 0x2a, 0x2b, 0x2c, 0x2d, 0x2e, 0x2f, 0x30, 0x31, 0x32, 0x33, 0x80, 0x80, 0x80, 0x80, 0x80,
+    0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80,
+    0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80,
+    0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80,
+    0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80,
+    0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80,
+    0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80,
+    0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80,
+    0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80
+};
+
+/** @short Value of a hex digit in the quoted-printable encoding, -1 if invalid
+
+RFC 2045 only permits uppercase letters in the escape sequences.
+*/
+inline int qpHexValue(const char c)
+{
+    if (c >= '0' && c <= '9')
+        return c - '0';
+    if (c >= 'A' && c <= 'F')
+        return c - 'A' + 10;
+    return -1;
+}
+
+}
+
+int base64EncodedLength(const int rawLength, const Base64LineMode lineMode)
+{
+    int res = (rawLength + 2) / 3 * 4;
+    if (lineMode == BASE64_MIME_LINES)
+        res += 2 * ((rawLength + base64LineInput - 1) / base64LineInput);
+    return res;
+}
+
+char *base64Encode(const char *input, const int length, char *output, const Base64LineMode lineMode)
+{
+    const uchar *src = reinterpret_cast<const uchar *>(input);
+    const int lineInput = lineMode == BASE64_MIME_LINES ? base64LineInput : length;
+    int remaining = length;
+    while (remaining > 0) {
+        const int chunk = qMin(remaining, lineInput);
+        // Complete triplets are mapped to four characters each. The line length is a multiple of three, so a partial
+        // triplet can only occur at the very end of the input.
+        const uchar *tripletsEnd = src + chunk / 3 * 3;
+        while (src != tripletsEnd) {
+            const uint value = (uint(src[0]) << 16) | (uint(src[1]) << 8) | uint(src[2]);
+            output[0] = base64Alphabet[value >> 18];
+            output[1] = base64Alphabet[(value >> 12) & 0x3f];
+            output[2] = base64Alphabet[(value >> 6) & 0x3f];
+            output[3] = base64Alphabet[value & 0x3f];
+            src += 3;
+            output += 4;
+        }
+        switch (chunk % 3) {
+        case 1:
+            output[0] = base64Alphabet[src[0] >> 2];
+            output[1] = base64Alphabet[(src[0] & 0x03) << 4];
+            output[2] = '=';
+            output[3] = '=';
+            ++src;
+            output += 4;
+            break;
+        case 2:
+            output[0] = base64Alphabet[src[0] >> 2];
+            output[1] = base64Alphabet[((src[0] & 0x03) << 4) | (src[1] >> 4)];
+            output[2] = base64Alphabet[(src[1] & 0x0f) << 2];
+            output[3] = '=';
+            src += 2;
+            output += 4;
+            break;
+        }
+        if (lineMode == BASE64_MIME_LINES) {
+            output[0] = '\r';
+            output[1] = '\n';
+            output += 2;
+        }
+        remaining -= chunk;
+    }
+    return output;
+}
+
+QByteArray base64Encode(const QByteArray &raw, const Base64LineMode lineMode)
+{
+    QByteArray res;
+    res.resize(base64EncodedLength(raw.size(), lineMode));
+    char *end = base64Encode(raw.constData(), raw.size(), res.data(), lineMode);
+    Q_ASSERT(end == res.constData() + res.size());
+    Q_UNUSED(end);
+    return res;
+}
+
+QByteArray base64Decode(const QByteArray &encoded)
+{
+    QByteArray res;
+    res.resize(encoded.size() * 3 / 4);
+    const uchar *src = reinterpret_cast<const uchar *>(encoded.constData());
+    const uchar *end = src + encoded.size();
+    uchar *begin = reinterpret_cast<uchar *>(res.data());
+    uchar *dst = begin;
+
+    uint bits = 0;
+    int bitCount = 0;
+    while (src != end) {
+        if (bitCount == 0) {
+            // The fast path: as long as there are no line breaks or other junk, whole quadruplets decode into triplets
+            while (end - src >= 4) {
+                const uchar a = base64Values[src[0]];
+                const uchar b = base64Values[src[1]];
+                const uchar c = base64Values[src[2]];
+                const uchar d = base64Values[src[3]];
+                if ((a | b | c | d) & 0x80)
+                    break;
+                const uint value = (uint(a) << 18) | (uint(b) << 12) | (uint(c) << 6) | uint(d);
+                dst[0] = value >> 16;
+                dst[1] = value >> 8;
+                dst[2] = value;
+                src += 4;
+                dst += 3;
+            }
+            if (src == end)
+                break;
+        }
+
+        // Slow path, one character at a time until we are aligned at a quadruplet boundary again
+        const uchar value = base64Values[*src++];
+        if (value & 0x80)
+            continue;
+        bits = (bits << 6) | value;
+        bitCount += 6;
+        if (bitCount >= 8) {
+            bitCount -= 8;
+            *dst++ = bits >> bitCount;
+            bits &= (1u << bitCount) - 1;
+        }
+    }
+    res.truncate(dst - begin);
+    return res;
+}
+
+QByteArray quotedPrintableDecode(const QByteArray &encoded)
+{
+    QByteArray res;
+    res.resize(encoded.size());
+    const char *src = encoded.constData();
+    const char *end = src + encoded.size();
+    char *begin = res.data();
+    char *dst = begin;
+
+    while (src != end) {
+        // Everything up to the next escape is copied verbatim
+        const char *escape = static_cast<const char *>(memchr(src, '=', end - src));
+        const char *runEnd = escape ? escape : end;
+        memcpy(dst, src, runEnd - src);
+        dst += runEnd - src;
+        src = runEnd;
+        if (!escape)
+            break;
+
+        if (end - src > 2) {
+            if (src[1] == '\n') {
+                // soft line break with a bare LF
+                src += 2;
+                continue;
+            } else if (src[1] == '\r' && src[2] == '\n') {
+                // soft line break
+                src += 3;
+                continue;
+            }
+            const int high = qpHexValue(src[1]);
+            const int low = qpHexValue(src[2]);
+            if (high != -1 && low != -1) {
+                *dst++ = char((high << 4) | low);
+                src += 3;
+                continue;
+            }
+        }
+        // Malformed escape sequence, or a truncated one at the very end of the input: skip the equals sign
+        ++src;
+    }
+    res.truncate(dst - begin);
+    return res;
+}
+
+}
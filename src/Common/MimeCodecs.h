@@ -0,0 +1,64 @@
+/* Copyright (C) 2006 - 2014 Jan Kundrát <jkt@flaska.net>
+
+   This file is part of the Trojita Qt IMAP e-mail client,
+   http://trojita.flaska.net/
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2 of
+   the License or (at your option) version 3 or any later version
+   accepted by the membership of KDE e.V. (or its successor approved
+   by the membership of KDE e.V.), which shall act as a proxy
+   defined in Section 14 of version 3 of the license.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef TROJITA_COMMON_MIMECODECS_H
+#define TROJITA_COMMON_MIMECODECS_H
+
+#include <QByteArray>
+
+namespace Common
+{
+
+/** @short How to split the base64 output into lines */
+typedef enum {
+    BASE64_SINGLE_LINE, /**< Produce one long line without any line breaks */
+    BASE64_MIME_LINES /**< Terminate each line of at most 76 characters, including the last one, by CRLF */
+} Base64LineMode;
+
+/** @short Return the number of bytes which base64Encode() produces for @arg rawLength bytes of input */
+int base64EncodedLength(const int rawLength, const Base64LineMode lineMode);
+
+/** @short Encode @arg length bytes at @arg input into base64, write the result to @arg output
+
+The output buffer has to be at least base64EncodedLength() bytes long. Returns a pointer one past the last byte written.
+*/
+char *base64Encode(const char *input, const int length, char *output, const Base64LineMode lineMode);
+
+/** @short Encode @arg raw into base64 */
+QByteArray base64Encode(const QByteArray &raw, const Base64LineMode lineMode = BASE64_SINGLE_LINE);
+
+/** @short Decode base64 data
+
+All characters outside of the base64 alphabet, including the padding, are skipped, just like QByteArray::fromBase64()
+does it.
+*/
+QByteArray base64Decode(const QByteArray &encoded);
+
+/** @short Decode data in the quoted-printable encoding
+
+Both soft line breaks terminated by CRLF and by a bare LF are accepted. Malformed escape sequences lose their equals sign.
+*/
+QByteArray quotedPrintableDecode(const QByteArray &encoded);
+
+}
+
+#endif // TROJITA_COMMON_MIMECODECS_H
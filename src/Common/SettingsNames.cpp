@@ -62,6 +62,8 @@ const QString SettingsNames::imapSslPemPubKey = QLatin1String("imap.ssl.pemPubKe
 const QString SettingsNames::imapBlacklistedCapabilities = QLatin1String("imap.capabilities.blacklist");
 const QString SettingsNames::imapUseSystemProxy = QLatin1String("imap.proxy.system");
 const QString SettingsNames::imapNeedsNetwork = QLatin1String("imap.needsNetwork");
+const QString SettingsNames::imapThreadedParser = QLatin1String("imap.parser.threaded");
+const QString SettingsNames::imapConnectionPoolSize = QLatin1String("imap.connections.poolSize");
 const QString SettingsNames::composerSaveToImapKey = QLatin1String("composer/saveToImapEnabled");
 const QString SettingsNames::composerImapSentKey = QLatin1String("composer/imapSentName");
 const QString SettingsNames::cacheMetadataKey = QLatin1String("offline.metadataCache");
@@ -71,6 +73,14 @@ const QString SettingsNames::cacheOfflineNone = QLatin1String("memory");
 const QString SettingsNames::cacheOfflineXDays = QLatin1String("days");
 const QString SettingsNames::cacheOfflineAll = QLatin1String("all");
 const QString SettingsNames::cacheOfflineNumberDaysKey = QLatin1String("offline.cache.numDays");
+const QString SettingsNames::cachePartStorageKey = QLatin1String("offline.cache.partStorage");
+const QString SettingsNames::cachePartStoragePacked = QLatin1String("packed");
+const QString SettingsNames::cacheCompressionKey = QLatin1String("offline.cache.compression");
+const QString SettingsNames::cacheMemoryBudgetKey = QLatin1String("offline.cache.memoryBudget");
+const QString SettingsNames::cacheFullTextIndexKey = QLatin1String("offline.cache.fullTextIndex");
+const QString SettingsNames::offlineSyncMailboxesKey = QLatin1String("offline.sync.mailboxes");
+const QString SettingsNames::offlineSyncBudgetKey = QLatin1String("offline.sync.budget");
+const QString SettingsNames::offlineSyncRateKey = QLatin1String("offline.sync.rate");
 const QString SettingsNames::xtConnectCacheDirectory = QLatin1String("xtconnect.cachedir");
 const QString SettingsNames::xtSyncMailboxList = QLatin1String("xtconnect.listOfMailboxes");
 const QString SettingsNames::xtDbHost = QLatin1String("xtconnect.db.hostname");
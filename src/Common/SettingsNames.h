@@ -35,10 +35,13 @@ struct SettingsNames {
     static const QString imapMethodKey, methodTCP, methodSSL, methodProcess, imapHostKey,
            imapPortKey, imapStartTlsKey, imapUserKey, imapPassKey, imapProcessKey,
            imapStartOffline, imapEnableId, obsImapSslPemCertificate, imapSslPemPubKey,
-           imapBlacklistedCapabilities, imapUseSystemProxy, imapNeedsNetwork;
+           imapBlacklistedCapabilities, imapUseSystemProxy, imapNeedsNetwork, imapThreadedParser,
+           imapConnectionPoolSize;
     static const QString composerSaveToImapKey, composerImapSentKey, smtpUseBurlKey;
     static const QString cacheMetadataKey, cacheMetadataMemory,
-           cacheOfflineKey, cacheOfflineNone, cacheOfflineXDays, cacheOfflineAll, cacheOfflineNumberDaysKey;
+           cacheOfflineKey, cacheOfflineNone, cacheOfflineXDays, cacheOfflineAll, cacheOfflineNumberDaysKey,
+           cachePartStorageKey, cachePartStoragePacked, cacheCompressionKey, cacheMemoryBudgetKey, cacheFullTextIndexKey,
+           offlineSyncMailboxesKey, offlineSyncBudgetKey, offlineSyncRateKey;
     static const QString xtConnectCacheDirectory, xtSyncMailboxList, xtDbHost, xtDbPort,
            xtDbDbName, xtDbUser;
     static const QString guiMsgListShowThreading;
@@ -0,0 +1,185 @@
+/* Copyright (C) 2006 - 2014 Jan Kundrát <jkt@flaska.net>
+
+   This file is part of the Trojita Qt IMAP e-mail client,
+   http://trojita.flaska.net/
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2 of
+   the License or (at your option) version 3 or any later version
+   accepted by the membership of KDE e.V. (or its successor approved
+   by the membership of KDE e.V.), which shall act as a proxy
+   defined in Section 14 of version 3 of the license.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef TROJITA_SLABALLOCATOR_H
+#define TROJITA_SLABALLOCATOR_H
+
+#include <cstddef>
+#include <cstdlib>
+#include <new>
+#include <QtGlobal>
+#include <QVector>
+
+namespace Common
+{
+
+/** @short Allocator for a huge number of small objects of the same size
+
+The memory is obtained from the system in big slabs, each holding many objects, which are then handed out one by one.
+Compared to allocating each object separately, there's no per-object bookkeeping overhead of the system allocator and
+objects which were created one after another end up next to each other in memory.
+
+Freed slots are chained into a free list which lives in the slots themselves, so they cost nothing extra. Each slab is
+aligned to its own size and starts with a pointer to the allocator which owns it; that's how release() finds the owner of
+any slot, which means that a class operator delete can give the memory back without the object having to remember where
+it came from. The slabs are only returned to the system when the allocator itself is destroyed, so each allocator should
+be owned by whatever owns the objects; there's no global instance.
+
+The SlabSize has to be a power of two. The slots are aligned for objects whose alignment requirements are not stricter
+than those of a pointer.
+
+This class is not thread-safe.
+*/
+template<std::size_t ObjectSize, std::size_t SlabSize = 64 * 1024>
+class SlabAllocator
+{
+public:
+    enum {
+        /** @short Size of one slot, rounded up so that each slot is aligned like a pointer and can hold the free list link */
+        SlotSize = (ObjectSize + sizeof(void *) - 1) / sizeof(void *) * sizeof(void *),
+        /** @short Each slab starts with a pointer to its owner */
+        HeaderSize = sizeof(void *),
+        ObjectsPerSlab = (SlabSize - HeaderSize) / SlotSize
+    };
+
+    SlabAllocator(): freeList_(0), unusedBegin_(0), unusedEnd_(0), liveCount_(0)
+    {
+        Q_ASSERT((SlabSize & (SlabSize - 1)) == 0);
+        Q_ASSERT(ObjectsPerSlab > 0);
+    }
+
+    ~SlabAllocator()
+    {
+        for (typename QVector<char *>::const_iterator it = slabs_.constBegin(); it != slabs_.constEnd(); ++it) {
+            if (liveCount_ == 0) {
+                freeSlab(*it);
+            } else {
+                // Leaking is better than pulling the rug from under objects which are still alive. Their release() will
+                // find no owner and leave the memory alone.
+                *reinterpret_cast<SlabAllocator **>(*it) = 0;
+            }
+        }
+    }
+
+    void *allocate()
+    {
+        ++liveCount_;
+        if (freeList_) {
+            void *slot = freeList_;
+            freeList_ = *static_cast<void **>(slot);
+            return slot;
+        }
+        if (unusedBegin_ == unusedEnd_) {
+            char *slab = allocateSlab();
+            *reinterpret_cast<SlabAllocator **>(slab) = this;
+            slabs_.append(slab);
+            unusedBegin_ = slab + HeaderSize;
+            unusedEnd_ = unusedBegin_ + SlotSize * ObjectsPerSlab;
+        }
+        void *res = unusedBegin_;
+        unusedBegin_ += SlotSize;
+        return res;
+    }
+
+    /** @short Put the slot back; its memory gets overwritten right away, so the object must be completely gone by now */
+    void deallocate(void *ptr)
+    {
+        if (!ptr)
+            return;
+        Q_ASSERT(liveCount_ > 0);
+        Q_ASSERT(owner(ptr) == this);
+        *static_cast<void **>(ptr) = freeList_;
+        freeList_ = ptr;
+        --liveCount_;
+    }
+
+    /** @short Return the allocator which has handed out the @arg ptr, or 0 if that allocator has been destroyed already */
+    static SlabAllocator *owner(const void *ptr)
+    {
+        return *reinterpret_cast<SlabAllocator * const *>(reinterpret_cast<quintptr>(ptr) & ~quintptr(SlabSize - 1));
+    }
+
+    /** @short Give the @arg ptr back to whichever allocator it came from */
+    static void release(void *ptr)
+    {
+        if (!ptr)
+            return;
+        if (SlabAllocator *allocator = owner(ptr))
+            allocator->deallocate(ptr);
+    }
+
+    /** @short Number of objects which have been allocated and not freed yet */
+    std::size_t liveCount() const
+    {
+        return liveCount_;
+    }
+
+    /** @short Number of slabs currently obtained from the system */
+    int slabCount() const
+    {
+        return slabs_.size();
+    }
+
+    /** @short Number of bytes obtained from the system for the slabs */
+    std::size_t bytesReserved() const
+    {
+        return static_cast<std::size_t>(slabs_.size()) * SlabSize;
+    }
+
+private:
+    static char *allocateSlab()
+    {
+        void *res = 0;
+#ifdef Q_OS_UNIX
+        if (posix_memalign(&res, SlabSize, SlabSize) != 0)
+            res = 0;
+#else
+        res = qMallocAligned(SlabSize, SlabSize);
+#endif
+        if (!res)
+            throw std::bad_alloc();
+        return static_cast<char *>(res);
+    }
+
+    static void freeSlab(char *slab)
+    {
+#ifdef Q_OS_UNIX
+        ::free(slab);
+#else
+        qFreeAligned(slab);
+#endif
+    }
+
+    QVector<char *> slabs_;
+    /** @short Head of the chain of free slots, each of which holds a pointer to the next one */
+    void *freeList_;
+    char *unusedBegin_;
+    char *unusedEnd_;
+    std::size_t liveCount_;
+
+    SlabAllocator(const SlabAllocator &); // don't implement
+    SlabAllocator &operator=(const SlabAllocator &); // don't implement
+};
+
+}
+
+#endif // TROJITA_SLABALLOCATOR_H
@@ -406,13 +406,7 @@ AttachmentItem::ContentTransferEncoding ImapPartAttachmentItem::suggestedCTE() c
 
 QSharedPointer<QIODevice> ImapPartAttachmentItem::rawData() const
 {
-    if (!index.isValid() || !index.data(RoleIsFetched).toBool())
-        return QSharedPointer<QIODevice>();
-
-    QSharedPointer<QIODevice> io(new QBuffer());
-    static_cast<QBuffer*>(io.data())->setData(index.data(RolePartData).toByteArray());
-    io->open(QIODevice::ReadOnly);
-    return io;
+    return partDataDevice(index);
 }
 
 bool ImapPartAttachmentItem::isAvailableLocally() const
@@ -432,7 +426,8 @@ QByteArray ImapPartAttachmentItem::imapUrl() const
 
 void ImapPartAttachmentItem::preload() const
 {
-    index.data(RolePartData);
+    // Triggers the download without reading the data of huge parts from the disk cache
+    index.data(RolePartDataFileName);
 }
 
 void ImapPartAttachmentItem::asDroppableMimeData(QDataStream &stream) const
@@ -31,7 +31,9 @@
 #include <QUrl>
 #include <QUuid>
 #include "Common/Application.h"
+#include "Common/MimeCodecs.h"
 #include "Composer/ComposerAttachments.h"
+#include "Composer/RawMessageDevice.h"
 #include "Gui/IconLoader.h"
 #include "Imap/Encoders.h"
 #include "Imap/Model/ItemRoles.h"
@@ -635,23 +637,31 @@ bool MessageComposer::writeAttachmentHeader(QIODevice *target, QString *errorMes
     return true;
 }
 
-bool MessageComposer::writeAttachmentBody(QIODevice *target, QString *errorMessage, const AttachmentItem *attachment) const
+/** @short Return a device providing the raw data of an attachment, or a null pointer if they aren't available */
+QSharedPointer<QIODevice> MessageComposer::attachmentBody(QString *errorMessage, const AttachmentItem *attachment) const
 {
     if (!attachment->isAvailableLocally()) {
         *errorMessage = tr("Attachment %1 is not available").arg(attachment->caption());
-        return false;
+        return QSharedPointer<QIODevice>();
     }
     QSharedPointer<QIODevice> io = attachment->rawData();
     if (!io) {
         *errorMessage = tr("Attachment %1 disappeared").arg(attachment->caption());
-        return false;
     }
+    return io;
+}
+
+bool MessageComposer::writeAttachmentBody(QIODevice *target, QString *errorMessage, const AttachmentItem *attachment) const
+{
+    QSharedPointer<QIODevice> io = attachmentBody(errorMessage, attachment);
+    if (!io)
+        return false;
     while (!io->atEnd()) {
         switch (attachment->suggestedCTE()) {
         case AttachmentItem::CTE_BASE64:
             // Base64 maps 6bit chunks into a single byte. Output shall have no more than 76 characters per line
-            // (not counting the CRLF pair).
-            target->write(io->read(76*6/8).toBase64() + "\r\n");
+            // (not counting the CRLF pair). Encode a batch of complete lines at once.
+            target->write(Common::base64Encode(io->read(76*6/8 * 1024), Common::BASE64_MIME_LINES));
             break;
         default:
             target->write(io->readAll());
@@ -661,24 +671,62 @@ bool MessageComposer::writeAttachmentBody(QIODevice *target, QString *errorMessa
 }
 
 bool MessageComposer::asRawMessage(QIODevice *target, QString *errorMessage) const
+{
+    QSharedPointer<QIODevice> source = rawMessageDevice(errorMessage);
+    if (!source)
+        return false;
+    while (!source->atEnd()) {
+        QByteArray chunk = source->read(64 * 1024);
+        if (chunk.isEmpty()) {
+            *errorMessage = source->errorString();
+            return false;
+        }
+        target->write(chunk);
+    }
+    return true;
+}
+
+/** @short Return a device which produces the raw message while it is being read
+
+The attachments are read from their sources only when the data are requested, so the whole message is never present
+in memory.  The size of the message is known in advance.  A null pointer is returned on error.
+*/
+QSharedPointer<QIODevice> MessageComposer::rawMessageDevice(QString *errorMessage) const
 {
     // We don't bother with checking that our boundary is not present in the individual parts. That's arguably wrong,
     // but we don't have much choice if we ever plan to use CATENATE.  It also looks like this is exactly how other MUAs
     // oeprate as well, so let's just join the universal dontcareism here.
     QByteArray boundary(generateMimeBoundary());
+    QSharedPointer<RawMessageDevice> device(new RawMessageDevice());
 
-    writeCommonMessageBeginning(target, boundary);
+    QByteArray chunk;
+    {
+        QBuffer io(&chunk);
+        io.open(QIODevice::WriteOnly);
+        writeCommonMessageBeginning(&io, boundary);
+    }
 
     if (!m_attachments.isEmpty()) {
         Q_FOREACH(const AttachmentItem *attachment, m_attachments) {
-            if (!writeAttachmentHeader(target, errorMessage, attachment, boundary))
-                return false;
-            if (!writeAttachmentBody(target, errorMessage, attachment))
-                return false;
+            {
+                QBuffer io(&chunk);
+                io.open(QIODevice::Append);
+                if (!writeAttachmentHeader(&io, errorMessage, attachment, boundary))
+                    return QSharedPointer<QIODevice>();
+            }
+            QSharedPointer<QIODevice> body = attachmentBody(errorMessage, attachment);
+            if (!body)
+                return QSharedPointer<QIODevice>();
+            device->appendData(chunk);
+            chunk.clear();
+            device->appendDevice(body, attachment->suggestedCTE() == AttachmentItem::CTE_BASE64 ?
+                                     RawMessageDevice::ENCODING_BASE64 : RawMessageDevice::ENCODING_NONE);
         }
-        target->write("\r\n--" + boundary + "--\r\n");
+        chunk.append("\r\n--" + boundary + "--\r\n");
     }
-    return true;
+    device->appendData(chunk);
+    device->open(QIODevice::ReadOnly | QIODevice::Unbuffered);
+    return device;
 }
 
 bool MessageComposer::asCatenateData(QList<Imap::Mailbox::CatenatePair> &target, QString *errorMessage) const
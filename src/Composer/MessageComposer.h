@@ -25,6 +25,7 @@
 
 #include <QAbstractListModel>
 #include <QPointer>
+#include <QSharedPointer>
 
 #include "Composer/ContentDisposition.h"
 #include "Composer/Recipients.h"
@@ -70,6 +71,7 @@ public:
 
     bool isReadyForSerialization() const;
     bool asRawMessage(QIODevice *target, QString *errorMessage) const;
+    QSharedPointer<QIODevice> rawMessageDevice(QString *errorMessage) const;
     bool asCatenateData(QList<Imap::Mailbox::CatenatePair> &target, QString *errorMessage) const;
 
     QDateTime timestamp() const;
@@ -94,6 +96,7 @@ private:
     void writeCommonMessageBeginning(QIODevice *target, const QByteArray boundary) const;
     bool writeAttachmentHeader(QIODevice *target, QString *errorMessage, const AttachmentItem *attachment, const QByteArray &boundary) const;
     bool writeAttachmentBody(QIODevice *target, QString *errorMessage, const AttachmentItem *attachment) const;
+    QSharedPointer<QIODevice> attachmentBody(QString *errorMessage, const AttachmentItem *attachment) const;
 
     void writeHeaderWithMsgIds(QIODevice *target, const QByteArray &headerName, const QList<QByteArray> &messageIds) const;
 
@@ -0,0 +1,172 @@
+/* Copyright (C) 2006 - 2014 Jan Kundrát <jkt@flaska.net>
+
+   This file is part of the Trojita Qt IMAP e-mail client,
+   http://trojita.flaska.net/
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2 of
+   the License or (at your option) version 3 or any later version
+   accepted by the membership of KDE e.V. (or its successor approved
+   by the membership of KDE e.V.), which shall act as a proxy
+   defined in Section 14 of version 3 of the license.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "RawMessageDevice.h"
+#include <cstring>
+#include "Common/MimeCodecs.h"
+
+namespace Composer {
+
+/** @short Number of raw bytes which make up one line of base64-encoded output */
+static const int base64LineInput = 76 * 6 / 8;
+
+/** @short Number of base64 lines which are encoded at once */
+static const int base64LinesPerChunk = 1024;
+
+RawMessageDevice::RawMessageDevice(QObject *parent):
+    QIODevice(parent), m_currentSegment(0), m_segmentOffset(0), m_encodedOffset(0), m_position(0), m_size(0)
+{
+}
+
+void RawMessageDevice::appendData(const QByteArray &data)
+{
+    Q_ASSERT(!isOpen());
+    if (data.isEmpty())
+        return;
+    Segment segment;
+    segment.data = data;
+    segment.encoding = ENCODING_NONE;
+    segment.size = data.size();
+    m_segments << segment;
+    m_size += segment.size;
+}
+
+void RawMessageDevice::appendDevice(const QSharedPointer<QIODevice> &device, const Encoding encoding)
+{
+    Q_ASSERT(!isOpen());
+    Q_ASSERT(device && device->isReadable());
+    Segment segment;
+    segment.device = device;
+    segment.encoding = encoding;
+    segment.size = encoding == ENCODING_BASE64 ? base64EncodedSize(device->size()) : device->size();
+    m_segments << segment;
+    m_size += segment.size;
+}
+
+bool RawMessageDevice::isSequential() const
+{
+    return true;
+}
+
+qint64 RawMessageDevice::size() const
+{
+    return m_size;
+}
+
+qint64 RawMessageDevice::bytesAvailable() const
+{
+    return m_size - m_position + QIODevice::bytesAvailable();
+}
+
+bool RawMessageDevice::reset()
+{
+    for (QList<Segment>::iterator it = m_segments.begin(); it != m_segments.end(); ++it) {
+        if (it->device && !it->device->reset())
+            return false;
+    }
+    m_currentSegment = 0;
+    m_segmentOffset = 0;
+    m_encoded.clear();
+    m_encodedOffset = 0;
+    m_position = 0;
+    return true;
+}
+
+qint64 RawMessageDevice::base64EncodedSize(const qint64 rawSize)
+{
+    const qint64 remainder = rawSize % base64LineInput;
+    return rawSize / base64LineInput * 78 + (remainder ? (remainder + 2) / 3 * 4 + 2 : 0);
+}
+
+/** @short Encode another batch of lines from the current segment, return false on error */
+bool RawMessageDevice::fillEncodedBuffer(Segment &segment)
+{
+    const int wanted = base64LineInput * base64LinesPerChunk;
+    QByteArray raw;
+    while (raw.size() < wanted) {
+        QByteArray buf = segment.device->read(wanted - raw.size());
+        if (buf.isEmpty())
+            break;
+        raw += buf;
+    }
+    if (raw.isEmpty())
+        return false;
+
+    m_encoded.resize(Common::base64EncodedLength(raw.size(), Common::BASE64_MIME_LINES));
+    Common::base64Encode(raw.constData(), raw.size(), m_encoded.data(), Common::BASE64_MIME_LINES);
+    m_encodedOffset = 0;
+    // The source must not deliver more than what it has promised
+    return m_encoded.size() <= segment.size - m_segmentOffset;
+}
+
+qint64 RawMessageDevice::readData(char *data, qint64 maxSize)
+{
+    qint64 done = 0;
+    while (done < maxSize && m_currentSegment < m_segments.size()) {
+        Segment &segment = m_segments[m_currentSegment];
+        if (m_segmentOffset == segment.size) {
+            ++m_currentSegment;
+            m_segmentOffset = 0;
+            m_encoded.clear();
+            m_encodedOffset = 0;
+            continue;
+        }
+
+        const qint64 wanted = qMin(maxSize - done, segment.size - m_segmentOffset);
+        qint64 n;
+        if (!segment.device) {
+            n = wanted;
+            memcpy(data + done, segment.data.constData() + m_segmentOffset, n);
+        } else if (segment.encoding == ENCODING_NONE) {
+            n = segment.device->read(data + done, wanted);
+        } else {
+            if (m_encodedOffset == m_encoded.size() && !fillEncodedBuffer(segment)) {
+                n = -1;
+            } else {
+                n = qMin(wanted, static_cast<qint64>(m_encoded.size() - m_encodedOffset));
+                memcpy(data + done, m_encoded.constData() + m_encodedOffset, n);
+                m_encodedOffset += n;
+            }
+        }
+
+        if (n <= 0) {
+            // The source has either failed, or it got shorter than what it was supposed to be
+            setErrorString(segment.device->errorString().isEmpty() ?
+                               tr("An attachment has changed while the message was being sent") :
+                               segment.device->errorString());
+            return done ? done : -1;
+        }
+        m_segmentOffset += n;
+        m_position += n;
+        done += n;
+    }
+    return done;
+}
+
+qint64 RawMessageDevice::writeData(const char *data, qint64 maxSize)
+{
+    Q_UNUSED(data);
+    Q_UNUSED(maxSize);
+    return -1;
+}
+
+}
@@ -0,0 +1,95 @@
+/* Copyright (C) 2006 - 2014 Jan Kundrát <jkt@flaska.net>
+
+   This file is part of the Trojita Qt IMAP e-mail client,
+   http://trojita.flaska.net/
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2 of
+   the License or (at your option) version 3 or any later version
+   accepted by the membership of KDE e.V. (or its successor approved
+   by the membership of KDE e.V.), which shall act as a proxy
+   defined in Section 14 of version 3 of the license.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef COMPOSER_RAWMESSAGEDEVICE_H
+#define COMPOSER_RAWMESSAGEDEVICE_H
+
+#include <QIODevice>
+#include <QList>
+#include <QSharedPointer>
+
+namespace Composer {
+
+/** @short Read-only device producing a message from a sequence of in-memory data and other devices
+
+The contents of the individual devices, e.g. the attachments, are only read when the data are requested by the consumer,
+and they are optionally encoded into base64 on the fly. The size of the whole message is known in advance, which makes
+it possible to send it as an IMAP literal, yet only a small part of it is kept in memory at any time.
+
+The device is sequential, but it can be rewound through reset() so that the same message can be produced again.
+*/
+class RawMessageDevice : public QIODevice
+{
+    Q_OBJECT
+public:
+    typedef enum {
+        ENCODING_NONE, /**< Copy the data verbatim */
+        ENCODING_BASE64 /**< Encode the data into base64 with lines of 76 characters */
+    } Encoding;
+
+    explicit RawMessageDevice(QObject *parent = 0);
+
+    /** @short Add the @arg data to the end of the message */
+    void appendData(const QByteArray &data);
+    /** @short Add the contents of the @arg device to the end of the message
+
+    The device has to be open for reading, it must be positioned at its start and it must know its size.
+    */
+    void appendDevice(const QSharedPointer<QIODevice> &device, const Encoding encoding);
+
+    virtual bool isSequential() const;
+    virtual qint64 size() const;
+    virtual qint64 bytesAvailable() const;
+    virtual bool reset();
+
+    /** @short Return the size of the base64 representation of @arg rawSize bytes, including the line breaks */
+    static qint64 base64EncodedSize(const qint64 rawSize);
+
+protected:
+    virtual qint64 readData(char *data, qint64 maxSize);
+    virtual qint64 writeData(const char *data, qint64 maxSize);
+
+private:
+    struct Segment {
+        QByteArray data;
+        QSharedPointer<QIODevice> device;
+        Encoding encoding;
+        /** @short Number of bytes this segment contributes to the message */
+        qint64 size;
+    };
+
+    bool fillEncodedBuffer(Segment &segment);
+
+    QList<Segment> m_segments;
+    int m_currentSegment;
+    /** @short Number of bytes of the current segment which have been produced already */
+    qint64 m_segmentOffset;
+    /** @short Encoded data of the current segment which haven't been consumed yet */
+    QByteArray m_encoded;
+    int m_encodedOffset;
+    qint64 m_position;
+    qint64 m_size;
+};
+
+}
+
+#endif // COMPOSER_RAWMESSAGEDEVICE_H
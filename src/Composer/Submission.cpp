@@ -21,7 +21,6 @@
    along with this program.  If not, see <http://www.gnu.org/licenses/>.
 */
 #include <QCoreApplication>
-#include <QBuffer>
 #include <QSettings>
 #include "Composer/Submission.h"
 #include "Composer/MessageComposer.h"
@@ -193,14 +192,16 @@ void Submission::send()
 void Submission::slotMessageDataAvailable()
 {
     m_rawMessageData.clear();
-    QBuffer buf(&m_rawMessageData);
-    buf.open(QIODevice::WriteOnly);
     QString errorMessage;
     QList<Imap::Mailbox::CatenatePair> catenateable;
 
-    if (shouldBuildMessageLocally() && !m_composer->asRawMessage(&buf, &errorMessage)) {
-        gotError(tr("Cannot send right now -- saving failed:\n %1").arg(errorMessage));
-        return;
+    if (shouldBuildMessageLocally()) {
+        // The message is produced while it's being sent, it is never kept in memory as a whole
+        m_rawMessageData = m_composer->rawMessageDevice(&errorMessage);
+        if (!m_rawMessageData) {
+            gotError(tr("Cannot send right now -- saving failed:\n %1").arg(errorMessage));
+            return;
+        }
     }
     if (m_model->isCatenateSupported() && !m_composer->asCatenateData(catenateable, &errorMessage)) {
         gotError(tr("Cannot send right now -- saving (CATENATE) failed:\n %1").arg(errorMessage));
@@ -280,6 +281,18 @@ void Submission::slotInvokeMsaNow()
     } else if (m_genUrlAuthReceived && m_useBurl) {
         msa->sendBurl(m_composer->rawFromAddress(), m_composer->rawRecipientAddresses(), m_urlauth.toUtf8());
     } else {
+        QString errorMessage;
+        if (!m_rawMessageData) {
+            m_rawMessageData = m_composer->rawMessageDevice(&errorMessage);
+        } else if (!m_rawMessageData->reset()) {
+            // The same data might have been saved into the sent folder already
+            errorMessage = m_rawMessageData->errorString();
+            m_rawMessageData.clear();
+        }
+        if (!m_rawMessageData) {
+            gotError(tr("Cannot send right now -- saving failed:\n %1").arg(errorMessage));
+            return;
+        }
         msa->sendMail(m_composer->rawFromAddress(), m_composer->rawRecipientAddresses(), m_rawMessageData);
     }
 }
@@ -24,9 +24,12 @@
 
 #include <QPersistentModelIndex>
 #include <QPointer>
+#include <QSharedPointer>
 
 #include "Recipients.h"
 
+class QIODevice;
+
 namespace Imap {
 namespace Mailbox {
 class ImapTask;
@@ -128,7 +131,8 @@ private:
     bool m_useImapSubmit;
 
     SubmissionProgress m_state;
-    QByteArray m_rawMessageData;
+    /** @short Producer of the message data, shared by the APPEND and the MSA */
+    QSharedPointer<QIODevice> m_rawMessageData;
     int m_msaMaximalProgress;
 
     MessageComposer *m_composer;
@@ -21,6 +21,7 @@
 */
 #include "MsgListView.h"
 
+#include <QAbstractProxyModel>
 #include <QAction>
 #include <QApplication>
 #include <QDesktopWidget>
@@ -29,8 +30,10 @@
 #include <QHeaderView>
 #include <QKeyEvent>
 #include <QPainter>
+#include <QScrollBar>
 #include <QSignalMapper>
 #include <QTimer>
+#include "Imap/Model/Model.h"
 #include "Imap/Model/MsgListModel.h"
 #include "Imap/Model/PrettyMsgListModel.h"
 
@@ -61,6 +64,14 @@ MsgListView::MsgListView(QWidget *parent): QTreeView(parent), m_autoActivateAfte
     m_naviActivationTimer = new QTimer(this);
     m_naviActivationTimer->setSingleShot(true);
     connect(m_naviActivationTimer, SIGNAL(timeout()), SLOT(slotCurrentActivated()));
+
+    // Don't bother the model with each and every pixel of scrolling, but report often enough to let it see the pace
+    m_viewportReportTimer = new QTimer(this);
+    m_viewportReportTimer->setSingleShot(true);
+    m_viewportReportTimer->setInterval(50);
+    connect(m_viewportReportTimer, SIGNAL(timeout()), this, SLOT(slotReportViewport()));
+    connect(verticalScrollBar(), SIGNAL(valueChanged(int)), this, SLOT(slotReportViewportLater()));
+    connect(verticalScrollBar(), SIGNAL(rangeChanged(int,int)), this, SLOT(slotReportViewportLater()));
 }
 
 // left might collapse a thread, question is whether ending there (on closing the thread) should be
@@ -114,6 +125,35 @@ void MsgListView::slotCurrentActivated()
     }
 }
 
+void MsgListView::slotReportViewportLater()
+{
+    if (!m_viewportReportTimer->isActive())
+        m_viewportReportTimer->start();
+}
+
+void MsgListView::slotReportViewport()
+{
+    QModelIndex first = indexAt(QPoint(0, 0));
+    if (!first.isValid())
+        return;
+    QModelIndex last = indexAt(QPoint(0, viewport()->height() - 1));
+    if (!last.isValid()) {
+        // The view is not filled up to the bottom
+        last = first;
+    }
+
+    // Strip all proxies; the threading model's placeholders for missing messages have no counterpart in the IMAP model
+    while (const QAbstractProxyModel *proxy = qobject_cast<const QAbstractProxyModel *>(first.model()))
+        first = proxy->mapToSource(first);
+    while (const QAbstractProxyModel *proxy = qobject_cast<const QAbstractProxyModel *>(last.model()))
+        last = proxy->mapToSource(last);
+    if (!first.isValid() || !last.isValid())
+        return;
+
+    if (Imap::Mailbox::Model *imapModel = const_cast<Imap::Mailbox::Model *>(qobject_cast<const Imap::Mailbox::Model *>(first.model())))
+        imapModel->setMessageListViewport(first, last);
+}
+
 int MsgListView::sizeHintForColumn(int column) const
 {
     QFont boldFont = font();
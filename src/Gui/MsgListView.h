@@ -70,11 +70,15 @@ private slots:
     /** @short conditionally emits activated(currentIndex()) for keyboard events */
     void slotCurrentActivated();
     void slotHandleNewColumns(int oldCount, int newCount);
+    /** @short Let the IMAP model know which messages are visible so that it can preload the right ones */
+    void slotReportViewport();
+    void slotReportViewportLater();
 private:
     static Imap::Mailbox::PrettyMsgListModel *findPrettyMsgListModel(QAbstractItemModel *model);
 
     QSignalMapper *headerFieldsMapper;
     QTimer *m_naviActivationTimer;
+    QTimer *m_viewportReportTimer;
     bool m_autoActivateAfterKeyNavigation;
     bool m_autoResizeSections;
 };
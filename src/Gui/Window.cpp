@@ -378,7 +378,7 @@ void MainWindow::createActions()
 
     actionThreadMsgList = new QAction(Gui::loadIcon(QLatin1String("mail-view-threaded")), tr("Show Messages in &Threads"), this);
     actionThreadMsgList->setCheckable(true);
-    // This action is enabled/disabled by model's capabilities
+    // This action is enabled as soon as the model reports its capabilities
     actionThreadMsgList->setEnabled(false);
     if (m_settings->value(Common::SettingsNames::guiMsgListShowThreading).toBool()) {
         actionThreadMsgList->setChecked(true);
@@ -848,26 +848,6 @@ bool MainWindow::eventFilter(QObject *o, QEvent *e)
         }
         return false;
     }
-    if (msgListWidget && msgListWidget->tree && o == msgListWidget->tree->header()->viewport()) {
-        // installed if sorting is not really possible.
-        QWidget *header = static_cast<QWidget*>(o);
-        QMouseEvent *mouse = static_cast<QMouseEvent*>(e);
-        if (e->type() == QEvent::MouseButtonPress) {
-            if (mouse->button() == Qt::LeftButton && header->cursor().shape() == Qt::ArrowCursor) {
-                m_headerDragStart = mouse->pos();
-            }
-            return false;
-        }
-        if (e->type() == QEvent::MouseButtonRelease) {
-            if (mouse->button() == Qt::LeftButton && header->cursor().shape() == Qt::ArrowCursor &&
-               (m_headerDragStart - mouse->pos()).manhattanLength() < QApplication::startDragDistance()) {
-                    m_actionSortDescending->toggle();
-                    Qt::SortOrder order = m_actionSortDescending->isChecked() ? Qt::DescendingOrder : Qt::AscendingOrder;
-                    msgListWidget->tree->header()->setSortIndicator(-1, order);
-                    return true; // prevent regular click
-            }
-        }
-    }
     return false;
 }
 
@@ -2010,13 +1990,8 @@ void MainWindow::slotHideRead()
 
 void MainWindow::slotCapabilitiesUpdated(const QStringList &capabilities)
 {
-    msgListWidget->tree->header()->viewport()->removeEventFilter(this);
-    if (capabilities.contains(QLatin1String("SORT"))) {
-        m_actionSortByDate->actionGroup()->setEnabled(true);
-    } else {
-        m_actionSortByDate->actionGroup()->setEnabled(false);
-        msgListWidget->tree->header()->viewport()->installEventFilter(this);
-    }
+    // Sorting is always available; when the server cannot do it, the messages are sorted locally
+    m_actionSortByDate->actionGroup()->setEnabled(true);
 
     msgListWidget->setFuzzySearchSupported(capabilities.contains(QLatin1String("SEARCH=FUZZY")));
 
@@ -2026,16 +2001,10 @@ void MainWindow::slotCapabilitiesUpdated(const QStringList &capabilities)
                                                Common::SettingsNames::guiMailboxListShowOnlySubscribed, false).toBool());
     m_actionSubscribeMailbox->setEnabled(m_actionShowOnlySubscribed->isEnabled());
 
-    const QStringList supportedCapabilities = Imap::Mailbox::ThreadingMsgListModel::supportedCapabilities();
-    Q_FOREACH(const QString &capability, capabilities) {
-        if (supportedCapabilities.contains(capability)) {
-            actionThreadMsgList->setEnabled(true);
-            if (actionThreadMsgList->isChecked())
-                slotThreadMsgList();
-            return;
-        }
-    }
-    actionThreadMsgList->setEnabled(false);
+    // Threading is always available; when the server cannot do it, the messages are threaded locally
+    actionThreadMsgList->setEnabled(true);
+    if (actionThreadMsgList->isChecked())
+        slotThreadMsgList();
 }
 
 void MainWindow::slotShowImapInfo()
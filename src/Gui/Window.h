@@ -332,7 +332,6 @@ private:
     MainWindow &operator=(const MainWindow &); // don't implement
 
     QSystemTrayIcon *m_trayIcon;
-    QPoint m_headerDragStart;
 };
 
 }
@@ -60,6 +60,7 @@
 **
 ****************************************************************************/
 #include "Encoders.h"
+#include "Common/MimeCodecs.h"
 #include "Parser/3rdparty/rfccodecs.h"
 #include "Parser/3rdparty/kcodecs.h"
 
@@ -426,7 +427,7 @@ QString decodeImapFolderName( const QByteArray& raw )
 
 QByteArray quotedPrintableDecode( const QByteArray& raw )
 {
-    return KCodecs::quotedPrintableDecode( raw );
+    return Common::quotedPrintableDecode( raw );
 }
 
 QByteArray quotedPrintableEncode(const QByteArray &raw)
@@ -698,7 +699,7 @@ void decodeContentTransferEncoding(const QByteArray &rawData, const QByteArray &
     if (encoding == "quoted-printable") {
         *outputData = quotedPrintableDecode(rawData);
     } else if (encoding == "base64") {
-        *outputData = QByteArray::fromBase64(rawData);
+        *outputData = Common::base64Decode(rawData);
     } else if (encoding.isEmpty() || encoding == "7bit" || encoding == "8bit" || encoding == "binary") {
         *outputData = rawData;
     } else {
@@ -707,4 +708,77 @@ void decodeContentTransferEncoding(const QByteArray &rawData, const QByteArray &
     }
 }
 
+ContentTransferDecoder::ContentTransferDecoder(const QByteArray &encoding): m_kind(CTE_IDENTITY)
+{
+    if (encoding == "quoted-printable") {
+        m_kind = CTE_QUOTED_PRINTABLE;
+    } else if (encoding == "base64") {
+        m_kind = CTE_BASE64;
+    } else if (!encoding.isEmpty() && encoding != "7bit" && encoding != "8bit" && encoding != "binary") {
+        qDebug() << "Warning: unknown encoding" << encoding;
+    }
+}
+
+QByteArray ContentTransferDecoder::decode(const QByteArray &chunk)
+{
+    if (m_kind == CTE_IDENTITY)
+        return chunk;
+
+    m_pending.append(chunk);
+    int cut = 0;
+
+    switch (m_kind) {
+    case CTE_BASE64:
+    {
+        // Only complete quadruplets of the base64 alphabet can be decoded; everything else (whitespace,...) is ignored
+        int significant = 0;
+        for (int i = 0; i < m_pending.size(); ++i) {
+            const char c = m_pending[i];
+            if ((c >= 'A' && c <= 'Z') || (c >= 'a' && c <= 'z') || (c >= '0' && c <= '9') || c == '+' || c == '/' || c == '=') {
+                if (++significant % 4 == 0)
+                    cut = i + 1;
+            }
+        }
+        break;
+    }
+    case CTE_QUOTED_PRINTABLE:
+        // Soft line breaks and the =XX escapes never span a newline, so it's always safe to decode whole lines
+        cut = m_pending.lastIndexOf('\n') + 1;
+        if (cut == 0 && m_pending.size() > 1000) {
+            // A very long line which violates RFC 2045; make sure not to split an escape sequence
+            cut = m_pending.size();
+            int escape = m_pending.indexOf('=', cut - 2);
+            if (escape != -1)
+                cut = escape;
+        }
+        break;
+    case CTE_IDENTITY:
+        Q_ASSERT(false);
+        break;
+    }
+
+    if (cut == 0)
+        return QByteArray();
+
+    QByteArray res;
+    if (cut == m_pending.size()) {
+        decodeContentTransferEncoding(m_pending, m_kind == CTE_BASE64 ? "base64" : "quoted-printable", &res);
+        m_pending.clear();
+    } else {
+        decodeContentTransferEncoding(m_pending.left(cut), m_kind == CTE_BASE64 ? "base64" : "quoted-printable", &res);
+        m_pending.remove(0, cut);
+    }
+    return res;
+}
+
+QByteArray ContentTransferDecoder::finish()
+{
+    if (m_pending.isEmpty())
+        return QByteArray();
+    QByteArray res;
+    decodeContentTransferEncoding(m_pending, m_kind == CTE_BASE64 ? "base64" : "quoted-printable", &res);
+    m_pending.clear();
+    return res;
+}
+
 }
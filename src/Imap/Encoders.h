@@ -60,6 +60,29 @@ QByteArray encodeRfc2231Parameter(const QByteArray &key, const QString &value);
 QString wrapFormatFlowed(const QString &input);
 
 void decodeContentTransferEncoding(const QByteArray &rawData, const QByteArray &encoding, QByteArray *outputData);
+
+/** @short Incremental version of decodeContentTransferEncoding()
+
+The encoded data can be passed in arbitrarily sized chunks; whatever cannot be decoded yet is kept until the next call
+to decode() or until finish() flushes it.
+*/
+class ContentTransferDecoder
+{
+public:
+    explicit ContentTransferDecoder(const QByteArray &encoding);
+    /** @short Decode as much of the data seen so far as possible */
+    QByteArray decode(const QByteArray &chunk);
+    /** @short Decode whatever remains buffered */
+    QByteArray finish();
+private:
+    typedef enum {
+        CTE_IDENTITY,
+        CTE_BASE64,
+        CTE_QUOTED_PRINTABLE
+    } Kind;
+    Kind m_kind;
+    QByteArray m_pending;
+};
 }
 
 #endif // IMAP_ENCODERS_H
@@ -21,11 +21,12 @@
 */
 
 #include "Cache.h"
+#include "FullTextIndex.h"
 
 namespace Imap {
 namespace Mailbox {
 
-AbstractCache::AbstractCache(QObject *parent): QObject(parent)
+AbstractCache::AbstractCache(QObject *parent): QObject(parent), m_fullTextIndex(0)
 {
 }
 
@@ -33,5 +34,70 @@ AbstractCache::~AbstractCache()
 {
 }
 
+void AbstractCache::setMsgFlagsBulk(const QString &mailbox, const QVector<QPair<uint, QStringList> > &flags)
+{
+    for (QVector<QPair<uint, QStringList> >::const_iterator it = flags.constBegin(); it != flags.constEnd(); ++it) {
+        setMsgFlags(mailbox, it->first, it->second);
+    }
+}
+
+void AbstractCache::updateUidMapping(const QString &mailbox, const QList<uint> &expungedUids, const QList<uint> &newUids)
+{
+    setUidMapping(mailbox, applyUidMappingUpdate(uidMapping(mailbox), expungedUids, newUids));
+}
+
+/** @short Remove the sorted @arg expungedUids from the @arg seqToUid and append the @arg newUids */
+QList<uint> AbstractCache::applyUidMappingUpdate(const QList<uint> &seqToUid, const QList<uint> &expungedUids,
+                                                 const QList<uint> &newUids)
+{
+    QList<uint> res;
+    if (expungedUids.isEmpty()) {
+        res = seqToUid;
+    } else {
+#if QT_VERSION >= 0x040700
+        res.reserve(seqToUid.size() + newUids.size());
+#endif
+        // Both lists are sorted, so this is a simple linear pass
+        QList<uint>::const_iterator expunged = expungedUids.constBegin();
+        for (QList<uint>::const_iterator it = seqToUid.constBegin(); it != seqToUid.constEnd(); ++it) {
+            while (expunged != expungedUids.constEnd() && *expunged < *it)
+                ++expunged;
+            if (expunged == expungedUids.constEnd() || *expunged != *it)
+                res.append(*it);
+        }
+    }
+    res += newUids;
+    return res;
+}
+
+bool AbstractCache::setMsgPartEncoded(const QString &mailbox, const uint uid, const QString &partId,
+                                      const QByteArray &encodedData, const QByteArray &encoding)
+{
+    Q_UNUSED(mailbox);
+    Q_UNUSED(uid);
+    Q_UNUSED(partId);
+    Q_UNUSED(encodedData);
+    Q_UNUSED(encoding);
+    return false;
+}
+
+void AbstractCache::setFullTextIndex(FullTextIndex *index)
+{
+    if (m_fullTextIndex == index)
+        return;
+    delete m_fullTextIndex;
+    m_fullTextIndex = index;
+    if (m_fullTextIndex)
+        m_fullTextIndex->setParent(this);
+}
+
+QString AbstractCache::messagePartFileName(const QString &mailbox, const uint uid, const QString &partId) const
+{
+    Q_UNUSED(mailbox);
+    Q_UNUSED(uid);
+    Q_UNUSED(partId);
+    return QString();
+}
+
 }
 }
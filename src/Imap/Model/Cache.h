@@ -23,7 +23,9 @@
 #ifndef IMAP_MODEL_CACHE_H
 #define IMAP_MODEL_CACHE_H
 
+#include <QPair>
 #include <QUrl>
+#include <QVector>
 #include "MailboxMetadata.h"
 #include "../Parser/Message.h"
 #include "Imap/Parser/ThreadingNode.h"
@@ -36,6 +38,8 @@ namespace Imap
 namespace Mailbox
 {
 
+class FullTextIndex;
+
 /** @short An abstract parent for all IMAP cache implementations */
 class AbstractCache: public QObject
 {
@@ -101,6 +105,12 @@ public:
     virtual void clearUidMapping(const QString &mailbox) = 0;
     /** @short Retrieve sequence to UID mapping */
     virtual QList<uint> uidMapping(const QString &mailbox) const = 0;
+    /** @short Update the stored seq->UID mapping with what has changed since it was saved
+
+    The @arg expungedUids are removed from the mapping and shall be sorted; the @arg newUids are appended at its end. The
+    default implementation rewrites the whole mapping.
+    */
+    virtual void updateUidMapping(const QString &mailbox, const QList<uint> &expungedUids, const QList<uint> &newUids);
 
     /** @short Remove all messages in given mailbox from the cache */
     virtual void clearAllMessages(const QString &mailbox) = 0;
@@ -115,6 +125,11 @@ public:
     virtual QStringList msgFlags(const QString &mailbox, const uint uid) const = 0;
     /** @short Save flags for one message in mailbox */
     virtual void setMsgFlags(const QString &mailbox, const uint uid, const QStringList &flags) = 0;
+    /** @short Save flags for many messages in the mailbox at once
+
+    The default implementation simply calls setMsgFlags() for each of them.
+    */
+    virtual void setMsgFlagsBulk(const QString &mailbox, const QVector<QPair<uint, QStringList> > &flags);
 
     /** @short Return part data or a null QByteArray if none available */
     virtual QByteArray messagePart(const QString &mailbox, const uint uid, const QString &partId) const = 0;
@@ -122,6 +137,15 @@ public:
     virtual void setMsgPart(const QString &mailbox, const uint uid, const QString &partId, const QByteArray &data) = 0;
     /** @short Drop the data for a message part which is no longer needed */
     virtual void forgetMessagePart(const QString &mailbox, const uint uid, const QString &partId) = 0;
+    /** @short Decode and save data for one message part without keeping the decoded form in memory
+
+    Caches which cannot store the data this way return false; the caller is then expected to decode the data itself and
+    use setMsgPart().
+    */
+    virtual bool setMsgPartEncoded(const QString &mailbox, const uint uid, const QString &partId,
+                                   const QByteArray &encodedData, const QByteArray &encoding);
+    /** @short Return the name of a plain file which holds the data of a message part, or a null QString */
+    virtual QString messagePartFileName(const QString &mailbox, const uint uid, const QString &partId) const;
 
     /** @short Return cached threading info for a given mailbox */
     virtual QVector<Imap::Responses::ThreadingNode> messageThreading(const QString &mailbox) = 0;
@@ -131,9 +155,24 @@ public:
     /** @short How many days is it OK not to mark entries as accessed? */
     virtual void setRenewalThreshold(const int days) = 0;
 
+    /** @short Return the full-text index of the cached messages, or 0 if there's none */
+    FullTextIndex *fullTextIndex() const { return m_fullTextIndex; }
+    /** @short Use the specified full-text index for local searching
+
+    Caches which store messages persistently keep the index updated with the envelopes passed to them and drop the removed
+    messages. The body parts are indexed by the Model, which knows their charset. The cache takes ownership of the @arg index.
+    */
+    void setFullTextIndex(FullTextIndex *index);
+
 signals:
     /** @short Some cache error has occurred */
     void error(const QString &error) const;
+
+protected:
+    static QList<uint> applyUidMappingUpdate(const QList<uint> &seqToUid, const QList<uint> &expungedUids,
+                                             const QList<uint> &newUids);
+
+    FullTextIndex *m_fullTextIndex;
 };
 
 }
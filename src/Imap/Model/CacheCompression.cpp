@@ -0,0 +1,287 @@
+/* Copyright (C) 2006 - 2014 Jan Kundrát <jkt@flaska.net>
+
+   This file is part of the Trojita Qt IMAP e-mail client,
+   http://trojita.flaska.net/
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2 of
+   the License or (at your option) version 3 or any later version
+   accepted by the membership of KDE e.V. (or its successor approved
+   by the membership of KDE e.V.), which shall act as a proxy
+   defined in Section 14 of version 3 of the license.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "CacheCompression.h"
+#include <cstring>
+
+namespace
+{
+
+/** @short Tags identifying the codec of a blob; the untagged qCompress() output never starts with a byte >= 0x80 */
+enum {
+    TAG_STORED = 0x80,
+    TAG_LZ = 0x81
+};
+
+const int lzHashBits = 13;
+const int lzMinMatch = 4;
+const int lzMaxOffset = 0xffff;
+/** @short Upper bound of how many output bytes a single input byte can expand to
+
+A byte of an extended match length stands for at most 255 bytes of output; nothing in the format expands better.
+*/
+const quint64 lzMaxExpansion = 255;
+
+inline quint32 read32(const uchar *ptr)
+{
+    quint32 res;
+    memcpy(&res, ptr, sizeof(res));
+    return res;
+}
+
+inline uint lzHash(const quint32 sequence)
+{
+    return (sequence * 2654435761U) >> (32 - lzHashBits);
+}
+
+/** @short Write a length which did not fit into the four bits of the token */
+inline uchar *writeExtendedLength(uchar *out, int length)
+{
+    while (length >= 255) {
+        *out++ = 255;
+        length -= 255;
+    }
+    *out++ = length;
+    return out;
+}
+
+/** @short Emit one sequence of literals which is optionally followed by a match */
+uchar *writeSequence(uchar *out, const uchar *literals, const int literalLength, const int offset, const int matchLength)
+{
+    uchar *token = out++;
+    const int matchCode = matchLength ? matchLength - lzMinMatch : 0;
+    *token = (qMin(literalLength, 15) << 4) | qMin(matchCode, 15);
+    if (literalLength >= 15)
+        out = writeExtendedLength(out, literalLength - 15);
+    memcpy(out, literals, literalLength);
+    out += literalLength;
+    if (matchLength) {
+        *out++ = offset & 0xff;
+        *out++ = offset >> 8;
+        if (matchCode >= 15)
+            out = writeExtendedLength(out, matchCode - 15);
+    }
+    return out;
+}
+
+/** @short Compress the input into a buffer which has to be at least lzBound(size) bytes long; returns the output size
+
+The format is similar to an LZ4 block: each sequence starts with a token whose upper four bits hold the number of
+literals and the lower ones the length of the following match. Both can be extended by additional bytes. The literals
+are followed by a two-byte offset of the match. The last sequence consists of literals only.
+*/
+int lzCompress(const uchar *src, const int size, uchar *dst)
+{
+    int table[1 << lzHashBits];
+    for (int i = 0; i < (1 << lzHashBits); ++i)
+        table[i] = -1;
+
+    uchar *out = dst;
+    int anchor = 0;
+    int pos = 0;
+    while (pos + lzMinMatch <= size) {
+        const quint32 sequence = read32(src + pos);
+        const uint hash = lzHash(sequence);
+        const int candidate = table[hash];
+        table[hash] = pos;
+        if (candidate >= 0 && pos - candidate <= lzMaxOffset && read32(src + candidate) == sequence) {
+            int matchLength = lzMinMatch;
+            while (pos + matchLength < size && src[candidate + matchLength] == src[pos + matchLength])
+                ++matchLength;
+            out = writeSequence(out, src + anchor, pos - anchor, pos - candidate, matchLength);
+            pos += matchLength;
+            anchor = pos;
+        } else {
+            ++pos;
+        }
+    }
+    out = writeSequence(out, src + anchor, size - anchor, 0, 0);
+    return out - dst;
+}
+
+/** @short Upper bound of the size of the compressed data */
+inline int lzBound(const int size)
+{
+    return size + size / 255 + 16;
+}
+
+/** @short Read an extended length, returning false if the input is exhausted or if the length would exceed the @arg limit
+
+The check happens before each addition, so a long run of 0xff bytes cannot overflow the length.
+*/
+inline bool readExtendedLength(const uchar *&in, const uchar *end, int &length, const int limit)
+{
+    uchar byte;
+    do {
+        if (in == end)
+            return false;
+        byte = *in++;
+        if (byte > limit - length)
+            return false;
+        length += byte;
+    } while (byte == 255);
+    return true;
+}
+
+/** @short Decompress exactly @arg size bytes into the @arg dst, checking for any inconsistency in the input */
+bool lzDecompress(const uchar *src, const int srcSize, uchar *dst, const int size)
+{
+    const uchar *in = src;
+    const uchar *inEnd = src + srcSize;
+    uchar *out = dst;
+    uchar *outEnd = dst + size;
+
+    while (true) {
+        if (in == inEnd)
+            return false;
+        const uchar token = *in++;
+        int literalLength = token >> 4;
+        if (literalLength == 15 && !readExtendedLength(in, inEnd, literalLength, qMin<int>(inEnd - in, outEnd - out)))
+            return false;
+        if (literalLength > inEnd - in || literalLength > outEnd - out)
+            return false;
+        memcpy(out, in, literalLength);
+        in += literalLength;
+        out += literalLength;
+
+        if (out == outEnd)
+            return in == inEnd;
+
+        if (inEnd - in < 2)
+            return false;
+        const int offset = in[0] | (in[1] << 8);
+        in += 2;
+        int matchLength = token & 0x0f;
+        if (matchLength == 15 && !readExtendedLength(in, inEnd, matchLength, int(outEnd - out) - lzMinMatch))
+            return false;
+        matchLength += lzMinMatch;
+        if (offset == 0 || offset > out - dst || matchLength > outEnd - out)
+            return false;
+        // The source and the destination can overlap, so the copying has to be done byte by byte
+        const uchar *match = out - offset;
+        for (int i = 0; i < matchLength; ++i)
+            *out++ = *match++;
+    }
+}
+
+}
+
+namespace Imap
+{
+namespace Mailbox
+{
+
+CacheCompression::CacheCompression(const Codec codec, const int storeUncompressedBelow):
+    m_codec(codec), m_storeUncompressedBelow(storeUncompressedBelow)
+{
+}
+
+QByteArray CacheCompression::compress(const QByteArray &data) const
+{
+    if (m_codec != CODEC_NONE && data.size() >= m_storeUncompressedBelow) {
+        switch (m_codec) {
+        case CODEC_NONE:
+            break;
+        case CODEC_ZLIB:
+        {
+            // This one is not tagged for compatibility with older versions
+            QByteArray res = qCompress(data);
+            if (res.size() < data.size())
+                return res;
+            break;
+        }
+        case CODEC_LZ:
+        {
+            // Tag, uncompressed size and the compressed data
+            QByteArray res(1 + 4 + lzBound(data.size()), Qt::Uninitialized);
+            uchar *out = reinterpret_cast<uchar *>(res.data());
+            out[0] = TAG_LZ;
+            const quint32 size = data.size();
+            out[1] = size >> 24;
+            out[2] = size >> 16;
+            out[3] = size >> 8;
+            out[4] = size;
+            const int compressedSize = lzCompress(reinterpret_cast<const uchar *>(data.constData()), data.size(), out + 5);
+            if (compressedSize + 4 < data.size()) {
+                res.resize(1 + 4 + compressedSize);
+                return res;
+            }
+            break;
+        }
+        }
+    }
+
+    QByteArray res;
+    res.reserve(data.size() + 1);
+    res.append(static_cast<char>(TAG_STORED));
+    res.append(data);
+    return res;
+}
+
+QByteArray CacheCompression::decompress(const QByteArray &data)
+{
+    return decompress(reinterpret_cast<const uchar *>(data.constData()), data.size());
+}
+
+QByteArray CacheCompression::decompress(const uchar *data, const int size)
+{
+    if (size == 0)
+        return QByteArray();
+
+    switch (data[0]) {
+    case TAG_STORED:
+        return QByteArray(reinterpret_cast<const char *>(data + 1), size - 1);
+    case TAG_LZ:
+    {
+        if (size < 5)
+            return QByteArray();
+        const quint32 expectedSize = (quint32(data[1]) << 24) | (quint32(data[2]) << 16) | (quint32(data[3]) << 8) | data[4];
+        // Don't let a corrupted header make us allocate gigabytes of memory
+        if (expectedSize > 0x7fffffff || expectedSize > quint64(size - 5 + 1) * lzMaxExpansion)
+            return QByteArray();
+        QByteArray res(expectedSize, Qt::Uninitialized);
+        if (!lzDecompress(data + 5, size - 5, reinterpret_cast<uchar *>(res.data()), expectedSize))
+            return QByteArray();
+        return res;
+    }
+    default:
+        if (data[0] >= 0x80) {
+            // Written by some future version using a codec we don't know
+            return QByteArray();
+        }
+        // Data written by an older version which used plain qCompress()
+        return qUncompress(data, size);
+    }
+}
+
+CacheCompression::Codec CacheCompression::codecFromName(const QString &name)
+{
+    if (name == QLatin1String("none"))
+        return CODEC_NONE;
+    else if (name == QLatin1String("lz"))
+        return CODEC_LZ;
+    else
+        return CODEC_ZLIB;
+}
+
+}
+}
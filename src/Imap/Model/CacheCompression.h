@@ -0,0 +1,78 @@
+/* Copyright (C) 2006 - 2014 Jan Kundrát <jkt@flaska.net>
+
+   This file is part of the Trojita Qt IMAP e-mail client,
+   http://trojita.flaska.net/
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2 of
+   the License or (at your option) version 3 or any later version
+   accepted by the membership of KDE e.V. (or its successor approved
+   by the membership of KDE e.V.), which shall act as a proxy
+   defined in Section 14 of version 3 of the license.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef IMAP_MODEL_CACHECOMPRESSION_H
+#define IMAP_MODEL_CACHECOMPRESSION_H
+
+#include <QByteArray>
+#include <QString>
+
+namespace Imap
+{
+
+namespace Mailbox
+{
+
+/** @short Compression of the blobs which are stored in the persistent cache
+
+Each blob is prefixed by a single byte identifying the codec which was used to produce it, so that the codec can be
+changed without invalidating the existing data. The zlib-compressed blobs are an exception; they are stored as plain
+qCompress() output like in older versions. They are recognized by their first byte, which is always below 0x80
+because it's the most significant byte of the uncompressed size.
+
+Blobs which are shorter than a given threshold, or which would not get any smaller, are stored uncompressed.
+*/
+class CacheCompression
+{
+public:
+    typedef enum {
+        /** @short No compression at all */
+        CODEC_NONE,
+        /** @short The zlib compression as implemented by qCompress() */
+        CODEC_ZLIB,
+        /** @short A simple and fast LZ77 compression which trades the compression ratio for speed */
+        CODEC_LZ
+    } Codec;
+
+    explicit CacheCompression(const Codec codec = CODEC_ZLIB, const int storeUncompressedBelow = 128);
+
+    Codec codec() const { return m_codec; }
+
+    /** @short Compress the data with the configured codec */
+    QByteArray compress(const QByteArray &data) const;
+    /** @short Decompress a blob produced by compress() or qCompress(), returning a null QByteArray upon error */
+    static QByteArray decompress(const QByteArray &data);
+    static QByteArray decompress(const uchar *data, const int size);
+
+    /** @short Convert the name of a codec as used in the settings, defaulting to CODEC_ZLIB for unknown names */
+    static Codec codecFromName(const QString &name);
+
+private:
+    Codec m_codec;
+    int m_storeUncompressedBelow;
+};
+
+}
+
+}
+
+#endif /* IMAP_MODEL_CACHECOMPRESSION_H */
@@ -22,6 +22,8 @@
 
 #include "CombinedCache.h"
 #include "DiskPartCache.h"
+#include "FullTextIndex.h"
+#include "PackedPartCache.h"
 #include "SQLCache.h"
 
 namespace Imap
@@ -29,12 +31,19 @@ namespace Imap
 namespace Mailbox
 {
 
-CombinedCache::CombinedCache(QObject *parent, const QString &name, const QString &cacheDir):
-    AbstractCache(parent), name(name), cacheDir(cacheDir)
+CombinedCache::CombinedCache(QObject *parent, const QString &name, const QString &cacheDir, const PartStorage partStorage):
+    AbstractCache(parent), diskPartCache(0), name(name), cacheDir(cacheDir)
 {
     sqlCache = new SQLCache(this);
     connect(sqlCache, SIGNAL(error(QString)), this, SIGNAL(error(QString)));
-    diskPartCache = new DiskPartCache(this, cacheDir);
+    switch (partStorage) {
+    case PART_STORAGE_FILES:
+        diskPartCache = new DiskPartCache(this, cacheDir);
+        break;
+    case PART_STORAGE_PACKED:
+        diskPartCache = new PackedPartCache(this, cacheDir);
+        break;
+    }
     connect(diskPartCache, SIGNAL(error(QString)), this, SIGNAL(error(QString)));
 }
 
@@ -87,16 +96,25 @@ void CombinedCache::clearUidMapping(const QString &mailbox)
     sqlCache->clearUidMapping(mailbox);
 }
 
+void CombinedCache::updateUidMapping(const QString &mailbox, const QList<uint> &expungedUids, const QList<uint> &newUids)
+{
+    sqlCache->updateUidMapping(mailbox, expungedUids, newUids);
+}
+
 void CombinedCache::clearAllMessages(const QString &mailbox)
 {
     sqlCache->clearAllMessages(mailbox);
     diskPartCache->clearAllMessages(mailbox);
+    if (m_fullTextIndex)
+        m_fullTextIndex->forgetMailbox(mailbox);
 }
 
 void CombinedCache::clearMessage(const QString mailbox, const uint uid)
 {
     sqlCache->clearMessage(mailbox, uid);
     diskPartCache->clearMessage(mailbox, uid);
+    if (m_fullTextIndex)
+        m_fullTextIndex->forgetMessage(mailbox, uid);
 }
 
 QStringList CombinedCache::msgFlags(const QString &mailbox, const uint uid) const
@@ -109,6 +127,11 @@ void CombinedCache::setMsgFlags(const QString &mailbox, const uint uid, const QS
     sqlCache->setMsgFlags(mailbox, uid, flags);
 }
 
+void CombinedCache::setMsgFlagsBulk(const QString &mailbox, const QVector<QPair<uint, QStringList> > &flags)
+{
+    sqlCache->setMsgFlagsBulk(mailbox, flags);
+}
+
 AbstractCache::MessageDataBundle CombinedCache::messageMetadata(const QString &mailbox, const uint uid) const
 {
     return sqlCache->messageMetadata(mailbox, uid);
@@ -117,6 +140,8 @@ AbstractCache::MessageDataBundle CombinedCache::messageMetadata(const QString &m
 void CombinedCache::setMessageMetadata(const QString &mailbox, const uint uid, const MessageDataBundle &metadata)
 {
     sqlCache->setMessageMetadata(mailbox, uid, metadata);
+    if (m_fullTextIndex)
+        m_fullTextIndex->addMetadata(mailbox, uid, metadata.envelope);
 }
 
 QByteArray CombinedCache::messagePart(const QString &mailbox, const uint uid, const QString &partId) const
@@ -143,6 +168,23 @@ void CombinedCache::forgetMessagePart(const QString &mailbox, const uint uid, co
     diskPartCache->forgetMessagePart(mailbox, uid, partId);
 }
 
+bool CombinedCache::setMsgPartEncoded(const QString &mailbox, const uint uid, const QString &partId,
+                                      const QByteArray &encodedData, const QByteArray &encoding)
+{
+    // Small parts are better off in the SQL cache
+    if (encodedData.size() < 1024 * 1024)
+        return false;
+    if (!diskPartCache->setMsgPartEncoded(mailbox, uid, partId, encodedData, encoding))
+        return false;
+    sqlCache->forgetMessagePart(mailbox, uid, partId);
+    return true;
+}
+
+QString CombinedCache::messagePartFileName(const QString &mailbox, const uint uid, const QString &partId) const
+{
+    return diskPartCache->messagePartFileName(mailbox, uid, partId);
+}
+
 QVector<Imap::Responses::ThreadingNode> CombinedCache::messageThreading(const QString &mailbox)
 {
     return sqlCache->messageThreading(mailbox);
@@ -158,5 +200,11 @@ void CombinedCache::setRenewalThreshold(const int days)
     sqlCache->setRenewalThreshold(days);
 }
 
+void CombinedCache::setCompression(const CacheCompression &compression)
+{
+    sqlCache->setCompression(compression);
+    diskPartCache->setCompression(compression);
+}
+
 }
 }
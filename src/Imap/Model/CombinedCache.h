@@ -31,6 +31,7 @@ namespace Imap
 namespace Mailbox
 {
 
+class CacheCompression;
 class SQLCache;
 class DiskPartCache;
 
@@ -50,13 +51,23 @@ class CombinedCache : public AbstractCache
 {
     Q_OBJECT
 public:
+    /** @short How to store the big message parts on disk */
+    typedef enum {
+        /** @short One file per message part, see DiskPartCache */
+        PART_STORAGE_FILES,
+        /** @short One append-only pack file per mailbox, see PackedPartCache */
+        PART_STORAGE_PACKED
+    } PartStorage;
+
     /** @short Constructor
 
       Create new instance, using the @arg name as the name for the database connection.
       Store all data into the @arg cacheDir directory. Actual opening of the DB connection
-      is deferred till a call to the load() method.
+      is deferred till a call to the load() method. The big message parts are stored as
+      specified by @arg partStorage.
     */
-    CombinedCache(QObject *parent, const QString &name, const QString &cacheDir);
+    CombinedCache(QObject *parent, const QString &name, const QString &cacheDir,
+                  const PartStorage partStorage = PART_STORAGE_FILES);
 
     virtual ~CombinedCache();
 
@@ -70,6 +81,7 @@ public:
     virtual void setUidMapping(const QString &mailbox, const QList<uint> &seqToUid);
     virtual void clearUidMapping(const QString &mailbox);
     virtual QList<uint> uidMapping(const QString &mailbox) const;
+    virtual void updateUidMapping(const QString &mailbox, const QList<uint> &expungedUids, const QList<uint> &newUids);
 
     virtual void clearAllMessages(const QString &mailbox);
     virtual void clearMessage(const QString mailbox, const uint uid);
@@ -79,16 +91,23 @@ public:
 
     virtual QStringList msgFlags(const QString &mailbox, const uint uid) const;
     virtual void setMsgFlags(const QString &mailbox, const uint uid, const QStringList &flags);
+    virtual void setMsgFlagsBulk(const QString &mailbox, const QVector<QPair<uint, QStringList> > &flags);
 
     virtual QByteArray messagePart(const QString &mailbox, const uint uid, const QString &partId) const;
     virtual void setMsgPart(const QString &mailbox, const uint uid, const QString &partId, const QByteArray &data);
     virtual void forgetMessagePart(const QString &mailbox, const uint uid, const QString &partId);
+    virtual bool setMsgPartEncoded(const QString &mailbox, const uint uid, const QString &partId,
+                                   const QByteArray &encodedData, const QByteArray &encoding);
+    virtual QString messagePartFileName(const QString &mailbox, const uint uid, const QString &partId) const;
 
     virtual QVector<Imap::Responses::ThreadingNode> messageThreading(const QString &mailbox);
     virtual void setMessageThreading(const QString &mailbox, const QVector<Imap::Responses::ThreadingNode> &threading);
 
     virtual void setRenewalThreshold(const int days);
 
+    /** @short Use the specified codec for all newly stored data */
+    void setCompression(const CacheCompression &compression);
+
     /** @short Open a connection to the cache */
     bool open();
 
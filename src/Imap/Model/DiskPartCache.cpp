@@ -23,6 +23,7 @@
 #include "DiskPartCache.h"
 #include <QDebug>
 #include <QDir>
+#include "Imap/Encoders.h"
 
 namespace
 {
@@ -79,7 +80,7 @@ DiskPartCache::DiskPartCache(QObject *parent, const QString &cacheDir_): QObject
 void DiskPartCache::clearAllMessages(const QString &mailbox)
 {
     QDir dir(dirForMailbox(mailbox));
-    Q_FOREACH(const QString& fname, dir.entryList(QStringList() << QLatin1String("*.cache"))) {
+    Q_FOREACH(const QString& fname, dir.entryList(QStringList() << QLatin1String("*.cache") << QLatin1String("*.data"))) {
         if (! dir.remove(fname)) {
             emit error(tr("Couldn't remove file %1 for mailbox %2").arg(fname, mailbox));
         }
@@ -89,7 +90,8 @@ void DiskPartCache::clearAllMessages(const QString &mailbox)
 void DiskPartCache::clearMessage(const QString mailbox, const uint uid)
 {
     QDir dir(dirForMailbox(mailbox));
-    Q_FOREACH(const QString& fname, dir.entryList(QStringList() << QString::fromUtf8("%1_*.cache").arg(QString::number(uid)))) {
+    Q_FOREACH(const QString& fname, dir.entryList(QStringList() << QString::fromUtf8("%1_*.cache").arg(QString::number(uid))
+                                                   << QString::fromUtf8("%1_*.data").arg(QString::number(uid)))) {
         if (! dir.remove(fname)) {
             emit error(tr("Couldn't remove file %1 for message %2, mailbox %3").arg(fname, QString::number(uid), mailbox));
         }
@@ -98,11 +100,15 @@ void DiskPartCache::clearMessage(const QString mailbox, const uint uid)
 
 QByteArray DiskPartCache::messagePart(const QString &mailbox, const uint uid, const QString &partId) const
 {
-    QFile buf(QString::fromUtf8("%1/%2_%3.cache").arg(dirForMailbox(mailbox), QString::number(uid), partId));
+    QFile plain(fileForPlainPart(mailbox, uid, partId));
+    if (plain.open(QIODevice::ReadOnly)) {
+        return plain.readAll();
+    }
+    QFile buf(fileForCompressedPart(mailbox, uid, partId));
     if (! buf.open(QIODevice::ReadOnly)) {
         return QByteArray();
     }
-    return qUncompress(buf.readAll());
+    return CacheCompression::decompress(buf.readAll());
 }
 
 void DiskPartCache::setMsgPart(const QString &mailbox, const uint uid, const QString &partId, const QByteArray &data)
@@ -110,18 +116,77 @@ void DiskPartCache::setMsgPart(const QString &mailbox, const uint uid, const QSt
     QString myPath = dirForMailbox(mailbox);
     QDir dir(myPath);
     dir.mkpath(myPath);
-    QString fileName = QString::fromUtf8("%1/%2_%3.cache").arg(myPath, QString::number(uid), partId);
+    QString fileName = fileForCompressedPart(mailbox, uid, partId);
+    QFile::remove(fileForPlainPart(mailbox, uid, partId));
     QFile buf(fileName);
     if (! buf.open(QIODevice::WriteOnly)) {
         emit error(tr("Couldn't save the part %1 of message %2 (mailbox %3) into file %4: %5 (%6)").arg(
                        partId, QString::number(uid), mailbox, fileName, buf.errorString(), fileErrorToString(buf.error())));
     }
-    buf.write(qCompress(data));
+    buf.write(m_compression.compress(data));
 }
 
 void DiskPartCache::forgetMessagePart(const QString &mailbox, const uint uid, const QString &partId)
 {
-    QFile(QString::fromUtf8("%1/%2_%3.cache").arg(dirForMailbox(mailbox), QString::number(uid), partId)).remove();
+    QFile(fileForCompressedPart(mailbox, uid, partId)).remove();
+    QFile(fileForPlainPart(mailbox, uid, partId)).remove();
+}
+
+bool DiskPartCache::setMsgPartEncoded(const QString &mailbox, const uint uid, const QString &partId,
+                                      const QByteArray &encodedData, const QByteArray &encoding)
+{
+    // How much of the encoded data to process at once
+    const int chunkSize = 64 * 1024;
+
+    QString myPath = dirForMailbox(mailbox);
+    QDir dir(myPath);
+    dir.mkpath(myPath);
+    QString fileName = fileForPlainPart(mailbox, uid, partId);
+    // Write into a temporary file first so that a half-written part is never mistaken for complete data
+    QFile buf(fileName + QLatin1String(".tmp"));
+    if (! buf.open(QIODevice::WriteOnly)) {
+        emit error(tr("Couldn't save the part %1 of message %2 (mailbox %3) into file %4: %5 (%6)").arg(
+                       partId, QString::number(uid), mailbox, buf.fileName(), buf.errorString(), fileErrorToString(buf.error())));
+        return false;
+    }
+
+    Imap::ContentTransferDecoder decoder(encoding);
+    bool ok = true;
+    for (int offset = 0; ok && offset < encodedData.size(); offset += chunkSize) {
+        // QByteArray::fromRawData does not copy the data, so the only allocation here is for the decoded chunk
+        const QByteArray chunk = QByteArray::fromRawData(encodedData.constData() + offset,
+                                                         qMin(chunkSize, encodedData.size() - offset));
+        const QByteArray decoded = decoder.decode(chunk);
+        ok = buf.write(decoded) == decoded.size();
+    }
+    if (ok) {
+        const QByteArray decoded = decoder.finish();
+        ok = buf.write(decoded) == decoded.size();
+    }
+    buf.close();
+
+    if (ok) {
+        QFile::remove(fileForCompressedPart(mailbox, uid, partId));
+        QFile::remove(fileName);
+        ok = buf.rename(fileName);
+    }
+    if (!ok) {
+        emit error(tr("Couldn't save the part %1 of message %2 (mailbox %3) into file %4: %5 (%6)").arg(
+                       partId, QString::number(uid), mailbox, fileName, buf.errorString(), fileErrorToString(buf.error())));
+        buf.remove();
+    }
+    return ok;
+}
+
+QString DiskPartCache::messagePartFileName(const QString &mailbox, const uint uid, const QString &partId) const
+{
+    QString fileName = fileForPlainPart(mailbox, uid, partId);
+    return QFile::exists(fileName) ? fileName : QString();
+}
+
+void DiskPartCache::setCompression(const CacheCompression &compression)
+{
+    m_compression = compression;
 }
 
 QString DiskPartCache::dirForMailbox(const QString &mailbox) const
@@ -129,6 +194,16 @@ QString DiskPartCache::dirForMailbox(const QString &mailbox) const
     return cacheDir + mailbox.toUtf8().toBase64();
 }
 
+QString DiskPartCache::fileForCompressedPart(const QString &mailbox, const uint uid, const QString &partId) const
+{
+    return QString::fromUtf8("%1/%2_%3.cache").arg(dirForMailbox(mailbox), QString::number(uid), partId);
+}
+
+QString DiskPartCache::fileForPlainPart(const QString &mailbox, const uint uid, const QString &partId) const
+{
+    return QString::fromUtf8("%1/%2_%3.data").arg(dirForMailbox(mailbox), QString::number(uid), partId);
+}
+
 }
 }
 
@@ -24,6 +24,7 @@
 #define IMAP_MODEL_DISKPARTCACHE_H
 
 #include <QObject>
+#include "CacheCompression.h"
 
 namespace Imap
 {
@@ -55,14 +56,35 @@ public:
     virtual void setMsgPart(const QString &mailbox, const uint uid, const QString &partId, const QByteArray &data);
     virtual void forgetMessagePart(const QString &mailbox, const uint uid, const QString &partId);
 
+    /** @short Undo the Content-Transfer-Encoding and write the result into an uncompressed file
+
+    The data are decoded and written in small pieces, so the decoded form of the part never has to be kept in memory.
+    Returns false if the data could not be written.
+    */
+    virtual bool setMsgPartEncoded(const QString &mailbox, const uint uid, const QString &partId,
+                                   const QByteArray &encodedData, const QByteArray &encoding);
+    /** @short Return the name of an uncompressed file holding the part data, or a null QString if there isn't any */
+    virtual QString messagePartFileName(const QString &mailbox, const uint uid, const QString &partId) const;
+
+    /** @short Use the specified compression for newly stored data */
+    void setCompression(const CacheCompression &compression);
+
 signals:
     /** @short An error has occurred while performing cache operations */
     void error(const QString &message);
 
-private:
+protected:
     /** @short Return the directory which should be used as a storage dir for a particular mailbox */
     QString dirForMailbox(const QString &mailbox) const;
 
+    CacheCompression m_compression;
+
+private:
+    /** @short Name of the file with compressed data as stored by setMsgPart() */
+    QString fileForCompressedPart(const QString &mailbox, const uint uid, const QString &partId) const;
+    /** @short Name of the file with plain data as stored by setMsgPartEncoded() */
+    QString fileForPlainPart(const QString &mailbox, const uint uid, const QString &partId) const;
+
     /** @short The root directory for all caching */
     QString cacheDir;
 };
@@ -0,0 +1,272 @@
+/* Copyright (C) 2006 - 2014 Jan Kundrát <jkt@flaska.net>
+
+   This file is part of the Trojita Qt IMAP e-mail client,
+   http://trojita.flaska.net/
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2 of
+   the License or (at your option) version 3 or any later version
+   accepted by the membership of KDE e.V. (or its successor approved
+   by the membership of KDE e.V.), which shall act as a proxy
+   defined in Section 14 of version 3 of the license.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <algorithm>
+#include <iterator>
+#include <QSet>
+#include <QSqlError>
+#include <QThread>
+#include "FullTextIndex.h"
+#include "FullTextIndexWorker.h"
+#include "Imap/Parser/Message.h"
+
+namespace
+{
+
+/** @short Words shorter than this are not worth indexing */
+const int minTokenLength = 2;
+
+/** @short Longer words are truncated; the prefix matching will still find them */
+const int maxTokenLength = 32;
+
+QString addressesToText(const QList<Imap::Message::MailAddress> &addresses)
+{
+    QStringList res;
+    Q_FOREACH(const Imap::Message::MailAddress &addr, addresses) {
+        res << addr.name << addr.mailbox << addr.host;
+    }
+    return res.join(QLatin1String(" "));
+}
+
+}
+
+namespace Imap
+{
+namespace Mailbox
+{
+
+FullTextIndex::FullTextIndex(QObject *parent, const QString &name, const QString &fileName):
+    QObject(parent), m_name(name), m_fileName(fileName), m_workerThread(0), m_worker(0)
+{
+}
+
+FullTextIndex::~FullTextIndex()
+{
+    if (m_worker) {
+        m_worker->disconnect(this);
+        QMetaObject::invokeMethod(m_worker, "close", Qt::BlockingQueuedConnection);
+        m_workerThread->quit();
+        m_workerThread->wait();
+        delete m_worker;
+    }
+    m_queryFindMailbox = QSqlQuery();
+    m_querySearchTerm = QSqlQuery();
+    m_queryIndexedMessages = QSqlQuery();
+    if (m_db.isValid()) {
+        m_db.close();
+        m_db = QSqlDatabase();
+        QSqlDatabase::removeDatabase(m_name + QLatin1String("-reader"));
+    }
+}
+
+bool FullTextIndex::open()
+{
+    Q_ASSERT(!m_worker);
+
+    // The worker has to create the tables before we can prepare our queries
+    m_workerThread = new QThread(this);
+    m_worker = new FullTextIndexWorker();
+    m_worker->moveToThread(m_workerThread);
+    connect(m_worker, SIGNAL(error(QString)), this, SIGNAL(error(QString)), Qt::QueuedConnection);
+    m_workerThread->start();
+    bool ok = false;
+    QMetaObject::invokeMethod(m_worker, "open", Qt::BlockingQueuedConnection, Q_RETURN_ARG(bool, ok),
+                              Q_ARG(QString, m_name + QLatin1String("-writer")), Q_ARG(QString, m_fileName));
+    if (!ok)
+        return false;
+
+    m_db = QSqlDatabase::addDatabase(QLatin1String("QSQLITE"), m_name + QLatin1String("-reader"));
+    m_db.setDatabaseName(m_fileName);
+    m_db.setConnectOptions(QLatin1String("QSQLITE_BUSY_TIMEOUT=5000"));
+    if (!m_db.open()) {
+        emit error(QString::fromUtf8("FullTextIndex: DB Error: %1").arg(m_db.lastError().text()));
+        return false;
+    }
+
+    m_queryFindMailbox = QSqlQuery(m_db);
+    m_querySearchTerm = QSqlQuery(m_db);
+    m_queryIndexedMessages = QSqlQuery(m_db);
+    if (!m_queryFindMailbox.prepare(QLatin1String("SELECT id FROM fts_mailboxes WHERE name = ?")) ||
+            !m_querySearchTerm.prepare(QLatin1String("SELECT uid FROM fts_postings WHERE mailbox = ? AND term >= ? AND term < ? "
+                                                     "AND ( field & ? ) != 0")) ||
+            !m_queryIndexedMessages.prepare(QLatin1String("SELECT uid FROM fts_docs WHERE mailbox = ? AND ( fields & ? ) = ?"))) {
+        emit error(QString::fromUtf8("FullTextIndex: Failed to prepare queries: %1").arg(m_db.lastError().text()));
+        return false;
+    }
+    return true;
+}
+
+void FullTextIndex::addMetadata(const QString &mailbox, const uint uid, const Imap::Message::Envelope &envelope)
+{
+    if (!m_worker)
+        return;
+    QMetaObject::invokeMethod(m_worker, "indexMetadata", Qt::QueuedConnection,
+                              Q_ARG(QString, mailbox), Q_ARG(uint, uid), Q_ARG(QString, envelope.subject),
+                              Q_ARG(QString, addressesToText(envelope.from + envelope.sender)),
+                              Q_ARG(QString, addressesToText(envelope.to + envelope.cc + envelope.bcc)));
+}
+
+void FullTextIndex::addBodyPart(const QString &mailbox, const uint uid, const QString &partId, const QByteArray &data,
+                                const QByteArray &charset)
+{
+    if (!m_worker)
+        return;
+    // Skip the HEADER, MIME, TEXT and X-RAW pseudo-parts, these are either not decoded or just duplicate the real parts
+    bool ok;
+    partId.mid(partId.lastIndexOf(QLatin1Char('.')) + 1).toUInt(&ok);
+    if (!ok)
+        return;
+    QMetaObject::invokeMethod(m_worker, "indexBody", Qt::QueuedConnection,
+                              Q_ARG(QString, mailbox), Q_ARG(uint, uid), Q_ARG(QByteArray, data), Q_ARG(QByteArray, charset));
+}
+
+void FullTextIndex::forgetMessage(const QString &mailbox, const uint uid)
+{
+    if (!m_worker)
+        return;
+    QMetaObject::invokeMethod(m_worker, "forgetMessage", Qt::QueuedConnection, Q_ARG(QString, mailbox), Q_ARG(uint, uid));
+}
+
+void FullTextIndex::forgetMailbox(const QString &mailbox)
+{
+    if (!m_worker)
+        return;
+    QMetaObject::invokeMethod(m_worker, "forgetMailbox", Qt::QueuedConnection, Q_ARG(QString, mailbox));
+}
+
+void FullTextIndex::flush()
+{
+    if (!m_worker)
+        return;
+    // The queued calls are processed in order, so once this one returns, everything submitted before has been committed
+    QMetaObject::invokeMethod(m_worker, "commit", Qt::BlockingQueuedConnection);
+}
+
+QList<uint> FullTextIndex::search(const QString &mailbox, const QStringList &words, const int fields) const
+{
+    QList<uint> res;
+    if (words.isEmpty())
+        return res;
+    const int id = mailboxId(mailbox);
+    if (id < 0)
+        return res;
+
+    bool firstWord = true;
+    Q_FOREACH(const QString &word, words) {
+        if (word.isEmpty())
+            continue;
+        // All words with the given prefix sort between the prefix itself and the prefix with its last character incremented
+        QString upperBound = word;
+        const ushort last = upperBound.at(upperBound.size() - 1).unicode();
+        if (last == 0xffff)
+            upperBound += QChar(0xffff);
+        else
+            upperBound[upperBound.size() - 1] = QChar(last + 1);
+
+        m_querySearchTerm.bindValue(0, id);
+        m_querySearchTerm.bindValue(1, word);
+        m_querySearchTerm.bindValue(2, upperBound);
+        m_querySearchTerm.bindValue(3, fields);
+        if (!m_querySearchTerm.exec()) {
+            emit error(QString::fromUtf8("FullTextIndex: Query Error: search: %1").arg(m_querySearchTerm.lastError().text()));
+            return QList<uint>();
+        }
+        QList<uint> uids;
+        while (m_querySearchTerm.next())
+            uids << m_querySearchTerm.value(0).toUInt();
+        // Don't keep the read transaction open, it would prevent the writer from checkpointing the log
+        m_querySearchTerm.finish();
+        qSort(uids);
+        uids.erase(std::unique(uids.begin(), uids.end()), uids.end());
+
+        if (firstWord) {
+            res = uids;
+            firstWord = false;
+        } else {
+            QList<uint> both;
+            std::set_intersection(res.constBegin(), res.constEnd(), uids.constBegin(), uids.constEnd(), std::back_inserter(both));
+            res = both;
+        }
+        if (res.isEmpty())
+            break;
+    }
+    return res;
+}
+
+QList<uint> FullTextIndex::indexedMessages(const QString &mailbox, const int fields) const
+{
+    QList<uint> res;
+    const int id = mailboxId(mailbox);
+    if (id < 0)
+        return res;
+    m_queryIndexedMessages.bindValue(0, id);
+    m_queryIndexedMessages.bindValue(1, fields);
+    m_queryIndexedMessages.bindValue(2, fields);
+    if (!m_queryIndexedMessages.exec()) {
+        emit error(QString::fromUtf8("FullTextIndex: Query Error: indexedMessages: %1").arg(m_queryIndexedMessages.lastError().text()));
+        return res;
+    }
+    while (m_queryIndexedMessages.next())
+        res << m_queryIndexedMessages.value(0).toUInt();
+    m_queryIndexedMessages.finish();
+    qSort(res);
+    return res;
+}
+
+/** @short Look up the numeric ID of the mailbox, or -1 if it isn't in the index yet */
+int FullTextIndex::mailboxId(const QString &mailbox) const
+{
+    if (!m_db.isOpen())
+        return -1;
+    m_queryFindMailbox.bindValue(0, mailbox.isEmpty() ? QLatin1String("") : mailbox);
+    if (!m_queryFindMailbox.exec())
+        return -1;
+    const int id = m_queryFindMailbox.first() ? m_queryFindMailbox.value(0).toInt() : -1;
+    m_queryFindMailbox.finish();
+    return id;
+}
+
+QStringList FullTextIndex::tokenize(const QString &text)
+{
+    QStringList res;
+    QSet<QString> seen;
+    int start = -1;
+    for (int i = 0; i <= text.size(); ++i) {
+        if (i < text.size() && text.at(i).isLetterOrNumber()) {
+            if (start == -1)
+                start = i;
+            continue;
+        }
+        if (start != -1 && i - start >= minTokenLength) {
+            QString word = text.mid(start, qMin(i - start, maxTokenLength)).toLower();
+            if (!seen.contains(word)) {
+                seen.insert(word);
+                res << word;
+            }
+        }
+        start = -1;
+    }
+    return res;
+}
+
+}
+}
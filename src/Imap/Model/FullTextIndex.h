@@ -0,0 +1,130 @@
+/* Copyright (C) 2006 - 2014 Jan Kundrát <jkt@flaska.net>
+
+   This file is part of the Trojita Qt IMAP e-mail client,
+   http://trojita.flaska.net/
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2 of
+   the License or (at your option) version 3 or any later version
+   accepted by the membership of KDE e.V. (or its successor approved
+   by the membership of KDE e.V.), which shall act as a proxy
+   defined in Section 14 of version 3 of the license.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#ifndef IMAP_MODEL_FULLTEXTINDEX_H
+#define IMAP_MODEL_FULLTEXTINDEX_H
+
+#include <QObject>
+#include <QSqlDatabase>
+#include <QSqlQuery>
+#include <QStringList>
+
+class QThread;
+
+namespace Imap
+{
+
+namespace Message
+{
+class Envelope;
+}
+
+namespace Mailbox
+{
+
+class FullTextIndexWorker;
+
+/** @short Local inverted index over the subjects, addresses and bodies of the cached messages
+
+The index is stored in its own SQLite database next to the regular cache. It maps lowercased words to the UIDs of the
+messages (and to the part of the message) in which they occur. The CombinedCache feeds the index with each envelope and each
+message part which it stores; all the actual work of updating the index happens in a background thread, see
+FullTextIndexWorker.
+
+Queries are executed synchronously in the thread which has opened the index. Each word of a query matches all indexed words
+which it is a prefix of. This is not exactly the substring semantics of the IMAP SEARCH, but it is what users typically
+expect from a quick search.
+
+Because not all messages are necessarily cached, the index also keeps track of which parts of which messages have been
+indexed. The users are expected to ask the IMAP server about the rest, see indexedMessages().
+*/
+class FullTextIndex : public QObject
+{
+    Q_OBJECT
+public:
+    /** @short Which parts of a message a word was found in */
+    typedef enum {
+        FIELD_SUBJECT = 1,
+        /** @short The From header */
+        FIELD_FROM = 2,
+        /** @short The To, Cc and Bcc headers */
+        FIELD_RECIPIENTS = 4,
+        /** @short Text of any of the message body parts */
+        FIELD_BODY = 8
+    } Field;
+
+    /** @short Create the index which is stored in the @arg fileName and which uses @arg name as a DB connection prefix */
+    FullTextIndex(QObject *parent, const QString &name, const QString &fileName);
+    virtual ~FullTextIndex();
+
+    /** @short Open the database and start the indexing thread */
+    bool open();
+
+    /** @short Schedule indexing of the subject and addresses from the message envelope */
+    void addMetadata(const QString &mailbox, const uint uid, const Imap::Message::Envelope &envelope);
+    /** @short Schedule indexing of a message part which has been stored in the cache
+
+    Only the leaf parts of the MIME tree are indexed. The @arg charset comes from the part's BODYSTRUCTURE; parts in an unknown
+    charset and parts without one which do not look like UTF-8 text are ignored by the worker.
+    */
+    void addBodyPart(const QString &mailbox, const uint uid, const QString &partId, const QByteArray &data,
+                     const QByteArray &charset);
+    /** @short Schedule removal of a message from the index */
+    void forgetMessage(const QString &mailbox, const uint uid);
+    /** @short Schedule removal of a whole mailbox from the index */
+    void forgetMailbox(const QString &mailbox);
+
+    /** @short Block until all pending updates have been committed */
+    void flush();
+
+    /** @short Return sorted UIDs of messages in @arg mailbox which contain all of the @arg words in any of the @arg fields
+
+    The @arg fields is a bitwise OR of the Field values.
+    */
+    QList<uint> search(const QString &mailbox, const QStringList &words, const int fields) const;
+    /** @short Return sorted UIDs of messages in @arg mailbox whose @arg fields have been completely indexed */
+    QList<uint> indexedMessages(const QString &mailbox, const int fields) const;
+
+    /** @short Split the text into a list of unique lowercased words, as stored in the index */
+    static QStringList tokenize(const QString &text);
+
+signals:
+    /** @short Some error has occurred */
+    void error(const QString &message) const;
+
+private:
+    int mailboxId(const QString &mailbox) const;
+
+    QString m_name;
+    QString m_fileName;
+    QThread *m_workerThread;
+    FullTextIndexWorker *m_worker;
+    QSqlDatabase m_db;
+    mutable QSqlQuery m_queryFindMailbox;
+    mutable QSqlQuery m_querySearchTerm;
+    mutable QSqlQuery m_queryIndexedMessages;
+};
+
+}
+
+}
+
+#endif /* IMAP_MODEL_FULLTEXTINDEX_H */
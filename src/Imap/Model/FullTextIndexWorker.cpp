@@ -0,0 +1,433 @@
+/* Copyright (C) 2006 - 2014 Jan Kundrát <jkt@flaska.net>
+
+   This file is part of the Trojita Qt IMAP e-mail client,
+   http://trojita.flaska.net/
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2 of
+   the License or (at your option) version 3 or any later version
+   accepted by the membership of KDE e.V. (or its successor approved
+   by the membership of KDE e.V.), which shall act as a proxy
+   defined in Section 14 of version 3 of the license.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "FullTextIndexWorker.h"
+#include <QDebug>
+#include <QSqlError>
+#include <QTextCodec>
+#include <QTimer>
+#include "FullTextIndex.h"
+
+namespace
+{
+
+/** @short Version of the database layout; a mismatch throws away the whole index */
+const int schemaVersion = 1;
+
+/** @short How many postings are inserted by one bulk INSERT
+
+Each row has four bound parameters, and SQLite limits both the number of parameters and the terms of a compound SELECT.
+*/
+const int bulkInsertRows = 100;
+
+/** @short Commit after this many messages even when the queue is still busy */
+const int maxUncommittedMessages = 1000;
+
+/** @short Commit after being idle for this long (in ms) */
+const int commitDelay = 200;
+
+/** @short Only the beginning of huge text parts is indexed */
+const int maxIndexedBodySize = 256 * 1024;
+
+}
+
+namespace Imap
+{
+namespace Mailbox
+{
+
+FullTextIndexWorker::FullTextIndexWorker(QObject *parent):
+    QObject(parent), m_commitTimer(0), m_inTransaction(false), m_uncommittedMessages(0)
+{
+    m_commitTimer = new QTimer(this);
+    m_commitTimer->setSingleShot(true);
+    m_commitTimer->setInterval(commitDelay);
+    connect(m_commitTimer, SIGNAL(timeout()), this, SLOT(commit()));
+}
+
+bool FullTextIndexWorker::open(const QString &name, const QString &fileName)
+{
+    m_name = name;
+    m_db = QSqlDatabase::addDatabase(QLatin1String("QSQLITE"), name);
+    m_db.setDatabaseName(fileName);
+    m_db.setConnectOptions(QLatin1String("QSQLITE_BUSY_TIMEOUT=5000"));
+    if (!m_db.open()) {
+        emitError(tr("Can't open database"), m_db);
+        return false;
+    }
+
+    QSqlQuery q(QString(), m_db);
+    // The readers in the GUI thread shall not be blocked by our writes. This requires SQLite 3.7; older versions simply
+    // stay in the default journal mode.
+    q.exec(QLatin1String("PRAGMA journal_mode = WAL"));
+    q.exec(QLatin1String("PRAGMA synchronous = NORMAL"));
+
+    if (!q.exec(QLatin1String("PRAGMA user_version")) || !q.first()) {
+        emitError(tr("Can't determine version info"), q);
+        return false;
+    }
+    const int version = q.value(0).toInt();
+    q.finish();
+    if (version != schemaVersion && !createTables())
+        return false;
+
+    return prepareQueries();
+}
+
+bool FullTextIndexWorker::createTables()
+{
+    QSqlQuery q(QString(), m_db);
+    QStringList statements;
+    statements << QLatin1String("DROP TABLE IF EXISTS fts_mailboxes")
+               << QLatin1String("DROP TABLE IF EXISTS fts_docs")
+               << QLatin1String("DROP TABLE IF EXISTS fts_postings")
+               << QLatin1String("CREATE TABLE fts_mailboxes ( id INTEGER PRIMARY KEY, name TEXT NOT NULL UNIQUE )")
+               << QLatin1String("CREATE TABLE fts_docs ( mailbox INT NOT NULL, uid INT NOT NULL, fields INT NOT NULL, "
+                                "PRIMARY KEY ( mailbox, uid ) )")
+               << QLatin1String("CREATE TABLE fts_postings ( mailbox INT NOT NULL, term TEXT NOT NULL, uid INT NOT NULL, "
+                                "field INT NOT NULL, PRIMARY KEY ( mailbox, term, uid, field ) )")
+               << QLatin1String("CREATE INDEX fts_postings_message ON fts_postings ( mailbox, uid )")
+               << QString::fromUtf8("PRAGMA user_version = %1").arg(schemaVersion);
+    Q_FOREACH(const QString &statement, statements) {
+        if (!q.exec(statement)) {
+            emitError(tr("Failed to prepare table structures"), q);
+            return false;
+        }
+    }
+    return true;
+}
+
+bool FullTextIndexWorker::prepareQueries()
+{
+#define TROJITA_FTS_PREPARE(QUERY, TEXT) \
+    QUERY = QSqlQuery(m_db); \
+    if (!QUERY.prepare(TEXT)) { \
+        emitError(tr("Failed to prepare " #QUERY), QUERY); \
+        return false; \
+    }
+
+    TROJITA_FTS_PREPARE(m_queryFindMailbox, QLatin1String("SELECT id FROM fts_mailboxes WHERE name = ?"));
+    TROJITA_FTS_PREPARE(m_queryInsertMailbox, QLatin1String("INSERT INTO fts_mailboxes ( name ) VALUES ( ? )"));
+    TROJITA_FTS_PREPARE(m_queryInsertPosting, QLatin1String("INSERT OR IGNORE INTO fts_postings ( mailbox, term, uid, field ) "
+                                                            "VALUES ( ?, ?, ?, ? )"));
+    QStringList selects;
+    for (int i = 0; i < bulkInsertRows; ++i)
+        selects << QLatin1String("SELECT ?, ?, ?, ?");
+    // The multi-row VALUES clause is not available in older SQLite versions, but a compound SELECT is
+    TROJITA_FTS_PREPARE(m_queryInsertPostingBulk, QLatin1String("INSERT OR IGNORE INTO fts_postings ( mailbox, term, uid, field ) ")
+                        + selects.join(QLatin1String(" UNION ALL ")));
+    TROJITA_FTS_PREPARE(m_queryInsertDoc, QLatin1String("INSERT OR IGNORE INTO fts_docs ( mailbox, uid, fields ) VALUES ( ?, ?, 0 )"));
+    TROJITA_FTS_PREPARE(m_queryUpdateDoc, QLatin1String("UPDATE fts_docs SET fields = fields | ? WHERE mailbox = ? AND uid = ?"));
+    TROJITA_FTS_PREPARE(m_queryForgetPostings, QLatin1String("DELETE FROM fts_postings WHERE mailbox = ? AND uid = ?"));
+    TROJITA_FTS_PREPARE(m_queryForgetDoc, QLatin1String("DELETE FROM fts_docs WHERE mailbox = ? AND uid = ?"));
+    TROJITA_FTS_PREPARE(m_queryForgetMailboxPostings, QLatin1String("DELETE FROM fts_postings WHERE mailbox = ?"));
+    TROJITA_FTS_PREPARE(m_queryForgetMailboxDocs, QLatin1String("DELETE FROM fts_docs WHERE mailbox = ?"));
+
+#undef TROJITA_FTS_PREPARE
+    return true;
+}
+
+void FullTextIndexWorker::close()
+{
+    commit();
+    m_queryFindMailbox = QSqlQuery();
+    m_queryInsertMailbox = QSqlQuery();
+    m_queryInsertPosting = QSqlQuery();
+    m_queryInsertPostingBulk = QSqlQuery();
+    m_queryInsertDoc = QSqlQuery();
+    m_queryUpdateDoc = QSqlQuery();
+    m_queryForgetPostings = QSqlQuery();
+    m_queryForgetDoc = QSqlQuery();
+    m_queryForgetMailboxPostings = QSqlQuery();
+    m_queryForgetMailboxDocs = QSqlQuery();
+    m_db.close();
+    m_db = QSqlDatabase();
+    if (!m_name.isEmpty())
+        QSqlDatabase::removeDatabase(m_name);
+}
+
+void FullTextIndexWorker::indexMetadata(const QString &mailbox, uint uid, const QString &subject, const QString &senders,
+                                        const QString &recipients)
+{
+    if (!ensureTransaction())
+        return;
+    int id = mailboxId(mailbox);
+    if (id < 0)
+        return;
+    addPostings(id, uid, FullTextIndex::tokenize(subject), FullTextIndex::FIELD_SUBJECT);
+    addPostings(id, uid, FullTextIndex::tokenize(senders), FullTextIndex::FIELD_FROM);
+    addPostings(id, uid, FullTextIndex::tokenize(recipients), FullTextIndex::FIELD_RECIPIENTS);
+    markIndexed(id, uid, FullTextIndex::FIELD_SUBJECT | FullTextIndex::FIELD_FROM | FullTextIndex::FIELD_RECIPIENTS);
+    messageProcessed();
+}
+
+void FullTextIndexWorker::indexBody(const QString &mailbox, uint uid, const QByteArray &data, const QByteArray &charset)
+{
+    QString text = decodeBodyText(data, charset);
+    if (text.isNull())
+        return;
+    if (!ensureTransaction())
+        return;
+    int id = mailboxId(mailbox);
+    if (id < 0)
+        return;
+    addPostings(id, uid, FullTextIndex::tokenize(text), FullTextIndex::FIELD_BODY);
+    markIndexed(id, uid, FullTextIndex::FIELD_BODY);
+    messageProcessed();
+}
+
+void FullTextIndexWorker::forgetMessage(const QString &mailbox, uint uid)
+{
+    if (!ensureTransaction())
+        return;
+    int id = mailboxId(mailbox);
+    if (id < 0)
+        return;
+    m_queryForgetPostings.bindValue(0, id);
+    m_queryForgetPostings.bindValue(1, uid);
+    if (!m_queryForgetPostings.exec()) {
+        emitError(tr("Query m_queryForgetPostings failed"), m_queryForgetPostings);
+        return;
+    }
+    m_queryForgetDoc.bindValue(0, id);
+    m_queryForgetDoc.bindValue(1, uid);
+    if (!m_queryForgetDoc.exec()) {
+        emitError(tr("Query m_queryForgetDoc failed"), m_queryForgetDoc);
+        return;
+    }
+    messageProcessed();
+}
+
+void FullTextIndexWorker::forgetMailbox(const QString &mailbox)
+{
+    if (!ensureTransaction())
+        return;
+    int id = mailboxId(mailbox);
+    if (id < 0)
+        return;
+    m_queryForgetMailboxPostings.bindValue(0, id);
+    if (!m_queryForgetMailboxPostings.exec()) {
+        emitError(tr("Query m_queryForgetMailboxPostings failed"), m_queryForgetMailboxPostings);
+        return;
+    }
+    m_queryForgetMailboxDocs.bindValue(0, id);
+    if (!m_queryForgetMailboxDocs.exec()) {
+        emitError(tr("Query m_queryForgetMailboxDocs failed"), m_queryForgetMailboxDocs);
+        return;
+    }
+    messageProcessed();
+}
+
+void FullTextIndexWorker::commit()
+{
+    m_commitTimer->stop();
+    if (!m_inTransaction)
+        return;
+    m_inTransaction = false;
+    m_uncommittedMessages = 0;
+    if (!m_db.commit())
+        emitError(tr("Can't commit the transaction"), m_db);
+}
+
+bool FullTextIndexWorker::ensureTransaction()
+{
+    if (!m_db.isOpen())
+        return false;
+    if (m_inTransaction)
+        return true;
+    if (!m_db.transaction()) {
+        emitError(tr("Can't start a transaction"), m_db);
+        return false;
+    }
+    m_inTransaction = true;
+    m_commitTimer->start();
+    return true;
+}
+
+void FullTextIndexWorker::messageProcessed()
+{
+    if (++m_uncommittedMessages >= maxUncommittedMessages) {
+        commit();
+    } else {
+        // Postpone the commit as long as there's more work arriving
+        m_commitTimer->start();
+    }
+}
+
+/** @short Return the numeric ID for the given mailbox name, creating a new one if needed; -1 on failure */
+int FullTextIndexWorker::mailboxId(const QString &mailbox)
+{
+    const QString name = mailbox.isEmpty() ? QLatin1String("") : mailbox;
+    QHash<QString, int>::const_iterator it = m_mailboxIds.constFind(name);
+    if (it != m_mailboxIds.constEnd())
+        return *it;
+
+    m_queryFindMailbox.bindValue(0, name);
+    if (!m_queryFindMailbox.exec()) {
+        emitError(tr("Query m_queryFindMailbox failed"), m_queryFindMailbox);
+        return -1;
+    }
+    int id;
+    if (m_queryFindMailbox.first()) {
+        id = m_queryFindMailbox.value(0).toInt();
+    } else {
+        m_queryInsertMailbox.bindValue(0, name);
+        if (!m_queryInsertMailbox.exec()) {
+            emitError(tr("Query m_queryInsertMailbox failed"), m_queryInsertMailbox);
+            return -1;
+        }
+        id = m_queryInsertMailbox.lastInsertId().toInt();
+    }
+    m_queryFindMailbox.finish();
+    m_mailboxIds[name] = id;
+    return id;
+}
+
+void FullTextIndexWorker::addPostings(const int mailbox, const uint uid, const QStringList &terms, const int field)
+{
+    int i = 0;
+    for (; i + bulkInsertRows <= terms.size(); i += bulkInsertRows) {
+        for (int row = 0; row < bulkInsertRows; ++row) {
+            m_queryInsertPostingBulk.bindValue(row * 4, mailbox);
+            m_queryInsertPostingBulk.bindValue(row * 4 + 1, terms[i + row]);
+            m_queryInsertPostingBulk.bindValue(row * 4 + 2, uid);
+            m_queryInsertPostingBulk.bindValue(row * 4 + 3, field);
+        }
+        if (!m_queryInsertPostingBulk.exec()) {
+            emitError(tr("Query m_queryInsertPostingBulk failed"), m_queryInsertPostingBulk);
+            return;
+        }
+    }
+    // The rest doesn't fill a whole bulk query
+    for (; i < terms.size(); ++i) {
+        m_queryInsertPosting.bindValue(0, mailbox);
+        m_queryInsertPosting.bindValue(1, terms[i]);
+        m_queryInsertPosting.bindValue(2, uid);
+        m_queryInsertPosting.bindValue(3, field);
+        if (!m_queryInsertPosting.exec()) {
+            emitError(tr("Query m_queryInsertPosting failed"), m_queryInsertPosting);
+            return;
+        }
+    }
+}
+
+void FullTextIndexWorker::markIndexed(const int mailbox, const uint uid, const int fields)
+{
+    m_queryInsertDoc.bindValue(0, mailbox);
+    m_queryInsertDoc.bindValue(1, uid);
+    if (!m_queryInsertDoc.exec()) {
+        emitError(tr("Query m_queryInsertDoc failed"), m_queryInsertDoc);
+        return;
+    }
+    m_queryUpdateDoc.bindValue(0, fields);
+    m_queryUpdateDoc.bindValue(1, mailbox);
+    m_queryUpdateDoc.bindValue(2, uid);
+    if (!m_queryUpdateDoc.exec())
+        emitError(tr("Query m_queryUpdateDoc failed"), m_queryUpdateDoc);
+}
+
+/** @short Convert the body part data in the specified @arg charset to text
+
+Parts without a charset are only accepted when they are valid UTF-8 (which includes plain ASCII). A null QString is returned
+for anything which cannot be decoded reliably, be it binary data or an unknown charset, so that such a part does not count
+as indexed.
+*/
+QString FullTextIndexWorker::decodeBodyText(const QByteArray &data, const QByteArray &charset)
+{
+    if (data.isEmpty())
+        return QString();
+    // Binary data are only detected when we have to guess; NULs are perfectly valid in UTF-16, for example
+    if (charset.isEmpty() && data.left(4096).contains('\0'))
+        return QString();
+
+    QTextCodec *codec = charset.isEmpty() ? QTextCodec::codecForMib(106) : QTextCodec::codecForName(charset);
+    if (!codec)
+        return QString();
+
+    QByteArray buf = data;
+    if (buf.size() > maxIndexedBodySize) {
+        int end = maxIndexedBodySize;
+        if (codec->mibEnum() == 106) {
+            // Don't cut a multibyte UTF-8 sequence in half
+            while (end > 0 && (static_cast<uchar>(buf[end - 1]) & 0xc0) == 0x80)
+                --end;
+            if (end > 0 && static_cast<uchar>(buf[end - 1]) >= 0xc0)
+                --end;
+        }
+        buf.truncate(end);
+    }
+
+    QTextCodec::ConverterState state;
+    QString text = codec->toUnicode(buf.constData(), buf.size(), &state);
+    if (charset.isEmpty() && state.invalidChars > 0)
+        return QString();
+
+    const QString head = text.left(1024);
+    if (head.contains(QLatin1String("<html"), Qt::CaseInsensitive) || head.contains(QLatin1String("<body"), Qt::CaseInsensitive))
+        text = stripMarkup(text);
+    return text;
+}
+
+/** @short Replace HTML tags and entities with whitespace so that they do not pollute the index */
+QString FullTextIndexWorker::stripMarkup(const QString &text)
+{
+    QString res;
+    res.reserve(text.size());
+    for (int i = 0; i < text.size(); ++i) {
+        const QChar c = text[i];
+        if (c == QLatin1Char('<')) {
+            int end = text.indexOf(QLatin1Char('>'), i);
+            if (end == -1)
+                break;
+            i = end;
+            res += QLatin1Char(' ');
+        } else if (c == QLatin1Char('&')) {
+            int end = text.indexOf(QLatin1Char(';'), i);
+            if (end != -1 && end - i <= 10) {
+                i = end;
+                res += QLatin1Char(' ');
+            } else {
+                res += c;
+            }
+        } else {
+            res += c;
+        }
+    }
+    return res;
+}
+
+void FullTextIndexWorker::emitError(const QString &message, const QSqlQuery &query)
+{
+    const QString text = QString::fromUtf8("FullTextIndex: Query Error: %1: %2").arg(message, query.lastError().text());
+    qDebug() << text;
+    emit error(text);
+}
+
+void FullTextIndexWorker::emitError(const QString &message, const QSqlDatabase &database)
+{
+    const QString text = QString::fromUtf8("FullTextIndex: DB Error: %1: %2").arg(message, database.lastError().text());
+    qDebug() << text;
+    emit error(text);
+}
+
+}
+}
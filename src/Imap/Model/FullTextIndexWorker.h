@@ -0,0 +1,118 @@
+/* Copyright (C) 2006 - 2014 Jan Kundrát <jkt@flaska.net>
+
+   This file is part of the Trojita Qt IMAP e-mail client,
+   http://trojita.flaska.net/
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2 of
+   the License or (at your option) version 3 or any later version
+   accepted by the membership of KDE e.V. (or its successor approved
+   by the membership of KDE e.V.), which shall act as a proxy
+   defined in Section 14 of version 3 of the license.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#ifndef IMAP_MODEL_FULLTEXTINDEXWORKER_H
+#define IMAP_MODEL_FULLTEXTINDEXWORKER_H
+
+#include <QHash>
+#include <QObject>
+#include <QSqlDatabase>
+#include <QSqlQuery>
+#include <QStringList>
+
+class QTimer;
+
+namespace Imap
+{
+
+namespace Mailbox
+{
+
+/** @short Maintain the on-disk full-text index in a background thread
+
+An instance of this class lives in a dedicated thread owned by FullTextIndex. All of its slots are invoked through queued
+calls, which means that the expensive operations (charset decoding, tokenization and the actual SQL inserts) never block
+the GUI. Updates are batched into transactions which get committed shortly after the incoming queue goes quiet, or after
+a certain number of messages has been processed.
+
+The index uses its own SQLite database, separate from the SQLCache. This class is the only one which writes into it.
+*/
+class FullTextIndexWorker : public QObject
+{
+    Q_OBJECT
+public:
+    explicit FullTextIndexWorker(QObject *parent = 0);
+
+    /** @short Turn the (already transfer-decoded) body part data in the given @arg charset into plain text suitable for indexing */
+    static QString decodeBodyText(const QByteArray &data, const QByteArray &charset);
+
+public slots:
+    /** @short Open the database under the connection name @arg name and create the tables if needed */
+    bool open(const QString &name, const QString &fileName);
+    /** @short Commit whatever is pending and release the database connection */
+    void close();
+
+    /** @short Index the subject and addresses of a message */
+    void indexMetadata(const QString &mailbox, uint uid, const QString &subject, const QString &senders, const QString &recipients);
+    /** @short Index the text of one message body part */
+    void indexBody(const QString &mailbox, uint uid, const QByteArray &data, const QByteArray &charset);
+    /** @short Remove a message from the index */
+    void forgetMessage(const QString &mailbox, uint uid);
+    /** @short Remove all messages of the given mailbox */
+    void forgetMailbox(const QString &mailbox);
+
+    /** @short Commit the current transaction, if any */
+    void commit();
+
+signals:
+    /** @short Some SQL error has occurred */
+    void error(const QString &message);
+
+private:
+    bool createTables();
+    bool prepareQueries();
+    bool ensureTransaction();
+    void messageProcessed();
+    int mailboxId(const QString &mailbox);
+    void addPostings(const int mailbox, const uint uid, const QStringList &terms, const int field);
+    void markIndexed(const int mailbox, const uint uid, const int fields);
+    void emitError(const QString &message, const QSqlQuery &query);
+    void emitError(const QString &message, const QSqlDatabase &database);
+
+    static QString stripMarkup(const QString &text);
+
+    QSqlDatabase m_db;
+    QString m_name;
+    QSqlQuery m_queryFindMailbox;
+    QSqlQuery m_queryInsertMailbox;
+    QSqlQuery m_queryInsertPosting;
+    QSqlQuery m_queryInsertPostingBulk;
+    QSqlQuery m_queryInsertDoc;
+    QSqlQuery m_queryUpdateDoc;
+    QSqlQuery m_queryForgetPostings;
+    QSqlQuery m_queryForgetDoc;
+    QSqlQuery m_queryForgetMailboxPostings;
+    QSqlQuery m_queryForgetMailboxDocs;
+
+    /** @short Cache of the numeric IDs of the mailbox names */
+    QHash<QString, int> m_mailboxIds;
+    /** @short Commit the transaction once we've been idle for a while */
+    QTimer *m_commitTimer;
+    bool m_inTransaction;
+    /** @short Number of messages touched in the current transaction */
+    int m_uncommittedMessages;
+};
+
+}
+
+}
+
+#endif /* IMAP_MODEL_FULLTEXTINDEXWORKER_H */
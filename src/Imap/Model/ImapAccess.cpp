@@ -29,7 +29,9 @@
 #include "Common/Paths.h"
 #include "Common/PortNumbers.h"
 #include "Common/SettingsNames.h"
+#include "Imap/Model/CacheCompression.h"
 #include "Imap/Model/CombinedCache.h"
+#include "Imap/Model/FullTextIndex.h"
 #include "Imap/Model/DummyNetworkWatcher.h"
 #include "Imap/Model/MemoryCache.h"
 #include "Imap/Model/SystemNetworkWatcher.h"
@@ -41,7 +43,7 @@ namespace Imap {
 
 ImapAccess::ImapAccess(QObject *parent, QSettings *settings, const QString &accountName) :
     QObject(parent), m_settings(settings), m_imapModel(0), m_mailboxModel(0), m_mailboxSubtreeModel(0), m_msgListModel(0),
-    m_threadingMsgListModel(0), m_visibleTasksModel(0), m_oneMessageModel(0), m_netWatcher(0), m_msgQNAM(0), m_port(0),
+    m_threadingMsgListModel(0), m_visibleTasksModel(0), m_oneMessageModel(0), m_netWatcher(0), m_offlineSync(0), m_msgQNAM(0), m_port(0),
     m_connectionMethod(Common::ConnectionMethod::Invalid),
     m_sslInfoIcon(Imap::Mailbox::CertificateUtils::NoIcon),
     m_accountName(accountName)
@@ -263,15 +265,30 @@ void ImapAccess::doConnect()
     Imap::Mailbox::AbstractCache *cache = 0;
 
     if (!shouldUsePersistentCache) {
-        cache = new Imap::Mailbox::MemoryCache(this);
+        cache = createMemoryCache(this);
     } else {
-        cache = new Imap::Mailbox::CombinedCache(this, QLatin1String("trojita-imap-cache"), m_cacheDir);
+        Imap::Mailbox::CombinedCache::PartStorage partStorage =
+                m_settings->value(Common::SettingsNames::cachePartStorageKey).toString() == Common::SettingsNames::cachePartStoragePacked ?
+                    Imap::Mailbox::CombinedCache::PART_STORAGE_PACKED : Imap::Mailbox::CombinedCache::PART_STORAGE_FILES;
+        cache = new Imap::Mailbox::CombinedCache(this, QLatin1String("trojita-imap-cache"), m_cacheDir, partStorage);
         connect(cache, SIGNAL(error(QString)), this, SLOT(onCacheError(QString)));
         if (! static_cast<Imap::Mailbox::CombinedCache *>(cache)->open()) {
             // Error message was already shown by the cacheError() slot
             cache->deleteLater();
-            cache = new Imap::Mailbox::MemoryCache(this);
+            cache = createMemoryCache(this);
         } else {
+            static_cast<Imap::Mailbox::CombinedCache *>(cache)->setCompression(Imap::Mailbox::CacheCompression(
+                    Imap::Mailbox::CacheCompression::codecFromName(m_settings->value(Common::SettingsNames::cacheCompressionKey).toString())));
+            if (m_settings->value(Common::SettingsNames::cacheFullTextIndexKey, true).toBool()) {
+                Imap::Mailbox::FullTextIndex *index = new Imap::Mailbox::FullTextIndex(
+                            cache, QLatin1String("trojita-imap-fulltext"), m_cacheDir + QLatin1String("fulltext.sqlite"));
+                if (index->open()) {
+                    cache->setFullTextIndex(index);
+                } else {
+                    // This is not fatal, the quick search will simply keep asking the server
+                    delete index;
+                }
+            }
             if (m_settings->value(Common::SettingsNames::cacheOfflineKey).toString() == Common::SettingsNames::cacheOfflineAll) {
                 cache->setRenewalThreshold(0);
             } else {
@@ -289,6 +306,8 @@ void ImapAccess::doConnect()
     m_imapModel->setObjectName(QString::fromUtf8("imapModel-%1").arg(m_accountName));
     m_imapModel->setCapabilitiesBlacklist(m_settings->value(Common::SettingsNames::imapBlacklistedCapabilities).toStringList());
     m_imapModel->setProperty("trojita-imap-enable-id", m_settings->value(Common::SettingsNames::imapEnableId, true).toBool());
+    m_imapModel->setProperty("trojita-imap-threaded-parser", m_settings->value(Common::SettingsNames::imapThreadedParser, false).toBool());
+    m_imapModel->setConnectionPoolSize(m_settings->value(Common::SettingsNames::imapConnectionPoolSize, 1).toInt());
     connect(m_imapModel, SIGNAL(alertReceived(QString)), this, SLOT(alertReceived(QString)));
     connect(m_imapModel, SIGNAL(imapError(QString)), this, SLOT(imapError(QString)));
     connect(m_imapModel, SIGNAL(networkError(QString)), this, SLOT(networkError(QString)));
@@ -329,17 +348,62 @@ void ImapAccess::doConnect()
     m_threadingMsgListModel = new Imap::Mailbox::ThreadingMsgListModel(this);
     m_threadingMsgListModel->setObjectName(QString::fromUtf8("threadingMsgListModel-%1").arg(m_accountName));
     m_threadingMsgListModel->setSourceModel(m_msgListModel);
+    setupOfflineSync();
     emit modelsChanged();
 }
 
 void ImapAccess::onCacheError(const QString &message)
 {
     if (m_imapModel) {
-        m_imapModel->setCache(new Imap::Mailbox::MemoryCache(m_imapModel));
+        m_imapModel->setCache(createMemoryCache(m_imapModel));
     }
     emit cacheError(message);
 }
 
+/** @short Create an in-memory cache whose message parts are limited by the configured budget (in MB) */
+Imap::Mailbox::AbstractCache *ImapAccess::createMemoryCache(QObject *parent)
+{
+    Imap::Mailbox::MemoryCache *cache = new Imap::Mailbox::MemoryCache(parent);
+    const int defaultBudget = 100;
+    bool ok;
+    int budget = m_settings->value(Common::SettingsNames::cacheMemoryBudgetKey, defaultBudget).toInt(&ok);
+    if (!ok)
+        budget = defaultBudget;
+    if (budget >= 0)
+        cache->setPartDataBudget(static_cast<qint64>(budget) * 1024 * 1024);
+    return cache;
+}
+
+/** @short Start mirroring the configured mailboxes in the background, if any */
+void ImapAccess::setupOfflineSync()
+{
+    const QStringList mailboxes = m_settings->value(Common::SettingsNames::offlineSyncMailboxesKey).toStringList();
+    if (mailboxes.isEmpty())
+        return;
+
+    // The mirroring gets a connection of its own, so that it doesn't compete with the mailbox which is being looked at
+    m_imapModel->setConnectionPoolSize(m_settings->value(Common::SettingsNames::imapConnectionPoolSize, 1).toInt() + 1);
+
+    m_offlineSync = new Imap::Mailbox::OfflineSyncScheduler(m_imapModel, m_imapModel);
+    m_offlineSync->setObjectName(QString::fromUtf8("offlineSync-%1").arg(m_accountName));
+    m_offlineSync->setMailboxes(mailboxes);
+
+    const int defaultBudget = 200;
+    bool ok;
+    int budget = m_settings->value(Common::SettingsNames::offlineSyncBudgetKey, defaultBudget).toInt(&ok);
+    if (!ok)
+        budget = defaultBudget;
+    m_offlineSync->setByteBudget(budget >= 0 ? static_cast<qint64>(budget) * 1024 * 1024 : -1);
+
+    const int defaultRate = 5;
+    int rate = m_settings->value(Common::SettingsNames::offlineSyncRateKey, defaultRate).toInt(&ok);
+    if (!ok)
+        rate = defaultRate;
+    m_offlineSync->setRateLimit(rate);
+
+    m_offlineSync->start();
+}
+
 QObject *ImapAccess::imapModel() const
 {
     return m_imapModel;
@@ -31,6 +31,7 @@
 #include "Imap/Model/Model.h"
 #include "Imap/Model/MsgListModel.h"
 #include "Imap/Model/NetworkWatcher.h"
+#include "Imap/Model/OfflineSyncScheduler.h"
 #include "Imap/Model/OneMessageModel.h"
 #include "Imap/Model/SubtreeModel.h"
 #include "Imap/Model/Utils.h"
@@ -123,6 +124,9 @@ public slots:
     void slotSslErrors(const QList<QSslCertificate> &sslCertificateChain, const QList<QSslError> &sslErrors);
 
 private:
+    Imap::Mailbox::AbstractCache *createMemoryCache(QObject *parent);
+    void setupOfflineSync();
+
     QSettings *m_settings;
     Imap::Mailbox::Model *m_imapModel;
     Imap::Mailbox::MailboxModel *m_mailboxModel;
@@ -132,6 +136,7 @@ private:
     Imap::Mailbox::VisibleTasksModel *m_visibleTasksModel;
     Imap::Mailbox::OneMessageModel *m_oneMessageModel;
     Imap::Mailbox::NetworkWatcher *m_netWatcher;
+    Imap::Mailbox::OfflineSyncScheduler *m_offlineSync;
     QNetworkAccessManager *m_msgQNAM;
 
     QString m_server;
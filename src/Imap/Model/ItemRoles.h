@@ -127,8 +127,14 @@ enum {
     */
     RoleMessageHasAttachments,
 
-    /** @short Contents of a message part */
+    /** @short Contents of a message part
+
+    Huge parts which are stored in a file of the disk cache are read from that file each time this role is requested.
+    Users which do not need the whole data in memory at once shall use partDataDevice() instead.
+    */
     RolePartData,
+    /** @short Name of a plain file holding the contents of a message part, or a null QString if the data are kept in memory */
+    RolePartDataFileName,
     /** @short MIME type of a message part */
     RolePartMimeType,
     /** @short Charset of a message part */
@@ -168,6 +174,11 @@ enum {
     RoleTaskIsVisible,
     /** @short A short explanaiton of the task -- what is it doing? */
     RoleTaskCompactName,
+    /** @short Number of messages whose metadata were not fetched over this connection because they were not needed anymore
+
+    Only the ParserState items of the TaskPresentationModel provide this role.
+    */
+    RoleTaskWithdrawnEnvelopeRequests,
 
     /** @short Content-Disposition (inline or attachment) of an attachment within MessageComposer
 
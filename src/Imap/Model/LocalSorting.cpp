@@ -0,0 +1,359 @@
+/* Copyright (C) 2006 - 2014 Jan Kundrát <jkt@flaska.net>
+
+   This file is part of the Trojita Qt IMAP e-mail client,
+   http://trojita.flaska.net/
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2 of
+   the License or (at your option) version 3 or any later version
+   accepted by the membership of KDE e.V. (or its successor approved
+   by the membership of KDE e.V.), which shall act as a proxy
+   defined in Section 14 of version 3 of the license.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "LocalSorting.h"
+#include <algorithm>
+#include <limits>
+#include <QDateTime>
+#include <QThread>
+#include "Imap/Parser/Message.h"
+
+namespace
+{
+
+/** @short Mailboxes smaller than this are sorted in the calling thread */
+const int parallelSortThreshold = 50000;
+/** @short Don't bother with more threads than this */
+const int maxSortThreads = 8;
+
+/** @short Sort a range of entries in a separate thread */
+template <typename Iterator, typename LessThan>
+class RangeSortThread: public QThread
+{
+public:
+    RangeSortThread(Iterator begin, Iterator end, LessThan lessThan): m_begin(begin), m_end(end), m_lessThan(lessThan) {}
+
+protected:
+    virtual void run()
+    {
+        std::sort(m_begin, m_end, m_lessThan);
+    }
+
+private:
+    Iterator m_begin;
+    Iterator m_end;
+    LessThan m_lessThan;
+};
+
+/** @short Return the offset after the subj-blob starting at @arg pos (including the trailing whitespace), or -1 */
+int skipSubjectBlob(const QString &subject, const int pos)
+{
+    if (pos >= subject.size() || subject[pos] != QLatin1Char('['))
+        return -1;
+    int end = pos + 1;
+    while (end < subject.size() && subject[end] != QLatin1Char('[') && subject[end] != QLatin1Char(']'))
+        ++end;
+    if (end >= subject.size() || subject[end] != QLatin1Char(']'))
+        return -1;
+    ++end;
+    while (end < subject.size() && subject[end] == QLatin1Char(' '))
+        ++end;
+    return end;
+}
+
+/** @short Return the offset after the subj-refwd starting at @arg pos, or -1 */
+int skipSubjectRefwd(const QString &subject, const int pos)
+{
+    int end = pos;
+    if (subject.mid(end, 2).compare(QLatin1String("re"), Qt::CaseInsensitive) == 0) {
+        end += 2;
+    } else if (subject.mid(end, 2).compare(QLatin1String("fw"), Qt::CaseInsensitive) == 0) {
+        end += 2;
+        if (end < subject.size() && subject[end].toLower() == QLatin1Char('d'))
+            ++end;
+    } else {
+        return -1;
+    }
+    while (end < subject.size() && subject[end] == QLatin1Char(' '))
+        ++end;
+    const int afterBlob = skipSubjectBlob(subject, end);
+    if (afterBlob != -1)
+        end = afterBlob;
+    if (end < subject.size() && subject[end] == QLatin1Char(':'))
+        return end + 1;
+    return -1;
+}
+
+/** @short Sort key of an address list, following the DISPLAYFROM and DISPLAYTO rules of RFC 5957 */
+QString addressKey(const QList<Imap::Message::MailAddress> &addresses)
+{
+    if (addresses.isEmpty())
+        return QString();
+    const Imap::Message::MailAddress &address = addresses.first();
+    if (!address.name.isEmpty())
+        return address.name;
+    if (address.host.isEmpty())
+        return address.mailbox;
+    return address.mailbox + QLatin1Char('@') + address.host;
+}
+
+/** @short Sort key of the messages whose date or size is not known; these go first, just like the empty strings */
+const qint64 missingNumberKey = std::numeric_limits<qint64>::min();
+
+/** @short Seconds since the epoch; unlike QDateTime::toTime_t(), this works for dates before 1970, too */
+qint64 dateKey(const QDateTime &date)
+{
+    if (!date.isValid())
+        return missingNumberKey;
+    const QDateTime utc = date.toUTC();
+    return static_cast<qint64>(QDate(1970, 1, 1).daysTo(utc.date())) * 86400 + QTime(0, 0).secsTo(utc.time());
+}
+
+}
+
+namespace Imap
+{
+namespace Mailbox
+{
+
+LocalSorting::LocalSorting(): m_criterium(SORT_ARRIVAL), m_nextGeneration(1), m_obsoleteEntries(0)
+{
+}
+
+void LocalSorting::clear()
+{
+    m_sorted.clear();
+    m_pending.clear();
+    m_generations.clear();
+    m_withoutData.clear();
+    m_obsoleteEntries = 0;
+}
+
+LocalSorting::Criterium LocalSorting::criterium() const
+{
+    return m_criterium;
+}
+
+void LocalSorting::setCriterium(const Criterium criterium)
+{
+    clear();
+    m_criterium = criterium;
+}
+
+bool LocalSorting::contains(const uint uid) const
+{
+    return m_generations.contains(uid);
+}
+
+bool LocalSorting::hasKey(const uint uid) const
+{
+    return m_generations.contains(uid) && !m_withoutData.contains(uid);
+}
+
+int LocalSorting::size() const
+{
+    return m_generations.size();
+}
+
+void LocalSorting::addMessage(const uint uid, const Message::Envelope &envelope, const QDateTime &internalDate, const uint size)
+{
+    QString text;
+    qint64 number = 0;
+    switch (m_criterium) {
+    case SORT_ARRIVAL:
+        number = dateKey(internalDate);
+        break;
+    case SORT_CC:
+        text = collationKey(addressKey(envelope.cc));
+        break;
+    case SORT_DATE:
+        // RFC 5256 says that the internal date shall be used when the Date header is missing or invalid
+        number = dateKey(envelope.date.isValid() ? envelope.date : internalDate);
+        break;
+    case SORT_FROM:
+        text = collationKey(addressKey(envelope.from));
+        break;
+    case SORT_SIZE:
+        number = size;
+        break;
+    case SORT_SUBJECT:
+        text = collationKey(baseSubject(envelope.subject));
+        break;
+    case SORT_TO:
+        text = collationKey(addressKey(envelope.to));
+        break;
+    }
+    m_withoutData.remove(uid);
+    insertEntry(uid, text, number);
+}
+
+void LocalSorting::addMessageWithoutData(const uint uid)
+{
+    m_withoutData.insert(uid);
+    const bool numeric = m_criterium == SORT_ARRIVAL || m_criterium == SORT_DATE || m_criterium == SORT_SIZE;
+    insertEntry(uid, QString(), numeric ? missingNumberKey : 0);
+}
+
+void LocalSorting::insertEntry(const uint uid, const QString &text, const qint64 number)
+{
+    Entry entry;
+    entry.text = text;
+    entry.number = number;
+    entry.uid = uid;
+    entry.generation = m_nextGeneration++;
+    QHash<uint, uint>::iterator it = m_generations.find(uid);
+    if (it == m_generations.end()) {
+        m_generations.insert(uid, entry.generation);
+    } else {
+        *it = entry.generation;
+        ++m_obsoleteEntries;
+    }
+    m_pending.append(entry);
+}
+
+void LocalSorting::removeMessage(const uint uid)
+{
+    if (m_generations.remove(uid)) {
+        m_withoutData.remove(uid);
+        ++m_obsoleteEntries;
+    }
+}
+
+QList<uint> LocalSorting::sortedUids()
+{
+    if (!m_pending.isEmpty()) {
+        // Only the new arrivals have to be sorted; the rest is a linear merge
+        sortEntries(m_pending);
+        const int oldSize = m_sorted.size();
+        m_sorted += m_pending;
+        m_pending.clear();
+        Entry *data = m_sorted.data();
+        std::inplace_merge(data, data + oldSize, data + m_sorted.size(), entryLessThan);
+    }
+
+    if (m_obsoleteEntries) {
+        QVector<Entry> current;
+        current.reserve(m_generations.size());
+        for (QVector<Entry>::const_iterator it = m_sorted.constBegin(); it != m_sorted.constEnd(); ++it) {
+            if (m_generations.value(it->uid) == it->generation)
+                current.append(*it);
+        }
+        m_sorted = current;
+        m_obsoleteEntries = 0;
+    }
+
+    QList<uint> res;
+#if QT_VERSION >= 0x040700
+    res.reserve(m_sorted.size());
+#endif
+    for (QVector<Entry>::const_iterator it = m_sorted.constBegin(); it != m_sorted.constEnd(); ++it)
+        res.append(it->uid);
+    return res;
+}
+
+bool LocalSorting::entryLessThan(const Entry &a, const Entry &b)
+{
+    // Only one of the keys is actually used by each criterium, the other one is always empty
+    if (a.number != b.number)
+        return a.number < b.number;
+    const int cmp = a.text.compare(b.text);
+    if (cmp != 0)
+        return cmp < 0;
+    return a.uid < b.uid;
+}
+
+void LocalSorting::sortEntries(QVector<Entry> &entries)
+{
+    const int threads = qMin(QThread::idealThreadCount(), maxSortThreads);
+    Entry *data = entries.data();
+    const int size = entries.size();
+    if (size < parallelSortThreshold || threads < 2) {
+        std::sort(data, data + size, entryLessThan);
+        return;
+    }
+
+    typedef RangeSortThread<Entry *, bool (*)(const Entry &, const Entry &)> SortThread;
+    const int chunk = (size + threads - 1) / threads;
+    QList<SortThread *> workers;
+    for (int begin = 0; begin < size; begin += chunk) {
+        SortThread *worker = new SortThread(data + begin, data + qMin(begin + chunk, size), entryLessThan);
+        worker->start();
+        workers << worker;
+    }
+    Q_FOREACH(SortThread *worker, workers) {
+        worker->wait();
+        delete worker;
+    }
+
+    for (int width = chunk; width < size; width *= 2) {
+        for (int begin = 0; begin + width < size; begin += 2 * width) {
+            std::inplace_merge(data + begin, data + begin + width, data + qMin(begin + 2 * width, size), entryLessThan);
+        }
+    }
+}
+
+QString LocalSorting::baseSubject(const QString &subject)
+{
+    // (1) all whitespace is collapsed into a single space
+    QString res = subject.simplified();
+
+    forever {
+        // (2) subj-trailer
+        while (res.endsWith(QLatin1String("(fwd)"), Qt::CaseInsensitive))
+            res = res.left(res.size() - 5).trimmed();
+
+        forever {
+            // (3) subj-leader, i.e. any number of subj-blobs followed by a subj-refwd, or just a whitespace
+            int pos = 0;
+            while (pos < res.size() && res[pos] == QLatin1Char(' '))
+                ++pos;
+            int afterBlobs = pos;
+            int afterBlob;
+            while ((afterBlob = skipSubjectBlob(res, afterBlobs)) != -1)
+                afterBlobs = afterBlob;
+            const int afterRefwd = skipSubjectRefwd(res, afterBlobs);
+            if (afterRefwd != -1) {
+                res = res.mid(afterRefwd);
+                continue;
+            }
+            if (pos) {
+                res = res.mid(pos);
+                continue;
+            }
+
+            // (4) a subj-blob, unless it's everything which is left
+            afterBlob = skipSubjectBlob(res, 0);
+            if (afterBlob != -1 && afterBlob < res.size()) {
+                res = res.mid(afterBlob);
+                continue;
+            }
+            break;
+        }
+
+        // (6) subj-fwd-hdr and subj-fwd-trl
+        if (res.startsWith(QLatin1String("[fwd:"), Qt::CaseInsensitive) && res.endsWith(QLatin1Char(']'))) {
+            res = res.mid(5, res.size() - 6).trimmed();
+            continue;
+        }
+        break;
+    }
+    return res;
+}
+
+QString LocalSorting::collationKey(const QString &text)
+{
+    // This is close enough to the i;unicode-casemap collation from RFC 5051
+    return text.normalized(QString::NormalizationForm_KD).toCaseFolded();
+}
+
+}
+}
@@ -0,0 +1,139 @@
+/* Copyright (C) 2006 - 2014 Jan Kundrát <jkt@flaska.net>
+
+   This file is part of the Trojita Qt IMAP e-mail client,
+   http://trojita.flaska.net/
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2 of
+   the License or (at your option) version 3 or any later version
+   accepted by the membership of KDE e.V. (or its successor approved
+   by the membership of KDE e.V.), which shall act as a proxy
+   defined in Section 14 of version 3 of the license.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef IMAP_MODEL_LOCALSORTING_H
+#define IMAP_MODEL_LOCALSORTING_H
+
+#include <QHash>
+#include <QList>
+#include <QSet>
+#include <QVector>
+
+class QDateTime;
+
+/** @short Namespace for IMAP interaction */
+namespace Imap
+{
+
+namespace Message
+{
+class Envelope;
+}
+
+/** @short Classes for handling of mailboxes and connections */
+namespace Mailbox
+{
+
+/** @short Client-side implementation of the SORT command
+
+This class orders messages by the same criteria which the IMAP server uses when asked for SORT (RFC 5256) or SORT=DISPLAY
+(RFC 5957). It works from the envelope data which we have in the cache, and it is used when the server does not support
+sorting at all, and when we're offline.
+
+The sort key of each message is computed once, when the message is added. Messages which arrive later are kept aside and
+merged into the sorted sequence the next time the result is requested, so keeping a big mailbox sorted costs time
+proportional to the number of new arrivals. Big batches are sorted in several threads. Ties are broken by the UID, i.e. by
+the order of arrival, just like the RFC requires.
+*/
+class LocalSorting
+{
+public:
+    typedef enum {
+        SORT_ARRIVAL,
+        SORT_CC,
+        SORT_DATE,
+        SORT_FROM,
+        SORT_SIZE,
+        SORT_SUBJECT,
+        SORT_TO
+    } Criterium;
+
+    LocalSorting();
+
+    /** @short Forget everything */
+    void clear();
+
+    Criterium criterium() const;
+    /** @short Change the sorting criterium; this forgets all messages which were added so far */
+    void setCriterium(const Criterium criterium);
+
+    /** @short Has the message with this UID been added already? */
+    bool contains(const uint uid) const;
+
+    /** @short Was the message added along with its metadata? */
+    bool hasKey(const uint uid) const;
+
+    /** @short Number of messages added so far */
+    int size() const;
+
+    /** @short Add a message, or update the sort key of one which has been added already */
+    void addMessage(const uint uid, const Imap::Message::Envelope &envelope, const QDateTime &internalDate, const uint size);
+
+    /** @short Add a message whose metadata are not available yet
+
+    Such a message is treated as if all of its fields were empty. Once the data arrive, call addMessage() to update it.
+    */
+    void addMessageWithoutData(const uint uid);
+
+    /** @short Forget about the message, e.g. because it got expunged */
+    void removeMessage(const uint uid);
+
+    /** @short Return UIDs of all messages in the ascending order, i.e. in the same form as the SORT response would use */
+    QList<uint> sortedUids();
+
+    /** @short Extract the base subject as defined by RFC 5256, section 2.1 */
+    static QString baseSubject(const QString &subject);
+
+    /** @short Return a key which can be compared in a case-insensitive manner */
+    static QString collationKey(const QString &text);
+
+private:
+    struct Entry {
+        QString text;
+        qint64 number;
+        uint uid;
+        uint generation;
+
+        Entry(): number(0), uid(0), generation(0) {}
+    };
+
+    void insertEntry(const uint uid, const QString &text, const qint64 number);
+    static bool entryLessThan(const Entry &a, const Entry &b);
+    static void sortEntries(QVector<Entry> &entries);
+
+    Criterium m_criterium;
+    /** @short Entries which are already sorted, possibly including obsolete ones */
+    QVector<Entry> m_sorted;
+    /** @short New entries which haven't been merged into m_sorted yet */
+    QVector<Entry> m_pending;
+    /** @short The generation of the current entry of each UID; entries with a different generation are obsolete */
+    QHash<uint, uint> m_generations;
+    /** @short UIDs which were added without any metadata */
+    QSet<uint> m_withoutData;
+    uint m_nextGeneration;
+    int m_obsoleteEntries;
+};
+
+}
+}
+
+#endif /* IMAP_MODEL_LOCALSORTING_H */
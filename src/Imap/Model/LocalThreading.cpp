@@ -0,0 +1,248 @@
+/* Copyright (C) 2006 - 2014 Jan Kundrát <jkt@flaska.net>
+
+   This file is part of the Trojita Qt IMAP e-mail client,
+   http://trojita.flaska.net/
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2 of
+   the License or (at your option) version 3 or any later version
+   accepted by the membership of KDE e.V. (or its successor approved
+   by the membership of KDE e.V.), which shall act as a proxy
+   defined in Section 14 of version 3 of the license.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "LocalThreading.h"
+#include <limits>
+#include <QPair>
+#include <QtAlgorithms>
+
+namespace Imap
+{
+namespace Mailbox
+{
+
+LocalThreading::LocalThreading()
+{
+}
+
+void LocalThreading::clear()
+{
+    m_containers.clear();
+    m_idTable.clear();
+    m_uids.clear();
+}
+
+bool LocalThreading::contains(const uint uid) const
+{
+    return m_uids.contains(uid);
+}
+
+int LocalThreading::size() const
+{
+    return m_uids.size();
+}
+
+QList<uint> LocalThreading::uids() const
+{
+    return m_uids.keys();
+}
+
+int LocalThreading::createContainer()
+{
+    m_containers.append(Container());
+    return m_containers.size() - 1;
+}
+
+int LocalThreading::containerForId(const QByteArray &messageId)
+{
+    QHash<QByteArray, int>::const_iterator it = m_idTable.constFind(messageId);
+    if (it != m_idTable.constEnd())
+        return *it;
+    int container = createContainer();
+    m_idTable.insert(messageId, container);
+    return container;
+}
+
+/** @short Is the @arg ancestor somewhere on the path from the @arg node to its thread root (including the node itself)? */
+bool LocalThreading::isAncestorOf(const int ancestor, int node) const
+{
+    while (node != -1) {
+        if (node == ancestor)
+            return true;
+        node = m_containers[node].parent;
+    }
+    return false;
+}
+
+void LocalThreading::link(const int parent, const int child)
+{
+    Q_ASSERT(m_containers[child].parent == -1);
+    m_containers[child].parent = parent;
+    m_containers[child].nextSibling = m_containers[parent].firstChild;
+    m_containers[parent].firstChild = child;
+}
+
+void LocalThreading::unlink(const int child)
+{
+    const int parent = m_containers[child].parent;
+    if (parent == -1)
+        return;
+
+    int *ptr = &m_containers[parent].firstChild;
+    while (*ptr != child) {
+        Q_ASSERT(*ptr != -1);
+        ptr = &m_containers[*ptr].nextSibling;
+    }
+    *ptr = m_containers[child].nextSibling;
+    m_containers[child].parent = -1;
+    m_containers[child].nextSibling = -1;
+}
+
+void LocalThreading::addMessage(const uint uid, const QByteArray &messageId, const QList<QByteArray> &references,
+                                const QList<QByteArray> &inReplyTo)
+{
+    if (m_uids.contains(uid))
+        return;
+
+    // A placeholder created by some earlier reference gets filled in; duplicate Message-Ids get a container of their own
+    int self = -1;
+    if (!messageId.isEmpty()) {
+        QHash<QByteArray, int>::const_iterator it = m_idTable.constFind(messageId);
+        if (it == m_idTable.constEnd()) {
+            self = createContainer();
+            m_idTable.insert(messageId, self);
+        } else if (m_containers[*it].uid == 0) {
+            self = *it;
+        }
+    }
+    if (self == -1)
+        self = createContainer();
+    m_containers[self].uid = uid;
+    m_uids.insert(uid, self);
+
+    QList<QByteArray> parents = references;
+    if (parents.isEmpty() && !inReplyTo.isEmpty())
+        parents << inReplyTo.first();
+
+    // Link the referenced messages together, without changing any existing links and without introducing loops
+    int previous = -1;
+    Q_FOREACH(const QByteArray &reference, parents) {
+        if (reference.isEmpty())
+            continue;
+        const int current = containerForId(reference);
+        if (previous != -1 && m_containers[current].parent == -1 && !isAncestorOf(current, previous))
+            link(previous, current);
+        previous = current;
+    }
+
+    // The message itself is authoritative about its parent, so a guess made from some other message's references is replaced
+    if (previous == -1 || previous == self || isAncestorOf(self, previous)) {
+        unlink(self);
+    } else if (m_containers[self].parent != previous) {
+        unlink(self);
+        link(previous, self);
+    }
+}
+
+void LocalThreading::removeMessage(const uint uid)
+{
+    QHash<uint, int>::iterator it = m_uids.find(uid);
+    if (it == m_uids.end())
+        return;
+
+    // The build() prunes placeholders without children, and a message with the same Message-Id can still fill this one
+    m_containers[*it].uid = 0;
+    m_uids.erase(it);
+}
+
+void LocalThreading::sortSiblings(QVector<Imap::Responses::ThreadingNode> &nodes, const QVector<uint> &keys)
+{
+    Q_ASSERT(nodes.size() == keys.size());
+    bool sorted = true;
+    for (int i = 1; i < keys.size() && sorted; ++i) {
+        if (keys[i - 1] > keys[i])
+            sorted = false;
+    }
+    if (sorted)
+        return;
+
+    QVector<QPair<uint, int> > order;
+    order.reserve(keys.size());
+    for (int i = 0; i < keys.size(); ++i)
+        order.append(qMakePair(keys[i], i));
+    qSort(order);
+    QVector<Imap::Responses::ThreadingNode> res;
+    res.reserve(nodes.size());
+    for (int i = 0; i < order.size(); ++i)
+        res.append(nodes[order[i].second]);
+    nodes = res;
+}
+
+/** @short Convert the subtree rooted at @arg container to ThreadingNodes and return the lowest UID in there
+
+Empty placeholders are pruned as specified by RFC 5256: their children are promoted to the parent level, except when that
+would put several messages to the top level.
+*/
+uint LocalThreading::build(const int container, QVector<Imap::Responses::ThreadingNode> &out, QVector<uint> &keys,
+                           const bool atRoot) const
+{
+    QVector<Imap::Responses::ThreadingNode> children;
+    QVector<uint> childKeys;
+    for (int child = m_containers[container].firstChild; child != -1; child = m_containers[child].nextSibling)
+        build(child, children, childKeys, false);
+
+    const uint uid = m_containers[container].uid;
+    uint key = uid ? uid : std::numeric_limits<uint>::max();
+    for (int i = 0; i < childKeys.size(); ++i)
+        key = qMin(key, childKeys[i]);
+
+    if (!uid) {
+        if (children.isEmpty())
+            return 0;
+        if (!atRoot || children.size() == 1) {
+            out += children;
+            keys += childKeys;
+            return key;
+        }
+    }
+
+    sortSiblings(children, childKeys);
+    out.append(Imap::Responses::ThreadingNode(uid, children));
+    keys.append(key);
+    return key;
+}
+
+QVector<Imap::Responses::ThreadingNode> LocalThreading::threading(const QList<uint> &unthreadedUids) const
+{
+    QVector<Imap::Responses::ThreadingNode> res;
+    QVector<uint> keys;
+    res.reserve(m_uids.size() + unthreadedUids.size());
+    keys.reserve(m_uids.size() + unthreadedUids.size());
+
+    for (int i = 0; i < m_containers.size(); ++i) {
+        if (m_containers[i].parent == -1)
+            build(i, res, keys, true);
+    }
+
+    Q_FOREACH(const uint uid, unthreadedUids) {
+        if (!m_uids.contains(uid)) {
+            res.append(Imap::Responses::ThreadingNode(uid));
+            keys.append(uid);
+        }
+    }
+
+    sortSiblings(res, keys);
+    return res;
+}
+
+}
+}
@@ -0,0 +1,114 @@
+/* Copyright (C) 2006 - 2014 Jan Kundrát <jkt@flaska.net>
+
+   This file is part of the Trojita Qt IMAP e-mail client,
+   http://trojita.flaska.net/
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2 of
+   the License or (at your option) version 3 or any later version
+   accepted by the membership of KDE e.V. (or its successor approved
+   by the membership of KDE e.V.), which shall act as a proxy
+   defined in Section 14 of version 3 of the license.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef IMAP_MODEL_LOCALTHREADING_H
+#define IMAP_MODEL_LOCALTHREADING_H
+
+#include <QHash>
+#include <QList>
+#include "Imap/Parser/ThreadingNode.h"
+
+/** @short Namespace for IMAP interaction */
+namespace Imap
+{
+
+/** @short Classes for handling of mailboxes and connections */
+namespace Mailbox
+{
+
+/** @short Client-side implementation of the REFERENCES threading algorithm
+
+This class builds a thread tree from the Message-Id, References and In-Reply-To headers in the same way as the IMAP server
+would do it when asked for THREAD=REFERENCES (RFC 5256), i.e. following the algorithm described by Jamie Zawinski. It is
+used when the server does not support threading at all, and when we're offline.
+
+The messages can be added in batches; the thread tree can be retrieved at any time and the engine keeps its state, so the
+newly arriving messages only have to be fed into it. There is no subject-based merging of threads, which matches what the
+THREAD=REFS algorithm does. Threads and siblings are ordered by the lowest UID in each subtree, i.e. in the order of arrival.
+*/
+class LocalThreading
+{
+public:
+    LocalThreading();
+
+    /** @short Forget everything */
+    void clear();
+
+    /** @short Has the message with this UID been added already? */
+    bool contains(const uint uid) const;
+
+    /** @short Number of messages added so far */
+    int size() const;
+
+    /** @short UIDs of all messages which have been added and not removed */
+    QList<uint> uids() const;
+
+    /** @short Add a message into the thread tree
+
+    The @arg references shall contain the message IDs from the References header, oldest first. If it's empty, the
+    @arg inReplyTo is used instead.
+    */
+    void addMessage(const uint uid, const QByteArray &messageId, const QList<QByteArray> &references,
+                    const QList<QByteArray> &inReplyTo = QList<QByteArray>());
+
+    /** @short Forget a message which has been expunged
+
+    The message's place in the tree is kept as an empty placeholder, so its replies stay together in the same thread.
+    */
+    void removeMessage(const uint uid);
+
+    /** @short Return the threading in the same form as the THREAD response would use
+
+    The @arg unthreadedUids shall contain messages which are known to be present in the mailbox, but whose headers are
+    not available yet. These are put into the result as separate threads.
+    */
+    QVector<Imap::Responses::ThreadingNode> threading(const QList<uint> &unthreadedUids = QList<uint>()) const;
+
+private:
+    /** @short A node in the thread tree; the ones with zero UID are placeholders for messages we haven't seen */
+    struct Container {
+        uint uid;
+        int parent;
+        int firstChild;
+        int nextSibling;
+
+        Container(): uid(0), parent(-1), firstChild(-1), nextSibling(-1) {}
+    };
+
+    int containerForId(const QByteArray &messageId);
+    int createContainer();
+    bool isAncestorOf(const int ancestor, int node) const;
+    void link(const int parent, const int child);
+    void unlink(const int child);
+    uint build(const int container, QVector<Imap::Responses::ThreadingNode> &out, QVector<uint> &keys, const bool atRoot) const;
+    static void sortSiblings(QVector<Imap::Responses::ThreadingNode> &nodes, const QVector<uint> &keys);
+
+    QVector<Container> m_containers;
+    QHash<QByteArray, int> m_idTable;
+    /** @short Container of each message which has been added */
+    QHash<uint, int> m_uids;
+};
+
+}
+}
+
+#endif /* IMAP_MODEL_LOCALTHREADING_H */
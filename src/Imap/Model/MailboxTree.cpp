@@ -21,13 +21,17 @@
 */
 
 #include <algorithm>
+#include <QFile>
+#include <QFileInfo>
 #include <QTextStream>
 #include "Common/FindWithUnknown.h"
 #include "Common/InvokeMethod.h"
 #include "Common/MetaTypes.h"
+#include "Common/SlabAllocator.h"
 #include "Imap/Encoders.h"
 #include "Imap/Parser/Rfc5322HeaderParser.h"
 #include "Imap/Tasks/KeepMailboxOpenTask.h"
+#include "FullTextIndex.h"
 #include "ItemRoles.h"
 #include "MailboxTree.h"
 #include "Model.h"
@@ -129,13 +133,15 @@ QModelIndex TreeItem::toIndex(Model *const model) const
 }
 
 
-TreeItemMailbox::TreeItemMailbox(TreeItem *parent): TreeItem(parent), maintainingTask(0)
+TreeItemMailbox::TreeItemMailbox(TreeItem *parent): TreeItem(parent), maintainingTask(0), m_savedUidMapSize(-1),
+    m_savedUidMapHighestUid(0)
 {
     m_children.prepend(new TreeItemMsgList(this));
 }
 
 TreeItemMailbox::TreeItemMailbox(TreeItem *parent, Responses::List response):
-    TreeItem(parent), m_metadata(response.mailbox, response.separator, QStringList()), maintainingTask(0)
+    TreeItem(parent), m_metadata(response.mailbox, response.separator, QStringList()), maintainingTask(0),
+    m_savedUidMapSize(-1), m_savedUidMapHighestUid(0)
 {
     for (QStringList::const_iterator it = response.flags.constBegin(); it != response.flags.constEnd(); ++it)
         m_metadata.flags.append(it->toUpper());
@@ -336,7 +342,7 @@ TreeItemChildrenList TreeItemMailbox::setChildren(const TreeItemChildrenList &it
 void TreeItemMailbox::handleFetchResponse(Model *const model,
         const Responses::Fetch &response,
         QList<TreeItemPart *> &changedParts,
-        TreeItemMessage *&changedMessage, bool usingQresync)
+        TreeItemMessage *&changedMessage, bool usingQresync, QVector<QPair<uint, QStringList> > *deferredFlags)
 {
     TreeItemMsgList *list = static_cast<TreeItemMsgList *>(m_children[0]);
 
@@ -504,25 +510,32 @@ void TreeItemMailbox::handleFetchResponse(Model *const model,
                 // One possibility is that it's already there because it was fetched before. The second option is that
                 // we were in fact asked to only fetch the raw data and the user is not itnerested in the processed data at all.
                 if (part->loading()) {
-                    // got to decode the part data by hand
-                    Imap::decodeContentTransferEncoding(data, part->encoding(), part->dataPtr());
+                    // Do not store the data into cache if the raw data are already there
+                    const bool shallCache = message->uid()
+                            && model->cache()->messagePart(mailbox(), message->uid(), part->partId() + QLatin1String(".X-RAW")).isNull();
+                    if (!shallCache || !storePartDataInFile(model, message, part, data, part->encoding())) {
+                        // got to decode the part data by hand
+                        Imap::decodeContentTransferEncoding(data, part->encoding(), part->dataPtr());
+                        if (shallCache) {
+                            model->cache()->setMsgPart(mailbox(), message->uid(), part->partId(), part->m_data);
+                            indexPartData(model, message, part);
+                        }
+                    }
                     part->setFetchStatus(DONE);
                     changedParts.append(part);
-                    if (message->uid()
-                            && model->cache()->messagePart(mailbox(), message->uid(), part->partId() + QLatin1String(".X-RAW")).isNull()) {
-                        // Do not store the data into cache if the raw data are already there
-                        model->cache()->setMsgPart(mailbox(), message->uid(), part->partId(), part->m_data);
-                    }
                 }
 
             } else {
                 // A BINARY FETCH item is already decoded for us, yay
-                part->m_data = data;
+                if (!message->uid() || !storePartDataInFile(model, message, part, data, QByteArray("binary"))) {
+                    part->m_data = data;
+                    if (message->uid()) {
+                        model->cache()->setMsgPart(mailbox(), message->uid(), part->partId(), part->m_data);
+                        indexPartData(model, message, part);
+                    }
+                }
                 part->setFetchStatus(DONE);
                 changedParts.append(part);
-                if (message->uid()) {
-                    model->cache()->setMsgPart(mailbox(), message->uid(), part->partId(), part->m_data);
-                }
             }
         } else if (it.key() == "INTERNALDATE") {
             message->data()->m_internalDate = static_cast<const Responses::RespData<QDateTime>&>(*(it.value())).data;
@@ -545,7 +558,10 @@ void TreeItemMailbox::handleFetchResponse(Model *const model,
             model->cache()->setMessageMetadata(mailbox(), message->uid(), dataForCache);
         }
         if (updatedFlags) {
-            model->cache()->setMsgFlags(mailbox(), message->uid(), message->m_flags);
+            if (deferredFlags)
+                deferredFlags->append(qMakePair(message->uid(), message->m_flags));
+            else
+                model->cache()->setMsgFlags(mailbox(), message->uid(), message->m_flags);
         }
     }
 }
@@ -561,7 +577,7 @@ The flags, on the other hand, are not critical -- if a message gets saved with t
 the corresponding SyncState and/or UIDs are saved, the wors case which could possibly happen are data which do not match the
 old state any longer. But the old state is not important anyway because it's already gone on the server.
 */
-void TreeItemMailbox::saveSyncStateAndUids(Model * model)
+void TreeItemMailbox::saveSyncStateAndUids(Model * model, const UidMapSaving saving)
 {
     TreeItemMsgList *list = dynamic_cast<TreeItemMsgList*>(m_children[0]);
     if (list->m_unreadMessageCount != -1) {
@@ -571,10 +587,59 @@ void TreeItemMailbox::saveSyncStateAndUids(Model * model)
         syncState.setRecent(list->m_recentMessageCount);
     }
     model->cache()->setMailboxSyncState(mailbox(), syncState);
-    model->saveUidMap(list);
+    if (saving == UID_MAP_FULL || !saveUidMapChanges(model, list)) {
+        model->saveUidMap(list);
+        rememberSavedUidMap(list);
+    }
     list->setFetchStatus(DONE);
 }
 
+/** @short Tell the cache just about what has changed in the UID mapping since the last time
+
+The messages which were present at that time can only get expunged, and the new arrivals are always appended at the end.
+Any change which doesn't fit into this picture, like a message whose UID is still unknown, makes us return false so that
+the caller can save the full mapping instead.
+*/
+bool TreeItemMailbox::saveUidMapChanges(Model *model, TreeItemMsgList *list)
+{
+    if (m_savedUidMapSize < 0)
+        return false;
+
+    int firstNew = list->m_children.size();
+    while (firstNew > 0 && static_cast<TreeItemMessage *>(list->m_children[firstNew - 1])->uid() > m_savedUidMapHighestUid)
+        --firstNew;
+    const int numNew = list->m_children.size() - firstNew;
+    if (m_savedUidMapSize - m_uidsExpungedSinceSave.size() + numNew != list->m_children.size())
+        return false;
+
+    if (!m_uidsExpungedSinceSave.isEmpty() || numNew) {
+        QList<uint> arrivals;
+        for (int i = firstNew; i < list->m_children.size(); ++i)
+            arrivals << static_cast<TreeItemMessage *>(list->m_children[i])->uid();
+        qSort(m_uidsExpungedSinceSave);
+        model->cache()->updateUidMapping(mailbox(), m_uidsExpungedSinceSave, arrivals);
+        if (numNew)
+            m_savedUidMapHighestUid = arrivals.last();
+    }
+    m_savedUidMapSize = list->m_children.size();
+    m_uidsExpungedSinceSave.clear();
+    return true;
+}
+
+void TreeItemMailbox::rememberSavedUidMap(TreeItemMsgList *list)
+{
+    m_savedUidMapSize = list->m_children.size();
+    m_savedUidMapHighestUid = list->m_children.isEmpty() ? 0 : static_cast<TreeItemMessage *>(list->m_children.last())->uid();
+    m_uidsExpungedSinceSave.clear();
+}
+
+void TreeItemMailbox::rememberExpungedUid(const uint uid)
+{
+    // Messages which haven't been saved yet are not interesting
+    if (m_savedUidMapSize >= 0 && uid && uid <= m_savedUidMapHighestUid)
+        m_uidsExpungedSinceSave << uid;
+}
+
 /** @short Process the EXPUNGE response when the UIDs are already synced */
 void TreeItemMailbox::handleExpunge(Model *const model, const Responses::NumberResponse &resp)
 {
@@ -591,6 +656,7 @@ void TreeItemMailbox::handleExpunge(Model *const model, const Responses::NumberR
     TreeItemMessage *message = static_cast<TreeItemMessage *>(*it);
     list->m_children.erase(it);
     model->cache()->clearMessage(static_cast<TreeItemMailbox *>(list->parent())->mailbox(), message->uid());
+    rememberExpungedUid(message->uid());
     for (int i = offset; i < list->m_children.size(); ++i) {
         --static_cast<TreeItemMessage *>(list->m_children[i])->m_offset;
     }
@@ -602,7 +668,62 @@ void TreeItemMailbox::handleExpunge(Model *const model, const Responses::NumberR
 
     if (list->accessFetchStatus() == DONE) {
         // Previously, we were synced, so we got to save this update
-        saveSyncStateAndUids(model);
+        saveSyncStateAndUids(model, UID_MAP_CHANGES);
+    }
+}
+
+/** @short Remove all messages whose UIDs are listed in the VANISHED (EARLIER)
+
+Unlike the plain VANISHED, the EARLIER form only removes messages whose UIDs are known, and it frequently refers to UIDs
+which are not in the mailbox at all. The UIDs are processed range by range starting at the end of the mailbox, so that the
+complexity depends on the number of ranges and on the number of removed messages, not on the number of the UIDs
+mentioned in the response. Each continuous block of removed messages is removed at once.
+*/
+void TreeItemMailbox::removeVanishedEarlier(Model *const model, TreeItemMsgList *list, const Sequence &uids)
+{
+    QModelIndex listIndex = list->toIndex(model);
+    const QVector<Sequence::Range> &ranges = uids.ranges();
+    for (int i = ranges.size() - 1; i >= 0 && !list->m_children.isEmpty(); --i) {
+        const uint lo = qMax(ranges[i].first, 1u);
+        const uint hi = ranges[i].second;
+        if (lo > hi)
+            continue;
+
+        int row = model->findMessageOrNextOneByUid(list, lo) - list->m_children.begin();
+        while (row < list->m_children.size()) {
+            // Messages with unknown UIDs are never removed by the VANISHED (EARLIER)
+            while (row < list->m_children.size() && static_cast<TreeItemMessage *>(list->m_children[row])->uid() == 0)
+                ++row;
+            int end = row;
+            while (end < list->m_children.size()) {
+                const uint uid = static_cast<TreeItemMessage *>(list->m_children[end])->uid();
+                if (uid == 0 || uid > hi)
+                    break;
+                ++end;
+            }
+            if (end == row)
+                break;
+
+            model->beginRemoveRows(listIndex, row, end - 1);
+            TreeItemChildrenList removed = list->m_children.mid(row, end - row);
+            list->m_children.erase(list->m_children.begin() + row, list->m_children.begin() + end);
+            for (int j = row; j < list->m_children.size(); ++j) {
+                static_cast<TreeItemMessage *>(list->m_children[j])->m_offset -= end - row;
+            }
+            model->endRemoveRows();
+
+            Q_FOREACH(TreeItem *item, removed) {
+                TreeItemMessage *message = static_cast<TreeItemMessage *>(item);
+                if (syncState.uidNext() <= message->uid()) {
+                    // We're informed about a message being deleted; this means that that UID must have been in the mailbox
+                    // for some (possibly tiny) time and we can therefore use it to get an idea about the UIDNEXT
+                    syncState.setUidNext(message->uid() + 1);
+                }
+                model->cache()->clearMessage(mailbox(), message->uid());
+                rememberExpungedUid(message->uid());
+                delete message;
+            }
+        }
     }
 }
 
@@ -612,10 +733,21 @@ void TreeItemMailbox::handleVanished(Model *const model, const Responses::Vanish
     Q_ASSERT(list);
     QModelIndex listIndex = list->toIndex(model);
 
-    QList<uint> uids = resp.uids;
-    qSort(uids);
-    // Remove duplicates -- even that garbage can be present in a perfectly valid VANISHED :(
-    uids.erase(std::unique(uids.begin(), uids.end()), uids.end());
+    if (resp.uids.contains(0)) {
+        qDebug() << "VANISHED informs about removal of UID zero...";
+        model->logTrace(listIndex.parent(), Common::LOG_MAILBOX_SYNC, QLatin1String("TreeItemMailbox::handleVanished"),
+                        "VANISHED contains UID zero for increased fun");
+    }
+
+    // The UIDs are kept as a sorted set of ranges, so even the duplicates which can be present in a perfectly valid VANISHED
+    // are gone by now
+    QList<uint> uids;
+    if (resp.earlier == Responses::Vanished::EARLIER) {
+        // The VANISHED (EARLIER) can easily cover the whole history of the mailbox, so let's not expand it
+        removeVanishedEarlier(model, list, resp.uids);
+    } else {
+        uids = resp.uids.toList();
+    }
 
     auto it = list->m_children.end();
     while (!uids.isEmpty()) {
@@ -624,9 +756,7 @@ void TreeItemMailbox::handleVanished(Model *const model, const Responses::Vanish
         uint uid = uids.takeLast();
 
         if (uid == 0) {
-            qDebug() << "VANISHED informs about removal of UID zero...";
-            model->logTrace(listIndex.parent(), Common::LOG_MAILBOX_SYNC, QLatin1String("TreeItemMailbox::handleVanished"),
-                            "VANISHED contains UID zero for increased fun");
+            // already reported above
             break;
         }
 
@@ -654,9 +784,6 @@ void TreeItemMailbox::handleVanished(Model *const model, const Responses::Vanish
         TreeItemMessage *msgCandidate = static_cast<TreeItemMessage*>(*it);
         if (msgCandidate->uid() == uid) {
             // will be deleted
-        } else if (resp.earlier == Responses::Vanished::EARLIER) {
-            // We don't have any such UID in our UID mapping, so we can safely ignore this one
-            continue;
         } else if (msgCandidate->uid() == 0) {
             // will be deleted
         } else {
@@ -705,6 +832,7 @@ void TreeItemMailbox::handleVanished(Model *const model, const Responses::Vanish
             syncState.setUidNext(uid + 1);
         }
         model->cache()->clearMessage(mailbox(), uid);
+        rememberExpungedUid(msgCandidate->uid());
         delete msgCandidate;
     }
 
@@ -717,7 +845,7 @@ void TreeItemMailbox::handleVanished(Model *const model, const Responses::Vanish
         int offset = list->m_children.size();
         model->beginInsertRows(parent, offset, syncState.exists() - 1);
         for (int i = 0; i < newArrivals; ++i) {
-            TreeItemMessage *msg = new TreeItemMessage(list);
+            TreeItemMessage *msg = new (list) TreeItemMessage(list);
             msg->m_offset = i + offset;
             list->m_children << msg;
             // yes, we really have to add this message with UID 0 :(
@@ -731,7 +859,7 @@ void TreeItemMailbox::handleVanished(Model *const model, const Responses::Vanish
 
     if (list->accessFetchStatus() == DONE) {
         // Previously, we were synced, so we got to save this update
-        saveSyncStateAndUids(model);
+        saveSyncStateAndUids(model, UID_MAP_CHANGES);
     }
 }
 
@@ -761,7 +889,7 @@ void TreeItemMailbox::handleExists(Model *const model, const Responses::NumberRe
     int offset = list->m_children.size();
     model->beginInsertRows(parent, offset, resp.number - 1);
     for (int i = 0; i < newArrivals; ++i) {
-        TreeItemMessage *msg = new TreeItemMessage(list);
+        TreeItemMessage *msg = new (list) TreeItemMessage(list);
         msg->m_offset = i + offset;
         list->m_children << msg;
         // yes, we really have to add this message with UID 0 :(
@@ -772,6 +900,34 @@ void TreeItemMailbox::handleExists(Model *const model, const Responses::NumberRe
     model->emitMessageCountChanged(this);
 }
 
+/** @short Let the cache decode the part data straight into a file, so that they do not have to be held in memory
+
+Returns false if the cache cannot do that; the caller is then responsible for decoding the data and storing them.
+*/
+bool TreeItemMailbox::storePartDataInFile(Model *const model, TreeItemMessage *message, TreeItemPart *part,
+                                          const QByteArray &data, const QByteArray &encoding)
+{
+    if (dynamic_cast<TreeItemModifiedPart*>(part))
+        return false;
+    if (!model->cache()->setMsgPartEncoded(mailbox(), message->uid(), part->partId(), data, encoding))
+        return false;
+    part->m_data.clear();
+    part->m_cacheFileName = model->cache()->messagePartFileName(mailbox(), message->uid(), part->partId());
+    return true;
+}
+
+/** @short Feed the full-text index with the text of a freshly cached message part
+
+This is done here rather than by the cache because only the BODYSTRUCTURE knows the charset of the part.
+*/
+void TreeItemMailbox::indexPartData(Model *const model, TreeItemMessage *message, TreeItemPart *part)
+{
+    FullTextIndex *index = model->cache()->fullTextIndex();
+    if (!index || !part->mimeType().startsWith(QLatin1String("text/")))
+        return;
+    index->addBodyPart(mailbox(), message->uid(), part->partId(), part->m_data, part->charset().toLatin1());
+}
+
 TreeItemPart *TreeItemMailbox::partIdToPtr(Model *const model, TreeItemMessage *message, const QString &msgId)
 {
     QString partIdentification;
@@ -838,14 +994,27 @@ bool TreeItemMailbox::isSelectable() const
 
 
 
+/** @short One slab allocator per TreeItemMsgList */
+class MessageArena: public Common::SlabAllocator<sizeof(TreeItemMessage)>
+{
+};
+
 TreeItemMsgList::TreeItemMsgList(TreeItem *parent):
     TreeItem(parent), m_numberFetchingStatus(NONE), m_totalMessageCount(-1),
-    m_unreadMessageCount(-1), m_recentMessageCount(-1)
+    m_unreadMessageCount(-1), m_recentMessageCount(-1), m_messageArena(0)
 {
     if (!parent->parent())
         setFetchStatus(DONE);
 }
 
+TreeItemMsgList::~TreeItemMsgList()
+{
+    // The messages live in our arena, so they have to go away before it does
+    qDeleteAll(m_children);
+    m_children.clear();
+    delete m_messageArena;
+}
+
 void TreeItemMsgList::fetch(Model *const model)
 {
     if (fetched() || isUnavailable(model))
@@ -973,7 +1142,7 @@ MessageDataPayload::~MessageDataPayload()
 }
 
 TreeItemMessage::TreeItemMessage(TreeItem *parent):
-    TreeItem(parent), m_offset(-1), m_uid(0), m_data(0), m_flagsHandled(false), m_wasUnread(false)
+    TreeItem(parent), m_offset(-1), m_uid(0), m_data(0), m_flagsHandled(false), m_wasUnread(false), m_knownFlags(0)
 {
 }
 
@@ -982,6 +1151,26 @@ TreeItemMessage::~TreeItemMessage()
     delete m_data;
 }
 
+void *TreeItemMessage::operator new(std::size_t size, TreeItemMsgList *list)
+{
+    Q_ASSERT(size == sizeof(TreeItemMessage));
+    Q_UNUSED(size);
+    if (!list->m_messageArena)
+        list->m_messageArena = new MessageArena();
+    return list->m_messageArena->allocate();
+}
+
+void TreeItemMessage::operator delete(void *ptr, TreeItemMsgList *list)
+{
+    list->m_messageArena->deallocate(ptr);
+}
+
+void TreeItemMessage::operator delete(void *ptr)
+{
+    // The slab knows which arena it belongs to, so this works even when the message is no longer in any list
+    MessageArena::release(ptr);
+}
+
 void TreeItemMessage::fetch(Model *const model)
 {
     if (fetched() || loading() || isUnavailable(model))
@@ -1193,32 +1382,32 @@ QVariant TreeItemMessage::data(Model *const model, int role)
 
 bool TreeItemMessage::isMarkedAsDeleted() const
 {
-    return m_flags.contains(FlagNames::deleted);
+    return m_knownFlags & KNOWN_FLAG_DELETED;
 }
 
 bool TreeItemMessage::isMarkedAsRead() const
 {
-    return m_flags.contains(FlagNames::seen);
+    return m_knownFlags & KNOWN_FLAG_SEEN;
 }
 
 bool TreeItemMessage::isMarkedAsReplied() const
 {
-    return m_flags.contains(FlagNames::answered);
+    return m_knownFlags & KNOWN_FLAG_ANSWERED;
 }
 
 bool TreeItemMessage::isMarkedAsForwarded() const
 {
-    return m_flags.contains(FlagNames::forwarded);
+    return m_knownFlags & KNOWN_FLAG_FORWARDED;
 }
 
 bool TreeItemMessage::isMarkedAsRecent() const
 {
-    return m_flags.contains(FlagNames::recent);
+    return m_knownFlags & KNOWN_FLAG_RECENT;
 }
 
 bool TreeItemMessage::isMarkedAsFlagged() const
 {
-    return m_flags.contains(FlagNames::flagged);
+    return m_knownFlags & KNOWN_FLAG_FLAGGED;
 }
 
 uint TreeItemMessage::uid() const
@@ -1248,7 +1437,7 @@ void TreeItemMessage::setFlags(TreeItemMsgList *list, const QStringList &flags,
 {
     // wasSeen is used to determine if the message was marked as read before this operation
     bool wasSeen = isMarkedAsRead();
-    m_flags = flags;
+    storeFlags(flags);
     if (list->m_numberFetchingStatus == DONE && forceChange) {
         bool isSeen = isMarkedAsRead();
         if (m_flagsHandled) {
@@ -1271,6 +1460,26 @@ void TreeItemMessage::setFlags(TreeItemMsgList *list, const QStringList &flags,
     }
 }
 
+void TreeItemMessage::storeFlags(const QStringList &flags)
+{
+    m_flags = flags;
+    m_knownFlags = 0;
+    for (QStringList::const_iterator it = m_flags.constBegin(); it != m_flags.constEnd(); ++it) {
+        if (*it == FlagNames::seen)
+            m_knownFlags |= KNOWN_FLAG_SEEN;
+        else if (*it == FlagNames::deleted)
+            m_knownFlags |= KNOWN_FLAG_DELETED;
+        else if (*it == FlagNames::answered)
+            m_knownFlags |= KNOWN_FLAG_ANSWERED;
+        else if (*it == FlagNames::forwarded)
+            m_knownFlags |= KNOWN_FLAG_FORWARDED;
+        else if (*it == FlagNames::recent)
+            m_knownFlags |= KNOWN_FLAG_RECENT;
+        else if (*it == FlagNames::flagged)
+            m_knownFlags |= KNOWN_FLAG_FLAGGED;
+    }
+}
+
 /** @short Process the data found in the headers passed along and file in auxiliary metadata
 
 This function accepts a snippet containing some RFC5322 headers of a message, no matter what headers are actually
@@ -1488,8 +1697,20 @@ QVariant TreeItemPart::data(Model *const model, int role)
                QString("%1").arg(m_mimeType) :
                QString("%1: %2").arg(partId()).arg(m_mimeType);
     case Qt::ToolTipRole:
+        if (!m_cacheFileName.isEmpty())
+            return Model::tr("%1 bytes of data").arg(QFileInfo(m_cacheFileName).size());
         return m_data.size() > 10000 ? Model::tr("%1 bytes of data").arg(m_data.size()) : m_data;
+    case RolePartDataFileName:
+        return m_cacheFileName;
     case RolePartData:
+        if (!m_cacheFileName.isEmpty()) {
+            QFile f(m_cacheFileName);
+            if (!f.open(QIODevice::ReadOnly)) {
+                qDebug() << "Cannot read part data from" << m_cacheFileName << f.errorString();
+                return QByteArray();
+            }
+            return f.readAll();
+        }
         return m_data;
     default:
         return QVariant();
@@ -1623,6 +1844,7 @@ void TreeItemPart::silentlyReleaseMemoryRecursive()
         m_partRaw = 0;
     }
     m_data.clear();
+    m_cacheFileName.clear();
     setFetchStatus(NONE);
     qDeleteAll(m_children);
     m_children.clear();
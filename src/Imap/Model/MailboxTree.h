@@ -127,6 +127,7 @@ public:
 
 class TreeItemPart;
 class TreeItemMessage;
+class MessageArena;
 
 class TreeItemMailbox: public TreeItem
 {
@@ -175,25 +176,49 @@ public:
 
       If \a changedPart is not null, it will be updated to point to the message
       part whose content got fetched.
+
+      If \a deferredFlags is not null, updated flags are appended to it instead of being saved into the cache right away,
+      so that the caller can save them in bulk.
     */
     void handleFetchResponse(Model *const model,
                              const Responses::Fetch &response,
                              QList<TreeItemPart *> &changedParts,
                              TreeItemMessage *&changedMessage,
-                             bool usingQresync);
+                             bool usingQresync,
+                             QVector<QPair<uint, QStringList> > *deferredFlags = 0);
     void rescanForChildMailboxes(Model *const model);
     void handleExpunge(Model *const model, const Responses::NumberResponse &resp);
     void handleExists(Model *const model, const Responses::NumberResponse &resp);
     void handleVanished(Model *const model, const Responses::Vanished &resp);
     bool isSelectable() const;
 
-    void saveSyncStateAndUids(Model *model);
+    /** @short How shall the UID mapping be saved into the cache? */
+    typedef enum {
+        UID_MAP_FULL, /**< Rewrite the whole mapping */
+        UID_MAP_CHANGES /**< Only record the expunges and new arrivals since the last save, if that is possible */
+    } UidMapSaving;
+
+    void saveSyncStateAndUids(Model *model, const UidMapSaving saving = UID_MAP_FULL);
 
 private:
     TreeItemPart *partIdToPtr(Model *model, TreeItemMessage *message, const QString &msgId);
+    bool storePartDataInFile(Model *const model, TreeItemMessage *message, TreeItemPart *part,
+                             const QByteArray &data, const QByteArray &encoding);
+    void indexPartData(Model *const model, TreeItemMessage *message, TreeItemPart *part);
+    bool saveUidMapChanges(Model *model, TreeItemMsgList *list);
+    void rememberSavedUidMap(TreeItemMsgList *list);
+    void rememberExpungedUid(const uint uid);
+    void removeVanishedEarlier(Model *const model, TreeItemMsgList *list, const Sequence &uids);
 
     /** @short ImapTask which is currently responsible for well-being of this mailbox */
     QPointer<KeepMailboxOpenTask> maintainingTask;
+
+    /** @short Number of messages in the UID mapping which was saved the last time, or -1 if not known */
+    int m_savedUidMapSize;
+    /** @short The highest UID in the UID mapping which was saved the last time */
+    uint m_savedUidMapHighestUid;
+    /** @short UIDs from the saved UID mapping which have been expunged since then */
+    QList<uint> m_uidsExpungedSinceSave;
 };
 
 class TreeItemMsgList: public TreeItem
@@ -208,8 +233,11 @@ class TreeItemMsgList: public TreeItem
     int m_totalMessageCount;
     int m_unreadMessageCount;
     int m_recentMessageCount;
+    /** @short Memory for the TreeItemMessage instances, released together with this list */
+    MessageArena *m_messageArena;
 public:
     explicit TreeItemMsgList(TreeItem *parent);
+    ~TreeItemMsgList();
 
     virtual void fetch(Model *const model);
     virtual unsigned int rowCount(Model *const model);
@@ -252,14 +280,30 @@ class TreeItemMessage: public TreeItem
     friend class KeepMailboxOpenTask; // needs access to m_offset
     friend class UpdateFlagsTask; // needs access to m_flags
     friend class UpdateFlagsOfAllMessagesTask; // needs access to m_flags
+    friend class ThreadingMsgListModel; // needs access to m_data for the client-side threading
     int m_offset;
     uint m_uid;
     mutable MessageDataPayload *m_data;
+    /** @short Message flags as obtained from Model::normalizeFlags(), ie. implicitly shared among all messages with the same flags */
     QStringList m_flags;
     bool m_flagsHandled;
     bool m_wasUnread;
+    /** @short Bitmask of the well-known flags present in m_flags */
+    quint8 m_knownFlags;
+
+    typedef enum {
+        KNOWN_FLAG_SEEN = 1 << 0,
+        KNOWN_FLAG_DELETED = 1 << 1,
+        KNOWN_FLAG_ANSWERED = 1 << 2,
+        KNOWN_FLAG_FORWARDED = 1 << 3,
+        KNOWN_FLAG_RECENT = 1 << 4,
+        KNOWN_FLAG_FLAGGED = 1 << 5
+    } KnownFlag;
+
     /** @short Set FLAGS and maintain the unread message counter */
     void setFlags(TreeItemMsgList *list, const QStringList &flags, bool forceChange);
+    /** @short Remember the FLAGS without touching any counters */
+    void storeFlags(const QStringList &flags);
     void processAdditionalHeaders(Model *model, const QByteArray &rawHeaders);
     static bool hasNestedAttachments(Model *const model, TreeItemPart *part);
 
@@ -272,6 +316,15 @@ public:
     explicit TreeItemMessage(TreeItem *parent);
     ~TreeItemMessage();
 
+    /** @short Allocate messages from the arena of the list they belong to; there can be hundreds of thousands of them
+
+    The regular operator delete finds the arena through the address of the object. The placement variant is only used when
+    a constructor throws.
+    */
+    static void *operator new(std::size_t size, TreeItemMsgList *list);
+    static void operator delete(void *ptr, TreeItemMsgList *list);
+    static void operator delete(void *ptr);
+
     virtual int row() const;
     virtual void fetch(Model *const model);
     virtual unsigned int rowCount(Model *const model);
@@ -303,6 +356,8 @@ class TreeItemPart: public TreeItem
     QString m_delSp;
     QByteArray m_encoding;
     QByteArray m_data;
+    /** @short Name of a file holding the part data in case they are not kept in m_data */
+    QString m_cacheFileName;
     QByteArray m_bodyFldId;
     QByteArray m_bodyDisposition;
     QString m_fileName;
@@ -347,6 +402,11 @@ public:
         Imap::Network::MsgPartNetworkReply.
      */
     QByteArray *dataPtr();
+    /** @short Name of a plain file with the part data, or a null QString if the data live in dataPtr()
+
+    Huge parts are decoded straight into the disk cache and are only read back on demand.
+    */
+    QString cacheFileName() const { return m_cacheFileName; }
     QString mimeType() const { return m_mimeType; }
     QString charset() const { return m_charset; }
     void setCharset(const QString &ch) { m_charset = ch; }
@@ -22,7 +22,6 @@
 
 #include "MemoryCache.h"
 #include <QDebug>
-#include <QFile>
 
 //#define CACHE_DEBUG
 
@@ -31,18 +30,36 @@ namespace Imap
 namespace Mailbox
 {
 
-MemoryCache::MemoryCache(QObject *parent): AbstractCache(parent)
+MemoryCache::MemoryCache(QObject *parent): AbstractCache(parent), m_lruClock(0), m_partBytes(0), m_partBudget(-1)
 {
 }
 
+int MemoryCache::findMailbox(const QString &mailbox) const
+{
+    return m_mailboxHandles.value(mailbox, -1);
+}
+
+int MemoryCache::ensureMailbox(const QString &mailbox)
+{
+    QHash<QString, int>::const_iterator it = m_mailboxHandles.constFind(mailbox);
+    if (it != m_mailboxHandles.constEnd())
+        return *it;
+    int handle = m_mailboxes.size();
+    m_mailboxes.append(MailboxData());
+    m_mailboxHandles[mailbox] = handle;
+    return handle;
+}
+
 QList<MailboxMetadata> MemoryCache::childMailboxes(const QString &mailbox) const
 {
-    return mailboxes[ mailbox ];
+    int handle = findMailbox(mailbox);
+    return handle == -1 ? QList<MailboxMetadata>() : m_mailboxes[handle].childMailboxes;
 }
 
 bool MemoryCache::childMailboxesFresh(const QString &mailbox) const
 {
-    return mailboxes.contains(mailbox);
+    int handle = findMailbox(mailbox);
+    return handle != -1 && m_mailboxes[handle].childMailboxesFresh;
 }
 
 void MemoryCache::setChildMailboxes(const QString &mailbox, const QList<MailboxMetadata> &data)
@@ -50,12 +67,15 @@ void MemoryCache::setChildMailboxes(const QString &mailbox, const QList<MailboxM
 #ifdef CACHE_DEBUG
     qDebug() << "setting child mailboxes for" << mailbox << "to" << data;
 #endif
-    mailboxes[mailbox] = data;
+    MailboxData &mbox = m_mailboxes[ensureMailbox(mailbox)];
+    mbox.childMailboxes = data;
+    mbox.childMailboxesFresh = true;
 }
 
 SyncState MemoryCache::mailboxSyncState(const QString &mailbox) const
 {
-    return syncState[mailbox];
+    int handle = findMailbox(mailbox);
+    return handle == -1 ? SyncState() : m_mailboxes[handle].syncState;
 }
 
 void MemoryCache::setMailboxSyncState(const QString &mailbox, const SyncState &state)
@@ -63,7 +83,7 @@ void MemoryCache::setMailboxSyncState(const QString &mailbox, const SyncState &s
 #ifdef CACHE_DEBUG
     qDebug() << "setting mailbox sync state of" << mailbox << "to" << state;
 #endif
-    syncState[mailbox] = state;
+    m_mailboxes[ensureMailbox(mailbox)].syncState = state;
 }
 
 void MemoryCache::setUidMapping(const QString &mailbox, const QList<uint> &mapping)
@@ -71,7 +91,7 @@ void MemoryCache::setUidMapping(const QString &mailbox, const QList<uint> &mappi
 #ifdef CACHE_DEBUG
     qDebug() << "saving UID mapping for" << mailbox << "to" << mapping;
 #endif
-    seqToUid[mailbox] = mapping;
+    m_mailboxes[ensureMailbox(mailbox)].seqToUid = mapping;
 }
 
 void MemoryCache::clearUidMapping(const QString &mailbox)
@@ -79,7 +99,9 @@ void MemoryCache::clearUidMapping(const QString &mailbox)
 #ifdef CACHE_DEBUG
     qDebug() << "clearing UID mapping for" << mailbox;
 #endif
-    seqToUid.remove(mailbox);
+    int handle = findMailbox(mailbox);
+    if (handle != -1)
+        m_mailboxes[handle].seqToUid.clear();
 }
 
 void MemoryCache::clearAllMessages(const QString &mailbox)
@@ -87,10 +109,14 @@ void MemoryCache::clearAllMessages(const QString &mailbox)
 #ifdef CACHE_DEBUG
     qDebug() << "pruging all info for mailbox" << mailbox;
 #endif
-    flags.remove(mailbox);
-    msgMetadata.remove(mailbox);
-    parts.remove(mailbox);
-    threads.remove(mailbox);
+    int handle = findMailbox(mailbox);
+    if (handle == -1)
+        return;
+    MailboxData &mbox = m_mailboxes[handle];
+    for (QHash<uint, MessageData>::iterator it = mbox.messages.begin(); it != mbox.messages.end(); ++it)
+        dropAllParts(*it);
+    mbox.messages.clear();
+    mbox.threading.clear();
 }
 
 void MemoryCache::clearMessage(const QString mailbox, const uint uid)
@@ -98,12 +124,15 @@ void MemoryCache::clearMessage(const QString mailbox, const uint uid)
 #ifdef CACHE_DEBUG
     qDebug() << "pruging all info for message" << mailbox << uid;
 #endif
-    if (flags.contains(mailbox))
-        flags[mailbox].remove(uid);
-    if (msgMetadata.contains(mailbox))
-        msgMetadata[mailbox].remove(uid);
-    if (parts.contains(mailbox))
-        parts[mailbox].remove(uid);
+    int handle = findMailbox(mailbox);
+    if (handle == -1)
+        return;
+    MailboxData &mbox = m_mailboxes[handle];
+    QHash<uint, MessageData>::iterator it = mbox.messages.find(uid);
+    if (it == mbox.messages.end())
+        return;
+    dropAllParts(*it);
+    mbox.messages.erase(it);
 }
 
 void MemoryCache::setMsgPart(const QString &mailbox, const uint uid, const QString &partId, const QByteArray &data)
@@ -111,7 +140,15 @@ void MemoryCache::setMsgPart(const QString &mailbox, const uint uid, const QStri
 #ifdef CACHE_DEBUG
     qDebug() << "set message part" << mailbox << uid << partId << data.size();
 #endif
-    parts[mailbox][uid][partId] = data;
+    int handle = ensureMailbox(mailbox);
+    MessageData &message = m_mailboxes[handle].messages[uid];
+    dropPart(message, partId);
+    CachedPart &part = message.parts[partId];
+    part.data = data;
+    part.lastUse = ++m_lruClock;
+    m_partLru.insert(part.lastUse, PartKey(handle, uid, partId));
+    m_partBytes += data.size();
+    evictParts();
 }
 
 void MemoryCache::forgetMessagePart(const QString &mailbox, const uint uid, const QString &partId)
@@ -119,8 +156,13 @@ void MemoryCache::forgetMessagePart(const QString &mailbox, const uint uid, cons
 #ifdef CACHE_DEBUG
     qDebug() << "forget message part" << mailbox << uid << partId;
 #endif
-    parts[mailbox][uid].remove(partId);
-
+    int handle = findMailbox(mailbox);
+    if (handle == -1)
+        return;
+    MailboxData &mbox = m_mailboxes[handle];
+    QHash<uint, MessageData>::iterator it = mbox.messages.find(uid);
+    if (it != mbox.messages.end())
+        dropPart(*it, partId);
 }
 
 void MemoryCache::setMsgFlags(const QString &mailbox, uint uid, const QStringList &newFlags)
@@ -128,55 +170,69 @@ void MemoryCache::setMsgFlags(const QString &mailbox, uint uid, const QStringLis
 #ifdef CACHE_DEBUG
     qDebug() << "set FLAGS for" << mailbox << uid << newFlags;
 #endif
-    flags[mailbox][uid] = newFlags;
+    m_mailboxes[ensureMailbox(mailbox)].messages[uid].flags = newFlags;
 }
 
 QStringList MemoryCache::msgFlags(const QString &mailbox, const uint uid) const
 {
-    return flags[mailbox][uid];
+    int handle = findMailbox(mailbox);
+    if (handle == -1)
+        return QStringList();
+    const MailboxData &mbox = m_mailboxes[handle];
+    QHash<uint, MessageData>::const_iterator it = mbox.messages.constFind(uid);
+    return it == mbox.messages.constEnd() ? QStringList() : it->flags;
 }
 
 QList<uint> MemoryCache::uidMapping(const QString &mailbox) const
 {
-    return seqToUid[ mailbox ];
+    int handle = findMailbox(mailbox);
+    return handle == -1 ? QList<uint>() : m_mailboxes[handle].seqToUid;
 }
 
 void MemoryCache::setMessageMetadata(const QString &mailbox, const uint uid, const MessageDataBundle &metadata)
 {
-    msgMetadata[mailbox][uid] = metadata;
+    m_mailboxes[ensureMailbox(mailbox)].messages[uid].metadata = metadata;
 }
 
 MemoryCache::MessageDataBundle MemoryCache::messageMetadata(const QString &mailbox, const uint uid) const
 {
-    const QMap<uint, MessageDataBundle> &firstLevel = msgMetadata[ mailbox ];
-    QMap<uint, MessageDataBundle>::const_iterator it = firstLevel.find(uid);
-    if (it == firstLevel.end()) {
+    int handle = findMailbox(mailbox);
+    if (handle == -1)
         return MessageDataBundle();
-    }
-    return *it;
+    const MailboxData &mbox = m_mailboxes[handle];
+    QHash<uint, MessageData>::const_iterator it = mbox.messages.constFind(uid);
+    return it == mbox.messages.constEnd() ? MessageDataBundle() : it->metadata;
 }
 
 QByteArray MemoryCache::messagePart(const QString &mailbox, const uint uid, const QString &partId) const
 {
-    if (! parts.contains(mailbox))
+    int handle = findMailbox(mailbox);
+    if (handle == -1)
         return QByteArray();
-    const QMap<uint, QMap<QString, QByteArray> > &mailboxParts = parts[ mailbox ];
-    if (! mailboxParts.contains(uid))
+    const MailboxData &mbox = m_mailboxes[handle];
+    QHash<uint, MessageData>::const_iterator message = mbox.messages.constFind(uid);
+    if (message == mbox.messages.constEnd())
         return QByteArray();
-    const QMap<QString, QByteArray> &messageParts = mailboxParts[ uid ];
-    if (! messageParts.contains(partId))
+    QHash<QString, CachedPart>::const_iterator part = message->parts.constFind(partId);
+    if (part == message->parts.constEnd())
         return QByteArray();
-    return messageParts[ partId ];
+
+    // Move the part to the tail of the LRU list
+    PartKey key = m_partLru.take(part->lastUse);
+    part->lastUse = ++m_lruClock;
+    m_partLru.insert(part->lastUse, key);
+    return part->data;
 }
 
 QVector<Imap::Responses::ThreadingNode> MemoryCache::messageThreading(const QString &mailbox)
 {
-    return threads[mailbox];
+    int handle = findMailbox(mailbox);
+    return handle == -1 ? QVector<Imap::Responses::ThreadingNode>() : m_mailboxes[handle].threading;
 }
 
 void MemoryCache::setMessageThreading(const QString &mailbox, const QVector<Imap::Responses::ThreadingNode> &threading)
 {
-    threads[mailbox] = threading;
+    m_mailboxes[ensureMailbox(mailbox)].threading = threading;
 }
 
 void MemoryCache::setRenewalThreshold(const int days)
@@ -184,5 +240,52 @@ void MemoryCache::setRenewalThreshold(const int days)
     Q_UNUSED(days);
 }
 
+void MemoryCache::setPartDataBudget(const qint64 bytes)
+{
+    m_partBudget = bytes;
+    evictParts();
+}
+
+qint64 MemoryCache::partDataSize() const
+{
+    return m_partBytes;
+}
+
+void MemoryCache::dropPart(MessageData &message, const QString &partId)
+{
+    QHash<QString, CachedPart>::iterator it = message.parts.find(partId);
+    if (it == message.parts.end())
+        return;
+    m_partBytes -= it->data.size();
+    m_partLru.remove(it->lastUse);
+    message.parts.erase(it);
+}
+
+void MemoryCache::dropAllParts(MessageData &message)
+{
+    for (QHash<QString, CachedPart>::const_iterator it = message.parts.constBegin(); it != message.parts.constEnd(); ++it) {
+        m_partBytes -= it->data.size();
+        m_partLru.remove(it->lastUse);
+    }
+    message.parts.clear();
+}
+
+void MemoryCache::evictParts()
+{
+    if (m_partBudget < 0)
+        return;
+
+    while (m_partBytes > m_partBudget && !m_partLru.isEmpty()) {
+        const PartKey key = m_partLru.constBegin().value();
+        MailboxData &mbox = m_mailboxes[key.mailbox];
+        QHash<uint, MessageData>::iterator message = mbox.messages.find(key.uid);
+        Q_ASSERT(message != mbox.messages.end());
+#ifdef CACHE_DEBUG
+        qDebug() << "evicting message part" << key.mailbox << key.uid << key.partId;
+#endif
+        dropPart(*message, key.partId);
+    }
+}
+
 }
 }
@@ -24,6 +24,7 @@
 #define IMAP_MODEL_MEMORYCACHE_H
 
 #include "Cache.h"
+#include <QHash>
 #include <QMap>
 
 /** @short Namespace for IMAP interaction */
@@ -36,8 +37,12 @@ namespace Mailbox
 
 /** @short A cache implementation that uses in-memory cache
 
-    It also has an optional feature to dump the data to a local file and read
-    it back in. Is isn't suitable for real production use, but it's a good start.
+    Each mailbox name is resolved to a numeric handle through a hash table only once per call; all the per-mailbox data
+    live in a flat table indexed by that handle and the per-message data are kept in a single hash keyed by the UID.
+
+    The data of the message parts are subject to an optional byte budget (see setPartDataBudget()). When it is exceeded,
+    the parts which have not been used for the longest time are dropped. They can always be fetched from the server
+    again, so this prevents the memory usage from growing without bounds during long sessions.
  */
 class MemoryCache : public AbstractCache
 {
@@ -74,14 +79,69 @@ public:
 
     virtual void setRenewalThreshold(const int days);
 
+    /** @short Limit the total size of the cached message parts to @arg bytes
+
+    A negative value means that there is no limit, which is the default.
+    */
+    void setPartDataBudget(const qint64 bytes);
+    /** @short Total size of the message parts which are currently held in the cache */
+    qint64 partDataSize() const;
+
 private:
-    QMap<QString, QList<MailboxMetadata> > mailboxes;
-    QMap<QString, SyncState> syncState;
-    QMap<QString, QList<uint> > seqToUid;
-    QMap<QString, QMap<uint,QStringList> > flags;
-    QMap<QString, QMap<uint, MessageDataBundle> > msgMetadata;
-    QMap<QString, QMap<uint, QMap<QString, QByteArray> > > parts;
-    QMap<QString, QVector<Imap::Responses::ThreadingNode> > threads;
+    /** @short Data of a message part along with its position in the LRU list */
+    struct CachedPart {
+        QByteArray data;
+        mutable quint64 lastUse;
+
+        CachedPart(): lastUse(0) {}
+    };
+
+    /** @short Everything we know about a single message */
+    struct MessageData {
+        QStringList flags;
+        MessageDataBundle metadata;
+        QHash<QString, CachedPart> parts;
+    };
+
+    /** @short Everything we know about a single mailbox */
+    struct MailboxData {
+        bool childMailboxesFresh;
+        QList<MailboxMetadata> childMailboxes;
+        SyncState syncState;
+        QList<uint> seqToUid;
+        QHash<uint, MessageData> messages;
+        QVector<Imap::Responses::ThreadingNode> threading;
+
+        MailboxData(): childMailboxesFresh(false) {}
+    };
+
+    /** @short Identification of a message part in the LRU list */
+    struct PartKey {
+        int mailbox;
+        uint uid;
+        QString partId;
+
+        PartKey(): mailbox(-1), uid(0) {}
+        PartKey(const int mailbox, const uint uid, const QString &partId): mailbox(mailbox), uid(uid), partId(partId) {}
+    };
+
+    /** @short Return the handle of the specified mailbox, or -1 if it isn't known yet */
+    int findMailbox(const QString &mailbox) const;
+    /** @short Return the handle of the specified mailbox, allocating a new one if needed */
+    int ensureMailbox(const QString &mailbox);
+
+    void dropPart(MessageData &message, const QString &partId);
+    void dropAllParts(MessageData &message);
+    void evictParts();
+
+    QHash<QString, int> m_mailboxHandles;
+    QVector<MailboxData> m_mailboxes;
+
+    /** @short The least recently used message parts come first */
+    mutable QMap<quint64, PartKey> m_partLru;
+    mutable quint64 m_lruClock;
+    qint64 m_partBytes;
+    qint64 m_partBudget;
 };
 
 }
@@ -36,6 +36,7 @@
 #include "Imap/Tasks/AppendTask.h"
 #include "Imap/Tasks/GetAnyConnectionTask.h"
 #include "Imap/Tasks/KeepMailboxOpenTask.h"
+#include "Imap/Tasks/NumberOfMessagesTask.h"
 #include "Imap/Tasks/OpenConnectionTask.h"
 #include "Imap/Tasks/UpdateFlagsTask.h"
 #include "Streams/SocketFactory.h"
@@ -92,6 +93,9 @@ bool messageHasUidZero(const TreeItem *const item)
     return message->uid() == 0;
 }
 
+/** @short Don't bother pruning the interned flag lists while there are fewer than this many of them */
+const int minFlagListsPruneThreshold = 64;
+
 }
 
 namespace Imap
@@ -103,8 +107,10 @@ Model::Model(QObject *parent, AbstractCache *cache, SocketFactoryPtr socketFacto
     // parent
     QAbstractItemModel(parent),
     // our tools
-    m_cache(cache), m_socketFactory(std::move(socketFactory)), m_taskFactory(std::move(taskFactory)), m_maxParsers(4), m_mailboxes(0),
-    m_netPolicy(NETWORK_OFFLINE),  m_taskModel(0), m_hasImapPassword(false)
+    m_cache(cache), m_socketFactory(std::move(socketFactory)), m_taskFactory(std::move(taskFactory)), m_maxParsers(1),
+    m_backgroundConnectionReserved(false), m_mailboxes(0),
+    m_netPolicy(NETWORK_OFFLINE),  m_taskModel(0),
+    m_flagListsCount(0), m_flagListsPruneThreshold(minFlagListsPruneThreshold), m_hasImapPassword(false)
 {
     m_cache->setParent(this);
     m_startTls = m_socketFactory->startTlsRequired();
@@ -126,6 +132,8 @@ Model::Model(QObject *parent, AbstractCache *cache, SocketFactoryPtr socketFacto
 
     m_taskModel = new TaskPresentationModel(this);
 
+    m_prefetchClock.start();
+
     // Make sure to update the first-character check inside normalizeFlags() when adding new flags here
     m_specialFlagNames[QLatin1String("\\seen")] = FlagNames::seen;
     m_specialFlagNames[QLatin1String("\\deleted")] = FlagNames::deleted;
@@ -479,6 +487,7 @@ void Model::replaceChildMailboxes(TreeItemMailbox *mailboxPtr, const TreeItemChi
         endRemoveRows();
 
         qDeleteAll(oldItems);
+        pruneFlagLists();
     }
 
     if (! mailboxes.isEmpty()) {
@@ -864,14 +873,15 @@ void Model::askForMessagesInMailbox(TreeItemMsgList *item)
         QModelIndex listIndex = item->toIndex(this);
         if (uidMapping.size()) {
             beginInsertRows(listIndex, 0, uidMapping.size() - 1);
+            item->m_children.reserve(uidMapping.size());
             for (uint seq = 0; seq < static_cast<uint>(uidMapping.size()); ++seq) {
-                TreeItemMessage *message = new TreeItemMessage(item);
+                TreeItemMessage *message = new (item) TreeItemMessage(item);
                 message->m_offset = seq;
                 message->m_uid = uidMapping[seq];
                 item->m_children << message;
                 QStringList flags = cache()->msgFlags(mailbox, message->m_uid);
                 flags.removeOne(QLatin1String("\\Recent"));
-                message->m_flags = normalizeFlags(flags);
+                message->storeFlags(normalizeFlags(flags));
             }
             endInsertRows();
         }
@@ -905,7 +915,12 @@ void Model::askForNumberOfMessages(TreeItemMsgList *item)
             item->m_numberFetchingStatus = TreeItem::UNAVAILABLE;
         }
     } else {
-        m_taskFactory->createNumberOfMessagesTask(this, mailboxPtr->toIndex(this));
+        // Mailboxes which get asked for during the same event loop iteration (like when expanding a subtree)
+        // share a single task, i.e. a single connection and a single pipelined burst of STATUS commands
+        QModelIndex mailboxIndex = mailboxPtr->toIndex(this);
+        if (!m_pendingNumberOfMessagesTask || !m_pendingNumberOfMessagesTask->addMailbox(mailboxIndex)) {
+            m_pendingNumberOfMessagesTask = m_taskFactory->createNumberOfMessagesTask(this, mailboxIndex);
+        }
     }
 }
 
@@ -926,16 +941,18 @@ void Model::askForMsgMetadata(TreeItemMessage *item, const PreloadingMode preloa
             item->data()->m_hdrReferences = data.hdrReferences;
             item->data()->m_hdrListPost = data.hdrListPost;
             item->data()->m_hdrListPostNo = data.hdrListPostNo;
-            QDataStream stream(&data.serializedBodyStructure, QIODevice::ReadOnly);
-            stream.setVersion(QDataStream::Qt_4_6);
-            QVariantList unserialized;
-            stream >> unserialized;
             QSharedPointer<Message::AbstractMessage> abstractMessage;
+            bool legacyBodyStructure = false;
             try {
-                abstractMessage = Message::AbstractMessage::fromList(unserialized, QByteArray(), 0);
+                abstractMessage = Message::AbstractMessage::fromCacheData(data.serializedBodyStructure, &legacyBodyStructure);
             } catch (Imap::ParserException &e) {
                 qDebug() << "Error when parsing cached BODYSTRUCTURE" << e.what();
             }
+            if (abstractMessage && legacyBodyStructure) {
+                // Upgrade the cache entry so that the next time, the faster format gets used
+                data.serializedBodyStructure = abstractMessage->toCacheData();
+                cache()->setMessageMetadata(mailboxPtr->mailbox(), item->uid(), data);
+            }
             if (! abstractMessage) {
                 item->setFetchStatus(TreeItem::UNAVAILABLE);
             } else {
@@ -970,32 +987,101 @@ void Model::askForMsgMetadata(TreeItemMessage *item, const PreloadingMode preloa
     {
         if (item->accessFetchStatus() != TreeItem::DONE) {
             item->setFetchStatus(TreeItem::LOADING);
-            findTaskResponsibleFor(mailboxPtr)->requestEnvelopeDownload(item->uid());
+            findTaskResponsibleFor(mailboxPtr)->requestEnvelopeDownload(item->uid(), preloadMode == PRELOAD_PER_POLICY ?
+                                                                            KeepMailboxOpenTask::ENVELOPE_VISIBLE :
+                                                                            KeepMailboxOpenTask::ENVELOPE_PRELOAD);
         }
 
         // preload
         if (preloadMode != PRELOAD_PER_POLICY)
             break;
-        bool ok;
-        int preload = property("trojita-imap-preload-msg-metadata").toInt(&ok);
-        if (! ok)
-            preload = 50;
-        int order = item->row();
-        for (int i = qMax(0, order - preload); i < qMin(list->m_children.size(), order + preload); ++i) {
-            TreeItemMessage *message = dynamic_cast<TreeItemMessage *>(list->m_children[i]);
-            Q_ASSERT(message);
-            if (item != message && !message->fetched() && !message->loading() && message->uid()) {
-                message->setFetchStatus(TreeItem::LOADING);
-                // cannot ask the KeepTask directly, that'd completely ignore the cache
-                // but we absolutely have to block the preload :)
-                askForMsgMetadata(message, PRELOAD_DISABLED);
-            }
+        updatePrefetchBaseSize();
+        int before = m_prefetchWindow.baseSize();
+        int after = before;
+        if (m_prefetchMsgList.isValid() && m_prefetchMsgList.internalPointer() == list) {
+            // The view told us where it is, so let's follow the scrolling
+            const qint64 now = m_prefetchClock.elapsed();
+            before = m_prefetchWindow.rowsBefore(now);
+            after = m_prefetchWindow.rowsAfter(now);
         }
+        const int order = item->row();
+        preloadMsgMetadata(list, order - before, order + after - 1);
     }
     break;
     }
 }
 
+void Model::preloadMsgMetadata(TreeItemMsgList *list, const int first, const int last)
+{
+    for (int i = qMax(0, first); i <= qMin(list->m_children.size() - 1, last); ++i) {
+        TreeItemMessage *message = dynamic_cast<TreeItemMessage *>(list->m_children[i]);
+        Q_ASSERT(message);
+        if (!message->fetched() && !message->loading() && message->uid()) {
+            message->setFetchStatus(TreeItem::LOADING);
+            // cannot ask the KeepTask directly, that'd completely ignore the cache
+            // but we absolutely have to block the preload :)
+            askForMsgMetadata(message, PRELOAD_DISABLED);
+        }
+    }
+}
+
+void Model::updatePrefetchBaseSize()
+{
+    bool ok;
+    int preload = property("trojita-imap-preload-msg-metadata").toInt(&ok);
+    if (! ok)
+        preload = 50;
+    m_prefetchWindow.setBaseSize(preload);
+}
+
+void Model::setMessageListViewport(const QModelIndex &first, const QModelIndex &last)
+{
+    if (!first.isValid() || !last.isValid())
+        return;
+
+    const Model *model = 0;
+    TreeItemMessage *firstMessage = dynamic_cast<TreeItemMessage *>(realTreeItem(first, &model));
+    Q_ASSERT(model == this);
+    TreeItemMessage *lastMessage = dynamic_cast<TreeItemMessage *>(realTreeItem(last, &model));
+    Q_ASSERT(model == this);
+    if (!firstMessage || !lastMessage || firstMessage->parent() != lastMessage->parent())
+        return;
+
+    TreeItemMsgList *list = dynamic_cast<TreeItemMsgList *>(firstMessage->parent());
+    Q_ASSERT(list);
+
+    // With a threading proxy, the visible messages need not be in the original order
+    const int firstRow = qMin(firstMessage->row(), lastMessage->row());
+    const int lastRow = qMax(firstMessage->row(), lastMessage->row());
+
+    updatePrefetchBaseSize();
+    if (!m_prefetchMsgList.isValid() || m_prefetchMsgList.internalPointer() != list) {
+        m_prefetchWindow.reset();
+        m_prefetchMsgList = list->toIndex(this);
+    }
+    const qint64 now = m_prefetchClock.elapsed();
+    const bool jumped = m_prefetchWindow.viewportChanged(firstRow, lastRow, now);
+
+    if (networkPolicy() != NETWORK_ONLINE)
+        return;
+
+    TreeItemMailbox *mailboxPtr = dynamic_cast<TreeItemMailbox *>(list->parent());
+    Q_ASSERT(mailboxPtr);
+    if (jumped && mailboxPtr->maintainingTask) {
+        // Whatever was queued for the old position is not interesting anymore
+        QList<uint> uids = mailboxPtr->maintainingTask->withdrawQueuedEnvelopePreload();
+        if (!uids.isEmpty()) {
+            qSort(uids);
+            Q_FOREACH(TreeItemMessage *message, findMessagesByUids(mailboxPtr, uids)) {
+                if (message->loading())
+                    message->setFetchStatus(TreeItem::NONE);
+            }
+        }
+    }
+
+    preloadMsgMetadata(list, firstRow - m_prefetchWindow.rowsBefore(now), lastRow + m_prefetchWindow.rowsAfter(now));
+}
+
 void Model::askForMsgPart(TreeItemPart *item, bool onlyFromCache)
 {
     Q_ASSERT(item->message());   // TreeItemMessage
@@ -1018,6 +1104,16 @@ void Model::askForMsgPart(TreeItemPart *item, bool onlyFromCache)
         Q_ASSERT(itemForFetchOperation);
     }
 
+    if (!isSpecialRawPart) {
+        const QString fileName = cache()->messagePartFileName(mailboxPtr->mailbox(), uid, item->partId());
+        if (!fileName.isEmpty()) {
+            // The data are available in a plain file, there's no point in reading them into memory right now
+            item->m_cacheFileName = fileName;
+            item->setFetchStatus(TreeItem::DONE);
+            return;
+        }
+    }
+
     const QByteArray &data = cache()->messagePart(mailboxPtr->mailbox(), uid,
                                                   isSpecialRawPart ?
                                                       itemForFetchOperation->partId() + QLatin1String(".X-RAW")
@@ -1077,17 +1173,7 @@ void Model::setNetworkPolicy(const NetworkPolicy policy)
                 // there's no point in sending LOGOUT over these
                 continue;
             }
-            Q_ASSERT(it->parser);
-            if (it->maintainingTask) {
-                // First of all, give the maintaining task a chance to finish its housekeeping
-                it->maintainingTask->stopForLogout();
-            }
-            // Kill all tasks that are also using this connection
-            Q_FOREACH(ImapTask *task, it->activeTasks) {
-                task->die(tr("Going offline"));
-            }
-            it->logoutCmd = it->parser->logout();
-            it->connState = CONN_STATE_LOGOUT;
+            logoutConnection(*it, tr("Going offline"));
         }
         m_netPolicy = NETWORK_OFFLINE;
         m_periodicMailboxNumbersRefresh->stop();
@@ -1191,6 +1277,81 @@ void Model::switchToMailbox(const QModelIndex &mbox)
     findTaskResponsibleFor(mbox);
 }
 
+/** @short Send LOGOUT over the connection after letting its maintaining task finish and killing all other tasks */
+void Model::logoutConnection(ParserState &state, const QString &reason)
+{
+    Q_ASSERT(state.parser);
+    if (state.maintainingTask) {
+        // First of all, give the maintaining task a chance to finish its housekeeping
+        state.maintainingTask->stopForLogout();
+    }
+    // Kill all tasks that are also using this connection
+    Q_FOREACH(ImapTask *task, state.activeTasks) {
+        task->die(reason);
+    }
+    state.logoutCmd = state.parser->logout();
+    state.connState = CONN_STATE_LOGOUT;
+}
+
+void Model::reserveBackgroundConnection()
+{
+    m_backgroundConnectionReserved = true;
+}
+
+void Model::releaseBackgroundConnection()
+{
+    m_backgroundConnectionReserved = false;
+    Parser *parser = usableBackgroundParser();
+    m_backgroundParser = 0;
+    if (!parser)
+        return;
+    logoutConnection(accessParser(parser), tr("Background synchronization finished"));
+}
+
+bool Model::openMailboxInBackground(const QModelIndex &mbox)
+{
+    if (!mbox.isValid() || m_netPolicy == NETWORK_OFFLINE)
+        return false;
+
+    QModelIndex translatedIndex;
+    TreeItemMailbox *mailboxPtr = dynamic_cast<TreeItemMailbox *>(realTreeItem(mbox, 0, &translatedIndex));
+    Q_ASSERT(mailboxPtr);
+
+    if (mailboxPtr->maintainingTask && accessParser(mailboxPtr->maintainingTask->parser).connState != CONN_STATE_LOGOUT)
+        return true;
+
+    Parser *parser = usableBackgroundParser();
+    if (!parser) {
+        // Look for a connection which isn't busy with any other mailbox, or open a new one if the pool permits that
+        int usableParsers = 0;
+        for (QMap<Parser *,ParserState>::const_iterator it = m_parsers.constBegin(); it != m_parsers.constEnd(); ++it) {
+            if (it->connState == CONN_STATE_LOGOUT)
+                continue;
+            ++usableParsers;
+            if (!it->maintainingTask && !parser)
+                parser = it.key();
+        }
+        if (!parser && usableParsers >= m_maxParsers)
+            return false;
+    }
+
+    KeepMailboxOpenTask *task = m_taskFactory->createKeepMailboxOpenTask(this, mailboxPtr->toIndex(this), parser);
+    if (m_backgroundConnectionReserved && m_maxParsers > 1)
+        m_backgroundParser = task->parser;
+    return true;
+}
+
+/** @short Return the connection reserved for the background work, provided that it is still usable */
+Parser *Model::usableBackgroundParser() const
+{
+    if (!m_backgroundParser)
+        return 0;
+    QMap<Parser *,ParserState>::const_iterator it = m_parsers.constFind(m_backgroundParser);
+    if (it == m_parsers.constEnd() || it->connState == CONN_STATE_LOGOUT)
+        return 0;
+    return it.key();
+}
+
 void Model::updateCapabilities(Parser *parser, const QStringList capabilities)
 {
     Q_ASSERT(parser);
@@ -1563,7 +1724,6 @@ KeepMailboxOpenTask *Model::findTaskResponsibleFor(const QModelIndex &mailbox)
 KeepMailboxOpenTask *Model::findTaskResponsibleFor(TreeItemMailbox *mailboxPtr)
 {
     Q_ASSERT(mailboxPtr);
-    bool canCreateParallelConn = m_parsers.isEmpty(); // FIXME: multiple connections
 
     if (mailboxPtr->maintainingTask) {
         // The requested mailbox already has the maintaining task associated
@@ -1574,23 +1734,40 @@ KeepMailboxOpenTask *Model::findTaskResponsibleFor(TreeItemMailbox *mailboxPtr)
             // it's usable as-is
             return mailboxPtr->maintainingTask;
         }
-    } else if (canCreateParallelConn) {
-        // The mailbox is not being maintained, but we can create a new connection
-        return m_taskFactory->createKeepMailboxOpenTask(this, mailboxPtr->toIndex(this), 0);
-    } else {
-        // Too bad, we have to re-use an existing parser. That will probably lead to
-        // stealing it from some mailbox, but there's no other way.
-        Q_ASSERT(!m_parsers.isEmpty());
+    }
 
-        for (QMap<Parser *,ParserState>::const_iterator it = m_parsers.constBegin(); it != m_parsers.constEnd(); ++it) {
-            if (it->connState == CONN_STATE_LOGOUT) {
-                // this one is not usable
-                continue;
-            }
-            return m_taskFactory->createKeepMailboxOpenTask(this, mailboxPtr->toIndex(this), it.key());
+    // The mailbox is not being maintained. A connection which does not keep any other mailbox open is the best candidate,
+    // then a completely new connection if the pool permits that, and the last resort is stealing a connection from some
+    // other mailbox.
+    // The connection reserved for the background work is left alone, and if it doesn't exist yet, there has to be room
+    // for it in the pool.
+    const bool reserving = m_backgroundConnectionReserved && m_maxParsers > 1;
+    Parser *reserved = reserving ? usableBackgroundParser() : 0;
+    const int maxParsers = reserving && !reserved ? m_maxParsers - 1 : m_maxParsers;
+    Parser *idle = 0;
+    Parser *victim = 0;
+    int usableParsers = 0;
+    for (QMap<Parser *,ParserState>::const_iterator it = m_parsers.constBegin(); it != m_parsers.constEnd(); ++it) {
+        if (it->connState == CONN_STATE_LOGOUT) {
+            // this one is not usable
+            continue;
         }
-        // At this point, we have no other choice than to create a new connection
+        ++usableParsers;
+        if (it.key() == reserved)
+            continue;
+        if (!it->maintainingTask && !idle)
+            idle = it.key();
+        if (!victim)
+            victim = it.key();
+    }
+
+    if (idle) {
+        return m_taskFactory->createKeepMailboxOpenTask(this, mailboxPtr->toIndex(this), idle);
+    } else if (usableParsers < maxParsers || !victim) {
         return m_taskFactory->createKeepMailboxOpenTask(this, mailboxPtr->toIndex(this), 0);
+    } else {
+        // Too bad, we have to re-use an existing parser
+        return m_taskFactory->createKeepMailboxOpenTask(this, mailboxPtr->toIndex(this), victim);
     }
 }
 
@@ -1842,12 +2019,63 @@ QStringList Model::normalizeFlags(const QStringList &source) const
             res.append(*it);
         }
     }
-    // Always sort the flags when performing normalization to obtain reasonable results and be ready for possible future
-    // deduplication of the actual QLists
+    // Always sort the flags when performing normalization to obtain reasonable results and to allow deduplication of the
+    // actual QLists
     res.sort();
+
+    // There are usually just a handful of distinct flag combinations in a mailbox, so let all messages with the same flags
+    // share a single list
+    uint hash = 0;
+    for (QStringList::const_iterator flag = res.constBegin(); flag != res.constEnd(); ++flag) {
+        hash = hash * 31 + qHash(*flag);
+    }
+    QList<QStringList> &bucket = m_flagLists[hash];
+    for (QList<QStringList>::const_iterator it = bucket.constBegin(); it != bucket.constEnd(); ++it) {
+        if (*it == res)
+            return *it;
+    }
+    bucket.append(res);
+    if (++m_flagListsCount > m_flagListsPruneThreshold)
+        pruneFlagLists();
     return res;
 }
 
+/** @short Forget those interned flag lists and flag names which are no longer used by any message
+
+The lists are implicitly shared, so a list whose only remaining copy is the one in m_flagLists is not needed anymore.
+This is called whenever a bunch of messages get thrown away, and also when the table grows too much, so that the flag
+combinations of closed or deleted mailboxes do not accumulate forever.
+*/
+void Model::pruneFlagLists() const
+{
+    m_flagListsCount = 0;
+    for (QHash<uint, QList<QStringList> >::iterator bucket = m_flagLists.begin(); bucket != m_flagLists.end(); /* nothing */) {
+        for (QList<QStringList>::iterator it = bucket->begin(); it != bucket->end(); /* nothing */) {
+            if (it->isDetached()) {
+                it = bucket->erase(it);
+            } else {
+                ++it;
+            }
+        }
+        if (bucket->isEmpty()) {
+            bucket = m_flagLists.erase(bucket);
+        } else {
+            m_flagListsCount += bucket->size();
+            ++bucket;
+        }
+    }
+    m_flagListsPruneThreshold = qMax(minFlagListsPruneThreshold, 2 * m_flagListsCount);
+
+    // The same applies to the individual flags; they are only referenced from the lists
+    for (QSet<QString>::iterator it = m_flagLiterals.begin(); it != m_flagLiterals.end(); /* nothing */) {
+        if (it->isDetached()) {
+            it = m_flagLiterals.erase(it);
+        } else {
+            ++it;
+        }
+    }
+}
+
 /** @short Set the IMAP username */
 void Model::setImapUser(const QString &imapUser)
 {
@@ -1966,7 +2194,7 @@ void Model::invalidateAllMessageCounts()
     }
 }
 
-AppendTask *Model::appendIntoMailbox(const QString &mailbox, const QByteArray &rawMessageData, const QStringList &flags,
+AppendTask *Model::appendIntoMailbox(const QString &mailbox, const QSharedPointer<QIODevice> &rawMessageData, const QStringList &flags,
                                      const QDateTime &timestamp)
 {
     return m_taskFactory->createAppendTask(this, mailbox, rawMessageData, flags, timestamp);
@@ -2054,6 +2282,11 @@ void Model::setCapabilitiesBlacklist(const QStringList &blacklist)
     m_capabilitiesBlacklist = blacklist;
 }
 
+void Model::setConnectionPoolSize(const int size)
+{
+    m_maxParsers = qMax(1, size);
+}
+
 bool Model::isCatenateSupported() const
 {
     return capabilities().contains(QLatin1String("CATENATE"));
@@ -26,6 +26,7 @@
 #define IMAP_MODEL_H
 
 #include <QAbstractItemModel>
+#include <QPersistentModelIndex>
 #include <QPointer>
 #include <QTimer>
 #include "Cache.h"
@@ -36,6 +37,7 @@
 #include "FlagsOperation.h"
 #include "NetworkPolicy.h"
 #include "ParserState.h"
+#include "PrefetchWindow.h"
 #include "TaskFactory.h"
 
 #include "Common/Logging.h"
@@ -78,6 +80,7 @@ class SystemNetworkWatcher;
 
 class ImapTask;
 class KeepMailboxOpenTask;
+class NumberOfMessagesTask;
 class TaskPresentationModel;
 template <typename SourceModel> class SubtreeClassSpecificItem;
 typedef std::unique_ptr<Streams::SocketFactory> SocketFactoryPtr;
@@ -111,6 +114,10 @@ class Model: public QAbstractItemModel
     TaskFactoryPtr m_taskFactory;
     mutable QMap<Parser *,ParserState> m_parsers;
     int m_maxParsers;
+    /** @short Shall one connection of the pool be kept for openMailboxInBackground()? */
+    bool m_backgroundConnectionReserved;
+    /** @short The connection used by openMailboxInBackground() */
+    QPointer<Parser> m_backgroundParser;
     mutable TreeItemMailbox *m_mailboxes;
     mutable NetworkPolicy m_netPolicy;
     bool m_startTls;
@@ -191,8 +198,11 @@ public:
     /** @short Unsubscribe a mailbox */
     void unsubscribeMailbox(const QString &name);
 
-    /** @short Save a message into a mailbox */
-    AppendTask* appendIntoMailbox(const QString &mailbox, const QByteArray &rawMessageData, const QStringList &flags,
+    /** @short Save a message into a mailbox
+
+    The message data are read from the @arg rawMessageData device while they are being sent.
+    */
+    AppendTask* appendIntoMailbox(const QString &mailbox, const QSharedPointer<QIODevice> &rawMessageData, const QStringList &flags,
                                   const QDateTime &timestamp);
 
     /** @short Save a message into a mailbox using the CATENATE extension */
@@ -282,6 +292,38 @@ public:
     */
     void setCapabilitiesBlacklist(const QStringList &blacklist);
 
+    /** @short Set the maximal number of parallel connections to the IMAP server
+
+    With just one connection, everything is multiplexed over it. With more of them, each mailbox which is kept open gets
+    its own connection as long as the limit allows that, and the tasks which can run on any connection are sent to the
+    least busy one, possibly opening a new connection if all of the existing ones are busy.
+    */
+    void setConnectionPoolSize(const int size);
+
+    /** @short Keep one connection of the pool for work which happens in the background
+
+    Mailboxes opened through openMailboxInBackground() will use this connection, while the mailboxes which the user
+    works with will not get it, not even when the rest of the pool is busy. This only has an effect when the pool permits
+    more than one connection.
+    */
+    void reserveBackgroundConnection();
+    /** @short Stop reserving the connection for the background work and log it out, closing its mailbox */
+    void releaseBackgroundConnection();
+    /** @short Open the mailbox over the reserved background connection
+
+    A mailbox which is already kept open over any connection is left where it is. Connections which keep another mailbox
+    open are never taken away, except for the reserved one. Returns false if there's no connection available right now.
+    */
+    bool openMailboxInBackground(const QModelIndex &mbox);
+
+    /** @short Inform the Model about which messages are currently visible
+
+    The @arg first and @arg last shall point to the topmost and the bottommost message shown by a view; proxy models are
+    fine. The Model uses this to follow the scrolling when preloading message metadata, and starts fetching the messages
+    which are likely to be scrolled into view soon.
+    */
+    void setMessageListViewport(const QModelIndex &first, const QModelIndex &last);
+
     bool isCatenateSupported() const;
     bool isGenUrlAuthSupported() const;
     bool isImapSubmissionSupported() const;
@@ -480,6 +522,10 @@ private:
     typedef enum {PRELOAD_PER_POLICY, PRELOAD_DISABLED} PreloadingMode;
 
     void askForMsgMetadata(TreeItemMessage *item, PreloadingMode preloadMode);
+    /** @short Request metadata of messages in the given range of rows which haven't been loaded yet */
+    void preloadMsgMetadata(TreeItemMsgList *list, const int first, const int last);
+    /** @short Update the base size of the m_prefetchWindow from the configuration */
+    void updatePrefetchBaseSize();
     void askForMsgPart(TreeItemPart *item, bool onlyFromCache=false);
 
     void finalizeList(Parser *parser, TreeItemMailbox *const mailboxPtr);
@@ -507,6 +553,8 @@ private:
     /** @short Return a corresponding KeepMailboxOpenTask for a given mailbox */
     KeepMailboxOpenTask *findTaskResponsibleFor(const QModelIndex &mailbox);
     KeepMailboxOpenTask *findTaskResponsibleFor(TreeItemMailbox *mailboxPtr);
+    Parser *usableBackgroundParser() const;
+    void logoutConnection(ParserState &state, const QString &reason);
 
     /** @short Find a mailbox which is expected to be common for all passed items
 
@@ -545,6 +593,8 @@ private:
 
     void informTasksAboutNewPassword();
 
+    void pruneFlagLists() const;
+
     QStringList onlineMessageFetch;
 
     /** @short Model visualizing the state of the tasks */
@@ -554,6 +604,12 @@ private:
 
     QHash<QString,QString> m_specialFlagNames;
     mutable QSet<QString> m_flagLiterals;
+    /** @short Implicitly shared lists of flags, keyed by a hash of their contents */
+    mutable QHash<uint, QList<QStringList> > m_flagLists;
+    /** @short Number of lists in m_flagLists */
+    mutable int m_flagListsCount;
+    /** @short The m_flagLists get pruned once they contain more than this many lists */
+    mutable int m_flagListsPruneThreshold;
 
     /** @short Username for login */
     QString m_imapUser;
@@ -563,9 +619,18 @@ private:
     bool m_hasImapPassword;
 
     QTimer *m_periodicMailboxNumbersRefresh;
+    /** @short The STATUS batch which still accepts further mailboxes */
+    QPointer<NumberOfMessagesTask> m_pendingNumberOfMessagesTask;
 
     QStringList m_capabilitiesBlacklist;
 
+    /** @short Adaptive size of the area around the visible messages whose metadata get preloaded */
+    PrefetchWindow m_prefetchWindow;
+    /** @short The list of messages whose viewport is tracked by the m_prefetchWindow */
+    QPersistentModelIndex m_prefetchMsgList;
+    /** @short Time source for the m_prefetchWindow */
+    PrefetchClock m_prefetchClock;
+
 protected slots:
     void responseReceived();
     void responseReceived(Imap::Parser *parser);
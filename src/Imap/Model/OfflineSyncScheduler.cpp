@@ -0,0 +1,249 @@
+/* Copyright (C) 2006 - 2014 Jan Kundrát <jkt@flaska.net>
+
+   This file is part of the Trojita Qt IMAP e-mail client,
+   http://trojita.flaska.net/
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2 of
+   the License or (at your option) version 3 or any later version
+   accepted by the membership of KDE e.V. (or its successor approved
+   by the membership of KDE e.V.), which shall act as a proxy
+   defined in Section 14 of version 3 of the license.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <QTimer>
+#include "OfflineSyncScheduler.h"
+#include "FindInterestingPart.h"
+#include "ItemRoles.h"
+#include "MailboxFinder.h"
+#include "Model.h"
+
+namespace
+{
+
+/** @short How many times slower the synchronization goes when the network is expensive */
+const int expensiveSlowdown = 10;
+
+/** @short Give up on the current mailbox after this many timer ticks without any progress */
+const int maxStalledTicks = 600;
+
+}
+
+namespace Imap
+{
+
+namespace Mailbox
+{
+
+OfflineSyncScheduler::OfflineSyncScheduler(QObject *parent, Model *model):
+    QObject(parent), m_model(model), m_currentRow(0), m_byteBudget(-1), m_bytesRequested(0), m_rateLimit(5),
+    m_stalledTicks(0), m_active(false), m_waitingForMailbox(false)
+{
+    Q_ASSERT(m_model);
+    m_finder = new MailboxFinder(this, m_model);
+    connect(m_finder, SIGNAL(mailboxFound(QString,QModelIndex)), this, SLOT(slotMailboxFound(QString,QModelIndex)));
+    m_timer = new QTimer(this);
+    connect(m_timer, SIGNAL(timeout()), this, SLOT(processNextMessage()));
+    connect(m_model, SIGNAL(networkPolicyChanged()), this, SLOT(slotNetworkPolicyChanged()));
+}
+
+void OfflineSyncScheduler::setMailboxes(const QStringList &mailboxes)
+{
+    m_mailboxes = mailboxes;
+    if (m_active)
+        start();
+}
+
+void OfflineSyncScheduler::setByteBudget(const qint64 bytes)
+{
+    m_byteBudget = bytes;
+}
+
+void OfflineSyncScheduler::setRateLimit(const int messagesPerSecond)
+{
+    m_rateLimit = qMax(1, messagesPerSecond);
+    updateTimer();
+}
+
+qint64 OfflineSyncScheduler::bytesRequested() const
+{
+    return m_bytesRequested;
+}
+
+bool OfflineSyncScheduler::isActive() const
+{
+    return m_active;
+}
+
+void OfflineSyncScheduler::start()
+{
+    m_pendingMailboxes = m_mailboxes;
+    m_bytesRequested = 0;
+    m_active = true;
+    m_model->reserveBackgroundConnection();
+    nextMailbox();
+    updateTimer();
+}
+
+void OfflineSyncScheduler::stop()
+{
+    if (m_active) {
+        // Don't keep the last mirrored mailbox open and IDLEing forever
+        m_model->releaseBackgroundConnection();
+    }
+    m_active = false;
+    m_waitingForMailbox = false;
+    m_pendingMailboxes.clear();
+    m_currentMailboxName.clear();
+    m_currentMailbox = QPersistentModelIndex();
+    updateTimer();
+}
+
+/** @short Forget about the current mailbox and ask for the index of the next one */
+void OfflineSyncScheduler::nextMailbox()
+{
+    m_currentMailbox = QPersistentModelIndex();
+    m_currentRow = 0;
+    m_stalledTicks = 0;
+
+    if (m_pendingMailboxes.isEmpty()) {
+        m_model->logTrace(0, Common::LOG_OTHER, QLatin1String("OfflineSyncScheduler"), QLatin1String("All mailboxes processed"));
+        stop();
+        emit finished();
+        return;
+    }
+
+    m_currentMailboxName = m_pendingMailboxes.takeFirst();
+    m_waitingForMailbox = true;
+    m_finder->addMailbox(m_currentMailboxName);
+}
+
+void OfflineSyncScheduler::slotMailboxFound(const QString &mailbox, const QModelIndex &index)
+{
+    if (!m_active || !m_waitingForMailbox || mailbox != m_currentMailboxName)
+        return;
+
+    m_waitingForMailbox = false;
+    m_currentMailbox = index;
+    m_model->openMailboxInBackground(index);
+}
+
+void OfflineSyncScheduler::slotNetworkPolicyChanged()
+{
+    if (m_active && m_currentMailbox.isValid() && m_model->isNetworkAvailable()) {
+        // The connection might have gone away in the meanwhile
+        m_model->openMailboxInBackground(m_currentMailbox);
+    }
+    updateTimer();
+}
+
+/** @short Keep the timer running at the pace corresponding to the current network policy */
+void OfflineSyncScheduler::updateTimer()
+{
+    if (!m_active || !m_model->isNetworkAvailable()) {
+        m_timer->stop();
+        return;
+    }
+
+    int interval = 1000 / m_rateLimit;
+    if (!m_model->isNetworkOnline())
+        interval *= expensiveSlowdown;
+    if (!m_timer->isActive() || m_timer->interval() != interval)
+        m_timer->start(interval);
+}
+
+void OfflineSyncScheduler::processNextMessage()
+{
+    if (!m_active || !m_model->isNetworkAvailable())
+        return;
+
+    if (++m_stalledTicks > maxStalledTicks) {
+        m_model->logTrace(0, Common::LOG_OTHER, QLatin1String("OfflineSyncScheduler"),
+                          QString::fromUtf8("No progress in mailbox %1, skipping it").arg(m_currentMailboxName));
+        nextMailbox();
+        return;
+    }
+
+    if (!m_currentMailbox.isValid()) {
+        // Either the MailboxFinder hasn't found it yet, or the index got invalidated, for example by a reconnect
+        if (!m_waitingForMailbox) {
+            m_waitingForMailbox = true;
+            m_finder->addMailbox(m_currentMailboxName);
+        }
+        return;
+    }
+
+    // Make sure that the mailbox is kept open over the background connection. Touching its data without that would let
+    // the Model pick a connection on its own, possibly the one used by the GUI.
+    if (!m_model->openMailboxInBackground(m_currentMailbox))
+        return;
+
+    // Asking for the number of rows is what triggers the mailbox synchronization
+    QModelIndex list = m_model->index(0, 0, m_currentMailbox);
+    const int rowCount = m_model->rowCount(list);
+    if (m_currentRow >= rowCount) {
+        if (m_currentMailbox.data(RoleMailboxItemsAreLoading).toBool())
+            return;
+        m_model->logTrace(0, Common::LOG_OTHER, QLatin1String("OfflineSyncScheduler"),
+                          QString::fromUtf8("Mailbox %1 is synchronized, %2 bytes requested so far").arg(
+                              m_currentMailboxName, QString::number(m_bytesRequested)));
+        emit mailboxSynced(m_currentMailboxName);
+        nextMailbox();
+        return;
+    }
+
+    QModelIndex message = m_model->index(m_currentRow, 0, list);
+    if (!message.data(RoleMessageUid).toUInt()) {
+        // The UID is not known yet, the mailbox is still getting synced
+        return;
+    }
+
+    if (!message.data(RoleIsFetched).toBool()) {
+        // This goes through Model::askForMsgMetadata(), including the cache lookup and preloading of the neighbors
+        message.data(RoleMessageSubject);
+        return;
+    }
+
+    QModelIndex mainPart;
+    QString partMessage;
+    switch (FindInterestingPart::findMainPartOfMessage(message, mainPart, partMessage, 0)) {
+    case FindInterestingPart::MAINPART_MESSAGE_NOT_LOADED:
+        return;
+    case FindInterestingPart::MAINPART_FOUND:
+    case FindInterestingPart::MAINPART_PART_CANNOT_DETERMINE:
+        break;
+    case FindInterestingPart::MAINPART_PART_LOADING:
+    {
+        const qint64 octets = mainPart.data(RolePartOctets).toUInt();
+        if (m_byteBudget >= 0 && m_bytesRequested + octets > m_byteBudget) {
+            m_model->logTrace(0, Common::LOG_OTHER, QLatin1String("OfflineSyncScheduler"),
+                              QString::fromUtf8("Byte budget exhausted after %1 bytes").arg(QString::number(m_bytesRequested)));
+            stop();
+            emit finished();
+            return;
+        }
+        // Either gets served from the cache, or a download is queued. Asking for the file name rather than the data
+        // themselves means that huge parts in the disk cache do not get read into memory.
+        mainPart.data(RolePartDataFileName);
+        if (!mainPart.data(RoleIsFetched).toBool())
+            m_bytesRequested += octets;
+        break;
+    }
+    }
+
+    ++m_currentRow;
+    m_stalledTicks = 0;
+}
+
+}
+
+}
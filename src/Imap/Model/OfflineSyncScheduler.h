@@ -0,0 +1,114 @@
+/* Copyright (C) 2006 - 2014 Jan Kundrát <jkt@flaska.net>
+
+   This file is part of the Trojita Qt IMAP e-mail client,
+   http://trojita.flaska.net/
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2 of
+   the License or (at your option) version 3 or any later version
+   accepted by the membership of KDE e.V. (or its successor approved
+   by the membership of KDE e.V.), which shall act as a proxy
+   defined in Section 14 of version 3 of the license.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef IMAP_MODEL_OFFLINESYNCSCHEDULER_H
+#define IMAP_MODEL_OFFLINESYNCSCHEDULER_H
+
+#include <QPersistentModelIndex>
+#include <QStringList>
+
+class QTimer;
+
+namespace Imap
+{
+
+namespace Mailbox
+{
+
+class MailboxFinder;
+class Model;
+
+/** @short Mirror a configured set of mailboxes into the offline cache in the background
+
+The Model only downloads data when somebody asks for them, which typically means that the GUI has to show a message before
+it gets fetched. This class walks the configured mailboxes one after another and requests the message metadata (the
+ENVELOPE and BODYSTRUCTURE) and the main textual part of each message. Everything is requested through the regular MVC
+API, so the data end up in the Model's cache exactly as if the user had looked at them.
+
+The work is split into small steps which are performed from a timer, one message at a time, so the scheduler never floods
+the connection. The pace is reduced when the network is marked as expensive and the whole process pauses while the Model
+is offline. Once the configured number of bytes of message bodies has been requested, the scheduler stops.
+
+The scheduler reserves one connection of the pool for itself and opens each mailbox through
+Model::openMailboxInBackground(), so the mailbox shown in the GUI is left alone. Once the scheduler stops, that connection
+is logged out so that the last mirrored mailbox does not remain open.
+*/
+class OfflineSyncScheduler : public QObject
+{
+    Q_OBJECT
+public:
+    OfflineSyncScheduler(QObject *parent, Model *model);
+
+    /** @short Specify which mailboxes shall be mirrored; the synchronization restarts from the first one */
+    void setMailboxes(const QStringList &mailboxes);
+    /** @short Stop requesting message bodies after this many bytes; a negative value means no limit */
+    void setByteBudget(const qint64 bytes);
+    /** @short How many messages to process per second when the network is not metered */
+    void setRateLimit(const int messagesPerSecond);
+
+    /** @short Number of bytes of message bodies which were requested from the network so far */
+    qint64 bytesRequested() const;
+    /** @short Is the synchronization in progress? */
+    bool isActive() const;
+
+public slots:
+    /** @short Start over from the first mailbox */
+    void start();
+    /** @short Stop the synchronization */
+    void stop();
+
+signals:
+    /** @short All messages in the given mailbox have been requested */
+    void mailboxSynced(const QString &mailbox);
+    /** @short There's nothing more to do, either because all mailboxes were processed or because of the budget */
+    void finished();
+
+private slots:
+    void slotMailboxFound(const QString &mailbox, const QModelIndex &index);
+    void slotNetworkPolicyChanged();
+    void processNextMessage();
+
+private:
+    void nextMailbox();
+    void updateTimer();
+
+    Model *m_model;
+    MailboxFinder *m_finder;
+    QTimer *m_timer;
+    QStringList m_mailboxes;
+    QStringList m_pendingMailboxes;
+    QString m_currentMailboxName;
+    QPersistentModelIndex m_currentMailbox;
+    int m_currentRow;
+    qint64 m_byteBudget;
+    qint64 m_bytesRequested;
+    int m_rateLimit;
+    int m_stalledTicks;
+    bool m_active;
+    bool m_waitingForMailbox;
+};
+
+}
+
+}
+
+#endif // IMAP_MODEL_OFFLINESYNCSCHEDULER_H
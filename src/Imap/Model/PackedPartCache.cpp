@@ -0,0 +1,496 @@
+/* Copyright (C) 2006 - 2014 Jan Kundrát <jkt@flaska.net>
+
+   This file is part of the Trojita Qt IMAP e-mail client,
+   http://trojita.flaska.net/
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2 of
+   the License or (at your option) version 3 or any later version
+   accepted by the membership of KDE e.V. (or its successor approved
+   by the membership of KDE e.V.), which shall act as a proxy
+   defined in Section 14 of version 3 of the license.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "PackedPartCache.h"
+#include <QDataStream>
+#include <QDebug>
+#include <QDir>
+#include <QFile>
+#include <QTimer>
+
+namespace
+{
+/** @short Identification of the pack file format, "TPK1" */
+const quint32 packMagic = 0x54504b31;
+/** @short Size of the file header, ie. of the magic number */
+const qint64 packHeaderSize = sizeof(quint32);
+/** @short Don't bother compacting a pack unless there's at least this much garbage in it */
+const qint64 minimalGarbageForCompaction = 1024 * 1024;
+/** @short How many pack files to keep open and mapped at the same time */
+const int maxOpenPacks = 8;
+}
+
+namespace Imap
+{
+namespace Mailbox
+{
+
+PackedPartCache::PackedPartCache(QObject *parent, const QString &cacheDir): DiskPartCache(parent, cacheDir)
+{
+}
+
+PackedPartCache::~PackedPartCache()
+{
+    Q_FOREACH(Pack *p, m_packs) {
+        closePack(p);
+        delete p;
+    }
+}
+
+void PackedPartCache::clearAllMessages(const QString &mailbox)
+{
+    forgetPack(mailbox);
+    m_compactionPending.remove(mailbox);
+    if (QFile::exists(packFileName(mailbox)) && !QFile::remove(packFileName(mailbox))) {
+        emit error(tr("Couldn't remove the pack file for mailbox %1").arg(mailbox));
+    }
+    // Get rid of the leftovers from the time this mailbox was using one file per part
+    DiskPartCache::clearAllMessages(mailbox);
+    m_legacyFiles[mailbox] = false;
+}
+
+void PackedPartCache::clearMessage(const QString mailbox, const uint uid)
+{
+    if (hasLegacyFiles(mailbox))
+        DiskPartCache::clearMessage(mailbox, uid);
+
+    Pack *p = pack(mailbox, PACK_READ);
+    if (!p)
+        return;
+    QHash<uint, QHash<QString, Entry> >::iterator message = p->index.find(uid);
+    if (message == p->index.end())
+        return;
+    if (!appendRecord(p, RECORD_FORGET_MESSAGE, uid, QString(), QByteArray()))
+        return;
+    for (QHash<QString, Entry>::const_iterator it = message->constBegin(); it != message->constEnd(); ++it) {
+        p->liveBytes -= it->recordLength;
+    }
+    p->index.erase(message);
+    maybeScheduleCompaction(mailbox, p);
+}
+
+QByteArray PackedPartCache::messagePart(const QString &mailbox, const uint uid, const QString &partId) const
+{
+    Pack *p = pack(mailbox, PACK_READ);
+    if (p) {
+        QHash<uint, QHash<QString, Entry> >::const_iterator message = p->index.constFind(uid);
+        if (message != p->index.constEnd()) {
+            QHash<QString, Entry>::const_iterator entry = message->constFind(partId);
+            if (entry != message->constEnd()) {
+                const uchar *data = mappedData(p, *entry);
+                if (!data)
+                    return QByteArray();
+                return CacheCompression::decompress(data, entry->dataLength);
+            }
+        }
+    }
+    if (hasLegacyFiles(mailbox))
+        return DiskPartCache::messagePart(mailbox, uid, partId);
+    return QByteArray();
+}
+
+void PackedPartCache::setMsgPart(const QString &mailbox, const uint uid, const QString &partId, const QByteArray &data)
+{
+    if (hasLegacyFiles(mailbox))
+        DiskPartCache::forgetMessagePart(mailbox, uid, partId);
+
+    Pack *p = pack(mailbox, PACK_WRITE);
+    if (!p)
+        return;
+    appendRecord(p, RECORD_PART, uid, partId, m_compression.compress(data));
+    maybeScheduleCompaction(mailbox, p);
+}
+
+void PackedPartCache::forgetMessagePart(const QString &mailbox, const uint uid, const QString &partId)
+{
+    if (hasLegacyFiles(mailbox))
+        DiskPartCache::forgetMessagePart(mailbox, uid, partId);
+
+    Pack *p = pack(mailbox, PACK_READ);
+    if (!p)
+        return;
+    QHash<uint, QHash<QString, Entry> >::iterator message = p->index.find(uid);
+    if (message == p->index.end() || !message->contains(partId))
+        return;
+    appendRecord(p, RECORD_FORGET_PART, uid, partId, QByteArray());
+    maybeScheduleCompaction(mailbox, p);
+}
+
+bool PackedPartCache::setMsgPartEncoded(const QString &mailbox, const uint uid, const QString &partId,
+                                        const QByteArray &encodedData, const QByteArray &encoding)
+{
+    Q_UNUSED(mailbox);
+    Q_UNUSED(uid);
+    Q_UNUSED(partId);
+    Q_UNUSED(encodedData);
+    Q_UNUSED(encoding);
+    return false;
+}
+
+QString PackedPartCache::messagePartFileName(const QString &mailbox, const uint uid, const QString &partId) const
+{
+    if (!hasLegacyFiles(mailbox))
+        return QString();
+    return DiskPartCache::messagePartFileName(mailbox, uid, partId);
+}
+
+/** @short Return an opened pack for the mailbox
+
+A pack which doesn't exist yet is only created when it is needed for writing.
+*/
+PackedPartCache::Pack *PackedPartCache::pack(const QString &mailbox, const PackAccess access) const
+{
+    Pack *p = m_packs.value(mailbox);
+    if (p)
+        return ensureOpen(mailbox, p) ? p : 0;
+
+    if (access == PACK_READ && !QFile::exists(packFileName(mailbox)))
+        return 0;
+
+    if (access == PACK_WRITE)
+        QDir().mkpath(dirForMailbox(mailbox));
+    p = new Pack();
+    if (!ensureOpen(mailbox, p)) {
+        delete p;
+        return 0;
+    }
+    if (!scan(p)) {
+        // It's just a cache, so start from scratch if the file is not usable
+        p->index.clear();
+        p->liveBytes = 0;
+        p->file->resize(0);
+        p->file->seek(0);
+        QDataStream stream(p->file);
+        stream << packMagic;
+    }
+    m_packs[mailbox] = p;
+    return p;
+}
+
+/** @short Open the pack file if it isn't open already, closing the least recently used packs if there are too many */
+bool PackedPartCache::ensureOpen(const QString &mailbox, Pack *p) const
+{
+    if (p->file) {
+        if (m_openPacks.last() != mailbox) {
+            m_openPacks.removeOne(mailbox);
+            m_openPacks.append(mailbox);
+        }
+        return true;
+    }
+
+    while (m_openPacks.size() >= maxOpenPacks) {
+        Pack *victim = m_packs.value(m_openPacks.takeFirst());
+        Q_ASSERT(victim);
+        closePack(victim);
+    }
+
+    p->file = new QFile(packFileName(mailbox));
+    if (!p->file->open(QIODevice::ReadWrite)) {
+        emit const_cast<PackedPartCache *>(this)->error(tr("Couldn't open the pack file %1: %2").arg(
+                                                            p->file->fileName(), p->file->errorString()));
+        delete p->file;
+        p->file = 0;
+        return false;
+    }
+    m_openPacks.append(mailbox);
+    return true;
+}
+
+/** @short Close the pack and forget its index */
+void PackedPartCache::forgetPack(const QString &mailbox)
+{
+    Pack *p = m_packs.take(mailbox);
+    if (!p)
+        return;
+    m_openPacks.removeOne(mailbox);
+    closePack(p);
+    delete p;
+}
+
+/** @short Find out whether the DiskPartCache has left any files in the directory of this mailbox
+
+The directory is only listed once; afterwards, the leftovers are assumed to be present until the mailbox gets cleared.
+*/
+bool PackedPartCache::hasLegacyFiles(const QString &mailbox) const
+{
+    QHash<QString, bool>::const_iterator it = m_legacyFiles.constFind(mailbox);
+    if (it != m_legacyFiles.constEnd())
+        return *it;
+    const bool present = !QDir(dirForMailbox(mailbox)).entryList(
+                QStringList() << QLatin1String("*.cache") << QLatin1String("*.data"), QDir::Files).isEmpty();
+    m_legacyFiles[mailbox] = present;
+    return present;
+}
+
+/** @short Rebuild the index of a pack by walking through the headers of all records */
+bool PackedPartCache::scan(Pack *p) const
+{
+    const qint64 size = p->file->size();
+    if (size < packHeaderSize)
+        return false;
+
+    p->file->seek(0);
+    QDataStream stream(p->file);
+    quint32 magic;
+    stream >> magic;
+    if (magic != packMagic)
+        return false;
+
+    qint64 pos = packHeaderSize;
+    while (pos < size) {
+        quint8 kind;
+        quint32 uid;
+        QString partId;
+        quint32 dataLength;
+        stream >> kind >> uid >> partId >> dataLength;
+        const qint64 dataOffset = p->file->pos();
+        if (stream.status() != QDataStream::Ok || dataOffset + dataLength > size
+                || kind < RECORD_PART || kind > RECORD_FORGET_MESSAGE) {
+            // A record which was not written completely, most likely because of a crash; throw it away
+            qDebug() << "PackedPartCache: truncating" << p->file->fileName() << "at" << pos;
+            p->file->resize(pos);
+            break;
+        }
+        Entry entry;
+        entry.dataOffset = dataOffset;
+        entry.dataLength = dataLength;
+        entry.recordLength = dataOffset + dataLength - pos;
+
+        switch (kind) {
+        case RECORD_PART:
+        {
+            QHash<QString, Entry> &message = p->index[uid];
+            QHash<QString, Entry>::const_iterator old = message.constFind(partId);
+            if (old != message.constEnd())
+                p->liveBytes -= old->recordLength;
+            message[partId] = entry;
+            p->liveBytes += entry.recordLength;
+            break;
+        }
+        case RECORD_FORGET_PART:
+        {
+            QHash<uint, QHash<QString, Entry> >::iterator message = p->index.find(uid);
+            if (message != p->index.end()) {
+                QHash<QString, Entry>::iterator old = message->find(partId);
+                if (old != message->end()) {
+                    p->liveBytes -= old->recordLength;
+                    message->erase(old);
+                }
+                if (message->isEmpty())
+                    p->index.erase(message);
+            }
+            break;
+        }
+        case RECORD_FORGET_MESSAGE:
+        {
+            QHash<uint, QHash<QString, Entry> >::iterator message = p->index.find(uid);
+            if (message != p->index.end()) {
+                for (QHash<QString, Entry>::const_iterator it = message->constBegin(); it != message->constEnd(); ++it)
+                    p->liveBytes -= it->recordLength;
+                p->index.erase(message);
+            }
+            break;
+        }
+        }
+
+        pos = dataOffset + dataLength;
+        p->file->seek(pos);
+    }
+    return true;
+}
+
+/** @short Append a record to the end of the pack and update the index accordingly */
+bool PackedPartCache::appendRecord(Pack *p, const RecordKind kind, const uint uid, const QString &partId, const QByteArray &data)
+{
+    Entry entry;
+    if (!writeRecord(p->file, kind, uid, partId, data, &entry)) {
+        emit error(tr("Couldn't write into the pack file %1: %2").arg(p->file->fileName(), p->file->errorString()));
+        return false;
+    }
+
+    switch (kind) {
+    case RECORD_PART:
+    {
+        QHash<QString, Entry> &message = p->index[uid];
+        QHash<QString, Entry>::const_iterator old = message.constFind(partId);
+        if (old != message.constEnd())
+            p->liveBytes -= old->recordLength;
+        message[partId] = entry;
+        p->liveBytes += entry.recordLength;
+        break;
+    }
+    case RECORD_FORGET_PART:
+    {
+        QHash<uint, QHash<QString, Entry> >::iterator message = p->index.find(uid);
+        Q_ASSERT(message != p->index.end());
+        QHash<QString, Entry>::iterator old = message->find(partId);
+        Q_ASSERT(old != message->end());
+        p->liveBytes -= old->recordLength;
+        message->erase(old);
+        if (message->isEmpty())
+            p->index.erase(message);
+        break;
+    }
+    case RECORD_FORGET_MESSAGE:
+        // The caller takes care of the index
+        break;
+    }
+    return true;
+}
+
+/** @short Write a complete record at the end of the file and report where its data ended up */
+bool PackedPartCache::writeRecord(QFile *file, const RecordKind kind, const uint uid, const QString &partId,
+                                  const QByteArray &data, Entry *entry) const
+{
+    QByteArray header;
+    QDataStream stream(&header, QIODevice::WriteOnly);
+    stream << static_cast<quint8>(kind) << static_cast<quint32>(uid) << partId << static_cast<quint32>(data.size());
+
+    const qint64 pos = file->size();
+    if (!file->seek(pos))
+        return false;
+    if (file->write(header) != header.size() || file->write(data) != data.size() || !file->flush()) {
+        // Make sure that a partial record doesn't stay around
+        file->resize(pos);
+        return false;
+    }
+    entry->dataOffset = pos + header.size();
+    entry->dataLength = data.size();
+    entry->recordLength = header.size() + data.size();
+    return true;
+}
+
+/** @short Return a pointer to the data of a record, extending the memory mapping if needed */
+const uchar *PackedPartCache::mappedData(Pack *p, const Entry &entry) const
+{
+    if (entry.dataOffset + entry.dataLength > p->mappedSize) {
+        if (p->map) {
+            p->file->unmap(p->map);
+            p->map = 0;
+            p->mappedSize = 0;
+        }
+        const qint64 size = p->file->size();
+        p->map = p->file->map(0, size);
+        if (!p->map) {
+            emit const_cast<PackedPartCache *>(this)->error(tr("Couldn't map the pack file %1: %2").arg(
+                                                                p->file->fileName(), p->file->errorString()));
+            return 0;
+        }
+        p->mappedSize = size;
+    }
+    return p->map + entry.dataOffset;
+}
+
+void PackedPartCache::closePack(Pack *p) const
+{
+    if (p->map)
+        p->file->unmap(p->map);
+    p->map = 0;
+    p->mappedSize = 0;
+    delete p->file;
+    p->file = 0;
+}
+
+void PackedPartCache::maybeScheduleCompaction(const QString &mailbox, Pack *p)
+{
+    const qint64 garbage = p->file->size() - packHeaderSize - p->liveBytes;
+    if (garbage < minimalGarbageForCompaction || garbage < p->liveBytes)
+        return;
+    if (m_compactionPending.isEmpty())
+        QTimer::singleShot(0, this, SLOT(compactPendingPacks()));
+    m_compactionPending.insert(mailbox);
+}
+
+void PackedPartCache::compactPendingPacks()
+{
+    Q_FOREACH(const QString &mailbox, m_compactionPending) {
+        Pack *p = m_packs.value(mailbox);
+        if (p && (!ensureOpen(mailbox, p) || !compact(mailbox, p))) {
+            // Compaction failed, so forget everything about this pack
+            clearAllMessages(mailbox);
+        }
+    }
+    m_compactionPending.clear();
+}
+
+/** @short Copy all live records of a pack into a fresh file which then replaces the original one */
+bool PackedPartCache::compact(const QString &mailbox, Pack *p)
+{
+    const QString fileName = packFileName(mailbox);
+    QFile newFile(fileName + QLatin1String(".new"));
+    if (!newFile.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+        emit error(tr("Couldn't compact the pack file %1: %2").arg(newFile.fileName(), newFile.errorString()));
+        return false;
+    }
+    {
+        QDataStream stream(&newFile);
+        stream << packMagic;
+    }
+
+    QHash<uint, QHash<QString, Entry> > newIndex;
+    qint64 newLiveBytes = 0;
+    for (QHash<uint, QHash<QString, Entry> >::const_iterator message = p->index.constBegin();
+         message != p->index.constEnd(); ++message) {
+        for (QHash<QString, Entry>::const_iterator it = message->constBegin(); it != message->constEnd(); ++it) {
+            const uchar *data = mappedData(p, *it);
+            Entry entry;
+            if (!data || !writeRecord(&newFile, RECORD_PART, message.key(), it.key(),
+                                      QByteArray::fromRawData(reinterpret_cast<const char *>(data), it->dataLength), &entry)) {
+                emit error(tr("Couldn't compact the pack file %1: %2").arg(newFile.fileName(), newFile.errorString()));
+                newFile.remove();
+                return false;
+            }
+            newIndex[message.key()][it.key()] = entry;
+            newLiveBytes += entry.recordLength;
+        }
+    }
+    newFile.close();
+
+    closePack(p);
+    QFile::remove(fileName);
+    if (!newFile.rename(fileName)) {
+        emit error(tr("Couldn't replace the pack file %1: %2").arg(fileName, newFile.errorString()));
+        newFile.remove();
+        forgetPack(mailbox);
+        return true;
+    }
+
+    p->file = new QFile(fileName);
+    if (!p->file->open(QIODevice::ReadWrite)) {
+        emit error(tr("Couldn't open the pack file %1: %2").arg(fileName, p->file->errorString()));
+        delete p->file;
+        p->file = 0;
+        forgetPack(mailbox);
+        return true;
+    }
+    p->index = newIndex;
+    p->liveBytes = newLiveBytes;
+    return true;
+}
+
+QString PackedPartCache::packFileName(const QString &mailbox) const
+{
+    return dirForMailbox(mailbox) + QLatin1String("/parts.pack");
+}
+
+}
+}
@@ -0,0 +1,143 @@
+/* Copyright (C) 2006 - 2014 Jan Kundrát <jkt@flaska.net>
+
+   This file is part of the Trojita Qt IMAP e-mail client,
+   http://trojita.flaska.net/
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2 of
+   the License or (at your option) version 3 or any later version
+   accepted by the membership of KDE e.V. (or its successor approved
+   by the membership of KDE e.V.), which shall act as a proxy
+   defined in Section 14 of version 3 of the license.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef IMAP_MODEL_PACKEDPARTCACHE_H
+#define IMAP_MODEL_PACKEDPARTCACHE_H
+
+#include <QHash>
+#include <QList>
+#include <QSet>
+#include "DiskPartCache.h"
+
+class QFile;
+
+namespace Imap
+{
+
+namespace Mailbox
+{
+
+/** @short Cache for big message parts which keeps all parts of a mailbox in a single append-only file
+
+The DiskPartCache uses one file per message part, which gets slow once there are hundreds of thousands of them. This
+class stores all parts of one mailbox in a "pack" file instead. New data and deletions are only ever appended to that
+file; deleting a part or a whole message writes a small tombstone record. The index of the pack is rebuilt by scanning
+the record headers when the pack is used for the first time, and the data are read through a memory mapping.
+
+Once a pack consists mostly of deleted data, it gets compacted from the event loop by copying the live records into a
+new file.
+
+Looking up data never creates a pack; the file is only created when something is written into it. The index of each
+pack stays in memory, but only a few recently used pack files are kept open and mapped at any given time.
+
+Parts which were stored in separate files by the DiskPartCache before the mailbox switched to a pack are still found
+and removed through the methods of the base class, until the mailbox gets cleared or those parts get replaced.
+
+The on-disk format is a header followed by a sequence of records:
+- quint8 record kind (part data, forgotten part, forgotten message),
+- quint32 UID,
+- QString part ID (as serialized by QDataStream),
+- quint32 length of the data, followed by the data compressed by CacheCompression.
+*/
+class PackedPartCache : public DiskPartCache
+{
+    Q_OBJECT
+public:
+    PackedPartCache(QObject *parent, const QString &cacheDir);
+    virtual ~PackedPartCache();
+
+    virtual void clearAllMessages(const QString &mailbox);
+    virtual void clearMessage(const QString mailbox, const uint uid);
+
+    virtual QByteArray messagePart(const QString &mailbox, const uint uid, const QString &partId) const;
+    virtual void setMsgPart(const QString &mailbox, const uint uid, const QString &partId, const QByteArray &data);
+    virtual void forgetMessagePart(const QString &mailbox, const uint uid, const QString &partId);
+
+    /** @short Not supported, the data always live inside the pack */
+    virtual bool setMsgPartEncoded(const QString &mailbox, const uint uid, const QString &partId,
+                                   const QByteArray &encodedData, const QByteArray &encoding);
+    /** @short Only the files created by the DiskPartCache in the past are supported, new data always live inside the pack */
+    virtual QString messagePartFileName(const QString &mailbox, const uint uid, const QString &partId) const;
+
+private slots:
+    /** @short Rewrite all packs which were found to contain too much garbage */
+    void compactPendingPacks();
+
+private:
+    typedef enum {
+        RECORD_PART = 1,
+        RECORD_FORGET_PART = 2,
+        RECORD_FORGET_MESSAGE = 3
+    } RecordKind;
+
+    /** @short Location of one part's data in the pack */
+    struct Entry {
+        qint64 dataOffset;
+        quint32 dataLength;
+        quint32 recordLength;
+    };
+
+    /** @short Whether a pack is needed for looking up data, or for writing into it */
+    typedef enum {
+        PACK_READ,
+        PACK_WRITE
+    } PackAccess;
+
+    /** @short A pack of one mailbox; the file and its mapping are only present while the pack is open */
+    struct Pack {
+        QFile *file;
+        uchar *map;
+        qint64 mappedSize;
+        QHash<uint, QHash<QString, Entry> > index;
+        /** @short Number of bytes occupied by records which are still in use */
+        qint64 liveBytes;
+
+        Pack(): file(0), map(0), mappedSize(0), liveBytes(0) {}
+    };
+
+    Pack *pack(const QString &mailbox, const PackAccess access) const;
+    bool ensureOpen(const QString &mailbox, Pack *p) const;
+    void forgetPack(const QString &mailbox);
+    bool hasLegacyFiles(const QString &mailbox) const;
+    bool scan(Pack *p) const;
+    bool appendRecord(Pack *p, const RecordKind kind, const uint uid, const QString &partId, const QByteArray &data);
+    bool writeRecord(QFile *file, const RecordKind kind, const uint uid, const QString &partId, const QByteArray &data,
+                     Entry *entry) const;
+    const uchar *mappedData(Pack *p, const Entry &entry) const;
+    void closePack(Pack *p) const;
+    void maybeScheduleCompaction(const QString &mailbox, Pack *p);
+    bool compact(const QString &mailbox, Pack *p);
+    QString packFileName(const QString &mailbox) const;
+
+    mutable QHash<QString, Pack *> m_packs;
+    /** @short Mailboxes whose pack file is open, the most recently used one at the end */
+    mutable QList<QString> m_openPacks;
+    /** @short Whether there are any files left over from the DiskPartCache in a mailbox's directory */
+    mutable QHash<QString, bool> m_legacyFiles;
+    QSet<QString> m_compactionPending;
+};
+
+}
+
+}
+
+#endif /* IMAP_MODEL_PACKEDPARTCACHE_H */
@@ -55,6 +55,9 @@ struct ParserState {
     /** @short Is the connection currently being processed? */
     int processingDepth;
 
+    /** @short Number of messages whose metadata did not have to be fetched because they went out of view in time */
+    uint withdrawnEnvelopeRequests;
+
     ParserState(Parser *parser);
     ParserState();
 };
@@ -0,0 +1,200 @@
+/* Copyright (C) 2006 - 2014 Jan Kundrát <jkt@flaska.net>
+
+   This file is part of the Trojita Qt IMAP e-mail client,
+   http://trojita.flaska.net/
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2 of
+   the License or (at your option) version 3 or any later version
+   accepted by the membership of KDE e.V. (or its successor approved
+   by the membership of KDE e.V.), which shall act as a proxy
+   defined in Section 14 of version 3 of the license.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <cmath>
+#include "PrefetchWindow.h"
+
+namespace
+{
+
+/** @short Scrolling is considered finished when the viewport hasn't moved for this long */
+const int idleAfter = 1000;
+
+/** @short Assumed round trip before the first fetch completes */
+const double initialLatency = 200;
+
+/** @short Weight of the newest sample in the moving averages */
+const double smoothing = 0.3;
+
+/** @short The look-ahead grows up to this multiple of the base size */
+const int maxWindowFactor = 20;
+
+/** @short Fetches have to differ in size at least this much before the transfer time can be told apart from the latency */
+const double minMessagesVariance = 1;
+
+}
+
+namespace Imap
+{
+
+namespace Mailbox
+{
+
+PrefetchWindow::PrefetchWindow():
+    m_baseSize(50), m_hasViewport(false), m_first(0), m_last(0), m_lastChange(0), m_velocity(0),
+    m_samples(0), m_avgMessages(0), m_avgMsecs(0), m_avgMessagesSq(0), m_avgProduct(0), m_latency(initialLatency),
+    m_msecsPerMessage(0)
+{
+}
+
+void PrefetchWindow::reset()
+{
+    m_hasViewport = false;
+    m_first = m_last = 0;
+    m_lastChange = 0;
+    m_velocity = 0;
+}
+
+void PrefetchWindow::setBaseSize(const int rows)
+{
+    m_baseSize = qMax(0, rows);
+}
+
+int PrefetchWindow::baseSize() const
+{
+    return m_baseSize;
+}
+
+bool PrefetchWindow::viewportChanged(const int first, const int last, const qint64 timestamp)
+{
+    Q_ASSERT(first <= last);
+    bool jumped = false;
+    if (m_hasViewport) {
+        const int page = m_last - m_first + 1;
+        const int delta = first - m_first;
+        const qint64 elapsed = timestamp - m_lastChange;
+        if (qAbs(delta) > page + qMax(lookAhead(timestamp), m_baseSize)) {
+            // The view has left the area which we have preloaded (a click into the scrollbar, the "End" key,...), so the old
+            // velocity is meaningless now
+            jumped = true;
+            m_velocity = 0;
+        } else if (elapsed > 0 && elapsed < idleAfter) {
+            const double current = static_cast<double>(delta) / elapsed;
+            m_velocity = m_velocity * (1 - smoothing) + current * smoothing;
+        } else {
+            // Either the clock went backwards, or the scrolling has just started again after a pause
+            m_velocity = elapsed > 0 ? static_cast<double>(delta) / idleAfter : 0;
+        }
+    }
+    m_hasViewport = true;
+    m_first = first;
+    m_last = last;
+    m_lastChange = timestamp;
+    return jumped;
+}
+
+void PrefetchWindow::fetchCompleted(const int messages, const int msecs)
+{
+    if (messages <= 0 || msecs < 0)
+        return;
+
+    // Each sample is roughly "msecs = latency + messages * msecsPerMessage"; a least-squares fit over the moving averages
+    // separates the two parts
+    const double weight = m_samples ? smoothing : 1;
+    ++m_samples;
+    m_avgMessages = m_avgMessages * (1 - weight) + messages * weight;
+    m_avgMsecs = m_avgMsecs * (1 - weight) + msecs * weight;
+    m_avgMessagesSq = m_avgMessagesSq * (1 - weight) + static_cast<double>(messages) * messages * weight;
+    m_avgProduct = m_avgProduct * (1 - weight) + static_cast<double>(messages) * msecs * weight;
+
+    const double variance = m_avgMessagesSq - m_avgMessages * m_avgMessages;
+    if (variance >= minMessagesVariance) {
+        m_msecsPerMessage = qMax(0.0, (m_avgProduct - m_avgMessages * m_avgMsecs) / variance);
+    }
+    // Without fetches of different sizes, the whole duration is considered to be the latency
+    m_latency = qMax(0.0, m_avgMsecs - m_msecsPerMessage * m_avgMessages);
+}
+
+double PrefetchWindow::velocity(const qint64 now) const
+{
+    if (!m_hasViewport || now - m_lastChange > idleAfter || now < m_lastChange)
+        return 0;
+    return m_velocity;
+}
+
+int PrefetchWindow::lookAhead(const qint64 now) const
+{
+    const int page = m_hasViewport ? m_last - m_first + 1 : 0;
+    const int maxWindow = qMax(m_baseSize, page) * maxWindowFactor;
+    // The rows which will scroll into view before the data arrive, with a safety margin of two, and at least one more
+    // screen. The data arrive after the round trip plus the time it takes to transfer the requested rows themselves,
+    // i.e. needed = 2 * v * (latency + needed * msecsPerMessage).
+    const double v = std::fabs(velocity(now));
+    const double backlog = 2 * v * m_msecsPerMessage;
+    if (backlog >= 1) {
+        // The user scrolls faster than the server can deliver
+        return maxWindow;
+    }
+    const double needed = 2 * v * m_latency / (1 - backlog);
+    return static_cast<int>(qMin(static_cast<double>(m_baseSize + page) + needed, static_cast<double>(maxWindow)));
+}
+
+int PrefetchWindow::rowsBefore(const qint64 now) const
+{
+    const double v = velocity(now);
+    if (v < 0)
+        return lookAhead(now);
+    else if (v > 0)
+        return qMin(m_baseSize, qMax(m_last - m_first + 1, m_baseSize / 5));
+    else
+        return m_baseSize;
+}
+
+int PrefetchWindow::rowsAfter(const qint64 now) const
+{
+    const double v = velocity(now);
+    if (v > 0)
+        return lookAhead(now);
+    else if (v < 0)
+        return qMin(m_baseSize, qMax(m_last - m_first + 1, m_baseSize / 5));
+    else
+        return m_baseSize;
+}
+
+bool PrefetchWindow::hasViewport() const
+{
+    return m_hasViewport;
+}
+
+int PrefetchWindow::firstVisible() const
+{
+    return m_first;
+}
+
+int PrefetchWindow::lastVisible() const
+{
+    return m_last;
+}
+
+int PrefetchWindow::latency() const
+{
+    return static_cast<int>(m_latency + 0.5);
+}
+
+int PrefetchWindow::throughput() const
+{
+    return m_msecsPerMessage > 0 ? static_cast<int>(1000 / m_msecsPerMessage + 0.5) : 0;
+}
+
+}
+
+}
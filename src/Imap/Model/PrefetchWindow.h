@@ -0,0 +1,122 @@
+/* Copyright (C) 2006 - 2014 Jan Kundrát <jkt@flaska.net>
+
+   This file is part of the Trojita Qt IMAP e-mail client,
+   http://trojita.flaska.net/
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2 of
+   the License or (at your option) version 3 or any later version
+   accepted by the membership of KDE e.V. (or its successor approved
+   by the membership of KDE e.V.), which shall act as a proxy
+   defined in Section 14 of version 3 of the license.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef IMAP_MODEL_PREFETCHWINDOW_H
+#define IMAP_MODEL_PREFETCHWINDOW_H
+
+#include <QtGlobal>
+#if QT_VERSION >= QT_VERSION_CHECK(4, 7, 0)
+#include <QElapsedTimer>
+#else
+#include <QTime>
+#endif
+
+namespace Imap
+{
+
+namespace Mailbox
+{
+
+/** @short Monotonic clock for the timestamps passed to the PrefetchWindow; Qt 4.6 doesn't have QElapsedTimer yet */
+#if QT_VERSION >= QT_VERSION_CHECK(4, 7, 0)
+typedef QElapsedTimer PrefetchClock;
+#else
+typedef QTime PrefetchClock;
+#endif
+
+/** @short Decide how many messages around the visible ones shall have their metadata preloaded
+
+Without any additional information, the window is symmetric and spans the configured base size in each direction, which is
+what the Model has always done. When the view reports its viewport through Model::setMessageListViewport(), the window
+follows the scrolling: it grows in the direction of the movement so that the rows which will become visible during the
+server's round trip are requested in advance, and it shrinks behind the viewport. Both the round trip time and the
+throughput, i.e. how many messages per second the server delivers, are learned from the completed metadata fetches by
+fitting their durations against the number of messages in them. A slow link means that the rows which are requested in
+advance take longer to arrive, so the window has to grow further.
+
+All timestamps are in milliseconds and only their differences matter.
+*/
+class PrefetchWindow
+{
+public:
+    PrefetchWindow();
+
+    /** @short Forget everything about the viewport, e.g. because another mailbox is being shown */
+    void reset();
+
+    /** @short How many messages to preload on each side when nothing else is known */
+    void setBaseSize(const int rows);
+    int baseSize() const;
+
+    /** @short The view now shows rows from @arg first to @arg last, inclusive
+
+    Returns true if the viewport has jumped rather than scrolled, i.e. if the new viewport is far from the previous one.
+    */
+    bool viewportChanged(const int first, const int last, const qint64 timestamp);
+
+    /** @short A fetch of metadata for @arg messages messages took @arg msecs milliseconds */
+    void fetchCompleted(const int messages, const int msecs);
+
+    /** @short Number of messages before the requested one which shall be preloaded */
+    int rowsBefore(const qint64 now) const;
+    /** @short Number of messages after the requested one which shall be preloaded */
+    int rowsAfter(const qint64 now) const;
+
+    bool hasViewport() const;
+    int firstVisible() const;
+    int lastVisible() const;
+
+    /** @short Estimated time of a metadata round trip, not counting the transfer of the data */
+    int latency() const;
+    /** @short Estimated number of messages per second which the server delivers, or zero if not known yet */
+    int throughput() const;
+
+private:
+    /** @short Current velocity in rows per millisecond, or zero if the user stopped scrolling */
+    double velocity(const qint64 now) const;
+    /** @short Number of rows to preload in the direction of the movement */
+    int lookAhead(const qint64 now) const;
+
+    int m_baseSize;
+    bool m_hasViewport;
+    int m_first;
+    int m_last;
+    qint64 m_lastChange;
+    double m_velocity;
+    /** @short Number of completed fetches which were taken into account */
+    int m_samples;
+    /** @short Moving averages of the number of messages, the duration, messages squared and messages times duration */
+    double m_avgMessages;
+    double m_avgMsecs;
+    double m_avgMessagesSq;
+    double m_avgProduct;
+    /** @short The fitted round trip time */
+    double m_latency;
+    /** @short The fitted transfer time of one message */
+    double m_msecsPerMessage;
+};
+
+}
+
+}
+
+#endif // IMAP_MODEL_PREFETCHWINDOW_H
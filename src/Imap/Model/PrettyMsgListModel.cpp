@@ -21,6 +21,7 @@
 */
 #include "PrettyMsgListModel.h"
 #include <QFont>
+#include <QStringList>
 #include "Gui/IconLoader.h"
 #include "ItemRoles.h"
 #include "MsgListModel.h"
@@ -34,9 +35,159 @@ namespace Imap
 namespace Mailbox
 {
 
-PrettyMsgListModel::PrettyMsgListModel(QObject *parent): QSortFilterProxyModel(parent), m_hideRead(false)
+PrettyMsgListModel::PrettyMsgListModel(QObject *parent):
+    QAbstractProxyModel(parent), m_hideRead(false), m_rowChangeInProgress(false), m_moveInProgress(false)
 {
-    setDynamicSortFilter(true);
+}
+
+void PrettyMsgListModel::setSourceModel(QAbstractItemModel *sourceModel)
+{
+    if (this->sourceModel()) {
+        this->sourceModel()->disconnect(this);
+    }
+
+    beginResetModel();
+    m_visibleThreads.clear();
+    m_sourceParents.clear();
+    Q_ASSERT(!sourceModel || qobject_cast<ThreadingMsgListModel*>(sourceModel));
+    QAbstractProxyModel::setSourceModel(sourceModel);
+    if (sourceModel) {
+        connect(sourceModel, SIGNAL(dataChanged(const QModelIndex &, const QModelIndex &)),
+                this, SLOT(handleDataChanged(const QModelIndex &, const QModelIndex &)));
+        connect(sourceModel, SIGNAL(headerDataChanged(Qt::Orientation, int, int)),
+                this, SIGNAL(headerDataChanged(Qt::Orientation, int, int)));
+        connect(sourceModel, SIGNAL(rowsAboutToBeInserted(const QModelIndex &, int, int)),
+                this, SLOT(handleRowsAboutToBeInserted(const QModelIndex &, int, int)));
+        connect(sourceModel, SIGNAL(rowsInserted(const QModelIndex &, int, int)),
+                this, SLOT(handleRowsInserted(const QModelIndex &, int, int)));
+        connect(sourceModel, SIGNAL(rowsAboutToBeRemoved(const QModelIndex &, int, int)),
+                this, SLOT(handleRowsAboutToBeRemoved(const QModelIndex &, int, int)));
+        connect(sourceModel, SIGNAL(rowsRemoved(const QModelIndex &, int, int)),
+                this, SLOT(handleRowsRemoved(const QModelIndex &, int, int)));
+        connect(sourceModel, SIGNAL(rowsAboutToBeMoved(const QModelIndex &, int, int, const QModelIndex &, int)),
+                this, SLOT(handleRowsAboutToBeMoved(const QModelIndex &, int, int, const QModelIndex &, int)));
+        connect(sourceModel, SIGNAL(rowsMoved(const QModelIndex &, int, int, const QModelIndex &, int)),
+                this, SLOT(handleRowsMoved(const QModelIndex &, int, int, const QModelIndex &, int)));
+        connect(sourceModel, SIGNAL(layoutAboutToBeChanged()), this, SLOT(handleLayoutAboutToBeChanged()));
+        connect(sourceModel, SIGNAL(layoutChanged()), this, SLOT(handleLayoutChanged()));
+        connect(sourceModel, SIGNAL(modelAboutToBeReset()), this, SLOT(handleModelAboutToBeReset()));
+        connect(sourceModel, SIGNAL(modelReset()), this, SLOT(handleModelReset()));
+        rebuildVisibleThreads();
+    }
+    endResetModel();
+}
+
+QModelIndex PrettyMsgListModel::index(int row, int column, const QModelIndex &parent) const
+{
+    if (!sourceModel() || row < 0 || column < 0)
+        return QModelIndex();
+
+    if (parent.isValid() && parent.model() != this)
+        return QModelIndex();
+
+    uint parentId = 0;
+    if (parent.isValid()) {
+        QModelIndex sourceParent = mapToSource(parent.sibling(parent.row(), 0));
+        if (!sourceParent.isValid() || row >= sourceModel()->rowCount(sourceParent))
+            return QModelIndex();
+        parentId = sourceParent.internalId();
+        Q_ASSERT(parentId);
+        if (!m_sourceParents.contains(parentId))
+            m_sourceParents[parentId] = sourceParent;
+    } else if (row >= m_visibleThreads.size()) {
+        return QModelIndex();
+    }
+
+    if (column >= sourceModel()->columnCount())
+        return QModelIndex();
+
+    return createIndex(row, column, parentId);
+}
+
+QModelIndex PrettyMsgListModel::parent(const QModelIndex &index) const
+{
+    if (!index.isValid() || index.model() != this || !index.internalId())
+        return QModelIndex();
+
+    QHash<uint, QPersistentModelIndex>::const_iterator it = m_sourceParents.constFind(index.internalId());
+    if (it == m_sourceParents.constEnd())
+        return QModelIndex();
+    return mapFromSource(*it);
+}
+
+int PrettyMsgListModel::rowCount(const QModelIndex &parent) const
+{
+    if (!sourceModel())
+        return 0;
+    if (!parent.isValid())
+        return m_visibleThreads.size();
+    if (parent.column() != 0)
+        return 0;
+    return sourceModel()->rowCount(mapToSource(parent));
+}
+
+int PrettyMsgListModel::columnCount(const QModelIndex &parent) const
+{
+    if (!sourceModel())
+        return 0;
+    return sourceModel()->columnCount(mapToSource(parent));
+}
+
+bool PrettyMsgListModel::hasChildren(const QModelIndex &parent) const
+{
+    if (!sourceModel())
+        return false;
+    if (!parent.isValid())
+        return !m_visibleThreads.isEmpty();
+    return sourceModel()->hasChildren(mapToSource(parent));
+}
+
+QModelIndex PrettyMsgListModel::mapToSource(const QModelIndex &proxyIndex) const
+{
+    if (!proxyIndex.isValid() || !sourceModel())
+        return QModelIndex();
+
+    Q_ASSERT(proxyIndex.model() == this);
+
+    if (!proxyIndex.internalId()) {
+        if (proxyIndex.row() >= m_visibleThreads.size())
+            return QModelIndex();
+        return sourceModel()->index(m_visibleThreads[proxyIndex.row()], proxyIndex.column());
+    }
+
+    QHash<uint, QPersistentModelIndex>::const_iterator it = m_sourceParents.constFind(proxyIndex.internalId());
+    if (it == m_sourceParents.constEnd() || !it->isValid())
+        return QModelIndex();
+    return sourceModel()->index(proxyIndex.row(), proxyIndex.column(), *it);
+}
+
+QModelIndex PrettyMsgListModel::mapFromSource(const QModelIndex &sourceIndex) const
+{
+    if (!sourceIndex.isValid() || !sourceModel())
+        return QModelIndex();
+
+    Q_ASSERT(sourceIndex.model() == sourceModel());
+
+    QModelIndex sourceParent = sourceIndex.parent();
+    uint parentId = 0;
+    if (sourceParent.isValid()) {
+        // Nested messages are visible as long as their thread is
+        QModelIndex root = sourceParent;
+        while (root.parent().isValid())
+            root = root.parent();
+        if (proxyRowForSourceRow(root.row()) == -1)
+            return QModelIndex();
+        parentId = sourceParent.internalId();
+        Q_ASSERT(parentId);
+        if (!m_sourceParents.contains(parentId))
+            m_sourceParents[parentId] = sourceParent;
+        return createIndex(sourceIndex.row(), sourceIndex.column(), parentId);
+    }
+
+    int row = proxyRowForSourceRow(sourceIndex.row());
+    if (row == -1)
+        return QModelIndex();
+    return createIndex(row, sourceIndex.column(), parentId);
 }
 
 QVariant PrettyMsgListModel::data(const QModelIndex &index, int role) const
@@ -198,7 +349,45 @@ QVariant PrettyMsgListModel::data(const QModelIndex &index, int role) const
     }
     }
 
-    return QSortFilterProxyModel::data(index, role);
+    return QAbstractProxyModel::data(index, role);
+}
+
+QVariant PrettyMsgListModel::headerData(int section, Qt::Orientation orientation, int role) const
+{
+    if (sourceModel()) {
+        return sourceModel()->headerData(section, orientation, role);
+    } else {
+        return QVariant();
+    }
+}
+
+#if QT_VERSION >= QT_VERSION_CHECK(5, 0, 0)
+QModelIndex PrettyMsgListModel::sibling(int row, int column, const QModelIndex &idx) const
+{
+    return index(row, column, idx.parent());
+}
+#endif
+
+QStringList PrettyMsgListModel::mimeTypes() const
+{
+    return sourceModel() ? sourceModel()->mimeTypes() : QStringList();
+}
+
+QMimeData *PrettyMsgListModel::mimeData(const QModelIndexList &indexes) const
+{
+    if (!sourceModel())
+        return 0;
+
+    QModelIndexList translated;
+    Q_FOREACH(const QModelIndex &idx, indexes) {
+        translated << mapToSource(idx);
+    }
+    return sourceModel()->mimeData(translated);
+}
+
+Qt::DropActions PrettyMsgListModel::supportedDropActions() const
+{
+    return sourceModel() ? sourceModel()->supportedDropActions() : Qt::DropActions(0);
 }
 
 /** @short Format a QDateTime for compact display in one column of the view */
@@ -238,24 +427,342 @@ QString PrettyMsgListModel::prettyFormatDate(const QDateTime &dateTime) const
 
 void PrettyMsgListModel::setHideRead(bool value)
 {
+    if (m_hideRead == value)
+        return;
     m_hideRead = value;
-    invalidateFilter();
+    if (sourceModel())
+        updateVisibleThreads(0, sourceModel()->rowCount() - 1);
 }
 
-bool PrettyMsgListModel::filterAcceptsRow(int source_row, const QModelIndex &source_parent) const
+/** @short Shall the thread whose root is at the given row of the source model be visible? */
+bool PrettyMsgListModel::acceptsThread(int sourceRow) const
 {
     if (!m_hideRead)
         return true;
 
-    QModelIndex source_index = sourceModel()->index(source_row, 0, source_parent);
+    QModelIndex root = sourceModel()->index(sourceRow, 0);
+    return root.data(RoleThreadRootWithUnreadMessages).toBool() || root.data(RoleMessageWasUnread).toBool();
+}
 
-    for (QModelIndex test = source_index; test.isValid(); test = test.parent())
-        if (test.data(RoleThreadRootWithUnreadMessages).toBool() || test.data(RoleMessageWasUnread).toBool())
-            return true;
+/** @short Return the proxy row of the first visible thread whose source row is not smaller than @arg sourceRow */
+int PrettyMsgListModel::firstProxyRowNotBefore(int sourceRow) const
+{
+    return qLowerBound(m_visibleThreads.constBegin(), m_visibleThreads.constEnd(), sourceRow) - m_visibleThreads.constBegin();
+}
+
+/** @short Return the proxy row of the top-level item at @arg sourceRow, or -1 when its thread is hidden */
+int PrettyMsgListModel::proxyRowForSourceRow(int sourceRow) const
+{
+    int row = firstProxyRowNotBefore(sourceRow);
+    return row < m_visibleThreads.size() && m_visibleThreads[row] == sourceRow ? row : -1;
+}
 
-    return false;
+/** @short Evaluate the filter for all threads without notifying anybody */
+void PrettyMsgListModel::rebuildVisibleThreads()
+{
+    m_visibleThreads.clear();
+    const int sourceRows = sourceModel()->rowCount();
+    m_visibleThreads.reserve(sourceRows);
+    for (int i = 0; i < sourceRows; ++i) {
+        if (acceptsThread(i))
+            m_visibleThreads.append(i);
+    }
 }
 
+/** @short Re-evaluate the filter for the given top-level rows of the source model
+
+Consecutive threads which change their visibility in the same direction are reported through a single signal.
+*/
+void PrettyMsgListModel::updateVisibleThreads(int firstSourceRow, int lastSourceRow)
+{
+    int sourceRow = firstSourceRow;
+    int proxyRow = firstProxyRowNotBefore(firstSourceRow);
+    while (sourceRow <= lastSourceRow) {
+        const bool visible = proxyRow < m_visibleThreads.size() && m_visibleThreads[proxyRow] == sourceRow;
+        if (visible == acceptsThread(sourceRow)) {
+            ++sourceRow;
+            if (visible)
+                ++proxyRow;
+            continue;
+        }
+
+        // Find the end of this run of changes
+        int runEnd = sourceRow + 1;
+        if (visible) {
+            while (runEnd <= lastSourceRow && proxyRow + runEnd - sourceRow < m_visibleThreads.size() &&
+                   m_visibleThreads[proxyRow + runEnd - sourceRow] == runEnd && !acceptsThread(runEnd)) {
+                ++runEnd;
+            }
+        } else {
+            while (runEnd <= lastSourceRow && (proxyRow == m_visibleThreads.size() || m_visibleThreads[proxyRow] != runEnd) &&
+                   acceptsThread(runEnd)) {
+                ++runEnd;
+            }
+        }
+        const int count = runEnd - sourceRow;
+
+        if (visible) {
+            beginRemoveRows(QModelIndex(), proxyRow, proxyRow + count - 1);
+            m_visibleThreads.remove(proxyRow, count);
+            endRemoveRows();
+        } else {
+            beginInsertRows(QModelIndex(), proxyRow, proxyRow + count - 1);
+            m_visibleThreads.insert(proxyRow, count, 0);
+            for (int i = 0; i < count; ++i)
+                m_visibleThreads[proxyRow + i] = sourceRow + i;
+            endInsertRows();
+            proxyRow += count;
+        }
+        sourceRow = runEnd;
+    }
+}
+
+/** @short Re-evaluate the filter for the thread which contains the @arg sourceIndex */
+void PrettyMsgListModel::updateThreadOf(const QModelIndex &sourceIndex)
+{
+    if (!m_hideRead || !sourceIndex.isValid())
+        return;
+
+    QModelIndex root = sourceIndex;
+    while (root.parent().isValid())
+        root = root.parent();
+    updateVisibleThreads(root.row(), root.row());
+}
+
+void PrettyMsgListModel::handleDataChanged(const QModelIndex &topLeft, const QModelIndex &bottomRight)
+{
+    Q_ASSERT(topLeft.parent() == bottomRight.parent());
+
+    QModelIndex sourceParent = topLeft.parent();
+    if (sourceParent.isValid()) {
+        QModelIndex proxyParent = mapFromSource(sourceParent);
+        if (!proxyParent.isValid())
+            return;
+        emit dataChanged(index(topLeft.row(), topLeft.column(), proxyParent),
+                         index(bottomRight.row(), bottomRight.column(), proxyParent));
+        return;
+    }
+
+    // The flags of a thread root, or of some message within its thread, have changed
+    if (m_hideRead)
+        updateVisibleThreads(topLeft.row(), bottomRight.row());
+
+    const int first = firstProxyRowNotBefore(topLeft.row());
+    const int last = firstProxyRowNotBefore(bottomRight.row() + 1) - 1;
+    if (first <= last)
+        emit dataChanged(index(first, topLeft.column()), index(last, bottomRight.column()));
+}
+
+void PrettyMsgListModel::handleRowsAboutToBeInserted(const QModelIndex &parent, int start, int end)
+{
+    Q_ASSERT(!m_rowChangeInProgress);
+    if (!parent.isValid()) {
+        // New threads are handled in one go once they are available in the source model
+        return;
+    }
+
+    QModelIndex proxyParent = mapFromSource(parent);
+    if (proxyParent.isValid()) {
+        beginInsertRows(proxyParent, start, end);
+        m_rowChangeInProgress = true;
+    }
+}
+
+void PrettyMsgListModel::handleRowsInserted(const QModelIndex &parent, int start, int end)
+{
+    if (parent.isValid()) {
+        if (m_rowChangeInProgress) {
+            m_rowChangeInProgress = false;
+            endInsertRows();
+        }
+        return;
+    }
+
+    // Shift the threads which come after the new ones and only then check which of the new threads are visible
+    const int count = end - start + 1;
+    for (QVector<int>::iterator it = m_visibleThreads.begin() + firstProxyRowNotBefore(start); it != m_visibleThreads.end(); ++it)
+        *it += count;
+    updateVisibleThreads(start, end);
+}
+
+void PrettyMsgListModel::handleRowsAboutToBeRemoved(const QModelIndex &parent, int start, int end)
+{
+    Q_ASSERT(!m_rowChangeInProgress);
+    if (parent.isValid()) {
+        QModelIndex proxyParent = mapFromSource(parent);
+        if (proxyParent.isValid()) {
+            beginRemoveRows(proxyParent, start, end);
+            m_rowChangeInProgress = true;
+        }
+        return;
+    }
+
+    const int first = firstProxyRowNotBefore(start);
+    const int last = firstProxyRowNotBefore(end + 1) - 1;
+    if (first <= last) {
+        beginRemoveRows(QModelIndex(), first, last);
+        m_rowChangeInProgress = true;
+    }
+}
+
+void PrettyMsgListModel::handleRowsRemoved(const QModelIndex &parent, int start, int end)
+{
+    if (!parent.isValid()) {
+        const int first = firstProxyRowNotBefore(start);
+        const int last = firstProxyRowNotBefore(end + 1) - 1;
+        m_visibleThreads.remove(first, last - first + 1);
+        const int count = end - start + 1;
+        for (QVector<int>::iterator it = m_visibleThreads.begin() + first; it != m_visibleThreads.end(); ++it)
+            *it -= count;
+    }
+
+    // Forget about the parents which are gone
+    for (QHash<uint, QPersistentModelIndex>::iterator it = m_sourceParents.begin(); it != m_sourceParents.end(); /* nothing */) {
+        if (it->isValid())
+            ++it;
+        else
+            it = m_sourceParents.erase(it);
+    }
+
+    if (m_rowChangeInProgress) {
+        m_rowChangeInProgress = false;
+        endRemoveRows();
+    }
+}
+
+void PrettyMsgListModel::handleRowsAboutToBeMoved(const QModelIndex &sourceParent, int sourceStart, int sourceEnd,
+                                                  const QModelIndex &destinationParent, int destinationRow)
+{
+    Q_ASSERT(!m_rowChangeInProgress);
+    Q_ASSERT(!m_moveInProgress);
+
+    // Whenever the rows cannot be moved within this model as well, they are removed here and inserted in handleRowsMoved()
+    if (sourceParent.isValid()) {
+        QModelIndex proxySourceParent = mapFromSource(sourceParent);
+        if (!proxySourceParent.isValid())
+            return;
+        if (destinationParent.isValid()) {
+            QModelIndex proxyDestinationParent = mapFromSource(destinationParent);
+            if (proxyDestinationParent.isValid()) {
+                m_moveInProgress = beginMoveRows(proxySourceParent, sourceStart, sourceEnd, proxyDestinationParent, destinationRow);
+                return;
+            }
+        }
+        beginRemoveRows(proxySourceParent, sourceStart, sourceEnd);
+        m_rowChangeInProgress = true;
+        return;
+    }
+
+    const int first = firstProxyRowNotBefore(sourceStart);
+    const int last = firstProxyRowNotBefore(sourceEnd + 1) - 1;
+    if (first > last)
+        return;
+    if (destinationParent.isValid()) {
+        beginRemoveRows(QModelIndex(), first, last);
+        m_rowChangeInProgress = true;
+    } else {
+        // Threads which stay at the top level keep their contents, and therefore their visibility as well
+        const int proxyDestinationRow = firstProxyRowNotBefore(destinationRow);
+        if (proxyDestinationRow < first || proxyDestinationRow > last + 1)
+            m_moveInProgress = beginMoveRows(QModelIndex(), first, last, QModelIndex(), proxyDestinationRow);
+    }
+}
+
+void PrettyMsgListModel::handleRowsMoved(const QModelIndex &sourceParent, int sourceStart, int sourceEnd,
+                                         const QModelIndex &destinationParent, int destinationRow)
+{
+    const int count = sourceEnd - sourceStart + 1;
+    if (!sourceParent.isValid()) {
+        // Take the threads out of the list of visible ones and put them back only if they remain at the top level
+        const int first = firstProxyRowNotBefore(sourceStart);
+        QVector<int> moved = m_visibleThreads.mid(first, firstProxyRowNotBefore(sourceEnd + 1) - first);
+        m_visibleThreads.remove(first, moved.size());
+        for (QVector<int>::iterator it = m_visibleThreads.begin() + first; it != m_visibleThreads.end(); ++it)
+            *it -= count;
+
+        if (!destinationParent.isValid()) {
+            // The destinationRow refers to the numbering from before the move
+            const int newStart = destinationRow > sourceEnd ? destinationRow - count : destinationRow;
+            const int proxyRow = firstProxyRowNotBefore(newStart);
+            for (QVector<int>::iterator it = m_visibleThreads.begin() + proxyRow; it != m_visibleThreads.end(); ++it)
+                *it += count;
+            m_visibleThreads.insert(proxyRow, moved.size(), 0);
+            for (int i = 0; i < moved.size(); ++i)
+                m_visibleThreads[proxyRow + i] = moved[i] + newStart - sourceStart;
+        }
+    } else if (!destinationParent.isValid()) {
+        for (QVector<int>::iterator it = m_visibleThreads.begin() + firstProxyRowNotBefore(destinationRow);
+             it != m_visibleThreads.end(); ++it) {
+            *it += count;
+        }
+    }
+
+    const bool movedHere = m_moveInProgress;
+    if (m_moveInProgress) {
+        m_moveInProgress = false;
+        endMoveRows();
+    } else if (m_rowChangeInProgress) {
+        m_rowChangeInProgress = false;
+        endRemoveRows();
+    }
+
+    if (!movedHere) {
+        if (destinationParent.isValid()) {
+            QModelIndex proxyDestinationParent = mapFromSource(destinationParent);
+            if (proxyDestinationParent.isValid()) {
+                beginInsertRows(proxyDestinationParent, destinationRow, destinationRow + count - 1);
+                endInsertRows();
+            }
+        } else if (sourceParent.isValid()) {
+            updateVisibleThreads(destinationRow, destinationRow + count - 1);
+        }
+    }
+
+    // Moving messages between threads might have changed whether these threads contain any unread messages
+    updateThreadOf(sourceParent);
+    updateThreadOf(destinationParent);
+}
+
+void PrettyMsgListModel::handleLayoutAboutToBeChanged()
+{
+    emit layoutAboutToBeChanged();
+
+    m_oldPersistentIndexes = persistentIndexList();
+    m_oldSourceIndexes.clear();
+    Q_FOREACH(const QModelIndex &idx, m_oldPersistentIndexes) {
+        m_oldSourceIndexes << QPersistentModelIndex(mapToSource(idx));
+    }
+}
+
+void PrettyMsgListModel::handleLayoutChanged()
+{
+    // The threads might have been reshuffled, and their contents might have changed, too
+    m_sourceParents.clear();
+    rebuildVisibleThreads();
+
+    Q_ASSERT(m_oldPersistentIndexes.size() == m_oldSourceIndexes.size());
+    QModelIndexList updatedIndexes;
+    Q_FOREACH(const QPersistentModelIndex &idx, m_oldSourceIndexes) {
+        updatedIndexes << mapFromSource(idx);
+    }
+    changePersistentIndexList(m_oldPersistentIndexes, updatedIndexes);
+    m_oldPersistentIndexes.clear();
+    m_oldSourceIndexes.clear();
+
+    emit layoutChanged();
+}
+
+void PrettyMsgListModel::handleModelAboutToBeReset()
+{
+    beginResetModel();
+}
+
+void PrettyMsgListModel::handleModelReset()
+{
+    m_sourceParents.clear();
+    rebuildVisibleThreads();
+    endResetModel();
+}
 
 void PrettyMsgListModel::sort(int column, Qt::SortOrder order)
 {
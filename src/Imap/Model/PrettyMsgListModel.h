@@ -22,7 +22,10 @@
 #ifndef PRETTYMSGLISTMODEL_H
 #define PRETTYMSGLISTMODEL_H
 
-#include <QSortFilterProxyModel>
+#include <QAbstractProxyModel>
+#include <QHash>
+#include <QPersistentModelIndex>
+#include <QVector>
 #include "Imap/Model/MailboxModel.h"
 
 namespace Imap
@@ -31,24 +34,87 @@ namespace Imap
 namespace Mailbox
 {
 
-/** @short A pretty proxy model which increases sexiness of the (Threaded)MsgListModel */
-class PrettyMsgListModel: public QSortFilterProxyModel
+/** @short A pretty proxy model which increases sexiness of the (Threaded)MsgListModel
+
+Apart from the pretty formatting, this model implements the "hide read messages" filter. The filter decides about whole
+threads -- if the thread root is accepted, all of its descendants are shown as well, otherwise the whole thread is hidden.
+That's why this model only keeps a sorted index of source rows of the visible thread roots and passes the nested items
+through unchanged.
+
+The index is updated incrementally; changes to the message flags only re-evaluate the affected rows and result in a minimal
+set of rows being inserted or removed. The source model has to be a ThreadingMsgListModel because the mapping relies on its
+stable internal IDs, with zero being reserved for the root.
+*/
+class PrettyMsgListModel: public QAbstractProxyModel
 {
     Q_OBJECT
 public:
     explicit PrettyMsgListModel(QObject *parent=0);
+
+    virtual void setSourceModel(QAbstractItemModel *sourceModel);
+
+    virtual QModelIndex index(int row, int column, const QModelIndex &parent=QModelIndex()) const;
+    virtual QModelIndex parent(const QModelIndex &index) const;
+    virtual int rowCount(const QModelIndex &parent=QModelIndex()) const;
+    virtual int columnCount(const QModelIndex &parent=QModelIndex()) const;
+    virtual bool hasChildren(const QModelIndex &parent=QModelIndex()) const;
+    virtual QModelIndex mapToSource(const QModelIndex &proxyIndex) const;
+    virtual QModelIndex mapFromSource(const QModelIndex &sourceIndex) const;
     virtual QVariant data(const QModelIndex &index, int role) const;
+    virtual QVariant headerData(int section, Qt::Orientation orientation, int role=Qt::DisplayRole) const;
+#if QT_VERSION >= QT_VERSION_CHECK(5, 0, 0)
+    virtual QModelIndex sibling(int row, int column, const QModelIndex &idx) const;
+#endif
+    virtual QStringList mimeTypes() const;
+    virtual QMimeData *mimeData(const QModelIndexList &indexes) const;
+    virtual Qt::DropActions supportedDropActions() const;
+
     void setHideRead(bool value);
-    virtual bool filterAcceptsRow(int source_row, const QModelIndex &source_parent) const;
     virtual void sort(int column, Qt::SortOrder order);
 
 signals:
     void sortingPreferenceChanged(int column, Qt::SortOrder order);
 
+private slots:
+    void handleDataChanged(const QModelIndex &topLeft, const QModelIndex &bottomRight);
+    void handleRowsAboutToBeInserted(const QModelIndex &parent, int start, int end);
+    void handleRowsInserted(const QModelIndex &parent, int start, int end);
+    void handleRowsAboutToBeRemoved(const QModelIndex &parent, int start, int end);
+    void handleRowsRemoved(const QModelIndex &parent, int start, int end);
+    void handleRowsAboutToBeMoved(const QModelIndex &sourceParent, int sourceStart, int sourceEnd,
+                                  const QModelIndex &destinationParent, int destinationRow);
+    void handleRowsMoved(const QModelIndex &sourceParent, int sourceStart, int sourceEnd,
+                         const QModelIndex &destinationParent, int destinationRow);
+    void handleLayoutAboutToBeChanged();
+    void handleLayoutChanged();
+    void handleModelAboutToBeReset();
+    void handleModelReset();
+
 private:
     QString prettyFormatDate(const QDateTime &dateTime) const;
 
+    bool acceptsThread(int sourceRow) const;
+    int firstProxyRowNotBefore(int sourceRow) const;
+    int proxyRowForSourceRow(int sourceRow) const;
+    void rebuildVisibleThreads();
+    void updateVisibleThreads(int firstSourceRow, int lastSourceRow);
+    void updateThreadOf(const QModelIndex &sourceIndex);
+
     bool m_hideRead;
+
+    /** @short Sorted source rows of the visible top-level items */
+    QVector<int> m_visibleThreads;
+
+    /** @short Source parents of the nested items which we have handed out, indexed by their internal ID */
+    mutable QHash<uint, QPersistentModelIndex> m_sourceParents;
+
+    /** @short Is there a beginInsertRows() or beginRemoveRows() which waits for its counterpart? */
+    bool m_rowChangeInProgress;
+    /** @short Is there a beginMoveRows() which waits for its counterpart? */
+    bool m_moveInProgress;
+
+    QModelIndexList m_oldPersistentIndexes;
+    QList<QPersistentModelIndex> m_oldSourceIndexes;
 };
 
 }
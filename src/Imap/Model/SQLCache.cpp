@@ -129,6 +129,21 @@ if ( ! q.exec( QLatin1String("CREATE TABLE mailbox_sync_state ( " \
         return false; \
     }
 
+#define TROJITA_SQL_CACHE_CREATE_UID_MAPPING_LOG \
+    if (! q.exec(QLatin1String("CREATE TABLE uid_mapping_log (" \
+                               "id INTEGER PRIMARY KEY, " \
+                               "mailbox STRING NOT NULL, " \
+                               "expunged BINARY, " \
+                               "arrived BINARY" \
+                               ")"))) { \
+        emitError(SQLCache::tr("Can't create table uid_mapping_log"), q); \
+        return false; \
+    } \
+    if (! q.exec(QLatin1String("CREATE INDEX uid_mapping_log_mailbox ON uid_mapping_log (mailbox, id)"))) { \
+        emitError(SQLCache::tr("Can't create index uid_mapping_log_mailbox"), q); \
+        return false; \
+    }
+
 bool SQLCache::open(const QString &name, const QString &fileName)
 {
 #ifdef CACHE_DEBUG
@@ -207,7 +222,17 @@ bool SQLCache::open(const QString &name, const QString &fileName)
         }
     }
 
-    if (version != 6) {
+    if (version == 6) {
+        // V7 stores the changes to the UID mapping as a log on top of the full copy
+        TROJITA_SQL_CACHE_CREATE_UID_MAPPING_LOG;
+        version = 7;
+        if (! q.exec(QLatin1String("UPDATE trojita SET version = 7;"))) {
+            emitError(tr("Failed to update cache DB scheme from v6 to v7"), q);
+            return false;
+        }
+    }
+
+    if (version != 7) {
         emitError(tr("Unknown version"));
         return false;
     }
@@ -232,7 +257,7 @@ bool SQLCache::createTables()
         emitError(tr("Failed to prepare table structures"), q);
         return false;
     }
-    if (! q.exec(QLatin1String("INSERT INTO trojita ( version ) VALUES ( 6 )"))) {
+    if (! q.exec(QLatin1String("INSERT INTO trojita ( version ) VALUES ( 7 )"))) {
         emitError(tr("Can't store version info"), q);
         return false;
     }
@@ -256,6 +281,8 @@ bool SQLCache::createTables()
         return false;
     }
 
+    TROJITA_SQL_CACHE_CREATE_UID_MAPPING_LOG;
+
     TROJITA_SQL_CACHE_CREATE_MSG_METADATA;
 
     if (! q.exec(QLatin1String("CREATE TABLE flags ("
@@ -341,6 +368,31 @@ bool SQLCache::prepareQueries()
         return false;
     }
 
+    queryUidMappingLog = QSqlQuery(db);
+    if (! queryUidMappingLog.prepare(QLatin1String("SELECT expunged, arrived FROM uid_mapping_log WHERE mailbox = ? ORDER BY id"))) {
+        emitError(tr("Failed to prepare queryUidMappingLog"), queryUidMappingLog);
+        return false;
+    }
+
+    queryAppendUidMappingLog = QSqlQuery(db);
+    if (! queryAppendUidMappingLog.prepare(QLatin1String("INSERT INTO uid_mapping_log (mailbox, expunged, arrived) VALUES (?, ?, ?)"))) {
+        emitError(tr("Failed to prepare queryAppendUidMappingLog"), queryAppendUidMappingLog);
+        return false;
+    }
+
+    queryClearUidMappingLog = QSqlQuery(db);
+    if (! queryClearUidMappingLog.prepare(QLatin1String("DELETE FROM uid_mapping_log WHERE mailbox = ?"))) {
+        emitError(tr("Failed to prepare queryClearUidMappingLog"), queryClearUidMappingLog);
+        return false;
+    }
+
+    queryUidMappingLogLength = QSqlQuery(db);
+    if (! queryUidMappingLogLength.prepare(QLatin1String("SELECT (SELECT COUNT(*) FROM uid_mapping WHERE mailbox = ?), "
+                                                         "(SELECT COUNT(*) FROM uid_mapping_log WHERE mailbox = ?)"))) {
+        emitError(tr("Failed to prepare queryUidMappingLogLength"), queryUidMappingLogLength);
+        return false;
+    }
+
     queryMessageMetadata = QSqlQuery(db);
     if (! queryMessageMetadata.prepare(QLatin1String("SELECT data, lastAccessDate FROM msg_metadata WHERE mailbox = ? AND uid = ?"))) {
         emitError(tr("Failed to prepare queryMessageMetadata"), queryMessageMetadata);
@@ -371,6 +423,14 @@ bool SQLCache::prepareQueries()
         return false;
     }
 
+    querySetMessageFlagsBulk = QSqlQuery(db);
+    if (!querySetMessageFlagsBulk.prepare(bulkInsertStatement(QLatin1String("flags"),
+                                                              QStringList() << QLatin1String("mailbox") << QLatin1String("uid")
+                                                              << QLatin1String("flags"), bulkInsertRows))) {
+        emitError(tr("Failed to prepare querySetMessageFlagsBulk"), querySetMessageFlagsBulk);
+        return false;
+    }
+
     queryClearAllMessages1 = QSqlQuery(db);
     if (! queryClearAllMessages1.prepare(QLatin1String("DELETE FROM msg_metadata WHERE mailbox = ?"))) {
         emitError(tr("Failed to prepare queryClearAllMessages1"), queryClearAllMessages1);
@@ -574,12 +634,34 @@ QList<uint> SQLCache::uidMapping(const QString &mailbox) const
         emitError(tr("Query queryUidMapping failed"), queryUidMapping);
         return res;
     }
-    if (queryUidMapping.first()) {
-        QDataStream stream(qUncompress(queryUidMapping.value(0).toByteArray()));
-        stream.setVersion(streamVersion);
-        stream >> res;
+    if (!queryUidMapping.first()) {
+        // "No data present" doesn't necessarily imply a problem -- it simply might not be there yet :)
+        return res;
+    }
+    QDataStream stream(CacheCompression::decompress(queryUidMapping.value(0).toByteArray()));
+    stream.setVersion(streamVersion);
+    stream >> res;
+
+    // Replay whatever has changed since the full mapping was stored
+    queryUidMappingLog.bindValue(0, mailboxName(mailbox));
+    if (! queryUidMappingLog.exec()) {
+        emitError(tr("Query queryUidMappingLog failed"), queryUidMappingLog);
+        return QList<uint>();
+    }
+    while (queryUidMappingLog.next()) {
+        QList<uint> expunged, arrived;
+        QDataStream expungedStream(queryUidMappingLog.value(0).toByteArray());
+        expungedStream.setVersion(streamVersion);
+        expungedStream >> expunged;
+        QDataStream arrivedStream(queryUidMappingLog.value(1).toByteArray());
+        arrivedStream.setVersion(streamVersion);
+        arrivedStream >> arrived;
+        if (expungedStream.status() != QDataStream::Ok || arrivedStream.status() != QDataStream::Ok) {
+            emitError(tr("Corrupt data in the UID mapping log of mailbox %1").arg(mailbox));
+            return QList<uint>();
+        }
+        res = applyUidMappingUpdate(res, expunged, arrived);
     }
-    // "No data present" doesn't necessarily imply a problem -- it simply might not be there yet :)
     return res;
 }
 
@@ -594,9 +676,63 @@ void SQLCache::setUidMapping(const QString &mailbox, const QList<uint> &seqToUid
     QDataStream stream(&buf, QIODevice::ReadWrite);
     stream.setVersion(streamVersion);
     stream << seqToUid;
-    querySetUidMapping.bindValue(1, qCompress(buf));
+    querySetUidMapping.bindValue(1, m_compression.compress(buf));
     if (! querySetUidMapping.exec()) {
         emitError(tr("Query querySetUidMapping failed"), querySetUidMapping);
+        m_uidMappingLogLength.remove(mailbox);
+        return;
+    }
+    queryClearUidMappingLog.bindValue(0, mailboxName(mailbox));
+    if (! queryClearUidMappingLog.exec()) {
+        emitError(tr("Query queryClearUidMappingLog failed"), queryClearUidMappingLog);
+        m_uidMappingLogLength.remove(mailbox);
+        return;
+    }
+    m_uidMappingLogLength[mailbox] = 0;
+}
+
+void SQLCache::updateUidMapping(const QString &mailbox, const QList<uint> &expungedUids, const QList<uint> &newUids)
+{
+#ifdef CACHE_DEBUG
+    qDebug() << "Updating UID mapping for" << mailbox << ":" << expungedUids.size() << "expunged," << newUids.size() << "new";
+#endif
+    touchingDB();
+    QHash<QString, int>::iterator length = m_uidMappingLogLength.find(mailbox);
+    if (length == m_uidMappingLogLength.end()) {
+        queryUidMappingLogLength.bindValue(0, mailboxName(mailbox));
+        queryUidMappingLogLength.bindValue(1, mailboxName(mailbox));
+        if (! queryUidMappingLogLength.exec() || ! queryUidMappingLogLength.first()) {
+            emitError(tr("Query queryUidMappingLogLength failed"), queryUidMappingLogLength);
+            return;
+        }
+        const bool hasMapping = queryUidMappingLogLength.value(0).toInt() > 0;
+        length = m_uidMappingLogLength.insert(mailbox, hasMapping ? queryUidMappingLogLength.value(1).toInt() : -1);
+        queryUidMappingLogLength.finish();
+    }
+    if (*length < 0) {
+        // There's no full copy which the changes could apply to; the sync code will notice that the mapping doesn't match
+        // the number of messages and will throw it away
+        return;
+    }
+
+    QByteArray expungedBuf, arrivedBuf;
+    QDataStream expungedStream(&expungedBuf, QIODevice::WriteOnly);
+    expungedStream.setVersion(streamVersion);
+    expungedStream << expungedUids;
+    QDataStream arrivedStream(&arrivedBuf, QIODevice::WriteOnly);
+    arrivedStream.setVersion(streamVersion);
+    arrivedStream << newUids;
+    queryAppendUidMappingLog.bindValue(0, mailboxName(mailbox));
+    queryAppendUidMappingLog.bindValue(1, expungedBuf);
+    queryAppendUidMappingLog.bindValue(2, arrivedBuf);
+    if (! queryAppendUidMappingLog.exec()) {
+        emitError(tr("Query queryAppendUidMappingLog failed"), queryAppendUidMappingLog);
+        return;
+    }
+
+    if (++*length >= uidMappingCheckpointInterval) {
+        // Replaying a long log would make opening the mailbox slow, so it's time to store the full mapping again
+        setUidMapping(mailbox, uidMapping(mailbox));
     }
 }
 
@@ -610,6 +746,11 @@ void SQLCache::clearUidMapping(const QString &mailbox)
     if (! queryClearUidMapping.exec()) {
         emitError(tr("Query queryClearUidMapping failed"), queryClearUidMapping);
     }
+    queryClearUidMappingLog.bindValue(0, mailboxName(mailbox));
+    if (! queryClearUidMappingLog.exec()) {
+        emitError(tr("Query queryClearUidMappingLog failed"), queryClearUidMappingLog);
+    }
+    m_uidMappingLogLength[mailbox] = -1;
 }
 
 void SQLCache::clearAllMessages(const QString &mailbox)
@@ -696,6 +837,35 @@ void SQLCache::setMsgFlags(const QString &mailbox, const uint uid, const QString
     }
 }
 
+void SQLCache::setMsgFlagsBulk(const QString &mailbox, const QVector<QPair<uint, QStringList> > &flags)
+{
+#ifdef CACHE_DEBUG
+    qDebug() << "Updating flags for" << flags.size() << "messages in" << mailbox;
+#endif
+    touchingDB();
+    const QString name = mailboxName(mailbox);
+    int i = 0;
+    for (; i + bulkInsertRows <= flags.size(); i += bulkInsertRows) {
+        for (int row = 0; row < bulkInsertRows; ++row) {
+            QByteArray buf;
+            QDataStream stream(&buf, QIODevice::WriteOnly);
+            stream.setVersion(streamVersion);
+            stream << flags[i + row].second;
+            querySetMessageFlagsBulk.bindValue(row * 3, name);
+            querySetMessageFlagsBulk.bindValue(row * 3 + 1, flags[i + row].first);
+            querySetMessageFlagsBulk.bindValue(row * 3 + 2, buf);
+        }
+        if (!querySetMessageFlagsBulk.exec()) {
+            emitError(tr("Query querySetMessageFlagsBulk failed"), querySetMessageFlagsBulk);
+            return;
+        }
+    }
+    // The rest doesn't fill a whole bulk query
+    for (; i < flags.size(); ++i) {
+        setMsgFlags(mailbox, flags[i].first, flags[i].second);
+    }
+}
+
 AbstractCache::MessageDataBundle SQLCache::messageMetadata(const QString &mailbox, uint uid) const
 {
     AbstractCache::MessageDataBundle res;
@@ -707,7 +877,7 @@ AbstractCache::MessageDataBundle SQLCache::messageMetadata(const QString &mailbo
     }
     if (queryMessageMetadata.first()) {
         res.uid = uid;
-        QDataStream stream(qUncompress(queryMessageMetadata.value(0).toByteArray()));
+        QDataStream stream(CacheCompression::decompress(queryMessageMetadata.value(0).toByteArray()));
         stream.setVersion(streamVersion);
         stream >> res.envelope >> res.internalDate >> res.size >> res.serializedBodyStructure >> res.hdrReferences
                   >> res.hdrListPost >> res.hdrListPostNo;
@@ -743,7 +913,7 @@ void SQLCache::setMessageMetadata(const QString &mailbox, const uint uid, const
     stream.setVersion(streamVersion);
     stream << metadata.envelope << metadata.internalDate << metadata.size << metadata.serializedBodyStructure
            << metadata.hdrReferences << metadata.hdrListPost << metadata.hdrListPostNo;
-    querySetMessageMetadata.bindValue(2, qCompress(buf));
+    querySetMessageMetadata.bindValue(2, m_compression.compress(buf));
     querySetMessageMetadata.bindValue(3, accessingThresholdDate.daysTo(QDate::currentDate()));
     if (! querySetMessageMetadata.exec()) {
         emitError(tr("Query querySetMessageMetadata failed"), querySetMessageMetadata);
@@ -761,7 +931,7 @@ QByteArray SQLCache::messagePart(const QString &mailbox, const uint uid, const Q
         return res;
     }
     if (queryMessagePart.first()) {
-        res = qUncompress(queryMessagePart.value(0).toByteArray());
+        res = CacheCompression::decompress(queryMessagePart.value(0).toByteArray());
         queryMessagePart.finish();
     }
     return res;
@@ -776,7 +946,7 @@ void SQLCache::setMsgPart(const QString &mailbox, const uint uid, const QString
     querySetMessagePart.bindValue(0, mailboxName(mailbox));
     querySetMessagePart.bindValue(1, uid);
     querySetMessagePart.bindValue(2, partId);
-    querySetMessagePart.bindValue(3, qCompress(data));
+    querySetMessagePart.bindValue(3, m_compression.compress(data));
     if (! querySetMessagePart.exec()) {
         emitError(tr("Query querySetMessagePart failed"), querySetMessagePart);
     }
@@ -805,7 +975,7 @@ QVector<Imap::Responses::ThreadingNode> SQLCache::messageThreading(const QString
         return res;
     }
     if (queryMessageThreading.first()) {
-        QDataStream stream(qUncompress(queryMessageThreading.value(0).toByteArray()));
+        QDataStream stream(CacheCompression::decompress(queryMessageThreading.value(0).toByteArray()));
         stream.setVersion(streamVersion);
         stream >> res;
     }
@@ -823,7 +993,7 @@ void SQLCache::setMessageThreading(const QString &mailbox, const QVector<Imap::R
     QDataStream stream(&buf, QIODevice::ReadWrite);
     stream.setVersion(streamVersion);
     stream << threading;
-    querySetMessageThreading.bindValue(1, qCompress(buf));
+    querySetMessageThreading.bindValue(1, m_compression.compress(buf));
     if (! querySetMessageThreading.exec()) {
         emitError(tr("Query querySetMessageThreading failed"), querySetMessageThreading);
     }
@@ -859,6 +1029,26 @@ void SQLCache::setRenewalThreshold(const int days)
     m_updateAccessIfOlder = days;
 }
 
+void SQLCache::setCompression(const CacheCompression &compression)
+{
+    m_compression = compression;
+}
+
+QString SQLCache::bulkInsertStatement(const QString &table, const QStringList &columns, const int rows)
+{
+    Q_ASSERT(rows > 0);
+    QStringList placeholders;
+    for (int i = 0; i < columns.size(); ++i)
+        placeholders << QLatin1String("?");
+    const QString oneRow = QLatin1String("SELECT ") + placeholders.join(QLatin1String(", "));
+    QStringList selects;
+    for (int i = 0; i < rows; ++i)
+        selects << oneRow;
+    // The multi-row VALUES clause is not available in older SQLite versions, but a compound SELECT is
+    return QString::fromUtf8("INSERT OR REPLACE INTO %1 ( %2 ) %3").arg(
+                table, columns.join(QLatin1String(", ")), selects.join(QLatin1String(" UNION ALL ")));
+}
+
 /** @short Return a proper represenation of the mailbox name to be used in the SQL queries
 
 A null QString is represented as NIL, which makes our cache unhappy.
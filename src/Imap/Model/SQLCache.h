@@ -24,6 +24,8 @@
 #define IMAP_MODEL_SQLCACHE_H
 
 #include "Cache.h"
+#include "CacheCompression.h"
+#include <QHash>
 #include <QSqlDatabase>
 #include <QSqlQuery>
 
@@ -75,6 +77,7 @@ public:
     virtual void setUidMapping(const QString &mailbox, const QList<uint> &seqToUid);
     virtual void clearUidMapping(const QString &mailbox);
     virtual QList<uint> uidMapping(const QString &mailbox) const;
+    virtual void updateUidMapping(const QString &mailbox, const QList<uint> &expungedUids, const QList<uint> &newUids);
 
     virtual void clearAllMessages(const QString &mailbox);
     virtual void clearMessage(const QString mailbox, const uint uid);
@@ -84,6 +87,7 @@ public:
 
     virtual QStringList msgFlags(const QString &mailbox, const uint uid) const;
     virtual void setMsgFlags(const QString &mailbox, const uint uid, const QStringList &flags);
+    virtual void setMsgFlagsBulk(const QString &mailbox, const QVector<QPair<uint, QStringList> > &flags);
 
     virtual QByteArray messagePart(const QString &mailbox, const uint uid, const QString &partId) const;
     virtual void setMsgPart(const QString &mailbox, const uint uid, const QString &partId, const QByteArray &data);
@@ -97,6 +101,9 @@ public:
 
     virtual void setRenewalThreshold(const int days);
 
+    /** @short Use the specified compression for newly stored data */
+    void setCompression(const CacheCompression &compression);
+
 private:
     /** @short Broadcast an error from the SQL query */
     void emitError(const QString &message, const QSqlQuery &query) const;
@@ -117,6 +124,17 @@ private:
     void init();
 
     static QString mailboxName(const QString &mailbox);
+    /** @short Build an INSERT OR REPLACE statement which stores @arg rows rows of @arg columns at once */
+    static QString bulkInsertStatement(const QString &table, const QStringList &columns, const int rows);
+
+    /** @short How many rows shall be inserted by a single bulk query
+
+    SQLite limits both the number of bound parameters and the number of terms in a compound SELECT statement.
+    */
+    static const int bulkInsertRows = 100;
+
+    /** @short After how many incremental updates shall the UID mapping be stored in full again */
+    static const int uidMappingCheckpointInterval = 64;
 
 private slots:
     /** @short We haven't committed for a while */
@@ -134,11 +152,17 @@ private:
     mutable QSqlQuery queryUidMapping;
     mutable QSqlQuery querySetUidMapping;
     mutable QSqlQuery queryClearUidMapping;
+    mutable QSqlQuery queryUidMappingLog;
+    mutable QSqlQuery queryAppendUidMappingLog;
+    mutable QSqlQuery queryClearUidMappingLog;
+    mutable QSqlQuery queryUidMappingLogLength;
     mutable QSqlQuery queryMessageMetadata;
     mutable QSqlQuery queryAccessMessageMetadata;
     mutable QSqlQuery querySetMessageMetadata;
     mutable QSqlQuery queryMessageFlags;
     mutable QSqlQuery querySetMessageFlags;
+    /** @short Like querySetMessageFlags, but for bulkInsertRows messages at once */
+    mutable QSqlQuery querySetMessageFlagsBulk;
     mutable QSqlQuery queryClearAllMessages1;
     mutable QSqlQuery queryClearAllMessages2;
     mutable QSqlQuery queryClearAllMessages3;
@@ -164,6 +188,11 @@ private:
     To disable updating of the DB accesses, set to zero.
     */
     int m_updateAccessIfOlder;
+
+    CacheCompression m_compression;
+
+    /** @short Number of records in the uid_mapping_log of each mailbox, or -1 if no full mapping is stored */
+    QHash<QString, int> m_uidMappingLogLength;
 };
 
 }
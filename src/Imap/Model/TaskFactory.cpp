@@ -173,7 +173,7 @@ SortTask *TaskFactory::createSortTask(Model *model, const QModelIndex &mailbox,
     return new SortTask(model, mailbox, searchConditions, sortCriteria);
 }
 
-AppendTask *TaskFactory::createAppendTask(Model *model, const QString &targetMailbox, const QByteArray &rawMessageData,
+AppendTask *TaskFactory::createAppendTask(Model *model, const QString &targetMailbox, const QSharedPointer<QIODevice> &rawMessageData,
                                           const QStringList &flags, const QDateTime &timestamp)
 {
     return new AppendTask(model, targetMailbox, rawMessageData, flags, timestamp);
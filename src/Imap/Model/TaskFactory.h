@@ -26,12 +26,15 @@
 #include <memory>
 #include <QMap>
 #include <QModelIndex>
+#include <QSharedPointer>
 #include "CatenateData.h"
 #include "CopyMoveOperation.h"
 #include "FlagsOperation.h"
 #include "SubscribeUnSubscribeOperation.h"
 #include "UidSubmitData.h"
 
+class QIODevice;
+
 namespace Imap
 {
 class Parser;
@@ -101,7 +104,7 @@ public:
     virtual NoopTask *createNoopTask(Model *model, ImapTask *parentTask);
     virtual UnSelectTask *createUnSelectTask(Model *model, ImapTask *parentTask);
     virtual SortTask *createSortTask(Model *model, const QModelIndex &mailbox, const QStringList &searchConditions, const QStringList &sortCriteria);
-    virtual AppendTask *createAppendTask(Model *model, const QString &targetMailbox, const QByteArray &rawMessageData,
+    virtual AppendTask *createAppendTask(Model *model, const QString &targetMailbox, const QSharedPointer<QIODevice> &rawMessageData,
                                          const QStringList &flags, const QDateTime &timestamp);
     virtual AppendTask *createAppendTask(Model *model, const QString &targetMailbox, const QList<CatenatePair> &data,
                                          const QStringList &flags, const QDateTime &timestamp);
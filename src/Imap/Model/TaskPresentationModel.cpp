@@ -192,13 +192,24 @@ QVariant TaskPresentationModel::data(const QModelIndex &index, int role) const
     case Qt::DisplayRole:
         if (isParserState) {
             Imap::Parser *parser = static_cast<Imap::Parser *>(index.internalPointer());
-            return tr("Parser %1").arg(QString::number(parser->parserId()));
+            const uint withdrawn = m_model->accessParser(parser).withdrawnEnvelopeRequests;
+            if (withdrawn) {
+                return tr("Parser %1 (%n header fetch(es) avoided)", 0, withdrawn).arg(QString::number(parser->parserId()));
+            } else {
+                return tr("Parser %1").arg(QString::number(parser->parserId()));
+            }
         } else {
             ImapTask *task = static_cast<ImapTask *>(index.internalPointer());
             QString className = QLatin1String(task->metaObject()->className());
             className.remove(QLatin1String("Imap::Mailbox::"));
             return tr("%1: %2").arg(className, task->debugIdentification());
         }
+    case RoleTaskWithdrawnEnvelopeRequests:
+        if (isParserState) {
+            return m_model->accessParser(static_cast<Imap::Parser *>(index.internalPointer())).withdrawnEnvelopeRequests;
+        } else {
+            return QVariant();
+        }
     case RoleTaskCompactName: {
         if (isParserState) {
             return QVariant();
@@ -249,6 +260,16 @@ void TaskPresentationModel::slotParserDeleted(Parser *parser)
     CHECK_TASK_TREE
 }
 
+/** @short Some statistics of the given parser have changed */
+void TaskPresentationModel::slotParserStateChanged(Parser *parser)
+{
+    int row = m_model->m_parsers.keys().indexOf(parser);
+    if (row == -1)
+        return;
+    QModelIndex index = createIndex(row, 0, parser);
+    emit dataChanged(index, index);
+}
+
 /** @short A parent of the given Imaptask has just changed
 
 The task might or might not have been present in the model before.  We don't know.
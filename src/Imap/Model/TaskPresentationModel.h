@@ -64,6 +64,7 @@ public slots:
 
     void slotParserCreated(Parser *parser);
     void slotParserDeleted(Parser *parser);
+    void slotParserStateChanged(Parser *parser);
 
 private:
     Model *m_model;
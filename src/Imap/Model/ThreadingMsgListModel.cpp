@@ -22,15 +22,26 @@
 
 #include "ThreadingMsgListModel.h"
 #include <algorithm>
+#include <iterator>
 #include <QBuffer>
 #include <QDebug>
+#include "Imap/Parser/Sequence.h"
 #include "Imap/Tasks/SortTask.h"
 #include "Imap/Tasks/ThreadTask.h"
+#include "FullTextIndex.h"
 #include "ItemRoles.h"
 #include "MailboxTree.h"
 #include "MsgListModel.h"
 #include "QAIM_reset.h"
 
+namespace
+{
+
+/** @short Longest UID set to send along with a search restricted to messages which are not in the full-text index */
+const int maxSearchUidSetLength = 4000;
+
+}
+
 #if 0
 namespace
 {
@@ -59,13 +70,18 @@ namespace Mailbox
 
 ThreadingMsgListModel::ThreadingMsgListModel(QObject *parent):
     QAbstractProxyModel(parent), threadingHelperLastId(0), modelResetInProgress(false), threadingInFlight(false),
-    m_shallBeThreading(false), m_sortTask(0), m_sortReverse(false), m_currentSortingCriteria(SORT_NONE),
-    m_searchValidity(RESULT_INVALIDATED)
+    m_shallBeThreading(false), m_sortTask(0), m_sortReverse(false), m_treeFollowsThreading(false),
+    m_currentSortingCriteria(SORT_NONE), m_searchValidity(RESULT_INVALIDATED), m_sortTaskCoversUnindexedOnly(false), m_localThreadingActive(false),
+    m_localSortingActive(false)
 {
     m_delayedPrune = new QTimer(this);
     m_delayedPrune->setSingleShot(true);
     m_delayedPrune->setInterval(0);
     connect(m_delayedPrune, SIGNAL(timeout()), this, SLOT(delayedPrune()));
+    m_delayedLocalThreading = new QTimer(this);
+    m_delayedLocalThreading->setSingleShot(true);
+    m_delayedLocalThreading->setInterval(0);
+    connect(m_delayedLocalThreading, SIGNAL(timeout()), this, SLOT(delayedLocalThreading()));
 }
 
 void ThreadingMsgListModel::setSourceModel(QAbstractItemModel *sourceModel)
@@ -76,6 +92,12 @@ void ThreadingMsgListModel::setSourceModel(QAbstractItemModel *sourceModel)
     threadedRootIds.clear();
     m_currentSortResult.clear();
     m_searchValidity = RESULT_INVALIDATED;
+    m_sortTaskCoversUnindexedOnly = false;
+    m_localSearchResult.clear();
+    m_localThreading.clear();
+    m_localThreadingActive = false;
+    m_localSorting.clear();
+    m_localSortingActive = false;
 
     if (this->sourceModel()) {
         // there's already something, so take care to disconnect all signals
@@ -143,10 +165,35 @@ void ThreadingMsgListModel::handleDataChanged(const QModelIndex &topLeft, const
     if (persistent != unknownUids.end()) {
         // The message wasn't fully synced before, and now it is
         persistent = unknownUids.erase(persistent);
+        QHash<void *, uint>::const_iterator known = ptrToInternal.constFind(topLeft.internalPointer());
+        QHash<uint, ThreadNodeInfo>::iterator node = threading.end();
+        if (known != ptrToInternal.constEnd())
+            node = threading.find(*known);
+        if (node != threading.end()) {
+            node->uid = topLeft.data(RoleMessageUid).toUInt();
+            if (node->parent == 0 && !threadedRootIds.contains(node->internalId)) {
+                // The handleRowsInserted() could not count this one among the thread roots while its UID was unknown.
+                // Keep the order of the tree so that the next THREAD response can still be applied incrementally.
+                QList<uint>::iterator pos = threadedRootIds.begin();
+                while (pos != threadedRootIds.end() && threading.value(*pos).offset < node->offset)
+                    ++pos;
+                threadedRootIds.insert(pos, node->internalId);
+            }
+        }
         if (unknownUids.isEmpty()) {
             wantThreading();
         }
     }
+
+    if ((m_shallBeThreading && m_localThreadingActive) || m_localSortingActive) {
+        // The local threading could only place this message at the top level before its headers became available, and the
+        // local sorting had to treat it as if all of its fields were empty
+        TreeItemMessage *message = static_cast<TreeItemMessage *>(topLeft.internalPointer());
+        if (message->uid() && message->fetched() &&
+                ((m_shallBeThreading && m_localThreadingActive && !m_localThreading.contains(message->uid())) ||
+                 (m_localSortingActive && !m_localSorting.hasKey(message->uid()))))
+            m_delayedLocalThreading->start();
+    }
 }
 
 QModelIndex ThreadingMsgListModel::index(int row, int column, const QModelIndex &parent) const
@@ -407,6 +454,8 @@ void ThreadingMsgListModel::handleRowsInserted(const QModelIndex &parent, int st
 
     if (m_shallBeThreading)
         wantThreading();
+    else if (m_localSortingActive)
+        m_delayedLocalThreading->start();
 }
 
 void ThreadingMsgListModel::resetMe()
@@ -422,6 +471,12 @@ void ThreadingMsgListModel::resetMe()
     threadedRootIds.clear();
     m_currentSortResult.clear();
     m_searchValidity = RESULT_INVALIDATED;
+    m_sortTaskCoversUnindexedOnly = false;
+    m_localSearchResult.clear();
+    m_localThreading.clear();
+    m_localThreadingActive = false;
+    m_localSorting.clear();
+    m_localSortingActive = false;
     RESET_MODEL;
     updateNoThreading();
     modelResetInProgress = false;
@@ -433,6 +488,7 @@ void ThreadingMsgListModel::resetMe()
 void ThreadingMsgListModel::updateNoThreading()
 {
     threadingHelperLastId = 0;
+    m_treeFollowsThreading = false;
 
     if (!sourceModel()) {
         // Maybe we got reset because the parent model is no longer here...
@@ -542,6 +598,13 @@ void ThreadingMsgListModel::wantThreading(const SkipSortSearch skipSortSearch)
     TreeItemMsgList *list = dynamic_cast<TreeItemMsgList*>(static_cast<TreeItem*>(realIndex.parent().internalPointer()));
     Q_ASSERT(list);
 
+    if (!serverSupportsThreading(realModel)) {
+        // Either the server doesn't support threading at all, or we're offline
+        threadLocally(list);
+        return;
+    }
+    m_localThreadingActive = false;
+
     // Something has happened and we want to process the THREAD response
     QVector<Imap::Responses::ThreadingNode> mapping = realModel->cache()->messageThreading(mailbox.data(RoleMailboxName).toString());
 
@@ -649,6 +712,62 @@ void ThreadingMsgListModel::askForThreading(const uint firstUnknownUid)
     }
 }
 
+bool ThreadingMsgListModel::serverSupportsThreading(const Model *realModel) const
+{
+    Q_FOREACH(const QString &capability, supportedCapabilities()) {
+        if (realModel->capabilities().contains(capability))
+            return true;
+    }
+    return false;
+}
+
+void ThreadingMsgListModel::threadLocally(TreeItemMsgList *list)
+{
+    m_localThreadingActive = true;
+
+    // Only the messages which we haven't seen yet have to be fed into the engine
+    QList<uint> unthreadedUids;
+    int numThreaded = 0;
+    for (int i = 0; i < list->m_children.size(); ++i) {
+        TreeItemMessage *message = static_cast<TreeItemMessage *>(list->m_children[i]);
+        const uint uid = message->uid();
+        if (!uid)
+            continue;
+        if (m_localThreading.contains(uid)) {
+            ++numThreaded;
+            continue;
+        }
+        if (message->fetched()) {
+            const MessageDataPayload *data = message->data();
+            m_localThreading.addMessage(uid, data->m_envelope.messageId, data->m_hdrReferences, data->m_envelope.inReplyTo);
+            ++numThreaded;
+        } else {
+            unthreadedUids << uid;
+        }
+    }
+
+    if (m_localThreading.size() > numThreaded) {
+        // Some messages have been expunged since the last time
+        QSet<uint> present;
+        for (int i = 0; i < list->m_children.size(); ++i)
+            present.insert(static_cast<TreeItemMessage *>(list->m_children[i])->uid());
+        Q_FOREACH(const uint uid, m_localThreading.uids()) {
+            if (!present.contains(uid))
+                m_localThreading.removeMessage(uid);
+        }
+    }
+
+    logTrace(QString::fromUtf8("ThreadingMsgListModel::threadLocally: %1 messages threaded, %2 without headers")
+             .arg(QString::number(m_localThreading.size()), QString::number(unthreadedUids.size())));
+    applyThreading(m_localThreading.threading(unthreadedUids));
+}
+
+void ThreadingMsgListModel::delayedLocalThreading()
+{
+    if (((m_shallBeThreading && m_localThreadingActive) || m_localSortingActive) && !threadingInFlight)
+        wantThreading();
+}
+
 /** @short Gather all UIDs present in the mapping and push them into the "uids" vector */
 static void gatherAllUidsFromThreadNode(QVector<uint> &uids, const QVector<Responses::ThreadingNode> &list)
 {
@@ -797,15 +916,23 @@ void ThreadingMsgListModel::slotThreadingAvailable(const QModelIndex &mailbox, c
 
 void ThreadingMsgListModel::slotSortingAvailable(const QList<uint> &uids)
 {
-    if (!m_sortTask->isPersistent()) {
-        disconnect(m_sortTask, 0, this, SLOT(slotSortingAvailable(QList<uint>)));
-        disconnect(m_sortTask, 0, this, SLOT(slotSortingFailed()));
-        disconnect(m_sortTask, 0, this, SLOT(slotSortingIncrementalUpdate(Imap::Responses::ESearch::IncrementalContextData_t)));
+    m_currentSortResult = uids;
 
-        m_sortTask = 0;
+    if (m_sortTaskCoversUnindexedOnly) {
+        m_sortTaskCoversUnindexedOnly = false;
+        // The server only knows about the part of the mailbox which is missing from the full-text index. Any incremental
+        // updates would cover just that part, so it's better to search again once the mailbox changes.
+        if (m_sortTask->isPersistent())
+            m_sortTask->cancelSortingUpdates();
+        forgetSortTask();
+        m_currentSortResult += m_localSearchResult;
+        qSort(m_currentSortResult);
+        m_currentSortResult.erase(std::unique(m_currentSortResult.begin(), m_currentSortResult.end()), m_currentSortResult.end());
+        m_localSearchResult.clear();
+    } else if (!m_sortTask->isPersistent()) {
+        forgetSortTask();
     }
 
-    m_currentSortResult = uids;
     if (m_searchValidity == RESULT_ASKED)
         m_searchValidity = RESULT_FRESH;
     wantThreading();
@@ -813,11 +940,18 @@ void ThreadingMsgListModel::slotSortingAvailable(const QList<uint> &uids)
 
 void ThreadingMsgListModel::slotSortingFailed()
 {
-    disconnect(m_sortTask, 0, this, SLOT(slotSortingAvailable(QList<uint>)));
-    disconnect(m_sortTask, 0, this, SLOT(slotSortingFailed()));
-    disconnect(m_sortTask, 0, this, SLOT(slotSortingIncrementalUpdate(Imap::Responses::ESearch::IncrementalContextData_t)));
+    forgetSortTask();
+
+    if (m_sortTaskCoversUnindexedOnly) {
+        m_sortTaskCoversUnindexedOnly = false;
+        // Whatever the full-text index has found is still better than nothing
+        m_currentSortResult = m_localSearchResult;
+        m_localSearchResult.clear();
+        m_searchValidity = RESULT_FRESH;
+        applySort();
+        return;
+    }
 
-    m_sortTask = 0;
     m_sortReverse = false;
     calculateNullSort();
     applySort();
@@ -862,6 +996,16 @@ void ThreadingMsgListModel::slotSortingIncrementalUpdate(const Responses::ESearc
     wantThreading();
 }
 
+void ThreadingMsgListModel::forgetSortTask()
+{
+    if (m_sortTask) {
+        disconnect(m_sortTask, 0, this, SLOT(slotSortingAvailable(QList<uint>)));
+        disconnect(m_sortTask, 0, this, SLOT(slotSortingFailed()));
+        disconnect(m_sortTask, 0, this, SLOT(slotSortingIncrementalUpdate(Imap::Responses::ESearch::IncrementalContextData_t)));
+    }
+    m_sortTask = 0;
+}
+
 /** @short Store UIDs of the thread roots as the "current search order" */
 void ThreadingMsgListModel::calculateNullSort()
 {
@@ -887,6 +1031,15 @@ void ThreadingMsgListModel::applyThreading(const QVector<Imap::Responses::Thread
         return;
     }
 
+    if (m_treeFollowsThreading && m_currentSortingCriteria == SORT_NONE && m_currentSearchConditions.isEmpty() && !m_sortReverse &&
+            !threading.isEmpty() && sourceModel()->rowCount() && threading.value(0).children == threadedRootIds) {
+        // The tree already shows the result of some earlier THREAD response. A new arrival typically affects just one or two
+        // threads, so there's no point in throwing everything away and making the views start from scratch.
+        applyThreadingIncrementally(mapping);
+        searchSortPreferenceImplementation(m_currentSearchConditions, m_currentSortingCriteria, m_sortReverse ? Qt::DescendingOrder : Qt::AscendingOrder);
+        return;
+    }
+
     emit layoutAboutToBeChanged();
 
     updatePersistentIndexesPhase1();
@@ -958,6 +1111,7 @@ void ThreadingMsgListModel::applyThreading(const QVector<Imap::Responses::Thread
     updatePersistentIndexesPhase2();
     if (rowCount())
         threadedRootIds = threading[0].children;
+    m_treeFollowsThreading = true;
     emit layoutChanged();
 
     // If the sorting was active before, we shall reactivate it now
@@ -1001,6 +1155,175 @@ void ThreadingMsgListModel::registerThreading(const QVector<Imap::Responses::Thr
     }
 }
 
+void ThreadingMsgListModel::applyThreadingIncrementally(const QVector<Imap::Responses::ThreadingNode> &mapping)
+{
+    // Work with pointers instead of going through the MVC API, just like the full rebuild does
+    QModelIndex firstMessageIndex = sourceModel()->index(0, 0);
+    Q_ASSERT(firstMessageIndex.isValid());
+    const Model *realModel = 0;
+    TreeItem *firstMessagePtr = Model::realTreeItem(firstMessageIndex, &realModel);
+    Q_ASSERT(firstMessagePtr);
+    Q_ASSERT(firstMessagePtr == firstMessageIndex.internalPointer());
+    TreeItemMsgList *list = dynamic_cast<TreeItemMsgList *>(firstMessagePtr->parent());
+    Q_ASSERT(list);
+
+    // Walk the new tree from the top and make our tree match it node by node. Everything above and before the node which is
+    // being processed is already at its final place, which means that each node is moved at most once.
+    QList<QPair<uint, int> > leftovers;
+    placeThreadingNodes(mapping, 0, const_cast<Model *>(realModel), list, leftovers);
+
+    // Whatever remains after the placed nodes is not mentioned in the THREAD response at all
+    for (QList<QPair<uint, int> >::const_iterator it = leftovers.constBegin(); it != leftovers.constEnd(); ++it) {
+        QHash<uint, ThreadNodeInfo>::iterator parent = threading.find(it->first);
+        Q_ASSERT(parent != threading.end());
+        if (parent->children.size() <= it->second)
+            continue;
+
+        beginRemoveRows(indexForThreadNode(it->first), it->second, parent->children.size() - 1);
+        std::vector<uint> queue(parent->children.constBegin() + it->second, parent->children.constEnd());
+        parent->children.erase(parent->children.begin() + it->second, parent->children.end());
+        for (std::vector<uint>::size_type i = 0; i < queue.size(); ++i) {
+            QHash<uint, ThreadNodeInfo>::iterator node = threading.find(queue[i]);
+            Q_ASSERT(node != threading.end());
+            queue.insert(queue.end(), node->children.constBegin(), node->children.constEnd());
+            QHash<void *, uint>::iterator ptrIt = ptrToInternal.find(node->ptr);
+            if (ptrIt != ptrToInternal.end() && *ptrIt == node->internalId)
+                ptrToInternal.erase(ptrIt);
+            threading.erase(node);
+        }
+        endRemoveRows();
+    }
+
+    threadedRootIds = threading.value(0).children;
+}
+
+void ThreadingMsgListModel::placeThreadingNodes(const QVector<Imap::Responses::ThreadingNode> &nodes, const uint parentId,
+                                                Model *realModel, TreeItemMsgList *list, QList<QPair<uint, int> > &leftovers)
+{
+    int row = 0;
+    for (QVector<Responses::ThreadingNode>::const_iterator it = nodes.constBegin(); it != nodes.constEnd(); ++it) {
+        placeThreadingNode(it->num, it->children, parentId, row, realModel, list, leftovers);
+    }
+
+    QHash<uint, ThreadNodeInfo>::const_iterator parent = threading.constFind(parentId);
+    Q_ASSERT(parent != threading.constEnd());
+    if (parent->children.size() > row)
+        leftovers.append(qMakePair(parentId, row));
+}
+
+void ThreadingMsgListModel::placeThreadingNode(const uint uid, const QVector<Imap::Responses::ThreadingNode> &children,
+                                               const uint parentId, int &row, Model *realModel, TreeItemMsgList *list,
+                                               QList<QPair<uint, int> > &leftovers)
+{
+    TreeItem *ptr = 0;
+    if (uid) {
+        TreeItemChildrenList::iterator it = realModel->findMessageOrNextOneByUid(list, uid);
+        if (it != list->m_children.end() && static_cast<TreeItemMessage *>(*it)->uid() == uid)
+            ptr = *it;
+    }
+
+    if (!ptr) {
+        // Either an empty node, or a message which is no longer in the mailbox. Do what pruneTree() would do with such a node,
+        // i.e. promote its first child to take its place and let the rest of its children become children of the promoted one.
+        if (!children.isEmpty()) {
+            placeThreadingNode(children.front().num, children.front().children + children.mid(1), parentId, row,
+                               realModel, list, leftovers);
+        }
+        return;
+    }
+
+    // The ptrToInternal might still refer to a node of an expunged message which lived at the same address
+    uint nodeId;
+    QHash<void *, uint>::const_iterator known = ptrToInternal.constFind(ptr);
+    QHash<uint, ThreadNodeInfo>::const_iterator node = threading.constEnd();
+    if (known != ptrToInternal.constEnd())
+        node = threading.constFind(*known);
+    if (node != threading.constEnd() && node->ptr == ptr) {
+        nodeId = node->internalId;
+        moveThreadNode(nodeId, parentId, row);
+    } else {
+        nodeId = insertThreadNode(ptr, parentId, row);
+    }
+    ++row;
+    placeThreadingNodes(children, nodeId, realModel, list, leftovers);
+}
+
+void ThreadingMsgListModel::moveThreadNode(const uint nodeId, const uint parentId, const int row)
+{
+    QHash<uint, ThreadNodeInfo>::iterator node = threading.find(nodeId);
+    Q_ASSERT(node != threading.end());
+    const uint oldParentId = node->parent;
+    const int oldRow = node->offset;
+    if (oldParentId == parentId && oldRow == row)
+        return;
+
+    // The destination and everything above it is already in place, so we cannot be moving a node into its own subtree
+    bool ok = beginMoveRows(indexForThreadNode(oldParentId), oldRow, oldRow, indexForThreadNode(parentId), row);
+    Q_ASSERT(ok);
+    Q_UNUSED(ok);
+
+    QHash<uint, ThreadNodeInfo>::iterator oldParent = threading.find(oldParentId);
+    Q_ASSERT(oldParent != threading.end());
+    Q_ASSERT(oldParent->children[oldRow] == nodeId);
+    oldParent->children.removeAt(oldRow);
+    node->parent = parentId;
+    QHash<uint, ThreadNodeInfo>::iterator newParent = threading.find(parentId);
+    Q_ASSERT(newParent != threading.end());
+    newParent->children.insert(row, nodeId);
+
+    if (oldParentId == parentId) {
+        // Within the same parent, we only ever move the nodes towards the beginning
+        Q_ASSERT(row < oldRow);
+        updateChildOffsets(parentId, row, oldRow);
+    } else {
+        updateChildOffsets(oldParentId, oldRow, oldParent->children.size() - 1);
+        updateChildOffsets(parentId, row, newParent->children.size() - 1);
+    }
+    endMoveRows();
+}
+
+uint ThreadingMsgListModel::insertThreadNode(TreeItem *ptr, const uint parentId, const int row)
+{
+    beginInsertRows(indexForThreadNode(parentId), row, row);
+    ThreadNodeInfo node;
+    node.internalId = ++threadingHelperLastId;
+    node.uid = static_cast<TreeItemMessage *>(ptr)->uid();
+    node.parent = parentId;
+    node.ptr = ptr;
+    node.offset = row;
+    Q_ASSERT(!threading.contains(node.internalId));
+    threading[node.internalId] = node;
+    ptrToInternal[ptr] = node.internalId;
+    QHash<uint, ThreadNodeInfo>::iterator parent = threading.find(parentId);
+    Q_ASSERT(parent != threading.end());
+    parent->children.insert(row, node.internalId);
+    updateChildOffsets(parentId, row + 1, parent->children.size() - 1);
+    endInsertRows();
+    return node.internalId;
+}
+
+void ThreadingMsgListModel::updateChildOffsets(const uint parentId, const int first, const int last)
+{
+    QHash<uint, ThreadNodeInfo>::const_iterator parent = threading.constFind(parentId);
+    Q_ASSERT(parent != threading.constEnd());
+    Q_ASSERT(last < parent->children.size());
+    for (int row = first; row <= last; ++row) {
+        QHash<uint, ThreadNodeInfo>::iterator child = threading.find(parent->children[row]);
+        Q_ASSERT(child != threading.end());
+        child->offset = row;
+    }
+}
+
+QModelIndex ThreadingMsgListModel::indexForThreadNode(const uint nodeId) const
+{
+    if (!nodeId)
+        return QModelIndex();
+
+    QHash<uint, ThreadNodeInfo>::const_iterator node = threading.constFind(nodeId);
+    Q_ASSERT(node != threading.constEnd());
+    return createIndex(node->offset, 0, node->internalId);
+}
+
 /** @short Gather a list of persistent indexes which we have to transform after out layout change */
 void ThreadingMsgListModel::updatePersistentIndexesPhase1()
 {
@@ -1290,6 +1613,7 @@ bool ThreadingMsgListModel::searchSortPreferenceImplementation(const QStringList
         sortOptions << (hasDisplaySort ? QLatin1String("DISPLAYTO") : QLatin1String("TO"));
         break;
     case SORT_NONE:
+        m_localSortingActive = false;
         if (m_sortTask && m_sortTask->isPersistent() &&
                 (m_currentSearchConditions != searchConditions || m_currentSortingCriteria != criterium)) {
             // Any change shall result in us killing that sort task
@@ -1302,10 +1626,18 @@ bool ThreadingMsgListModel::searchSortPreferenceImplementation(const QStringList
             // This operation is special, it will immediately restore the original shape of the mailbox
             m_currentSearchConditions = searchConditions;
             calculateNullSort();
-            applySort();
+            if (m_sortReverse || m_currentSortResult.size() != threadedRootIds.size() ||
+                    threading.value(0).children != threadedRootIds) {
+                applySort();
+            }
             return true;
         } else if (searchConditions != m_currentSearchConditions || m_searchValidity != RESULT_FRESH) {
             // We have to update our search conditions
+            TreeItemMsgList *list = dynamic_cast<TreeItemMsgList*>(static_cast<TreeItem*>(realIndex.parent().internalPointer()));
+            Q_ASSERT(list);
+            if (searchLocally(realModel, mailboxIndex, list, searchConditions))
+                return true;
+            m_sortTaskCoversUnindexedOnly = false;
             m_sortTask = realModel->m_taskFactory->createSortTask(const_cast<Model *>(realModel), mailboxIndex, searchConditions,
                                                                   QStringList());
             connect(m_sortTask, SIGNAL(sortingAvailable(QList<uint>)), this, SLOT(slotSortingAvailable(QList<uint>)));
@@ -1323,8 +1655,17 @@ bool ThreadingMsgListModel::searchSortPreferenceImplementation(const QStringList
         return true;
     }
 
+    if (searchConditions.isEmpty() && (!hasSort || !realModel->isNetworkAvailable())) {
+        // The server cannot sort for us, or we're offline; the cached metadata will have to do
+        TreeItemMsgList *list = dynamic_cast<TreeItemMsgList*>(static_cast<TreeItem*>(realIndex.parent().internalPointer()));
+        Q_ASSERT(list);
+        sortLocally(realModel, mailboxIndex, list, criterium);
+        return true;
+    }
+    m_localSortingActive = false;
+
     if (!hasSort) {
-        // sorting is completely unsupported
+        // sorting of search results is completely unsupported
         return false;
     }
 
@@ -1342,6 +1683,7 @@ bool ThreadingMsgListModel::searchSortPreferenceImplementation(const QStringList
         if (m_sortTask && m_sortTask->isPersistent())
             m_sortTask->cancelSortingUpdates();
 
+        m_sortTaskCoversUnindexedOnly = false;
         m_sortTask = realModel->m_taskFactory->createSortTask(const_cast<Model *>(realModel), mailboxIndex, searchConditions, sortOptions);
         connect(m_sortTask, SIGNAL(sortingAvailable(QList<uint>)), this, SLOT(slotSortingAvailable(QList<uint>)));
         connect(m_sortTask, SIGNAL(sortingFailed()), this, SLOT(slotSortingFailed()));
@@ -1353,6 +1695,202 @@ bool ThreadingMsgListModel::searchSortPreferenceImplementation(const QStringList
     return true;
 }
 
+void ThreadingMsgListModel::sortLocally(const Model *realModel, const QModelIndex &mailboxIndex, TreeItemMsgList *list,
+                                        const SortCriterium criterium)
+{
+    LocalSorting::Criterium localCriterium = LocalSorting::SORT_ARRIVAL;
+    switch (criterium) {
+    case SORT_ARRIVAL:
+    case SORT_NONE:
+        break;
+    case SORT_CC:
+        localCriterium = LocalSorting::SORT_CC;
+        break;
+    case SORT_DATE:
+        localCriterium = LocalSorting::SORT_DATE;
+        break;
+    case SORT_FROM:
+        localCriterium = LocalSorting::SORT_FROM;
+        break;
+    case SORT_SIZE:
+        localCriterium = LocalSorting::SORT_SIZE;
+        break;
+    case SORT_SUBJECT:
+        localCriterium = LocalSorting::SORT_SUBJECT;
+        break;
+    case SORT_TO:
+        localCriterium = LocalSorting::SORT_TO;
+        break;
+    }
+
+    if (m_sortTask && m_sortTask->isPersistent())
+        m_sortTask->cancelSortingUpdates();
+    forgetSortTask();
+    m_sortTaskCoversUnindexedOnly = false;
+    m_localSearchResult.clear();
+    m_currentSearchConditions.clear();
+    m_currentSortingCriteria = criterium;
+    m_localSortingActive = true;
+
+    if (m_localSorting.criterium() != localCriterium)
+        m_localSorting.setCriterium(localCriterium);
+
+    // Only the new arrivals and the messages whose metadata have just become available have to be fed into the engine
+    const QString mailbox = mailboxIndex.data(RoleMailboxName).toString();
+    int numMessages = 0;
+    int numWithoutData = 0;
+    for (int i = 0; i < list->m_children.size(); ++i) {
+        TreeItemMessage *message = static_cast<TreeItemMessage *>(list->m_children[i]);
+        const uint uid = message->uid();
+        if (!uid)
+            continue;
+        ++numMessages;
+        if (message->fetched()) {
+            if (!m_localSorting.hasKey(uid)) {
+                const MessageDataPayload *data = message->data();
+                m_localSorting.addMessage(uid, data->m_envelope, data->m_internalDate, data->m_size);
+            }
+        } else if (!m_localSorting.contains(uid)) {
+            // Most of a big mailbox is typically not loaded into the tree, but the envelopes are likely in the cache already.
+            // Messages which the cache does not know are looked up just once; their data will come through the tree.
+            AbstractCache::MessageDataBundle cached = realModel->cache()->messageMetadata(mailbox, uid);
+            if (cached.uid == uid) {
+                m_localSorting.addMessage(uid, cached.envelope, cached.internalDate, cached.size);
+            } else {
+                ++numWithoutData;
+                m_localSorting.addMessageWithoutData(uid);
+            }
+        } else if (!m_localSorting.hasKey(uid)) {
+            ++numWithoutData;
+        }
+    }
+
+    QList<uint> sorted = m_localSorting.sortedUids();
+    if (sorted.size() > numMessages) {
+        // Some messages have been expunged since the last time
+        QSet<uint> present;
+        for (int i = 0; i < list->m_children.size(); ++i)
+            present.insert(static_cast<TreeItemMessage *>(list->m_children[i])->uid());
+        Q_FOREACH(const uint uid, sorted) {
+            if (!present.contains(uid))
+                m_localSorting.removeMessage(uid);
+        }
+        sorted = m_localSorting.sortedUids();
+    }
+
+    logTrace(QString::fromUtf8("ThreadingMsgListModel::sortLocally: %1 messages sorted, %2 without metadata")
+             .arg(QString::number(sorted.size()), QString::number(numWithoutData)));
+    m_currentSortResult = sorted;
+    m_searchValidity = RESULT_FRESH;
+    applySort();
+}
+
+bool ThreadingMsgListModel::searchLocally(const Model *realModel, const QModelIndex &mailboxIndex, TreeItemMsgList *list,
+                                          const QStringList &searchConditions)
+{
+    FullTextIndex *index = realModel->cache()->fullTextIndex();
+    if (!index)
+        return false;
+
+    // We only understand what the quick search produces: a chain of ORs followed by the same text looked up in several fields
+    int pos = 0;
+    while (pos < searchConditions.size() && searchConditions[pos] == QLatin1String("OR"))
+        ++pos;
+    const int numOr = pos;
+    int numKeys = 0;
+    int fields = 0;
+    QString text;
+    while (pos < searchConditions.size()) {
+        if (searchConditions[pos] == QLatin1String("FUZZY")) {
+            ++pos;
+            continue;
+        }
+        if (pos + 1 >= searchConditions.size())
+            return false;
+        const QString &key = searchConditions[pos];
+        if (key == QLatin1String("SUBJECT")) {
+            fields |= FullTextIndex::FIELD_SUBJECT;
+        } else if (key == QLatin1String("BODY")) {
+            fields |= FullTextIndex::FIELD_BODY;
+        } else if (key == QLatin1String("FROM")) {
+            fields |= FullTextIndex::FIELD_FROM;
+        } else if (key == QLatin1String("TO") || key == QLatin1String("CC") || key == QLatin1String("BCC")) {
+            fields |= FullTextIndex::FIELD_RECIPIENTS;
+        } else {
+            return false;
+        }
+        if (numKeys && searchConditions[pos + 1] != text)
+            return false;
+        text = searchConditions[pos + 1];
+        ++numKeys;
+        pos += 2;
+    }
+    if (!numKeys || numOr != numKeys - 1)
+        return false;
+
+    const QStringList words = FullTextIndex::tokenize(text);
+    if (words.isEmpty())
+        return false;
+
+    QList<uint> uids;
+    for (int i = 0; i < list->m_children.size(); ++i) {
+        uint uid = static_cast<TreeItemMessage*>(list->m_children[i])->uid();
+        if (uid)
+            uids << uid;
+    }
+    qSort(uids);
+
+    const QString mailbox = mailboxIndex.data(RoleMailboxName).toString();
+    const QList<uint> found = index->search(mailbox, words, fields);
+    const QList<uint> indexed = index->indexedMessages(mailbox, fields);
+
+    // The index might still know about messages which are gone by now
+    QList<uint> matches;
+    std::set_intersection(found.constBegin(), found.constEnd(), uids.constBegin(), uids.constEnd(), std::back_inserter(matches));
+    // Messages which we cannot say anything about
+    QList<uint> notIndexed, unknown;
+    std::set_difference(uids.constBegin(), uids.constEnd(), indexed.constBegin(), indexed.constEnd(), std::back_inserter(notIndexed));
+    std::set_difference(notIndexed.constBegin(), notIndexed.constEnd(), matches.constBegin(), matches.constEnd(),
+                        std::back_inserter(unknown));
+
+    logTrace(QString::fromUtf8("Full-text index: %1 matches, %2 messages have to be searched on the server")
+             .arg(QString::number(matches.size()), QString::number(unknown.size())));
+
+    if (m_sortTask && m_sortTask->isPersistent() && searchConditions == m_currentSearchConditions) {
+        // Our caller has already cancelled the updates if the conditions have changed
+        m_sortTask->cancelSortingUpdates();
+    }
+    forgetSortTask();
+
+    m_currentSearchConditions = searchConditions;
+    m_currentSortResult = matches;
+
+    if (unknown.isEmpty() || !realModel->isNetworkAvailable()) {
+        m_sortTaskCoversUnindexedOnly = false;
+        m_localSearchResult.clear();
+        m_searchValidity = RESULT_FRESH;
+        applySort();
+        return true;
+    }
+
+    // Show what we've got so far and ask the server about the rest
+    m_localSearchResult = matches;
+    m_sortTaskCoversUnindexedOnly = true;
+    m_searchValidity = RESULT_ASKED;
+    applySort();
+    QStringList serverConditions;
+    const QByteArray unknownUids = Sequence::fromList(unknown).toByteArray();
+    if (unknownUids.size() <= maxSearchUidSetLength)
+        serverConditions << QLatin1String("UID") << QString::fromUtf8(unknownUids);
+    // else: the command would be too long, so let the server go through the whole mailbox; we still merge the results
+    serverConditions += searchConditions;
+    m_sortTask = realModel->m_taskFactory->createSortTask(const_cast<Model *>(realModel), mailboxIndex, serverConditions,
+                                                          QStringList());
+    connect(m_sortTask, SIGNAL(sortingAvailable(QList<uint>)), this, SLOT(slotSortingAvailable(QList<uint>)));
+    connect(m_sortTask, SIGNAL(sortingFailed()), this, SLOT(slotSortingFailed()));
+    return true;
+}
+
 void ThreadingMsgListModel::applySort()
 {
     if (!sourceModel()->rowCount()) {
@@ -26,6 +26,8 @@
 #include <QAbstractProxyModel>
 #include <QPointer>
 #include <QSet>
+#include "Imap/Model/LocalSorting.h"
+#include "Imap/Model/LocalThreading.h"
 #include "Imap/Parser/Response.h"
 
 class QTimer;
@@ -190,6 +192,7 @@ public slots:
     void slotIncrementalThreadingFailed();
 
     void delayedPrune();
+    void delayedLocalThreading();
 
 signals:
     void sortingFailed();
@@ -204,6 +207,16 @@ private:
     */
     void askForThreading(const uint firstUnknownUid = 0);
 
+    /** @short Can the server do the threading for us? */
+    bool serverSupportsThreading(const Model *realModel) const;
+
+    /** @short Thread the messages through the LocalThreading engine when the server cannot do that */
+    void threadLocally(TreeItemMsgList *list);
+
+    /** @short Sort the messages through the LocalSorting engine when the server cannot do that */
+    void sortLocally(const Model *realModel, const QModelIndex &mailboxIndex, TreeItemMsgList *list,
+                     const SortCriterium criterium);
+
     void updatePersistentIndexesPhase1();
     void updatePersistentIndexesPhase2();
 
@@ -220,9 +233,49 @@ private:
     void registerThreading(const QVector<Imap::Responses::ThreadingNode> &mapping, uint parentId,
                            const QHash<uint,void *> &uidToPtr, QSet<uint> &usedNodes);
 
+    /** @short Turn the current tree into the one described by a THREAD response through fine-grained moves and insertions
+
+    This is only correct when the current tree was built from an earlier THREAD response and has not been sorted or filtered
+    since then; applyThreading() checks that.
+    */
+    void applyThreadingIncrementally(const QVector<Imap::Responses::ThreadingNode> &mapping);
+
+    /** @short Make the children of the @arg parentId match the @arg nodes from a THREAD response
+
+    Nodes which remain after the matching ones are recorded in the @arg leftovers; they might still get claimed by some later
+    part of the THREAD response.
+    */
+    void placeThreadingNodes(const QVector<Imap::Responses::ThreadingNode> &nodes, const uint parentId, Model *realModel,
+                             TreeItemMsgList *list, QList<QPair<uint, int> > &leftovers);
+
+    /** @short Put the message with @arg uid to the @arg row of the @arg parentId and continue with its @arg children */
+    void placeThreadingNode(const uint uid, const QVector<Imap::Responses::ThreadingNode> &children, const uint parentId, int &row,
+                            Model *realModel, TreeItemMsgList *list, QList<QPair<uint, int> > &leftovers);
+
+    /** @short Move an existing node under the @arg parentId to the specified @arg row */
+    void moveThreadNode(const uint nodeId, const uint parentId, const int row);
+
+    /** @short Create a node for a message which is not in the tree yet */
+    uint insertThreadNode(TreeItem *ptr, const uint parentId, const int row);
+
+    /** @short Refresh the offsets of the children of @arg parentId which are placed between @arg first and @arg last */
+    void updateChildOffsets(const uint parentId, const int first, const int last);
+
+    /** @short Return the model index of the threading node @arg nodeId */
+    QModelIndex indexForThreadNode(const uint nodeId) const;
+
     bool searchSortPreferenceImplementation(const QStringList &searchConditions, const SortCriterium criterium,
                                             const Qt::SortOrder order = Qt::AscendingOrder);
 
+    /** @short Try to answer the search through the local full-text index
+
+    Returns false if the index cannot help and the whole search shall go to the server.
+    */
+    bool searchLocally(const Model *realModel, const QModelIndex &mailboxIndex, TreeItemMsgList *list,
+                       const QStringList &searchConditions);
+    /** @short Stop listening to the current SortTask */
+    void forgetSortTask();
+
     /** @short Remove fake messages from the threading tree */
     void pruneTree();
 
@@ -290,6 +343,9 @@ private:
     /** @short IDs of all thread roots when no sorting or filtering is applied */
     QList<uint> threadedRootIds;
 
+    /** @short Does the tree reflect a THREAD response, as opposed to the flat list from updateNoThreading()? */
+    bool m_treeFollowsThreading;
+
     /** @short Sorting criteria of the current copy of the sort result */
     SortCriterium m_currentSortingCriteria;
 
@@ -311,8 +367,24 @@ private:
 
     ResultValidity m_searchValidity;
 
+    /** @short Is the current SortTask restricted to messages which are missing from the full-text index? */
+    bool m_sortTaskCoversUnindexedOnly;
+    /** @short Local matches which shall be merged with the result of a SortTask restricted to the unindexed messages */
+    QList<uint> m_localSearchResult;
+
     QTimer *m_delayedPrune;
 
+    /** @short Client-side threading state, used when the server doesn't support THREAD */
+    LocalThreading m_localThreading;
+    /** @short Is the current threading coming from the m_localThreading? */
+    bool m_localThreadingActive;
+    /** @short Client-side sorting state, used when the server doesn't support SORT */
+    LocalSorting m_localSorting;
+    /** @short Is the current sort result coming from the m_localSorting? */
+    bool m_localSortingActive;
+    /** @short Re-thread or re-sort locally once the headers of some not-yet-processed messages arrive */
+    QTimer *m_delayedLocalThreading;
+
     friend class ::ImapModelThreadingTest; // needs access to wantThreading();
 };
 
@@ -21,8 +21,10 @@
 */
 #include "Utils.h"
 #include <cmath>
+#include <QBuffer>
 #include <QDateTime>
 #include <QDir>
+#include <QFile>
 #if QT_VERSION >= QT_VERSION_CHECK(5, 0, 0)
 #include <QGuiApplication>
 #endif
@@ -36,6 +38,7 @@
 
 #include "Common/Paths.h"
 #include "Common/SettingsNames.h"
+#include "Imap/Model/ItemRoles.h"
 #include "Imap/Model/Model.h"
 
 #ifdef TROJITA_MOBILITY_SYSTEMINFO
@@ -417,6 +420,30 @@ void CertificateUtils::formatSslState(const QList<QSslCertificate> &sslChain, co
     }
 }
 
+/** @short Open the contents of an already fetched message part for reading
+
+Huge parts which live in a file of the disk cache are read straight from that file, so their data are never loaded into
+memory as a whole. Returns a null pointer if the data are not available yet.
+*/
+QSharedPointer<QIODevice> partDataDevice(const QModelIndex &partIndex)
+{
+    if (!partIndex.isValid() || !partIndex.data(RoleIsFetched).toBool())
+        return QSharedPointer<QIODevice>();
+
+    QSharedPointer<QIODevice> io;
+    const QString fileName = partIndex.data(RolePartDataFileName).toString();
+    if (!fileName.isEmpty()) {
+        io = QSharedPointer<QIODevice>(new QFile(fileName));
+    } else {
+        QBuffer *buf = new QBuffer();
+        buf->setData(partIndex.data(RolePartData).toByteArray());
+        io = QSharedPointer<QIODevice>(buf);
+    }
+    if (!io->open(QIODevice::ReadOnly))
+        return QSharedPointer<QIODevice>();
+    return io;
+}
+
 }
 
 /** @short Return current date in the RFC2822 format
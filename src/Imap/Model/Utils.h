@@ -25,7 +25,9 @@
 #include <QDateTime>
 #include <QModelIndex>
 #include <QObject>
+#include <QSharedPointer>
 
+class QIODevice;
 class QSettings;
 class QSslCertificate;
 class QSslError;
@@ -74,6 +76,8 @@ public:
     static QByteArray htmlHexifyByteArray(const QByteArray &rawInput);
 };
 
+QSharedPointer<QIODevice> partDataDevice(const QModelIndex &partIndex);
+
 }
 
 QString formatDateTimeWithTimeZoneAtEnd(const QDateTime &now, const QString &format);
@@ -90,6 +90,18 @@ void MsgPartNetworkReply::slotMyDataChanged()
     if (!part.data(Mailbox::RoleIsFetched).toBool())
         return;
 
+    Mailbox::TreeItemPart *partPtr = dynamic_cast<Mailbox::TreeItemPart *>(static_cast<Mailbox::TreeItem *>(part.internalPointer()));
+    Q_ASSERT(partPtr);
+    if (!partPtr->cacheFileName().isEmpty() && !file.isOpen()) {
+        file.setFileName(partPtr->cacheFileName());
+        if (!file.open(QIODevice::ReadOnly)) {
+            setError(ContentNotFoundError, file.errorString());
+            emit error(ContentNotFoundError);
+            emit finished();
+            return;
+        }
+    }
+
     MsgPartNetAccessManager *netAccess = qobject_cast<MsgPartNetAccessManager*>(manager());
     Q_ASSERT(netAccess);
     QString mimeType = netAccess->translateToSupportedMimeType(part.data(Mailbox::RolePartMimeType).toString());
@@ -116,20 +128,29 @@ void MsgPartNetworkReply::close()
 {
     disconnectBufferIfVanished();
     buffer.close();
+    file.close();
 }
 
 /** @short QIODevice compatibility */
 qint64 MsgPartNetworkReply::bytesAvailable() const
 {
     disconnectBufferIfVanished();
-    return buffer.bytesAvailable() + QNetworkReply::bytesAvailable();
+    return dataDevice()->bytesAvailable() + QNetworkReply::bytesAvailable();
 }
 
 /** @short QIODevice compatibility */
 qint64 MsgPartNetworkReply::readData(char *data, qint64 maxSize)
 {
     disconnectBufferIfVanished();
-    return buffer.read(data, maxSize);
+    return dataDevice()->read(data, maxSize);
+}
+
+/** @short Return the device which actually holds the data */
+QIODevice *MsgPartNetworkReply::dataDevice() const
+{
+    if (file.isOpen())
+        return &file;
+    return &buffer;
 }
 
 
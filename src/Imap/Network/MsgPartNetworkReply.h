@@ -23,6 +23,7 @@
 #define MSGPARTNETWORKREPLY_H
 
 #include <QBuffer>
+#include <QFile>
 #include <QModelIndex>
 #include <QNetworkReply>
 
@@ -49,9 +50,12 @@ protected:
     virtual qint64 readData(char *data, qint64 maxSize);
 private:
     void disconnectBufferIfVanished() const;
+    QIODevice *dataDevice() const;
 
     QPersistentModelIndex part;
     mutable QBuffer buffer;
+    /** @short Data of huge parts are served from their cache file instead of the in-memory buffer */
+    mutable QFile file;
 
     MsgPartNetworkReply(const MsgPartNetworkReply &); // don't implement
     MsgPartNetworkReply &operator=(const MsgPartNetworkReply &); // don't implement
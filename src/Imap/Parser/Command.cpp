@@ -75,7 +75,10 @@ QTextStream &operator<<(QTextStream &stream, const PartOfCommand &part)
     }
     break;
     case LITERAL:
-        stream << "{" << part.text.length() << "}" << endl << part.text;
+        if (part.device)
+            stream << "{" << part.literalSize() << "}" << endl << "[streamed literal data]";
+        else
+            stream << "{" << part.text.length() << "}" << endl << part.text;
         break;
     case IDLE:
         stream << "IDLE" << endl << "[Entering IDLE mode...]";
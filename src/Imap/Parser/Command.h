@@ -23,7 +23,9 @@
 #define IMAP_COMMAND_H
 
 #include <QDateTime>
+#include <QIODevice>
 #include <QList>
+#include <QSharedPointer>
 #include <QTextStream>
 
 /** @short Namespace for IMAP interaction */
@@ -69,16 +71,28 @@ class PartOfCommand
 {
     TokenType kind; /**< What encoding to use for this item */
     QByteArray text; /**< Actual text to send */
+    /** @short Source of a literal which is too big to be kept in memory as a whole, if any */
+    QSharedPointer<QIODevice> device;
     bool numberSent;
+    bool dataSent;
 
     friend QTextStream &operator<<(QTextStream &stream, const PartOfCommand &c);
     friend class ::Imap::Parser;
 
 public:
     /** Default constructor */
-    PartOfCommand(const TokenType kind, const QByteArray &text): kind(kind), text(text), numberSent(false) {}
+    PartOfCommand(const TokenType kind, const QByteArray &text): kind(kind), text(text), numberSent(false), dataSent(false) {}
     /** Constructor that guesses correct type for passed string */
-    PartOfCommand(const QByteArray &text): kind(howToTransmit(text)), text(text), numberSent(false) {}
+    PartOfCommand(const QByteArray &text): kind(howToTransmit(text)), text(text), numberSent(false), dataSent(false) {}
+    /** @short Constructor for a literal whose data are read from the @arg device while they are being sent
+
+    The device must report its full size() in advance, and it must deliver exactly that many bytes.
+    */
+    explicit PartOfCommand(const QSharedPointer<QIODevice> &device):
+        kind(LITERAL), device(device), numberSent(false), dataSent(false) {}
+
+    /** @short Size of the literal data */
+    qint64 literalSize() const { return device ? device->size() : text.size(); }
 };
 
 /** @short Abstract class for specifying what command to execute */
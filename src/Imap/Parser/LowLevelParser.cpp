@@ -405,6 +405,43 @@ QList<uint> getSequence(const QByteArray &line, int &start)
     }
 }
 
+Sequence getSequenceSet(const QByteArray &line, int &start)
+{
+    Sequence seq;
+    uint lo = LowLevelParser::getUInt(line, start);
+    uint hi = lo;
+
+    enum {COMMA, RANGE} currentType = COMMA;
+
+    while (start < line.size() - 2 && (line[start] == ':' || line[start] == ',')) {
+        if (line[start] == ':') {
+            if (currentType == RANGE) {
+                // Now "x:y:z" is a funny syntax
+                throw UnexpectedHere("Sequence set: range cannot me defined by three numbers", line, start);
+            }
+            currentType = RANGE;
+        } else {
+            seq.add(lo, hi);
+            currentType = COMMA;
+        }
+
+        ++start;
+        if (start >= line.size() - 2) throw NoData("Truncated sequence set", line, start);
+
+        uint num = LowLevelParser::getUInt(line, start);
+        if (currentType == COMMA) {
+            lo = hi = num;
+        } else {
+            if (hi >= num)
+                throw UnexpectedHere("Sequence set contains an invalid range. "
+                                     "First item of a range must always be smaller than the second item.", line, start);
+            hi = num;
+        }
+    }
+    seq.add(lo, hi);
+    return seq;
+}
+
 QDateTime parseRFC2822DateTime(const QString &string)
 {
     QStringList monthNames = QStringList() << QLatin1String("jan") << QLatin1String("feb") << QLatin1String("mar")
@@ -25,6 +25,7 @@
 #include <QList>
 #include <QPair>
 #include <QVariant>
+#include "Sequence.h"
 
 namespace Imap
 {
@@ -71,6 +72,9 @@ QPair<QByteArray,ParsedAs> getString(const QByteArray &line, int &start);
 /** @short Read atom or string */
 QPair<QByteArray,ParsedAs> getAString(const QByteArray &line, int &start);
 
+/** @short Does the input start with a NIL atom? */
+bool startsWithNil(const QByteArray &line, int start);
+
 /** @short Read NIL or a string */
 QPair<QByteArray,ParsedAs> getNString(const QByteArray &line, int &start);
 
@@ -94,9 +98,16 @@ QVariantList parseList(const char open, const char close,
 /** @short Read one item from input, store it in a most-appropriate form */
 QVariant getAnything(const QByteArray &line, int &start);
 
-/** @short Parse a sequence set from the input */
+/** @short Parse a sequence set from the input, preserving the order of the items */
 QList<uint> getSequence(const QByteArray &line, int &start);
 
+/** @short Parse a sequence set from the input as a set of ranges
+
+Unlike getSequence(), the ranges are never expanded into individual numbers, so parsing
+"1:100000" is as cheap as parsing a single number. The order of the items is not preserved.
+*/
+Sequence getSequenceSet(const QByteArray &line, int &start);
+
 /** @short Parse RFC2822-like formatted date
  *
  * Code for this class was lobotomized from KDE's KDateTime.
@@ -22,6 +22,7 @@
 
 #include <typeinfo>
 
+#include <QDataStream>
 #include <QTextDocument>
 #include <QUrl>
 #if QT_VERSION >= QT_VERSION_CHECK(5, 0, 0)
@@ -62,6 +63,21 @@ QList<MailAddress> Envelope::getListOfAddresses(const QVariant &in, const QByteA
     return res;
 }
 
+/** @short Parse the date from ENVELOPE, returning a null QDateTime if it's missing or malformed */
+static QDateTime envelopeDate(const QByteArray &dateStr)
+{
+    QDateTime date;
+    if (! dateStr.isEmpty()) {
+        try {
+            date = LowLevelParser::parseRFC2822DateTime(dateStr);
+        } catch (ParseError &) {
+            // FIXME: log this
+            //throw ParseError( e.what(), line, start );
+        }
+    }
+    return date;
+}
+
 Envelope Envelope::fromList(const QVariantList &items, const QByteArray &line, const int start)
 {
     if (items.size() != 10)
@@ -70,20 +86,10 @@ Envelope Envelope::fromList(const QVariantList &items, const QByteArray &line, c
     // date
     QDateTime date;
     if (items[0].type() == QVariant::ByteArray) {
-        QByteArray dateStr = items[0].toByteArray();
-        if (! dateStr.isEmpty()) {
-            try {
-                date = LowLevelParser::parseRFC2822DateTime(dateStr);
-            } catch (ParseError &) {
-                // FIXME: log this
-                //throw ParseError( e.what(), line, start );
-            }
-        }
+        date = envelopeDate(items[0].toByteArray());
     }
     // Otherwise it's "invalid", null.
 
-    QString subject = Imap::decodeRFC2047String(items[1].toByteArray());
-
     QList<MailAddress> from, sender, replyTo, to, cc, bcc;
     from = Envelope::getListOfAddresses(items[2], line, start);
     sender = Envelope::getListOfAddresses(items[3], line, start);
@@ -92,15 +98,24 @@ Envelope Envelope::fromList(const QVariantList &items, const QByteArray &line, c
     cc = Envelope::getListOfAddresses(items[6], line, start);
     bcc = Envelope::getListOfAddresses(items[7], line, start);
 
-    LowLevelParser::Rfc5322HeaderParser headerParser;
-
     if (items[8].type() != QVariant::ByteArray)
         throw UnexpectedHere("Envelope::fromList: inReplyTo not a QByteArray", line, start);
-    QByteArray inReplyTo = items[8].toByteArray();
 
     if (items[9].type() != QVariant::ByteArray)
         throw UnexpectedHere("Envelope::fromList: messageId not a QByteArray", line, start);
-    QByteArray messageId = items[9].toByteArray();
+
+    return fromFields(date, items[1].toByteArray(), from, sender, replyTo, to, cc, bcc,
+                      items[8].toByteArray(), items[9].toByteArray());
+}
+
+Envelope Envelope::fromFields(const QDateTime &date, const QByteArray &rawSubject, const QList<MailAddress> &from,
+                              const QList<MailAddress> &sender, const QList<MailAddress> &replyTo,
+                              const QList<MailAddress> &to, const QList<MailAddress> &cc, const QList<MailAddress> &bcc,
+                              const QByteArray &inReplyTo, QByteArray messageId)
+{
+    QString subject = Imap::decodeRFC2047String(rawSubject);
+
+    LowLevelParser::Rfc5322HeaderParser headerParser;
 
     QByteArray buf;
     if (!messageId.isEmpty())
@@ -637,6 +652,748 @@ QSharedPointer<AbstractMessage> AbstractMessage::fromList(const QVariantList &it
     }
 }
 
+/** @short Recursive-descent reader of ENVELOPE and BODYSTRUCTURE
+
+This is a faster alternative to LowLevelParser::parseList() followed by Envelope::fromList() or AbstractMessage::fromList().
+The typed objects are created directly from the response without going through a tree of QVariants.
+
+The reader only deals with data which look reasonable. Whenever something unusual is found, an exception is thrown and
+the caller is expected to retry with the generic code.
+*/
+class StructureReader
+{
+public:
+    StructureReader(const QByteArray &line, int &start):
+        m_line(line), m_start(start)
+    {
+    }
+
+    Envelope envelope()
+    {
+        openList();
+        QDateTime date = envelopeDate(scalar());
+        QByteArray subject = scalar();
+        QList<MailAddress> from = addresses();
+        QList<MailAddress> sender = addresses();
+        QList<MailAddress> replyTo = addresses();
+        QList<MailAddress> to = addresses();
+        QList<MailAddress> cc = addresses();
+        QList<MailAddress> bcc = addresses();
+        QByteArray inReplyTo = scalar();
+        QByteArray messageId = scalar();
+        closeList();
+        return Envelope::fromFields(date, subject, from, sender, replyTo, to, cc, bcc, inReplyTo, messageId);
+    }
+
+    QSharedPointer<AbstractMessage> body()
+    {
+        openList();
+        if (atEnd())
+            throw NoData("StructureReader: empty body", m_line, m_start);
+        return atList() ? multipartBody() : singlepartBody();
+    }
+
+private:
+    void eatSpaces()
+    {
+        LowLevelParser::eatSpaces(m_line, m_start);
+        if (m_start >= m_line.size())
+            throw NoData("StructureReader: truncated data", m_line, m_start);
+    }
+
+    bool atEnd()
+    {
+        eatSpaces();
+        return m_line[m_start] == ')';
+    }
+
+    bool atList()
+    {
+        eatSpaces();
+        return m_line[m_start] == '(';
+    }
+
+    void openList()
+    {
+        eatSpaces();
+        if (m_line[m_start] != '(')
+            throw UnexpectedHere("StructureReader: expected a list", m_line, m_start);
+        ++m_start;
+    }
+
+    void closeList()
+    {
+        eatSpaces();
+        if (m_line[m_start] != ')')
+            throw UnexpectedHere("StructureReader: expected end of list", m_line, m_start);
+        ++m_start;
+    }
+
+    /** @short Read a string, NIL or an atom; the same as what LowLevelParser::getAnything() would do for these */
+    QByteArray scalar()
+    {
+        eatSpaces();
+        QByteArray res;
+        const char c = m_line[m_start];
+        if (c == '"' || c == '{' || c == '~') {
+            res = LowLevelParser::getString(m_line, m_start).first;
+        } else if (LowLevelParser::startsWithNil(m_line, m_start)) {
+            m_start += 3;
+        } else if (c == '(' || c == ')' || c == '[' || c == '\\') {
+            throw UnexpectedHere("StructureReader: expected a string", m_line, m_start);
+        } else {
+            res = LowLevelParser::getAtom(m_line, m_start);
+            if (m_start < m_line.size() && m_line[m_start] == '[')
+                throw UnexpectedHere("StructureReader: unexpected [", m_line, m_start);
+        }
+        return res;
+    }
+
+    /** @short Read anything at all, as a QVariant */
+    QVariant anything()
+    {
+        eatSpaces();
+        return LowLevelParser::getAnything(m_line, m_start);
+    }
+
+    /** @short Convert to a QString the same way as QVariant::toString() does */
+    static QString toString(const QByteArray &data)
+    {
+        return QVariant(data).toString();
+    }
+
+    /** @short Read a number; missing and negative ones are treated as zero, just like AbstractMessage::extractUInt() does */
+    uint number()
+    {
+        QByteArray data = scalar();
+        bool ok = false;
+        int number = QVariant(data).toInt(&ok);
+        if (ok)
+            return number >= 0 ? number : 0;
+        if (data.isEmpty())
+            return 0;
+        throw UnexpectedHere("StructureReader: not a number", m_line, m_start);
+    }
+
+    QList<MailAddress> addresses()
+    {
+        QList<MailAddress> res;
+        if (!atList()) {
+            if (!scalar().isNull())
+                throw UnexpectedHere("StructureReader: address list is neither a list nor NIL", m_line, m_start);
+            return res;
+        }
+        openList();
+        while (!atEnd()) {
+            openList();
+            QByteArray name = scalar();
+            QByteArray adl = scalar();
+            QByteArray mailbox = scalar();
+            QByteArray host = scalar();
+            closeList();
+            res << MailAddress(Imap::decodeRFC2047String(name), Imap::decodeRFC2047String(adl),
+                               Imap::decodeRFC2047String(mailbox), Imap::decodeRFC2047String(host));
+        }
+        closeList();
+        return res;
+    }
+
+    AbstractMessage::bodyFldParam_t bodyFldParam()
+    {
+        AbstractMessage::bodyFldParam_t res;
+        if (!atList()) {
+            if (!scalar().isNull())
+                throw UnexpectedHere("StructureReader: body-fld-param is neither a list nor NIL", m_line, m_start);
+            return res;
+        }
+        openList();
+        while (!atEnd()) {
+            QByteArray key = scalar().toUpper();
+            if (atEnd())
+                throw UnexpectedHere("StructureReader: body-fld-param: wrong number of entries", m_line, m_start);
+            res[key] = scalar();
+        }
+        closeList();
+        return res;
+    }
+
+    AbstractMessage::bodyFldDsp_t bodyFldDsp()
+    {
+        AbstractMessage::bodyFldDsp_t res;
+        if (!atList()) {
+            if (!scalar().isNull())
+                throw UnexpectedHere("StructureReader: body-fld-dsp is neither a list nor NIL", m_line, m_start);
+            return res;
+        }
+        openList();
+        res.first = scalar();
+        res.second = bodyFldParam();
+        closeList();
+        return res;
+    }
+
+    QList<QByteArray> bodyFldLang()
+    {
+        QList<QByteArray> res;
+        if (!atList()) {
+            QByteArray lang = scalar();
+            if (!lang.isNull())
+                res << lang;
+            return res;
+        }
+        openList();
+        while (!atEnd())
+            res << scalar();
+        closeList();
+        return res;
+    }
+
+    /** @short Read the body-extension, i.e. everything up to the end of the current list */
+    QVariant bodyExtension()
+    {
+        QVariantList list;
+        while (!atEnd())
+            list << anything();
+        if (list.isEmpty())
+            return QVariant();
+        if (list.size() == 1)
+            return list.front();
+        return list;
+    }
+
+    QSharedPointer<AbstractMessage> singlepartBody()
+    {
+        QString mediaType = toString(scalar()).toLower();
+        if (atEnd())
+            throw NoData("StructureReader: body-type-1part: no media subtype", m_line, m_start);
+        QString mediaSubType = toString(scalar()).toLower();
+
+        // The fields which the generic parser would complain about via qDebug() are better left to it
+        if (atEnd())
+            throw NoData("StructureReader: body-type-1part: no body-fields", m_line, m_start);
+        AbstractMessage::bodyFldParam_t bodyFldParam = this->bodyFldParam();
+        QByteArray bodyFldId = scalar();
+        QByteArray bodyFldDesc = scalar();
+        QByteArray bodyFldEnc = scalar();
+        uint bodyFldOctets = number();
+
+        uint bodyFldLines = 0;
+        Envelope envelope;
+        QSharedPointer<AbstractMessage> body;
+
+        enum { MESSAGE, TEXT, BASIC} kind;
+
+        if (mediaType == QLatin1String("message") && mediaSubType == QLatin1String("rfc822")) {
+            kind = MESSAGE;
+            if (!atList())
+                throw UnexpectedHere("StructureReader: message/rfc822: envelope not a list", m_line, m_start);
+            envelope = this->envelope();
+            if (!atList())
+                throw UnexpectedHere("StructureReader: message/rfc822: body not a list", m_line, m_start);
+            body = this->body();
+            bodyFldLines = number();
+        } else if (mediaType == QLatin1String("text")) {
+            kind = TEXT;
+            if (!atEnd())
+                bodyFldLines = number();
+        } else {
+            kind = BASIC;
+        }
+
+        QByteArray bodyFldMd5;
+        if (!atEnd())
+            bodyFldMd5 = scalar();
+
+        AbstractMessage::bodyFldDsp_t bodyFldDsp;
+        if (!atEnd())
+            bodyFldDsp = this->bodyFldDsp();
+
+        QList<QByteArray> bodyFldLang;
+        if (!atEnd())
+            bodyFldLang = this->bodyFldLang();
+
+        QByteArray bodyFldLoc;
+        if (!atEnd())
+            bodyFldLoc = scalar();
+
+        QVariant bodyExtension = this->bodyExtension();
+        closeList();
+
+        switch (kind) {
+        case MESSAGE:
+            return QSharedPointer<AbstractMessage>(
+                       new MsgMessage(mediaType, mediaSubType, bodyFldParam,
+                                      bodyFldId, bodyFldDesc, bodyFldEnc, bodyFldOctets,
+                                      bodyFldMd5, bodyFldDsp, bodyFldLang, bodyFldLoc,
+                                      bodyExtension, envelope, body, bodyFldLines)
+                   );
+        case TEXT:
+            return QSharedPointer<AbstractMessage>(
+                       new TextMessage(mediaType, mediaSubType, bodyFldParam,
+                                       bodyFldId, bodyFldDesc, bodyFldEnc, bodyFldOctets,
+                                       bodyFldMd5, bodyFldDsp, bodyFldLang, bodyFldLoc,
+                                       bodyExtension, bodyFldLines)
+                   );
+        case BASIC:
+        default:
+            return QSharedPointer<AbstractMessage>(
+                       new BasicMessage(mediaType, mediaSubType, bodyFldParam,
+                                        bodyFldId, bodyFldDesc, bodyFldEnc, bodyFldOctets,
+                                        bodyFldMd5, bodyFldDsp, bodyFldLang, bodyFldLoc,
+                                        bodyExtension)
+                   );
+        }
+    }
+
+    QSharedPointer<AbstractMessage> multipartBody()
+    {
+        QList<QSharedPointer<AbstractMessage> > bodies;
+        while (atList())
+            bodies << body();
+
+        if (atEnd())
+            throw UnexpectedHere("StructureReader: body-type-mpart: no media-subtype", m_line, m_start);
+        QString mediaSubType = toString(scalar()).toLower();
+
+        AbstractMessage::bodyFldParam_t bodyFldParam;
+        if (!atEnd())
+            bodyFldParam = this->bodyFldParam();
+
+        AbstractMessage::bodyFldDsp_t bodyFldDsp;
+        if (!atEnd())
+            bodyFldDsp = this->bodyFldDsp();
+
+        QList<QByteArray> bodyFldLang;
+        if (!atEnd())
+            bodyFldLang = this->bodyFldLang();
+
+        QByteArray bodyFldLoc;
+        if (!atEnd())
+            bodyFldLoc = scalar();
+
+        QVariant bodyExtension = this->bodyExtension();
+        closeList();
+
+        return QSharedPointer<AbstractMessage>(
+                   new MultiMessage(bodies, mediaSubType, bodyFldParam,
+                                    bodyFldDsp, bodyFldLang, bodyFldLoc, bodyExtension));
+    }
+
+    const QByteArray &m_line;
+    int &m_start;
+};
+
+Envelope Envelope::fromLine(const QByteArray &line, int &start)
+{
+    return StructureReader(line, start).envelope();
+}
+
+QSharedPointer<AbstractMessage> AbstractMessage::fromLine(const QByteArray &line, int &start)
+{
+    return StructureReader(line, start).body();
+}
+
+namespace
+{
+
+/** @short Marker of the compact BODYSTRUCTURE format
+
+The legacy format begins with a big-endian item count of the QVariantList, so the very first byte was always zero.
+*/
+const char cacheDataMagic = '\xb5';
+/** @short Version of the compact BODYSTRUCTURE format, to be increased on each incompatible change */
+const char cacheDataVersion = 1;
+
+enum CachedPartKind {
+    PART_BASIC,
+    PART_TEXT,
+    PART_MESSAGE,
+    PART_MULTIPART
+};
+
+/** @short Helper for dumping the MIME tree into the compact binary form
+
+All numbers are stored as variable-length integers, seven bits per byte. Strings are prefixed by their length plus one,
+with zero being reserved for the null ones.
+*/
+class CacheDataWriter
+{
+public:
+    explicit CacheDataWriter(QByteArray &out): m_out(out)
+    {
+    }
+
+    void number(quint32 num)
+    {
+        while (num >= 0x80) {
+            m_out.append(static_cast<char>((num & 0x7f) | 0x80));
+            num >>= 7;
+        }
+        m_out.append(static_cast<char>(num));
+    }
+
+    void bytes(const QByteArray &data)
+    {
+        if (data.isNull()) {
+            number(0);
+        } else {
+            number(data.size() + 1);
+            m_out.append(data);
+        }
+    }
+
+    void string(const QString &data)
+    {
+        bytes(data.isNull() ? QByteArray() : data.toUtf8());
+    }
+
+    void list(const QList<QByteArray> &data)
+    {
+        number(data.size());
+        Q_FOREACH(const QByteArray &item, data)
+            bytes(item);
+    }
+
+    void params(const AbstractMessage::bodyFldParam_t &data)
+    {
+        number(data.size());
+        for (AbstractMessage::bodyFldParam_t::const_iterator it = data.constBegin(); it != data.constEnd(); ++it) {
+            bytes(it.key());
+            bytes(it.value());
+        }
+    }
+
+    void dateTime(const QDateTime &data)
+    {
+        if (!data.isValid()) {
+            number(0);
+            return;
+        }
+        // We never produce anything else but UTC, but let's be careful with whatever could come from the outside
+        QDateTime utc = data.toUTC();
+        number(1);
+        number(static_cast<quint32>(utc.date().toJulianDay()));
+        number(QTime(0, 0).msecsTo(utc.time()));
+    }
+
+    void addresses(const QList<MailAddress> &data)
+    {
+        number(data.size());
+        Q_FOREACH(const MailAddress &addr, data) {
+            string(addr.name);
+            string(addr.adl);
+            string(addr.mailbox);
+            string(addr.host);
+        }
+    }
+
+    void envelope(const Envelope &data)
+    {
+        dateTime(data.date);
+        string(data.subject);
+        addresses(data.from);
+        addresses(data.sender);
+        addresses(data.replyTo);
+        addresses(data.to);
+        addresses(data.cc);
+        addresses(data.bcc);
+        list(data.inReplyTo);
+        bytes(data.messageId);
+    }
+
+    /** @short Store the fields which are present in all body types */
+    void extensionFields(const AbstractMessage &part)
+    {
+        bytes(part.bodyFldDsp.first);
+        params(part.bodyFldDsp.second);
+        list(part.bodyFldLang);
+        bytes(part.bodyFldLoc);
+        if (part.bodyExtension.isValid()) {
+            // This is rare enough and its structure arbitrary, so there's no point in inventing anything better here
+            QByteArray buf;
+            QDataStream stream(&buf, QIODevice::WriteOnly);
+            stream.setVersion(QDataStream::Qt_4_6);
+            stream << part.bodyExtension;
+            bytes(buf);
+        } else {
+            bytes(QByteArray());
+        }
+    }
+
+    void part(const AbstractMessage &part)
+    {
+        if (const MultiMessage *multi = dynamic_cast<const MultiMessage *>(&part)) {
+            m_out.append(static_cast<char>(PART_MULTIPART));
+            number(multi->bodies.size());
+            Q_FOREACH(const QSharedPointer<AbstractMessage> &child, multi->bodies)
+                this->part(*child);
+            string(multi->mediaSubType);
+            params(multi->bodyFldParam);
+            extensionFields(*multi);
+            return;
+        }
+
+        const OneMessage *one = dynamic_cast<const OneMessage *>(&part);
+        Q_ASSERT(one);
+        const TextMessage *text = dynamic_cast<const TextMessage *>(&part);
+        const MsgMessage *msg = dynamic_cast<const MsgMessage *>(&part);
+        m_out.append(static_cast<char>(text ? PART_TEXT : (msg ? PART_MESSAGE : PART_BASIC)));
+        string(one->mediaType);
+        string(one->mediaSubType);
+        params(one->bodyFldParam);
+        bytes(one->bodyFldId);
+        bytes(one->bodyFldDesc);
+        bytes(one->bodyFldEnc);
+        number(one->bodyFldOctets);
+        bytes(one->bodyFldMd5);
+        extensionFields(*one);
+        if (text) {
+            number(text->bodyFldLines);
+        } else if (msg) {
+            envelope(msg->envelope);
+            this->part(*msg->body);
+            number(msg->bodyFldLines);
+        }
+    }
+
+private:
+    QByteArray &m_out;
+};
+
+/** @short Counterpart to CacheDataWriter */
+class CacheDataReader
+{
+public:
+    explicit CacheDataReader(const QByteArray &data, const int offset):
+        m_data(data), m_pos(data.constData() + offset), m_end(data.constData() + data.size())
+    {
+    }
+
+    bool atEnd() const
+    {
+        return m_pos == m_end;
+    }
+
+    quint32 number()
+    {
+        quint32 res = 0;
+        for (int shift = 0; shift < 32; shift += 7) {
+            need(1);
+            const uchar c = *m_pos++;
+            res |= static_cast<quint32>(c & 0x7f) << shift;
+            if (!(c & 0x80))
+                return res;
+        }
+        throw ParseError("fromCacheData: malformed number", m_data, m_pos - m_data.constData());
+    }
+
+    QByteArray bytes()
+    {
+        const quint32 size = number();
+        if (!size)
+            return QByteArray();
+        need(size - 1);
+        QByteArray res(m_pos, size - 1);
+        m_pos += size - 1;
+        return res;
+    }
+
+    QString string()
+    {
+        const quint32 size = number();
+        if (!size)
+            return QString();
+        if (size == 1)
+            return QString(QLatin1String(""));
+        need(size - 1);
+        QString res = QString::fromUtf8(m_pos, size - 1);
+        m_pos += size - 1;
+        return res;
+    }
+
+    QList<QByteArray> list()
+    {
+        QList<QByteArray> res;
+        for (quint32 i = number(); i > 0; --i)
+            res << bytes();
+        return res;
+    }
+
+    AbstractMessage::bodyFldParam_t params()
+    {
+        AbstractMessage::bodyFldParam_t res;
+        for (quint32 i = number(); i > 0; --i) {
+            QByteArray key = bytes();
+            res[key] = bytes();
+        }
+        return res;
+    }
+
+    QDateTime dateTime()
+    {
+        if (!number())
+            return QDateTime();
+        QDate date = QDate::fromJulianDay(number());
+        QTime time = QTime(0, 0).addMSecs(number());
+        return QDateTime(date, time, Qt::UTC);
+    }
+
+    QList<MailAddress> addresses()
+    {
+        QList<MailAddress> res;
+        for (quint32 i = number(); i > 0; --i) {
+            QString name = string();
+            QString adl = string();
+            QString mailbox = string();
+            QString host = string();
+            res << MailAddress(name, adl, mailbox, host);
+        }
+        return res;
+    }
+
+    Envelope envelope()
+    {
+        Envelope res;
+        res.date = dateTime();
+        res.subject = string();
+        res.from = addresses();
+        res.sender = addresses();
+        res.replyTo = addresses();
+        res.to = addresses();
+        res.cc = addresses();
+        res.bcc = addresses();
+        res.inReplyTo = list();
+        res.messageId = bytes();
+        return res;
+    }
+
+    QSharedPointer<AbstractMessage> part()
+    {
+        need(1);
+        const char kind = *m_pos++;
+
+        if (kind == PART_MULTIPART) {
+            QList<QSharedPointer<AbstractMessage> > bodies;
+            for (quint32 i = number(); i > 0; --i)
+                bodies << part();
+            QString mediaSubType = string();
+            AbstractMessage::bodyFldParam_t bodyFldParam = params();
+            AbstractMessage::bodyFldDsp_t bodyFldDsp;
+            QList<QByteArray> bodyFldLang;
+            QByteArray bodyFldLoc;
+            QVariant bodyExtension;
+            extensionFields(bodyFldDsp, bodyFldLang, bodyFldLoc, bodyExtension);
+            return QSharedPointer<AbstractMessage>(
+                       new MultiMessage(bodies, mediaSubType, bodyFldParam, bodyFldDsp, bodyFldLang, bodyFldLoc, bodyExtension));
+        }
+
+        QString mediaType = string();
+        QString mediaSubType = string();
+        AbstractMessage::bodyFldParam_t bodyFldParam = params();
+        QByteArray bodyFldId = bytes();
+        QByteArray bodyFldDesc = bytes();
+        QByteArray bodyFldEnc = bytes();
+        uint bodyFldOctets = number();
+        QByteArray bodyFldMd5 = bytes();
+        AbstractMessage::bodyFldDsp_t bodyFldDsp;
+        QList<QByteArray> bodyFldLang;
+        QByteArray bodyFldLoc;
+        QVariant bodyExtension;
+        extensionFields(bodyFldDsp, bodyFldLang, bodyFldLoc, bodyExtension);
+
+        switch (kind) {
+        case PART_BASIC:
+            return QSharedPointer<AbstractMessage>(
+                       new BasicMessage(mediaType, mediaSubType, bodyFldParam,
+                                        bodyFldId, bodyFldDesc, bodyFldEnc, bodyFldOctets,
+                                        bodyFldMd5, bodyFldDsp, bodyFldLang, bodyFldLoc,
+                                        bodyExtension));
+        case PART_TEXT:
+        {
+            uint bodyFldLines = number();
+            return QSharedPointer<AbstractMessage>(
+                       new TextMessage(mediaType, mediaSubType, bodyFldParam,
+                                       bodyFldId, bodyFldDesc, bodyFldEnc, bodyFldOctets,
+                                       bodyFldMd5, bodyFldDsp, bodyFldLang, bodyFldLoc,
+                                       bodyExtension, bodyFldLines));
+        }
+        case PART_MESSAGE:
+        {
+            Envelope envelope = this->envelope();
+            QSharedPointer<AbstractMessage> body = part();
+            uint bodyFldLines = number();
+            return QSharedPointer<AbstractMessage>(
+                       new MsgMessage(mediaType, mediaSubType, bodyFldParam,
+                                      bodyFldId, bodyFldDesc, bodyFldEnc, bodyFldOctets,
+                                      bodyFldMd5, bodyFldDsp, bodyFldLang, bodyFldLoc,
+                                      bodyExtension, envelope, body, bodyFldLines));
+        }
+        }
+        throw ParseError("fromCacheData: unknown kind of body part", m_data, m_pos - m_data.constData());
+    }
+
+private:
+    void need(const quint32 size)
+    {
+        if (static_cast<quint32>(m_end - m_pos) < size)
+            throw ParseError("fromCacheData: truncated data", m_data, m_pos - m_data.constData());
+    }
+
+    void extensionFields(AbstractMessage::bodyFldDsp_t &bodyFldDsp, QList<QByteArray> &bodyFldLang,
+                         QByteArray &bodyFldLoc, QVariant &bodyExtension)
+    {
+        bodyFldDsp.first = bytes();
+        bodyFldDsp.second = params();
+        bodyFldLang = list();
+        bodyFldLoc = bytes();
+        QByteArray buf = bytes();
+        if (!buf.isNull()) {
+            QDataStream stream(buf);
+            stream.setVersion(QDataStream::Qt_4_6);
+            stream >> bodyExtension;
+        }
+    }
+
+    const QByteArray &m_data;
+    const char *m_pos;
+    const char *m_end;
+};
+
+}
+
+QByteArray AbstractMessage::toCacheData() const
+{
+    QByteArray res;
+    res.reserve(256);
+    res.append(cacheDataMagic);
+    res.append(cacheDataVersion);
+    CacheDataWriter(res).part(*this);
+    return res;
+}
+
+QSharedPointer<AbstractMessage> AbstractMessage::fromCacheData(const QByteArray &data, bool *legacy)
+{
+    if (data.size() < 2 || data[0] != cacheDataMagic) {
+        if (legacy)
+            *legacy = true;
+        QDataStream stream(data);
+        stream.setVersion(QDataStream::Qt_4_6);
+        QVariantList unserialized;
+        stream >> unserialized;
+        return fromList(unserialized, QByteArray(), 0);
+    }
+
+    if (legacy)
+        *legacy = false;
+    if (data[1] != cacheDataVersion)
+        throw ParseError("fromCacheData: unsupported version", data, 1);
+    CacheDataReader reader(data, 2);
+    QSharedPointer<AbstractMessage> res = reader.part();
+    if (!reader.atEnd())
+        throw TooMuchData("fromCacheData: trailing garbage", data, 0);
+    return res;
+}
+
 void dumpListOfAddresses(QTextStream &stream, const QList<MailAddress> &list, const int indent)
 {
     QByteArray lf("\n");
@@ -72,6 +72,11 @@ public:
         date(_date), subject(_subject), from(_from), sender(_sender), replyTo(_replyTo),
         to(_to), cc(_cc), bcc(_bcc), inReplyTo(_inReplyTo), messageId(_messageId) {}
     static Envelope fromList(const QVariantList &items, const QByteArray &line, const int start);
+    /** @short Parse the ENVELOPE straight from the response, without building the QVariantList first
+
+    Parsing starts at the opening parenthesis at offset @arg start, which is moved past the closing one.
+    */
+    static Envelope fromLine(const QByteArray &line, int &start);
     QTextStream &dump(QTextStream &s, const int indent) const;
 
     void clear();
@@ -79,7 +84,12 @@ public:
 private:
     static QList<MailAddress> getListOfAddresses(const QVariant &in,
             const QByteArray &line, const int start);
+    static Envelope fromFields(const QDateTime &date, const QByteArray &rawSubject, const QList<MailAddress> &from,
+                               const QList<MailAddress> &sender, const QList<MailAddress> &replyTo,
+                               const QList<MailAddress> &to, const QList<MailAddress> &cc, const QList<MailAddress> &bcc,
+                               const QByteArray &inReplyTo, QByteArray messageId);
     friend class Fetch;
+    friend class StructureReader;
 };
 
 
@@ -104,6 +114,23 @@ public:
 
     virtual ~AbstractMessage() {}
     static QSharedPointer<AbstractMessage> fromList(const QVariantList &items, const QByteArray &line, const int start);
+    /** @short Parse the BODYSTRUCTURE straight from the response, without building the QVariantList first
+
+    Parsing starts at the opening parenthesis at offset @arg start, which is moved past the closing one.
+
+    Only the well-formed input is handled here. Anything unusual throws an exception, so that the caller can fall back to
+    the more lenient parseList() and fromList().
+    */
+    static QSharedPointer<AbstractMessage> fromLine(const QByteArray &line, int &start);
+    /** @short Serialize the whole MIME tree into the compact binary form which is stored in the cache */
+    QByteArray toCacheData() const;
+    /** @short Restore the MIME tree from the data created by toCacheData()
+
+    The legacy format, i.e. the QVariantList as returned by the IMAP parser and serialized through QDataStream, is
+    recognized as well. When the @arg legacy is not null, it is set to true if the data used the old format. Malformed
+    data throw a ParseError.
+    */
+    static QSharedPointer<AbstractMessage> fromCacheData(const QByteArray &data, bool *legacy = 0);
 
     static bodyFldParam_t makeBodyFldParam(const QVariant &list, const QByteArray &line, const int start);
     static bodyFldDsp_t makeBodyFldDsp(const QVariant &list, const QByteArray &line, const int start);
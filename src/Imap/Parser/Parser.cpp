@@ -25,9 +25,11 @@
 #include <QMutexLocker>
 #include <QProcess>
 #include <QSslError>
+#include <QThread>
 #include <QTime>
 #include <QTimer>
 #include "Parser.h"
+#include "ParserWorker.h"
 #include "Imap/Encoders.h"
 #include "LowLevelParser.h"
 #include "../../Streams/IODeviceSocket.h"
@@ -86,17 +88,44 @@
 namespace Imap
 {
 
+/** @short Upper limit on how much memory to reserve for an incoming literal before its data actually arrive */
+static const int literalReservationStep = 4 * 1024 * 1024;
+
+/** @short Size of the chunks in which a streamed literal is read from its source */
+static const qint64 literalStreamingChunkSize = 64 * 1024;
+
+/** @short Stop reading a streamed literal when the socket has this many bytes waiting to be sent */
+static const qint64 literalStreamingBufferSize = 256 * 1024;
+
+/** @short Convert one item of the search criteria into a part of the command
+
+A sequence set (as used with the UID search key) would normally get sent as a quoted string because of the colons and
+commas, which is not allowed at that position. It is a valid atom, though, so numbers, ranges and their lists are sent as-is.
+*/
+static Commands::PartOfCommand searchCriteriaItem(const QString &item)
+{
+    bool isSequence = !item.isEmpty();
+    for (int i = 0; i < item.size() && isSequence; ++i) {
+        const ushort c = item.at(i).unicode();
+        isSequence = (c >= '0' && c <= '9') || c == ':' || c == ',';
+    }
+    return isSequence ? Commands::PartOfCommand(Commands::ATOM, item.toUtf8()) : Commands::PartOfCommand(item.toUtf8());
+}
+
 Parser::Parser(QObject *parent, Streams::Socket *socket, const uint myId):
     QObject(parent), socket(socket), m_lastTagUsed(0), idling(false), waitForInitialIdle(false),
     literalPlus(false), waitingForContinuation(false), startTlsInProgress(false), compressDeflateInProgress(false),
     waitingForConnection(true), waitingForEncryption(socket->isConnectingEncryptedSinceStart()), waitingForSslPolicy(false),
-    m_expectsInitialGreeting(true), readingMode(ReadingLine), oldLiteralPosition(0), m_parserId(myId)
+    m_expectsInitialGreeting(true), m_streamingLiteral(false), m_literalBytesRemaining(0),
+    readingMode(ReadingLine), oldLiteralPosition(0), m_parserId(myId),
+    m_worker(0), m_workerThread(0)
 {
     connect(socket, SIGNAL(disconnected(const QString &)),
             this, SLOT(handleDisconnected(const QString &)));
     connect(socket, SIGNAL(readyRead()), this, SLOT(handleReadyRead()));
     connect(socket, SIGNAL(stateChanged(Imap::ConnectionState,QString)), this, SLOT(slotSocketStateChanged(Imap::ConnectionState,QString)));
     connect(socket, SIGNAL(encrypted()), this, SLOT(handleSocketEncrypted()));
+    connect(socket, SIGNAL(bytesWritten()), this, SLOT(handleSocketBytesWritten()));
 }
 
 CommandHandle Parser::noop()
@@ -266,6 +295,20 @@ CommandHandle Parser::append(const QString &mailbox, const QByteArray &message,
     return queueCommand(command);
 }
 
+CommandHandle Parser::append(const QString &mailbox, const QSharedPointer<QIODevice> &message, const QStringList &flags,
+                             const QDateTime &timestamp)
+{
+    Commands::Command command("APPEND");
+    command << encodeImapFolderName(mailbox);
+    if (flags.count())
+        command << Commands::PartOfCommand(Commands::ATOM, "(" + flags.join(QLatin1String(" ")).toUtf8() + ")");
+    if (timestamp.isValid())
+        command << Commands::PartOfCommand(Imap::dateTimeToInternalDate(timestamp).toUtf8());
+    command << Commands::PartOfCommand(message);
+
+    return queueCommand(command);
+}
+
 CommandHandle Parser::appendCatenate(const QString &mailbox, const QList<Imap::Mailbox::CatenatePair> &data,
                                      const QStringList &flags, const QDateTime &timestamp)
 {
@@ -323,7 +366,7 @@ CommandHandle Parser::searchHelper(const QByteArray &command, const QStringList
         cmd << Commands::PartOfCommand(Commands::ATOM, criteria.front().toUtf8());
     } else {
         for (QStringList::const_iterator it = criteria.begin(); it != criteria.end(); ++it)
-            cmd << it->toUtf8();
+            cmd << searchCriteriaItem(*it);
     }
 
     return queueCommand(cmd);
@@ -358,7 +401,7 @@ CommandHandle Parser::sortHelper(const QByteArray &command, const QStringList &s
         cmd << Commands::PartOfCommand(Commands::ATOM, searchCriteria.front().toUtf8());
     } else {
         for (QStringList::const_iterator it = searchCriteria.begin(); it != searchCriteria.end(); ++it)
-            cmd << it->toUtf8();
+            cmd << searchCriteriaItem(*it);
     }
 
     return queueCommand(cmd);
@@ -611,6 +654,16 @@ CommandHandle Parser::queueCommand(Commands::Command command)
 }
 
 void Parser::queueResponse(const QSharedPointer<Responses::AbstractResponse> &resp)
+{
+    if (m_worker) {
+        // There might be some untagged responses still being parsed by the worker thread, so we cannot just jump the queue
+        m_worker->enqueueResponse(resp);
+    } else {
+        deliverResponse(resp);
+    }
+}
+
+void Parser::deliverResponse(const QSharedPointer<Responses::AbstractResponse> &resp)
 {
     respQueue.push_back(resp);
     // Try to limit the signal rate -- when there are multiple items in the queue, there's no point in sending more signals
@@ -671,7 +724,13 @@ void Parser::handleReadyRead()
         {
             QByteArray buf = socket->read(readingBytes);
             readingBytes -= buf.size();
-            currentLine += buf;
+            if (currentLine.capacity() - currentLine.size() < buf.size()) {
+                // Grow geometrically, but only as far as the data which have already arrived justify it, and
+                // never past the declared size of the literal
+                int step = qMax(currentLine.size(), literalReservationStep);
+                currentLine.reserve(currentLine.size() + buf.size() + static_cast<int>(qMin<uint>(readingBytes, step)) + 1024);
+            }
+            currentLine.append(buf);
             if (readingBytes == 0) {
                 // we've read the literal
                 readingMode = ReadingLine;
@@ -701,6 +760,13 @@ void Parser::reallyReadLine()
             oldLiteralPosition = offset;
             readingMode = ReadingNumberOfBytes;
             readingBytes = number;
+            // The literal is going to arrive in many small chunks. Reserve space for them in big steps, so that the
+            // buffer does not get reallocated (and its contents copied) on every chunk. The first step is bounded, so
+            // that a server cannot make us allocate insane amounts of memory before actually sending the data; the
+            // buffer only grows further as the literal arrives. There's some slack for the rest of the response as well.
+            currentLine.reserve(currentLine.size() + qMin(number, literalReservationStep) + 1024);
+            // The literal still gets copied once more when LowLevelParser::getString() extracts it from the line. Handing
+            // it over without that copy would need the Responses to work on something else than one contiguous QByteArray.
         } else if (currentLine.endsWith("\r\n")) {
             // it's complete
             if (startTlsInProgress && currentLine.startsWith(startTlsCommand)) {
@@ -726,10 +792,52 @@ void Parser::executeCommands()
 {
     while (! waitingForContinuation && ! waitForInitialIdle &&
            ! waitingForConnection && ! waitingForEncryption && ! waitingForSslPolicy &&
-           ! cmdQueue.isEmpty() && ! startTlsInProgress && !compressDeflateInProgress)
+           ! cmdQueue.isEmpty() && ! startTlsInProgress && !compressDeflateInProgress && !m_streamingLiteral)
         executeACommand();
 }
 
+/** @short Some data were sent, so we might be able to continue with streaming a literal */
+void Parser::handleSocketBytesWritten()
+{
+    if (!m_streamingLiteral)
+        return;
+    if (sendLiteralData())
+        executeCommands();
+}
+
+bool Parser::sendLiteralData()
+{
+    Q_ASSERT(m_streamingLiteral);
+    Q_ASSERT(!cmdQueue.isEmpty());
+    Commands::Command &cmd = cmdQueue.first();
+    Commands::PartOfCommand &part = cmd.cmds[cmd.currentPart];
+    Q_ASSERT(part.device);
+
+    while (m_literalBytesRemaining > 0 && socket->bytesToWrite() < literalStreamingBufferSize) {
+        QByteArray chunk = part.device->read(qMin(m_literalBytesRemaining, literalStreamingChunkSize));
+        if (chunk.isEmpty()) {
+            // The size of the literal has been announced already, so there's no way to recover from this one
+            QString reason = tr("Cannot read the data to be sent: %1").arg(part.device->errorString());
+            m_streamingLiteral = false;
+            // Nothing else can be sent over this connection anymore
+            cmdQueue.clear();
+            socket->close();
+            handleDisconnected(reason);
+            return false;
+        }
+        socket->write(chunk);
+        m_literalBytesRemaining -= chunk.size();
+    }
+
+    if (m_literalBytesRemaining > 0)
+        return false;
+
+    part.dataSent = true;
+    m_streamingLiteral = false;
+    emit lineSent(this, "*** literal data, " + QByteArray::number(part.literalSize()) + " bytes");
+    return true;
+}
+
 void Parser::finishStartTls()
 {
     emit lineSent(this, "*** STARTTLS");
@@ -830,7 +938,42 @@ void Parser::executeACommand()
         }
         break;
         case Commands::LITERAL:
-            if (literalPlus) {
+            if (part.device) {
+                if (!part.numberSent) {
+                    buf.append('{');
+                    buf.append(QByteArray::number(part.literalSize()));
+                    buf.append(literalPlus ? "+}\r\n" : "}\r\n");
+                    part.numberSent = true;
+                    if (!literalPlus) {
+#ifdef PRINT_TRAFFIC_TX
+                        qDebug() << m_parserId << ">>>" << buf.left(PRINT_TRAFFIC_TX).trimmed();
+#endif
+                        socket->write(buf);
+                        waitingForContinuation = true;
+                        Q_ASSERT(literalCommandTag.isEmpty());
+                        literalCommandTag = cmd.cmds.first().text;
+                        Q_ASSERT(!literalCommandTag.isEmpty());
+                        emit lineSent(this, buf);
+                        return; // and wait for continuation request
+                    }
+                }
+                if (!part.dataSent) {
+                    // The data are read from the device only as fast as the socket manages to send them
+                    if (!buf.isEmpty()) {
+#ifdef PRINT_TRAFFIC_TX
+                        qDebug() << m_parserId << ">>>" << buf.left(PRINT_TRAFFIC_TX).trimmed();
+#endif
+                        socket->write(buf);
+                        emit lineSent(this, buf);
+                        buf.clear();
+                    }
+                    m_streamingLiteral = true;
+                    m_literalBytesRemaining = part.literalSize();
+                    if (!sendLiteralData())
+                        return; // will be resumed once the socket has sent some data
+                }
+                // The literal is out; the rest of the command follows
+            } else if (literalPlus) {
                 buf.append('{');
                 buf.append(QByteArray::number(part.text.size()));
                 buf.append("+}\r\n");
@@ -935,7 +1078,10 @@ void Parser::processLine(QByteArray line)
         throw NotAnImapServerError(std::string(), line, -1);
     } else if (line.startsWith("* ")) {
         m_expectsInitialGreeting = false;
-        queueResponse(parseUntagged(line));
+        if (m_worker)
+            m_worker->enqueueLine(line);
+        else
+            queueResponse(parseUntagged(line));
     } else if (line.startsWith("+ ")) {
         if (waitingForContinuation) {
             waitingForContinuation = false;
@@ -1130,6 +1276,29 @@ void Parser::enableLiteralPlus(const bool enabled)
     literalPlus = enabled;
 }
 
+void Parser::enableParsingInThread()
+{
+    if (m_worker)
+        return;
+
+    m_workerThread = new QThread(this);
+    m_worker = new ParserWorker();
+    m_worker->moveToThread(m_workerThread);
+    connect(m_worker, SIGNAL(responsesAvailable()), this, SLOT(slotWorkerResponsesAvailable()), Qt::QueuedConnection);
+    m_workerThread->start();
+}
+
+/** @short Pick up whatever the worker thread has parsed so far */
+void Parser::slotWorkerResponsesAvailable()
+{
+    Q_ASSERT(m_worker);
+    m_worker->rearmNotification();
+    QSharedPointer<Responses::AbstractResponse> resp;
+    while (m_worker->dequeueResponse(resp)) {
+        deliverResponse(resp);
+    }
+}
+
 void Parser::handleDisconnected(const QString &reason)
 {
     emit lineReceived(this, "*** Socket disconnected: " + reason.toUtf8());
@@ -1147,6 +1316,13 @@ Parser::~Parser()
     socket->disconnect(this);
     socket->close();
     socket->deleteLater();
+
+    if (m_worker) {
+        m_worker->disconnect(this);
+        m_workerThread->quit();
+        m_workerThread->wait();
+        delete m_worker;
+    }
 }
 
 uint Parser::parserId() const
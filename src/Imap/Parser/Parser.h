@@ -39,6 +39,7 @@
  */
 
 class ImapParserParseTest;
+class QThread;
 
 namespace Streams {
 class Socket;
@@ -48,6 +49,8 @@ class Socket;
 namespace Imap
 {
 
+class ParserWorker;
+
 /** @short A handle identifying a command sent to the server */
 typedef QByteArray CommandHandle;
 
@@ -60,6 +63,7 @@ class Parser : public QObject
     Q_OBJECT
 
     friend class ::ImapParserParseTest;
+    friend class ParserWorker;
 
 public:
     /** @short Constructor.
@@ -78,6 +82,16 @@ public:
     /** @short Enable/Disable sending literals using the LITERAL+ extension */
     void enableLiteralPlus(const bool enabled=true);
 
+    /** @short Parse the untagged responses in a dedicated thread
+
+    When enabled, the heavy lifting of turning the untagged responses into their Responses::AbstractResponse form happens
+    in a background thread, so that a flood of FETCH responses does not block the thread which owns this Parser. The
+    responses are still delivered in the original order through the usual responseReceived() signal.
+
+    This has to be called before any data are received.
+    */
+    void enableParsingInThread();
+
     uint parserId() const;
 
 public slots:
@@ -143,6 +157,14 @@ public slots:
     CommandHandle append(const QString &mailbox, const QByteArray &message,
                          const QStringList &flags = QStringList(), const QDateTime &timestamp = QDateTime());
 
+    /** @short APPEND with the message data being read from the @arg message device as they are sent
+
+    The device has to know its size() in advance. Only a limited amount of data is read ahead of what the socket
+    has managed to send, so the message never has to be present in memory as a whole.
+    */
+    CommandHandle append(const QString &mailbox, const QSharedPointer<QIODevice> &message,
+                         const QStringList &flags = QStringList(), const QDateTime &timestamp = QDateTime());
+
     /** @short APPEND CATENATE, RFC 4469 */
     CommandHandle appendCatenate(const QString &mailbox, const QList<Imap::Mailbox::CatenatePair> &data,
                                  const QStringList &flags = QStringList(), const QDateTime &timestamp = QDateTime());
@@ -314,6 +336,8 @@ private slots:
     void finishStartTls();
     void handleSocketEncrypted();
     void handleCompressionPossibleActivated();
+    void slotWorkerResponsesAvailable();
+    void handleSocketBytesWritten();
 
 private:
     /** @short Private copy constructor */
@@ -332,6 +356,9 @@ private:
     /** @short Helper for handleReadyRead() -- actually read & parse the data */
     void reallyReadLine();
 
+    /** @short Write another chunk of a streamed literal, return true once all of the data have been written */
+    bool sendLiteralData();
+
     /** @short Helper for search() and uidSearch() */
     CommandHandle searchHelper(const QByteArray &command, const QStringList &criteria,
                                const QByteArray &charset = QByteArray());
@@ -345,22 +372,25 @@ private:
     void processLine(QByteArray line);
 
     /** @short Parse line for untagged reply */
-    QSharedPointer<Responses::AbstractResponse> parseUntagged(const QByteArray &line);
+    static QSharedPointer<Responses::AbstractResponse> parseUntagged(const QByteArray &line);
 
     /** @short Parse line for tagged reply */
     QSharedPointer<Responses::AbstractResponse> parseTagged(const QByteArray &line);
 
     /** @short helper for parseUntagged() */
-    QSharedPointer<Responses::AbstractResponse> parseUntaggedNumber(
+    static QSharedPointer<Responses::AbstractResponse> parseUntaggedNumber(
         const QByteArray &line, int &start, const uint number);
 
     /** @short helper for parseUntagged() */
-    QSharedPointer<Responses::AbstractResponse> parseUntaggedText(
+    static QSharedPointer<Responses::AbstractResponse> parseUntaggedText(
         const QByteArray &line, int &start);
 
-    /** @short Add parsed response to the internal queue, emit notification signal */
+    /** @short Add parsed response to the internal queue, or pass it through the worker thread to keep the ordering intact */
     void queueResponse(const QSharedPointer<Responses::AbstractResponse> &resp);
 
+    /** @short Add parsed response to the internal queue, emit notification signal */
+    void deliverResponse(const QSharedPointer<Responses::AbstractResponse> &resp);
+
     /** @short Connection to the IMAP server */
     Streams::Socket *socket;
 
@@ -384,6 +414,10 @@ private:
     bool waitingForEncryption;
     bool waitingForSslPolicy;
     bool m_expectsInitialGreeting;
+    /** @short Data of a literal are being read from a QIODevice and written to the socket */
+    bool m_streamingLiteral;
+    /** @short How many bytes of the streamed literal are still to be sent */
+    qint64 m_literalBytesRemaining;
 
     enum { ReadingLine, ReadingNumberOfBytes } readingMode;
     QByteArray currentLine;
@@ -396,6 +430,10 @@ private:
 
     /** @short Unique-id for debugging purposes */
     uint m_parserId;
+
+    /** @short Background parsing of untagged responses, if enabled */
+    ParserWorker *m_worker;
+    QThread *m_workerThread;
 };
 
 QTextStream &operator<<(QTextStream &stream, const Sequence &s);
@@ -0,0 +1,86 @@
+/* Copyright (C) 2006 - 2014 Jan Kundrát <jkt@flaska.net>
+
+   This file is part of the Trojita Qt IMAP e-mail client,
+   http://trojita.flaska.net/
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2 of
+   the License or (at your option) version 3 or any later version
+   accepted by the membership of KDE e.V. (or its successor approved
+   by the membership of KDE e.V.), which shall act as a proxy
+   defined in Section 14 of version 3 of the license.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "ParserWorker.h"
+#include "Parser.h"
+
+namespace Imap
+{
+
+ParserWorker::ParserWorker(): m_jobsScheduled(false), m_resultsSignalled(false)
+{
+}
+
+void ParserWorker::enqueueLine(const QByteArray &line)
+{
+    Job job;
+    job.line = line;
+    enqueueJob(job);
+}
+
+void ParserWorker::enqueueResponse(const QSharedPointer<Responses::AbstractResponse> &resp)
+{
+    Job job;
+    job.response = resp;
+    enqueueJob(job);
+}
+
+void ParserWorker::enqueueJob(const Job &job)
+{
+    m_jobs.push(job);
+    // Only post an event when the worker is not going to look at the queue anyway
+    if (!m_jobsScheduled.exchange(true))
+        QMetaObject::invokeMethod(this, "processPendingJobs", Qt::QueuedConnection);
+}
+
+void ParserWorker::processPendingJobs()
+{
+    // The flag has to be cleared before draining the queue, otherwise we could miss an item pushed in the meanwhile
+    m_jobsScheduled.store(false);
+
+    Job job;
+    while (m_jobs.pop(job)) {
+        QSharedPointer<Responses::AbstractResponse> resp = job.response;
+        if (!resp) {
+            try {
+                resp = Parser::parseUntagged(job.line);
+            } catch (ImapException &e) {
+                resp = QSharedPointer<Responses::AbstractResponse>(new Responses::ParseErrorResponse(e));
+            }
+        }
+        m_results.push(resp);
+        if (!m_resultsSignalled.exchange(true))
+            emit responsesAvailable();
+    }
+}
+
+bool ParserWorker::dequeueResponse(QSharedPointer<Responses::AbstractResponse> &resp)
+{
+    return m_results.pop(resp);
+}
+
+void ParserWorker::rearmNotification()
+{
+    m_resultsSignalled.store(false);
+}
+
+}
@@ -0,0 +1,99 @@
+/* Copyright (C) 2006 - 2014 Jan Kundrát <jkt@flaska.net>
+
+   This file is part of the Trojita Qt IMAP e-mail client,
+   http://trojita.flaska.net/
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2 of
+   the License or (at your option) version 3 or any later version
+   accepted by the membership of KDE e.V. (or its successor approved
+   by the membership of KDE e.V.), which shall act as a proxy
+   defined in Section 14 of version 3 of the license.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#ifndef IMAP_PARSER_WORKER_H
+#define IMAP_PARSER_WORKER_H
+
+#include <atomic>
+#include <QObject>
+#include <QSharedPointer>
+#include "Common/LockFreeQueue.h"
+#include "Response.h"
+
+namespace Imap
+{
+
+/** @short Parse untagged responses in a background thread
+
+The Parser itself stays in the thread which owns the socket and which issues commands; it is responsible for splitting
+the incoming byte stream into lines, for handling continuation requests and for all the other state transitions which have
+to happen synchronously (STARTTLS, COMPRESS DEFLATE). Complete lines of untagged responses are then handed over to an
+instance of this class which lives in a dedicated thread and which turns them into Responses::AbstractResponse instances.
+This is where the expensive work (decoding of BODYSTRUCTURE and ENVELOPE, for example) happens.
+
+The order of responses is preserved -- the Parser feeds the worker with already parsed responses, too, and these are simply
+passed back in their original position.
+
+Communication with the worker happens through lock-free queues, so neither of the threads ever blocks.
+*/
+class ParserWorker : public QObject
+{
+    Q_OBJECT
+public:
+    ParserWorker();
+
+    /** @short Schedule a raw line of an untagged response for parsing; only to be called from the Parser's thread */
+    void enqueueLine(const QByteArray &line);
+
+    /** @short Enqueue an already parsed response so that it gets delivered in order; only to be called from the Parser's thread */
+    void enqueueResponse(const QSharedPointer<Responses::AbstractResponse> &resp);
+
+    /** @short Retrieve the next response in order; only to be called from the Parser's thread */
+    bool dequeueResponse(QSharedPointer<Responses::AbstractResponse> &resp);
+
+    /** @short Start listening for the responsesAvailable() signal again */
+    void rearmNotification();
+
+signals:
+    /** @short Some responses are waiting to be picked up by dequeueResponse()
+
+    This signal is emitted from the worker thread. It is only emitted once after each call to rearmNotification().
+    */
+    void responsesAvailable();
+
+private slots:
+    void processPendingJobs();
+
+private:
+    /** @short One item of work for the worker thread */
+    struct Job {
+        /** @short A raw line to be parsed */
+        QByteArray line;
+        /** @short A response which has been parsed already */
+        QSharedPointer<Responses::AbstractResponse> response;
+    };
+
+    void enqueueJob(const Job &job);
+
+    Common::LockFreeQueue<Job> m_jobs;
+    Common::LockFreeQueue<QSharedPointer<Responses::AbstractResponse> > m_results;
+    /** @short Has the processPendingJobs() been scheduled already? */
+    std::atomic<bool> m_jobsScheduled;
+    /** @short Has the responsesAvailable() been emitted since the last rearmNotification()? */
+    std::atomic<bool> m_resultsSignalled;
+
+    ParserWorker(const ParserWorker &); // don't implement
+    ParserWorker &operator=(const ParserWorker &); // don't implement
+};
+
+}
+
+#endif // IMAP_PARSER_WORKER_H
@@ -504,7 +504,7 @@ State::State(const QByteArray &tag, const Kind kind, const QByteArray &line, int
                 throw InvalidResponseCode("Malformed APPENDUID: cannot extract UIDVALIDITY", line, start);
             int pos = 0;
             QByteArray s1 = originalList[2].toByteArray();
-            Sequence seq = Sequence::fromList(LowLevelParser::getSequence(s1, pos));
+            Sequence seq = LowLevelParser::getSequenceSet(s1, pos);
             if (!seq.isValid())
                 throw InvalidResponseCode("Malformed APPENDUID: cannot extract UID or the list of UIDs", line, start);
             if (pos != s1.size())
@@ -524,14 +524,14 @@ State::State(const QByteArray &tag, const Kind kind, const QByteArray &line, int
                 throw InvalidResponseCode("Malformed COPYUID: cannot extract UIDVALIDITY", line, start);
             int pos = 0;
             QByteArray s1 = originalList[2].toByteArray();
-            Sequence seq1 = Sequence::fromList(LowLevelParser::getSequence(s1, pos));
+            Sequence seq1 = LowLevelParser::getSequenceSet(s1, pos);
             if (!seq1.isValid())
                 throw InvalidResponseCode("Malformed COPYUID: cannot extract the first sequence", line, start);
             if (pos != s1.size())
                 throw InvalidResponseCode("Malformed COPYUID: garbage found after the first sequence", line, start);
             pos = 0;
             QByteArray s2 = originalList[3].toByteArray();
-            Sequence seq2 = Sequence::fromList(LowLevelParser::getSequence(s2, pos));
+            Sequence seq2 = LowLevelParser::getSequenceSet(s2, pos);
             if (!seq2.isValid())
                 throw InvalidResponseCode("Malformed COPYUID: cannot extract the second sequence", line, start);
             if (pos != s2.size())
@@ -921,19 +921,32 @@ Fetch::Fetch(const uint number, const QByteArray &line, int &start): number(numb
         } else if (identifier.startsWith("BODY[") || identifier.startsWith("BINARY[") || identifier.startsWith("RFC822")) {
             data[identifier] = QSharedPointer<AbstractData>(new RespData<QByteArray>(LowLevelParser::getNString(line, start).first));
         } else if (identifier == "ENVELOPE") {
-            QVariantList list = LowLevelParser::parseList('(', ')', line, start);
-            data[identifier] = QSharedPointer<AbstractData>(new RespData<Message::Envelope>(Message::Envelope::fromList(list, line, start)));
+            const int envelopeStart = start;
+            Message::Envelope envelope;
+            try {
+                envelope = Message::Envelope::fromLine(line, start);
+            } catch (const ParserException &) {
+                // Something unusual; the generic code is much more forgiving
+                start = envelopeStart;
+                QVariantList list = LowLevelParser::parseList('(', ')', line, start);
+                envelope = Message::Envelope::fromList(list, line, start);
+            }
+            data[identifier] = QSharedPointer<AbstractData>(new RespData<Message::Envelope>(envelope));
         } else if (identifier == "INTERNALDATE") {
             QByteArray buf = LowLevelParser::getNString(line, start).first;
             data[identifier] = QSharedPointer<AbstractData>(new RespData<QDateTime>(dateify(buf, line, start)));
         } else if (identifier == "BODY" || identifier == "BODYSTRUCTURE") {
-            QVariantList list = LowLevelParser::parseList('(', ')', line, start);
-            data[identifier] = Message::AbstractMessage::fromList(list, line, start);
-            QByteArray buffer;
-            QDataStream stream(&buffer, QIODevice::WriteOnly);
-            stream.setVersion(QDataStream::Qt_4_6);
-            stream << list;
-            data["x-trojita-bodystructure"] = QSharedPointer<AbstractData>(new RespData<QByteArray>(buffer));
+            const int bodyStart = start;
+            QSharedPointer<Message::AbstractMessage> body;
+            try {
+                body = Message::AbstractMessage::fromLine(line, start);
+            } catch (const ParserException &) {
+                start = bodyStart;
+                QVariantList list = LowLevelParser::parseList('(', ')', line, start);
+                body = Message::AbstractMessage::fromList(list, line, start);
+            }
+            data[identifier] = body;
+            data["x-trojita-bodystructure"] = QSharedPointer<AbstractData>(new RespData<QByteArray>(body->toCacheData()));
         } else {
             // Unrecognized identifier, let's treat it as QByteArray so that we don't break needlessly
             data[identifier] = QSharedPointer<AbstractData>(new RespData<QByteArray>(LowLevelParser::getNString(line, start).first));
@@ -1094,7 +1107,7 @@ Vanished::Vanished(const QByteArray &line, int &start): earlier(NOT_EARLIER)
         start += prefixLength + 1; // one for the required space
     }
 
-    uids = LowLevelParser::getSequence(line, start);
+    uids = LowLevelParser::getSequenceSet(line, start);
 
     if (start != line.size() - 2)
         throw TooMuchData(line, start);
@@ -1291,11 +1304,7 @@ QTextStream &Vanished::dump(QTextStream &s) const
     s << "VANISHED ";
     if (earlier == EARLIER)
         s << "(EARLIER) ";
-    s << "(";
-    Q_FOREACH(const uint &uid, uids) {
-        s << " " << uid;
-    }
-    return s << ")";
+    return s << "(" << uids.toByteArray() << ")";
 }
 
 QTextStream &GenUrlAuth::dump(QTextStream &s) const
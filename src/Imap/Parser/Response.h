@@ -32,6 +32,7 @@
 #include "Command.h"
 #include "../Exceptions.h"
 #include "Data.h"
+#include "Sequence.h"
 #include "ThreadingNode.h"
 
 #ifdef _MSC_VER
@@ -633,9 +634,10 @@ class Vanished: public AbstractResponse
 public:
     typedef enum {EARLIER, NOT_EARLIER} EarlierOrNow;
     EarlierOrNow earlier;
-    QList<uint> uids;
+    /** @short UIDs of the removed messages, kept as ranges exactly as the server sent them */
+    Sequence uids;
     Vanished(const QByteArray &line, int &start);
-    Vanished(EarlierOrNow earlier, const QList<uint> &uids): earlier(earlier), uids(uids) {}
+    Vanished(EarlierOrNow earlier, const Sequence &uids): earlier(earlier), uids(uids) {}
     virtual QTextStream &dump(QTextStream &s) const;
     virtual bool eq(const AbstractResponse &other) const;
     virtual void plug(Imap::Parser *parser, Imap::Mailbox::Model *model) const;
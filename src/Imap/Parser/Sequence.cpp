@@ -21,113 +21,160 @@
 */
 
 #include "Sequence.h"
-#include <QStringList>
+#include <limits>
 #include <QTextStream>
 
+namespace
+{
+
+/** @short The number which stands for the "*" in the unlimited sequences */
+const uint unlimitedMarker = std::numeric_limits<uint>::max();
+
+/** @short Return true if the @arg range ends before the @arg num and cannot be merged with it */
+bool endsBefore(const Imap::Sequence::Range &range, const uint num)
+{
+    return range.second < num && num - range.second > 1;
+}
+
+/** @short Predicate for the binary search among the ranges */
+bool rangeEndsBefore(const Imap::Sequence::Range &range, const uint num)
+{
+    return range.second < num;
+}
+
+}
+
 namespace Imap
 {
 
-Sequence::Sequence(const uint num): kind(DISTINCT)
+Sequence::Sequence(const uint num)
 {
-    list << num;
+    m_ranges << Range(num, num);
+}
+
+Sequence::Sequence(const uint lo, const uint hi)
+{
+    if (lo <= hi)
+        m_ranges << Range(lo, hi);
 }
 
 Sequence Sequence::startingAt(const uint lo)
 {
-    Sequence res(lo);
-    res.lo = lo;
-    res.kind = UNLIMITED;
-    return res;
+    return Sequence(lo, unlimitedMarker);
 }
 
 QByteArray Sequence::toByteArray() const
 {
-    switch (kind) {
-    case DISTINCT:
-    {
-        Q_ASSERT(! list.isEmpty());
-
-        QStringList res;
-        int i = 0;
-        while (i < list.size()) {
-            int old = i;
-            while (i < list.size() - 1 &&
-                   list[i] == list[ i + 1 ] - 1)
-                ++i;
-            if (old != i) {
-                // we've found a sequence
-                res << QString::number(list[old]) + QLatin1Char(':') + QString::number(list[i]);
-            } else {
-                res << QString::number(list[i]);
-            }
-            ++i;
+    Q_ASSERT(isValid());
+
+    QByteArray res;
+    for (QVector<Range>::const_iterator it = m_ranges.constBegin(); it != m_ranges.constEnd(); ++it) {
+        if (!res.isEmpty())
+            res += ',';
+        res += QByteArray::number(it->first);
+        if (it->second == unlimitedMarker) {
+            res += ":*";
+        } else if (it->second != it->first) {
+            res += ':';
+            res += QByteArray::number(it->second);
         }
-        return res.join(QLatin1String(",")).toLocal8Bit();
-    }
-    case RANGE:
-        Q_ASSERT(lo <= hi);
-        if (lo == hi)
-            return QByteArray::number(lo);
-        else
-            return QByteArray::number(lo) + ':' + QByteArray::number(hi);
-    case UNLIMITED:
-        return QByteArray::number(lo) + ":*";
     }
-    // fix gcc warning
-    Q_ASSERT(false);
-    return QByteArray();
+    return res;
 }
 
 QList<uint> Sequence::toList() const
 {
-    switch (kind) {
-    case DISTINCT:
-        Q_ASSERT(!list.isEmpty());
-        return list;
-    case RANGE:
-        Q_ASSERT(lo <= hi);
-        if (lo == hi) {
-            return QList<uint>() << lo;
-        } else {
-            QList<uint> res;
-            for (uint i = lo; i < hi; ++i)
-                res << i;
-            return res;
-        }
-    case UNLIMITED:
-        Q_ASSERT(false);
-        return QList<uint>();
+    Q_ASSERT(isValid());
+    Q_ASSERT(!isUnlimited());
+
+    QList<uint> res;
+#if QT_VERSION >= 0x040700
+    res.reserve(count());
+#endif
+    for (QVector<Range>::const_iterator it = m_ranges.constBegin(); it != m_ranges.constEnd(); ++it) {
+        for (uint i = it->first; i < it->second; ++i)
+            res << i;
+        res << it->second;
     }
-    Q_ASSERT(false);
-    return QList<uint>();
+    return res;
 }
 
-Sequence &Sequence::add(uint num)
+Sequence &Sequence::add(const uint num)
 {
-    Q_ASSERT(kind == DISTINCT);
-    QList<uint>::iterator it = qLowerBound(list.begin(), list.end(), num);
-    if (it == list.end() || *it != num)
-        list.insert(it, num);
+    return add(num, num);
+}
+
+Sequence &Sequence::add(const uint lo, const uint hi)
+{
+    Q_ASSERT(lo <= hi);
+
+    if (m_ranges.isEmpty() || endsBefore(m_ranges.last(), lo)) {
+        // The most common case -- the numbers are being added in the increasing order
+        m_ranges << Range(lo, hi);
+        return *this;
+    }
+
+    // Find the first range which either overlaps the new one, or could be merged with it
+    int i = qLowerBound(m_ranges.begin(), m_ranges.end(), lo == 0 ? 0 : lo - 1, rangeEndsBefore) - m_ranges.begin();
+    Q_ASSERT(i < m_ranges.size());
+    if (endsBefore(Range(lo, hi), m_ranges[i].first)) {
+        // There's a gap between the new range and the following one
+        m_ranges.insert(i, Range(lo, hi));
+        return *this;
+    }
+
+    // Extend the range and swallow all of the following ranges which now touch it
+    Range &range = m_ranges[i];
+    range.first = qMin(range.first, lo);
+    range.second = qMax(range.second, hi);
+    int last = i + 1;
+    while (last < m_ranges.size() && !endsBefore(range, m_ranges[last].first)) {
+        range.second = qMax(range.second, m_ranges[last].second);
+        ++last;
+    }
+    m_ranges.remove(i + 1, last - i - 1);
     return *this;
 }
 
+bool Sequence::contains(const uint num) const
+{
+    QVector<Range>::const_iterator it = qLowerBound(m_ranges.constBegin(), m_ranges.constEnd(), num, rangeEndsBefore);
+    return it != m_ranges.constEnd() && it->first <= num;
+}
+
+uint Sequence::count() const
+{
+    Q_ASSERT(!isUnlimited());
+    uint res = 0;
+    for (QVector<Range>::const_iterator it = m_ranges.constBegin(); it != m_ranges.constEnd(); ++it)
+        res += it->second - it->first + 1;
+    return res;
+}
+
+bool Sequence::isUnlimited() const
+{
+    return !m_ranges.isEmpty() && m_ranges.last().second == unlimitedMarker;
+}
+
+const QVector<Sequence::Range> &Sequence::ranges() const
+{
+    return m_ranges;
+}
+
 Sequence Sequence::fromList(QList<uint> numbers)
 {
     Q_ASSERT(!numbers.isEmpty());
     qSort(numbers);
-    Sequence seq(numbers.first());
-    for (int i = 1; i < numbers.size(); ++i) {
-        seq.add(numbers[i]);
+    Sequence seq;
+    Q_FOREACH(const uint num, numbers) {
+        seq.add(num);
     }
     return seq;
 }
 
 bool Sequence::isValid() const
 {
-    if (kind == DISTINCT && list.isEmpty())
-        return false;
-    else
-        return true;
+    return !m_ranges.isEmpty();
 }
 
 QTextStream &operator<<(QTextStream &stream, const Sequence &s)
@@ -137,8 +184,7 @@ QTextStream &operator<<(QTextStream &stream, const Sequence &s)
 
 bool operator==(const Sequence &a, const Sequence &b)
 {
-    // This operator is used only in the test suite, so performance doesn't matter and this was *so* easy to hack together...
-    return a.toList() == b.toList();
+    return a.ranges() == b.ranges();
 }
 
 }
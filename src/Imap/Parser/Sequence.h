@@ -24,7 +24,9 @@
 #define IMAP_PARSER_SEQUENCE_H
 
 #include <QList>
+#include <QPair>
 #include <QString>
+#include <QVector>
 
 /** @short Namespace for IMAP interaction */
 namespace Imap
@@ -35,15 +37,20 @@ namespace Imap
   Although named a sequence, there's no reason for a sequence to contain
   only consecutive ranges of numbers. For example, a set of
   { 1, 2, 3, 10, 15, 16, 17 } is perfectly valid sequence.
+
+  The numbers are stored as a sorted list of disjoint, non-adjacent ranges, so the memory
+  requirements and the cost of the set operations depend on the number of ranges and not
+  on the number of messages which are covered by this sequence.  A sequence like "1:100000"
+  is therefore as cheap as a sequence holding a single number.
 */
 class Sequence
 {
-    uint lo, hi;
-    QList<uint> list;
-    enum { DISTINCT, RANGE, UNLIMITED } kind;
 public:
+    /** @short An inclusive range of numbers */
+    typedef QPair<uint, uint> Range;
+
     /** @short Construct an invalid sequence */
-    Sequence(): kind(DISTINCT) {}
+    Sequence() {}
 
     /** @short Construct a sequence holding only one number
 
@@ -55,30 +62,48 @@ public:
 
     /** @short Construct a sequence holding a set of numbers between upper and lower bound
 
-      This sequence can't be expanded ever after. Calling add() on it will
-      assert().
+      If the @arg lo is bigger than @arg hi, the sequence is left empty.
     */
-    Sequence(const uint lo, const uint hi): lo(lo), hi(hi), kind(RANGE) {}
+    Sequence(const uint lo, const uint hi);
 
     /** @short Create an "unlimited" sequence
 
       That's a sequence that starts at the specified offset and grow to the
-      current maximal boundary. There's no way to add a distinct item to
-      this set; doing so via the add() method will assert */
+      current maximal boundary, i.e. "lo:*". The "*" is represented by the biggest
+      possible number. */
     static Sequence startingAt(const uint lo);
 
-    /** @short Add another number to the sequence
+    /** @short Add another number to the sequence */
+    Sequence &add(const uint num);
+
+    /** @short Add all numbers between @arg lo and @arg hi (inclusive) to the sequence
 
-      Note that you can only add numbers to a sequence created by the
-      Sequence( const uint num ) constructor. Attempting to do so on other
-      kinds of sequences will assert().
+      Adding ranges in the increasing order is cheap, the ranges are simply appended.
     */
-    Sequence &add(const uint num);
+    Sequence &add(const uint lo, const uint hi);
+
+    /** @short Return true if the @arg num is a member of this sequence */
+    bool contains(const uint num) const;
+
+    /** @short Return the number of items in this sequence
+
+      The sequence must not be an unlimited one.
+    */
+    uint count() const;
+
+    /** @short Return true if the sequence grows to the "*" */
+    bool isUnlimited() const;
+
+    /** @short Return the sorted list of disjoint ranges which make up this sequence */
+    const QVector<Range> &ranges() const;
 
     /** @short Converts sequence to a textual representation suitable for sending over the wire */
     QByteArray toByteArray() const;
 
-    /** @short Converts sequence to a list of UIDs */
+    /** @short Converts sequence to a sorted list of UIDs
+
+      The sequence must not be an unlimited one.
+    */
     QList<uint> toList() const;
 
     /** @short Create a sequence from a list of numbers */
@@ -87,6 +112,8 @@ public:
     /** @short Return true if the sequence contains at least some items */
     bool isValid() const;
 
+private:
+    QVector<Range> m_ranges;
 };
 
 bool operator==(const Sequence &a, const Sequence &b);
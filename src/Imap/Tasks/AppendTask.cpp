@@ -31,7 +31,7 @@ namespace Imap
 namespace Mailbox
 {
 
-AppendTask::AppendTask(Model *model, const QString &targetMailbox, const QByteArray &rawMessageData, const QStringList &flags,
+AppendTask::AppendTask(Model *model, const QString &targetMailbox, const QSharedPointer<QIODevice> &rawMessageData, const QStringList &flags,
                        const QDateTime &timestamp):
     ImapTask(model), targetMailbox(targetMailbox), rawMessageData(rawMessageData), flags(flags), timestamp(timestamp)
 {
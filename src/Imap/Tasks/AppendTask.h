@@ -36,7 +36,7 @@ class AppendTask : public ImapTask
 {
     Q_OBJECT
 public:
-    AppendTask(Model *model, const QString &targetMailbox, const QByteArray &rawMessageData, const QStringList &flags,
+    AppendTask(Model *model, const QString &targetMailbox, const QSharedPointer<QIODevice> &rawMessageData, const QStringList &flags,
                const QDateTime &timestamp);
     AppendTask(Model *model, const QString &targetMailbox, const QList<CatenatePair> &data, const QStringList &flags,
                const QDateTime &timestamp);
@@ -54,7 +54,7 @@ private:
     ImapTask *conn;
     CommandHandle tag;
     QString targetMailbox;
-    QByteArray rawMessageData;
+    QSharedPointer<QIODevice> rawMessageData;
     QList<CatenatePair> data;
     QStringList flags;
     QDateTime timestamp;
@@ -53,6 +53,7 @@ void FetchMsgMetadataTask::perform()
     tag = parser->uidFetch(seq, QStringList() << QLatin1String("ENVELOPE") << QLatin1String("INTERNALDATE") <<
                            QLatin1String("BODYSTRUCTURE") << QLatin1String("RFC822.SIZE") <<
                            QLatin1String("BODY.PEEK[HEADER.FIELDS (References List-Post)]"));
+    sentAt.start();
 }
 
 bool FetchMsgMetadataTask::handleFetch(const Imap::Responses::Fetch *const resp)
@@ -76,6 +77,7 @@ bool FetchMsgMetadataTask::handleStateHelper(const Imap::Responses::State *const
     if (resp->tag == tag) {
 
         if (resp->kind == Responses::OK) {
+            model->m_prefetchWindow.fetchCompleted(uids.size(), static_cast<int>(sentAt.elapsed()));
             _completed();
         } else {
             _failed("UID FETCH failed");
@@ -25,6 +25,7 @@
 
 #include <QPersistentModelIndex>
 #include "ImapTask.h"
+#include "Imap/Model/PrefetchWindow.h"
 
 namespace Imap
 {
@@ -50,6 +51,8 @@ private:
     ImapTask *conn;
     QPersistentModelIndex mailbox;
     QList<uint> uids;
+    /** @short When was the command sent, for estimating the round trip time */
+    PrefetchClock sentAt;
 };
 
 }
@@ -32,20 +32,45 @@ namespace Imap
 namespace Mailbox
 {
 
+namespace
+{
+
+/** @short How many tasks are there waiting for the connection, not counting the task which just keeps a mailbox open */
+int connectionLoad(const ParserState &state)
+{
+    int load = state.activeTasks.size();
+    if (state.maintainingTask && state.activeTasks.contains(state.maintainingTask.data()))
+        --load;
+    return load;
+}
+
+}
+
 GetAnyConnectionTask::GetAnyConnectionTask(Model *model) :
     ImapTask(model), newConn(0)
 {
-    QMap<Parser *,ParserState>::iterator it = model->m_parsers.begin();
-    while (it != model->m_parsers.end()) {
-        if (it->connState == CONN_STATE_LOGOUT) {
+    // Use the least busy connection
+    QMap<Parser *,ParserState>::iterator it = model->m_parsers.end();
+    int bestLoad = 0;
+    int usableParsers = 0;
+    for (QMap<Parser *,ParserState>::iterator candidate = model->m_parsers.begin(); candidate != model->m_parsers.end(); ++candidate) {
+        if (candidate->connState == CONN_STATE_LOGOUT) {
             // We cannot possibly use this connection
-            ++it;
-        } else {
-            // we've found it
-            break;
+            continue;
+        }
+        ++usableParsers;
+        int load = connectionLoad(*candidate);
+        if (it == model->m_parsers.end() || load < bestLoad) {
+            it = candidate;
+            bestLoad = load;
         }
     }
 
+    if (it != model->m_parsers.end() && bestLoad > 0 && usableParsers < model->m_maxParsers) {
+        // All connections are busy, but we're allowed to open yet another one
+        it = model->m_parsers.end();
+    }
+
     if (it == model->m_parsers.end()) {
         // We're creating a completely new connection
         if (model->networkPolicy() == NETWORK_OFFLINE) {
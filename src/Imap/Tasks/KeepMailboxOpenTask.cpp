@@ -295,6 +295,7 @@ void KeepMailboxOpenTask::terminate()
     Q_ASSERT(dependingTasksNoMailbox.isEmpty());
     Q_ASSERT(requestedParts.isEmpty());
     Q_ASSERT(requestedEnvelopes.isEmpty());
+    Q_ASSERT(requestedPreloadEnvelopes.isEmpty());
     Q_ASSERT(runningTasksForThisMailbox.isEmpty());
     Q_ASSERT(abortableTasks.isEmpty());
 
@@ -550,7 +551,7 @@ bool KeepMailboxOpenTask::handleStateHelper(const Imap::Responses::State *const
             // -> we should save this
             TreeItemMailbox *mailbox = dynamic_cast<TreeItemMailbox *>(static_cast<TreeItem *>(mailboxIndex.internalPointer()));
             Q_ASSERT(mailbox);
-            mailbox->saveSyncStateAndUids(model);
+            mailbox->saveSyncStateAndUids(model, TreeItemMailbox::UID_MAP_CHANGES);
         }
 
         if (resp->kind != Responses::OK) {
@@ -737,14 +738,36 @@ void KeepMailboxOpenTask::requestPartDownload(const uint uid, const QString &par
     }
 }
 
-void KeepMailboxOpenTask::requestEnvelopeDownload(const uint uid)
+void KeepMailboxOpenTask::requestEnvelopeDownload(const uint uid, const EnvelopePriority priority)
 {
-    requestedEnvelopes.append(uid);
+    switch (priority) {
+    case ENVELOPE_VISIBLE:
+        // It might have been requested as a part of the preload already, in which case it just gets a higher priority
+        requestedPreloadEnvelopes.removeOne(uid);
+        if (!requestedEnvelopes.contains(uid))
+            requestedEnvelopes.append(uid);
+        break;
+    case ENVELOPE_PRELOAD:
+        if (!requestedEnvelopes.contains(uid) && !requestedPreloadEnvelopes.contains(uid))
+            requestedPreloadEnvelopes.append(uid);
+        break;
+    }
     if (!fetchEnvelopeTimer->isActive()) {
         fetchEnvelopeTimer->start();
     }
 }
 
+QList<uint> KeepMailboxOpenTask::withdrawQueuedEnvelopePreload()
+{
+    QList<uint> res = requestedPreloadEnvelopes;
+    requestedPreloadEnvelopes.clear();
+    if (!res.isEmpty() && parser && model->m_parsers.contains(parser)) {
+        model->accessParser(parser).withdrawnEnvelopeRequests += res.size();
+        model->m_taskModel->slotParserStateChanged(parser);
+    }
+    return res;
+}
+
 void KeepMailboxOpenTask::slotFetchRequestedParts()
 {
     // FIXME: abort/die
@@ -780,19 +803,30 @@ void KeepMailboxOpenTask::slotFetchRequestedEnvelopes()
 {
     // FIXME: abort/die
 
-    if (requestedEnvelopes.isEmpty())
+    if (requestedEnvelopes.isEmpty() && requestedPreloadEnvelopes.isEmpty())
+        return;
+
+    // Whatever is not turned into a FetchMsgMetadataTask yet can still be withdrawn, so don't hurry when there's enough
+    // work queued already
+    if (!shouldExit && fetchMetadataTasks.size() >= limitParallelFetchTasks)
         return;
 
     breakOrCancelPossibleIdle();
 
     QList<uint> fetchNow;
     if (shouldExit) {
-        fetchNow = requestedEnvelopes;
+        fetchNow = requestedEnvelopes + requestedPreloadEnvelopes;
         requestedEnvelopes.clear();
+        requestedPreloadEnvelopes.clear();
     } else {
-        const int amount = qMin(requestedEnvelopes.size(), limitMessagesAtOnce); // FIXME: add an extra limit?
+        // The visible messages go first, the rest of the batch is filled with the preloaded ones. The Sequence will
+        // coalesce the UIDs into ranges.
+        int amount = qMin(requestedEnvelopes.size(), limitMessagesAtOnce); // FIXME: add an extra limit?
         fetchNow = requestedEnvelopes.mid(0, amount);
         requestedEnvelopes.erase(requestedEnvelopes.begin(), requestedEnvelopes.begin() + amount);
+        amount = qMin(requestedPreloadEnvelopes.size(), limitMessagesAtOnce - fetchNow.size());
+        fetchNow += requestedPreloadEnvelopes.mid(0, amount);
+        requestedPreloadEnvelopes.erase(requestedPreloadEnvelopes.begin(), requestedPreloadEnvelopes.begin() + amount);
     }
     fetchMetadataTasks << model->m_taskFactory->createFetchMsgMetadataTask(model, mailboxIndex, fetchNow);
 }
@@ -918,7 +952,8 @@ bool KeepMailboxOpenTask::hasPendingInternalActions() const
 {
     bool hasToWaitForIdleTermination = idleLauncher ? idleLauncher->waitingForIdleTaggedTermination() : false;
     return !(dependingTasksForThisMailbox.isEmpty() && dependingTasksNoMailbox.isEmpty() && runningTasksForThisMailbox.isEmpty() &&
-             requestedParts.isEmpty() && requestedEnvelopes.isEmpty() && newArrivalsFetch.isEmpty()) || hasToWaitForIdleTermination;
+             requestedParts.isEmpty() && requestedEnvelopes.isEmpty() && requestedPreloadEnvelopes.isEmpty() &&
+             newArrivalsFetch.isEmpty()) || hasToWaitForIdleTermination;
 }
 
 /** @short Returns true if this task can be safely terminated
@@ -978,7 +1013,7 @@ void KeepMailboxOpenTask::saveSyncStateNowOrLater(Imap::Mailbox::TreeItemMailbox
 {
     TreeItemMsgList *list = static_cast<TreeItemMsgList*>(mailbox->m_children[0]);
     if (list->fetched()) {
-        mailbox->saveSyncStateAndUids(model);
+        mailbox->saveSyncStateAndUids(model, TreeItemMailbox::UID_MAP_CHANGES);
     } else {
         list->setFetchStatus(Imap::Mailbox::TreeItem::LOADING);
     }
@@ -146,8 +146,20 @@ public:
     QString debugIdentification() const;
 
     void requestPartDownload(const uint uid, const QString &partId, const uint estimatedSize);
+
+    /** @short How urgently are the message metadata needed */
+    typedef enum {
+        ENVELOPE_VISIBLE, /**< @short Somebody is looking at the message right now */
+        ENVELOPE_PRELOAD /**< @short The message will likely be needed soon */
+    } EnvelopePriority;
+
     /** @short Request a delayed loading of a message envelope */
-    void requestEnvelopeDownload(const uint uid);
+    void requestEnvelopeDownload(const uint uid, const EnvelopePriority priority = ENVELOPE_VISIBLE);
+    /** @short Forget about the queued preloading requests which were not sent to the server yet
+
+    Returns the UIDs of messages which will not be fetched after all.
+    */
+    QList<uint> withdrawQueuedEnvelopePreload();
 
     virtual QVariant taskData(const int role) const;
 
@@ -288,6 +300,8 @@ protected:
     not enough because of output sorting, threads etc etc.
     */
     QList<uint> requestedEnvelopes;
+    /** @short Same as requestedEnvelopes, but for the less urgent ENVELOPE_PRELOAD requests */
+    QList<uint> requestedPreloadEnvelopes;
 
     uint limitBytesAtOnce;
     int limitMessagesAtOnce;
@@ -33,14 +33,38 @@ namespace Mailbox
 {
 
 
+namespace
+{
+
+/** @short How many mailboxes shall share a single burst of pipelined STATUS commands */
+const int maxMailboxesPerTask = 100;
+
+}
+
 NumberOfMessagesTask::NumberOfMessagesTask(Model *model, const QModelIndex &mailbox):
-    ImapTask(model), mailboxIndex(mailbox)
+    ImapTask(model), m_hasFailures(false)
 {
     Q_ASSERT(dynamic_cast<TreeItemMailbox *>(static_cast<TreeItem *>(mailbox.internalPointer())));
+    mailboxIndexes << mailbox;
     conn = model->m_taskFactory->createGetAnyConnectionTask(model);
     conn->addDependentTask(this);
 }
 
+/** @short Ask for the numbers of another mailbox as a part of this task
+
+Returns false when the task has already started (or is too busy), in which case the caller is expected
+to create another task.
+*/
+bool NumberOfMessagesTask::addMailbox(const QModelIndex &mailbox)
+{
+    if (parser || _finished || mailboxIndexes.size() >= maxMailboxesPerTask)
+        return false;
+
+    Q_ASSERT(dynamic_cast<TreeItemMailbox *>(static_cast<TreeItem *>(mailbox.internalPointer())));
+    mailboxIndexes << mailbox;
+    return true;
+}
+
 void NumberOfMessagesTask::perform()
 {
     parser = conn->parser;
@@ -48,16 +72,20 @@ void NumberOfMessagesTask::perform()
 
     IMAP_TASK_CHECK_ABORT_DIE;
 
-    if (! mailboxIndex.isValid()) {
-        // FIXME: add proper fix
-        log("Mailbox vanished before we could ask for number of messages inside");
-        _completed();
-        return;
+    Q_FOREACH(const QPersistentModelIndex &mailboxIndex, mailboxIndexes) {
+        if (! mailboxIndex.isValid()) {
+            // FIXME: add proper fix
+            log("Mailbox vanished before we could ask for number of messages inside");
+            continue;
+        }
+        TreeItemMailbox *mailbox = dynamic_cast<TreeItemMailbox *>(static_cast<TreeItem *>(mailboxIndex.internalPointer()));
+        Q_ASSERT(mailbox);
+
+        tags << parser->status(mailbox->mailbox(), requestedStatusOptions());
     }
-    TreeItemMailbox *mailbox = dynamic_cast<TreeItemMailbox *>(static_cast<TreeItem *>(mailboxIndex.internalPointer()));
-    Q_ASSERT(mailbox);
 
-    tag = parser->status(mailbox->mailbox(), requestedStatusOptions());
+    if (tags.isEmpty())
+        _completed();
 }
 
 /** @short What kind of information are we interested in? */
@@ -71,27 +99,38 @@ bool NumberOfMessagesTask::handleStateHelper(const Imap::Responses::State *const
     if (resp->tag.isEmpty())
         return false;
 
-    if (resp->tag == tag) {
-        if (resp->kind == Responses::OK) {
-            _completed();
-        } else {
-            _failed("STATUS has failed");
-            // FIXME: error handling
-        }
-        return true;
-    } else {
+    int pos = tags.indexOf(resp->tag);
+    if (pos == -1)
         return false;
+
+    tags.removeAt(pos);
+    if (resp->kind != Responses::OK) {
+        // FIXME: error handling
+        m_hasFailures = true;
     }
+
+    if (tags.isEmpty()) {
+        if (m_hasFailures)
+            _failed("STATUS has failed");
+        else
+            _completed();
+    }
+    return true;
 }
 
 QString NumberOfMessagesTask::debugIdentification() const
 {
-    if (! mailboxIndex.isValid())
-        return QLatin1String("[invalid mailboxIndex]");
-
-    TreeItemMailbox *mailbox = dynamic_cast<TreeItemMailbox *>(static_cast<TreeItem *>(mailboxIndex.internalPointer()));
-    Q_ASSERT(mailbox);
-    return QString::fromUtf8("attached to %1").arg(mailbox->mailbox());
+    QStringList names;
+    Q_FOREACH(const QPersistentModelIndex &mailboxIndex, mailboxIndexes) {
+        if (! mailboxIndex.isValid()) {
+            names << QLatin1String("[invalid mailboxIndex]");
+            continue;
+        }
+        TreeItemMailbox *mailbox = dynamic_cast<TreeItemMailbox *>(static_cast<TreeItem *>(mailboxIndex.internalPointer()));
+        Q_ASSERT(mailbox);
+        names << mailbox->mailbox();
+    }
+    return QString::fromUtf8("attached to %1").arg(names.join(QLatin1String(", ")));
 }
 
 QVariant NumberOfMessagesTask::taskData(const int role) const
@@ -31,7 +31,11 @@ namespace Imap
 namespace Mailbox
 {
 
-/** @short Ask for number of messages in a certain mailbox */
+/** @short Ask for number of messages in a set of mailboxes
+
+The STATUS commands for all mailboxes which have been added before the task got a chance to run are sent
+in one go, pipelined over a single connection.
+*/
 class NumberOfMessagesTask : public ImapTask
 {
     Q_OBJECT
@@ -39,6 +43,8 @@ public:
     NumberOfMessagesTask(Model *model, const QModelIndex &mailbox);
     virtual void perform();
 
+    bool addMailbox(const QModelIndex &mailbox);
+
     virtual bool handleStateHelper(const Imap::Responses::State *const resp);
 
     virtual QString debugIdentification() const;
@@ -47,9 +53,10 @@ public:
 
     static QStringList requestedStatusOptions();
 private:
-    CommandHandle tag;
+    QList<CommandHandle> tags;
     ImapTask *conn;
-    QPersistentModelIndex mailboxIndex;
+    QList<QPersistentModelIndex> mailboxIndexes;
+    bool m_hasFailures;
 };
 
 }
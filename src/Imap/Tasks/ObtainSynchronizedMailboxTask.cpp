@@ -69,6 +69,7 @@ void ObtainSynchronizedMailboxTask::perform()
 
     if (_dead || _aborted) {
         // We're at the very start, so let's try to abort in a sane way
+        flushPendingFlags();
         _failed("Asked to abort or die");
         die(tr("Mailbox syncing dead or aborted"));
         return;
@@ -134,6 +135,7 @@ bool ObtainSynchronizedMailboxTask::handleStateHelper(const Imap::Responses::Sta
         return false;
 
     if (_dead) {
+        flushPendingFlags();
         _failed("Asked to die");
         return true;
     }
@@ -162,6 +164,7 @@ bool ObtainSynchronizedMailboxTask::handleStateHelper(const Imap::Responses::Sta
             Q_ASSERT(mailbox);
             syncFlags(mailbox);
         } else {
+            flushPendingFlags();
             _failed(QLatin1String("UID syncing failed: ") + resp->message);
             // FIXME: UNSELECT?
         }
@@ -175,6 +178,7 @@ bool ObtainSynchronizedMailboxTask::handleStateHelper(const Imap::Responses::Sta
             TreeItemMailbox *mailbox = dynamic_cast<TreeItemMailbox *>(static_cast<TreeItem *>(mailboxIndex.internalPointer()));
             Q_ASSERT(mailbox);
             status = STATE_DONE;
+            flushPendingFlags();
             log("Flags synchronized", Common::LOG_MAILBOX_SYNC);
             notifyInterestingMessages(mailbox);
             flagsCmd.clear();
@@ -188,6 +192,7 @@ bool ObtainSynchronizedMailboxTask::handleStateHelper(const Imap::Responses::Sta
             }
         } else {
             status = STATE_DONE;
+            flushPendingFlags();
             _failed(QLatin1String("Flags synchronization failed: ") + resp->message);
             // FIXME: UNSELECT?
         }
@@ -394,12 +399,13 @@ void ObtainSynchronizedMailboxTask::fullMboxSync(TreeItemMailbox *mailbox, TreeI
         list->m_children.clear();
         model->endRemoveRows();
         qDeleteAll(oldItems);
+        model->pruneFlagLists();
     }
     if (mailbox->syncState.exists()) {
         list->m_children.reserve(mailbox->syncState.exists());
         model->beginInsertRows(parent, 0, mailbox->syncState.exists() - 1);
         for (uint i = 0; i < mailbox->syncState.exists(); ++i) {
-            TreeItemMessage *msg = new TreeItemMessage(list);
+            TreeItemMessage *msg = new (list) TreeItemMessage(list);
             msg->m_offset = i;
             list->m_children << msg;
         }
@@ -454,7 +460,7 @@ void ObtainSynchronizedMailboxTask::syncNoNewNoDeletions(TreeItemMailbox *mailbo
         TreeItemChildrenList messages;
         list->m_children.reserve(mailbox->syncState.exists());
         for (uint i = 0; i < mailbox->syncState.exists(); ++i) {
-            TreeItemMessage *msg = new TreeItemMessage(list);
+            TreeItemMessage *msg = new (list) TreeItemMessage(list);
             msg->m_offset = i;
             msg->m_uid = uidMap[ i ];
             messages << msg;
@@ -708,7 +714,7 @@ bool ObtainSynchronizedMailboxTask::handleNumberResponse(const Imap::Responses::
                     list->m_children.reserve(resp->number);
                     model->beginInsertRows(parent, offset, resp->number - 1);
                     for (int i = 0; i < newArrivals; ++i) {
-                        TreeItemMessage *msg = new TreeItemMessage(list);
+                        TreeItemMessage *msg = new (list) TreeItemMessage(list);
                         msg->m_offset = i + offset;
                         list->m_children << msg;
                         // yes, we really have to add this message with UID 0 :(
@@ -972,7 +978,11 @@ bool ObtainSynchronizedMailboxTask::handleFetch(const Imap::Responses::Fetch *co
     Q_ASSERT(mailbox);
     QList<TreeItemPart *> changedParts;
     TreeItemMessage *changedMessage = 0;
-    mailbox->handleFetchResponse(model, *resp, changedParts, changedMessage, m_usingQresync);
+    // Saving the flags one by one is way too slow when syncing huge mailboxes, so they get saved in batches
+    mailbox->handleFetchResponse(model, *resp, changedParts, changedMessage, m_usingQresync,
+                                 status == STATE_SYNCING_FLAGS ? &m_pendingFlags : 0);
+    if (m_pendingFlags.size() >= 1000)
+        flushPendingFlags();
     if (changedMessage) {
         QModelIndex index = changedMessage->toIndex(model);
         emit model->dataChanged(index, index);
@@ -990,6 +1000,15 @@ bool ObtainSynchronizedMailboxTask::handleFetch(const Imap::Responses::Fetch *co
     return true;
 }
 
+void ObtainSynchronizedMailboxTask::flushPendingFlags()
+{
+    if (m_pendingFlags.isEmpty())
+        return;
+    if (mailboxIndex.isValid())
+        model->cache()->setMsgFlagsBulk(mailboxIndex.data(RoleMailboxName).toString(), m_pendingFlags);
+    m_pendingFlags.clear();
+}
+
 /** @short Apply the received UID map to the messages in mailbox
 
 The @arg firstUnknownUidOffset corresponds to the offset of a message whose UID is specified by the first item in the UID map.
@@ -1017,7 +1036,7 @@ void ObtainSynchronizedMailboxTask::applyUids(TreeItemMailbox *mailbox)
             model->beginInsertRows(parent, i, futureTotalMessages - 1);
             for (/*nothing*/; i < futureTotalMessages; ++i) {
                 // Add all messages in one go
-                TreeItemMessage *msg = new TreeItemMessage(list);
+                TreeItemMessage *msg = new (list) TreeItemMessage(list);
                 msg->m_offset = i;
                 // We're iterating with i, so we got to update the uidOffset
                 uidOffset = i - firstUnknownUidOffset;
@@ -1178,6 +1197,7 @@ bool ObtainSynchronizedMailboxTask::dieIfInvalidMailbox()
 void ObtainSynchronizedMailboxTask::slotUnSelectCompleted()
 {
     // Now, just finish and signal a failure
+    flushPendingFlags();
     _failed("Escaped from mailbox");
 }
 
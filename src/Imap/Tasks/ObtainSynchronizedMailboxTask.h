@@ -80,6 +80,9 @@ private:
 
     void notifyInterestingMessages(TreeItemMailbox *mailbox);
 
+    /** @short Save the flags collected during the flag syncing into the cache */
+    void flushPendingFlags();
+
     bool handleResponseCodeInsideState(const Imap::Responses::State *const resp);
 
     /** @short Check current mailbox for validty, and take an evasive action if it disappeared
@@ -113,6 +116,8 @@ private:
     uint firstUnknownUidOffset;
     SyncState oldSyncState;
     bool m_usingQresync;
+    /** @short Flags which were updated during the flag syncing and have not been saved into the cache yet */
+    QVector<QPair<uint, QStringList> > m_pendingFlags;
 
     /** @short An UNSELECT task, if active */
     UnSelectTask *unSelectTask;
@@ -72,15 +72,28 @@ bool UpdateFlagsOfAllMessagesTask::handleStateHelper(const Imap::Responses::Stat
             TreeItemMsgList *list = dynamic_cast<TreeItemMsgList*>(mailbox->m_children [0]);
             Q_ASSERT(list);
 
+            // Messages share their lists of flags, so there are only a few distinct lists to update
+            QList<QPair<QStringList, QStringList> > updatedFlags;
+
             Q_FOREACH (TreeItem *item, list->m_children) {
                 TreeItemMessage *message = dynamic_cast<TreeItemMessage *>(item);
                 Q_ASSERT(message);
 
                 Q_ASSERT(flagOperation == Imap::Mailbox::FLAG_ADD || flagOperation == Imap::Mailbox::FLAG_ADD_SILENT);
-                QStringList newFlags = message->m_flags;
-                if (!newFlags.contains(flags)) {
-                    newFlags << flags;
-                    message->setFlags(list, model->normalizeFlags(newFlags), true);
+                if (!message->m_flags.contains(flags)) {
+                    QStringList newFlags;
+                    for (QList<QPair<QStringList, QStringList> >::const_iterator it = updatedFlags.constBegin();
+                         it != updatedFlags.constEnd(); ++it) {
+                        if (it->first == message->m_flags) {
+                            newFlags = it->second;
+                            break;
+                        }
+                    }
+                    if (newFlags.isEmpty()) {
+                        newFlags = model->normalizeFlags(QStringList(message->m_flags) << flags);
+                        updatedFlags << qMakePair(message->m_flags, newFlags);
+                    }
+                    message->setFlags(list, newFlags, true);
                     model->cache()->setMsgFlags(mailbox->mailbox(), message->uid(), newFlags);
                     QModelIndex messageIndex = model->createIndex(message->m_offset, 0, message);
 
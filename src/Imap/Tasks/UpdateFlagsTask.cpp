@@ -94,9 +94,8 @@ void UpdateFlagsTask::perform()
                 Q_ASSERT(list);
                 QStringList newFlags = message->m_flags;
                 newFlags.removeOne(flags);
-                message->setFlags(list, newFlags , false);
-                // we don't have to either re-sort or call Model::normalizeFlags again from this context;
-                // this will change when the model starts de-duplicating whole lists
+                // The list remains sorted, but it has to be normalized again so that it gets shared with other messages
+                message->setFlags(list, model->normalizeFlags(newFlags), false);
                 model->cache()->setMsgFlags(static_cast<TreeItemMailbox*>(list->parent())->mailbox(), message->uid(), newFlags);
                 break;
             }
@@ -43,7 +43,7 @@ bool AbstractMSA::supportsImapSending() const
     return false;
 }
 
-void AbstractMSA::sendMail(const QByteArray &from, const QList<QByteArray> &to, const QByteArray &data)
+void AbstractMSA::sendMail(const QByteArray &from, const QList<QByteArray> &to, const QSharedPointer<QIODevice> &data)
 {
     Q_UNUSED(from);
     Q_UNUSED(to);
@@ -23,7 +23,9 @@
 #define ABSTRACTMSA_H
 
 #include <QByteArray>
+#include <QIODevice>
 #include <QObject>
+#include <QSharedPointer>
 #include "Imap/Model/UidSubmitData.h"
 
 namespace MSA
@@ -37,7 +39,11 @@ public:
     virtual ~AbstractMSA();
     virtual bool supportsBurl() const;
     virtual bool supportsImapSending() const;
-    virtual void sendMail(const QByteArray &from, const QList<QByteArray> &to, const QByteArray &data);
+    /** @short Send the message which is read from the @arg data device
+
+    The device knows its size in advance. It is read only as fast as the message can be submitted.
+    */
+    virtual void sendMail(const QByteArray &from, const QList<QByteArray> &to, const QSharedPointer<QIODevice> &data);
     virtual void sendBurl(const QByteArray &from, const QList<QByteArray> &to, const QByteArray &imapUrl);
     virtual void sendImap(const QString &mailbox, const int uidValidity, const int uid,
                           const Imap::Mailbox::UidSubmitOptionsList options);
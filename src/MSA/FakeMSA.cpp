@@ -33,9 +33,9 @@ Fake::~Fake()
 {
 }
 
-void Fake::sendMail(const QByteArray &from, const QList<QByteArray> &to, const QByteArray &data)
+void Fake::sendMail(const QByteArray &from, const QList<QByteArray> &to, const QSharedPointer<QIODevice> &data)
 {
-    emit m_factory->requestedSending(from, to, data);
+    emit m_factory->requestedSending(from, to, data->readAll());
 }
 
 void Fake::sendBurl(const QByteArray &from, const QList<QByteArray> &to, const QByteArray &imapUrl)
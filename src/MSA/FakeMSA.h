@@ -35,7 +35,7 @@ class Fake : public AbstractMSA
 public:
     Fake(QObject *parent, FakeFactory *factory, const bool supportsBurl, const bool supportsImap);
     virtual ~Fake();
-    virtual void sendMail(const QByteArray &from, const QList<QByteArray> &to, const QByteArray &data);
+    virtual void sendMail(const QByteArray &from, const QList<QByteArray> &to, const QSharedPointer<QIODevice> &data);
     virtual void sendBurl(const QByteArray &from, const QList<QByteArray> &to, const QByteArray &imapUrl);
 public slots:
     virtual void cancel();
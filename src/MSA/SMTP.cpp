@@ -80,14 +80,14 @@ void SMTP::setPassword(const QString &password)
         sendContinueGotPassword();
 }
 
-void SMTP::sendMail(const QByteArray &from, const QList<QByteArray> &to, const QByteArray &data)
+void SMTP::sendMail(const QByteArray &from, const QList<QByteArray> &to, const QSharedPointer<QIODevice> &data)
 {
     this->from = from;
     this->to = to;
-    this->data = data;
+    this->messageData = data;
     this->sendingMode = MODE_SMTP_DATA;
     this->isWaitingForPassword = true;
-    emit progressMax(data.size());
+    emit progressMax(data->size());
     emit progress(0);
     emit connecting();
     if (!auth || !pass.isEmpty()) {
@@ -114,13 +114,8 @@ void SMTP::sendContinueGotPassword()
     emit sending(); // FIXME: later
     switch (sendingMode) {
     case MODE_SMTP_DATA:
-        {
-            //RFC5321 specifies to prepend a period to lines starting with a period in section 4.5.2
-            if (data.startsWith('.'))
-                data.prepend('.');
-            data.replace("\n.", "\n..");
-            qwwSmtp->sendMail(from, to, QString::fromUtf8(data));
-        }
+        // The dot-stuffing from RFC 5321, section 4.5.2 is performed while the data are being sent
+        qwwSmtp->sendMail(from, to, messageData.data());
         break;
     case MODE_SMTP_BURL:
         qwwSmtp->sendMailBurl(from, to, data);
@@ -34,7 +34,7 @@ class SMTP : public AbstractMSA
 public:
     SMTP(QObject *parent, const QString &host, quint16 port, bool encryptedConnect, bool startTls, bool auth,
          const QString &user, const QString &pass);
-    virtual void sendMail(const QByteArray &from, const QList<QByteArray> &to, const QByteArray &data);
+    virtual void sendMail(const QByteArray &from, const QList<QByteArray> &to, const QSharedPointer<QIODevice> &data);
 
     virtual bool supportsBurl() const;
     virtual void sendBurl(const QByteArray &from, const QList<QByteArray> &to, const QByteArray &imapUrl);
@@ -56,6 +56,7 @@ private:
     QByteArray from;
     QList<QByteArray> to;
     QByteArray data;
+    QSharedPointer<QIODevice> messageData;
     bool isWaitingForPassword;
     enum { MODE_SMTP_INVALID, MODE_SMTP_DATA, MODE_SMTP_BURL } sendingMode;
 
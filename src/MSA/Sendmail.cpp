@@ -25,7 +25,7 @@ namespace MSA
 {
 
 Sendmail::Sendmail(QObject *parent, const QString &command, const QStringList &args):
-    AbstractMSA(parent), command(command), args(args)
+    AbstractMSA(parent), command(command), args(args), messageSize(0), writtenSoFar(0)
 {
     proc = new QProcess(this);
     connect(proc, SIGNAL(started()), this, SLOT(handleStarted()));
@@ -41,11 +41,12 @@ Sendmail::~Sendmail()
     proc->waitForFinished();
 }
 
-void Sendmail::sendMail(const QByteArray &from, const QList<QByteArray> &to, const QByteArray &data)
+void Sendmail::sendMail(const QByteArray &from, const QList<QByteArray> &to, const QSharedPointer<QIODevice> &data)
 {
     // first +1 for the process startup
     // second +1 for waiting for the result
-    emit progressMax(data.size() + 2);
+    messageSize = data->size();
+    emit progressMax(messageSize + 2);
     emit progress(0);
     QStringList myArgs = args;
     myArgs << "-f" << from;
@@ -71,8 +72,28 @@ void Sendmail::handleStarted()
     emit progress(1);
 
     emit sending();
-    proc->write(dataToSend);
-    proc->closeWriteChannel();
+    writeMoreData();
+}
+
+/** @short Pass another part of the message to the process, unless it hasn't consumed the previous data yet */
+void Sendmail::writeMoreData()
+{
+    while (dataToSend && proc->bytesToWrite() < 256 * 1024) {
+        if (dataToSend->atEnd()) {
+            dataToSend.clear();
+            proc->closeWriteChannel();
+            return;
+        }
+        QByteArray chunk = dataToSend->read(64 * 1024);
+        if (chunk.isEmpty()) {
+            QString message = dataToSend->errorString();
+            dataToSend.clear();
+            proc->kill();
+            emit error(tr("Cannot read the message: %1").arg(message));
+            return;
+        }
+        proc->write(chunk);
+    }
 }
 
 void Sendmail::handleError(QProcess::ProcessError e)
@@ -86,12 +107,13 @@ void Sendmail::handleBytesWritten(qint64 bytes)
     writtenSoFar += bytes;
     // +1 due to starting at one
     emit progress(writtenSoFar + 1);
+    writeMoreData();
 }
 
 void Sendmail::handleFinished(const int exitCode)
 {
     // that's the last one
-    emit progressMax(dataToSend.size() + 2);
+    emit progressMax(messageSize + 2);
 
     if (exitCode == 0) {
         emit sent();
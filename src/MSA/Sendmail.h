@@ -36,7 +36,7 @@ class Sendmail : public AbstractMSA
 public:
     Sendmail(QObject *parent, const QString &command, const QStringList &args);
     virtual ~Sendmail();
-    virtual void sendMail(const QByteArray &from, const QList<QByteArray> &to, const QByteArray &data);
+    virtual void sendMail(const QByteArray &from, const QList<QByteArray> &to, const QSharedPointer<QIODevice> &data);
 private slots:
     void handleError(QProcess::ProcessError e);
     void handleBytesWritten(qint64 bytes);
@@ -48,9 +48,12 @@ private:
     QProcess *proc;
     QString command;
     QStringList args;
-    QByteArray dataToSend;
+    QSharedPointer<QIODevice> dataToSend;
+    int messageSize;
     int writtenSoFar;
 
+    void writeMoreData();
+
     Sendmail(const Sendmail &); // don't implement
     Sendmail &operator=(const Sendmail &); // don't implement
 };
@@ -59,6 +59,11 @@ void FakeSocket::slotEmitEncrypted()
     emit encrypted();
 }
 
+void FakeSocket::slotEmitBytesWritten()
+{
+    emit bytesWritten();
+}
+
 void FakeSocket::fakeReading(const QByteArray &what)
 {
     // The position of the cursor is shared for both reading and writing, and therefore
@@ -89,7 +94,8 @@ bool FakeSocket::canReadLine()
 
 QByteArray FakeSocket::read(qint64 maxSize)
 {
-    return readChannel->read(maxSize);
+    // Don't let QIODevice preallocate a huge buffer for nothing, see IODeviceSocket::read()
+    return readChannel->read(qMin(maxSize, readChannel->bytesAvailable()));
 }
 
 QByteArray FakeSocket::readLine(qint64 maxSize)
@@ -127,11 +133,18 @@ void FakeSocket::close()
     writeChannel->write(QByteArray("[*** close ***]"));
 }
 
+qint64 FakeSocket::bytesToWrite()
+{
+    return w.size();
+}
+
 QByteArray FakeSocket::writtenStuff()
 {
     QByteArray res = w;
     w.clear();
     writeChannel->seek(0);
+    if (!res.isEmpty())
+        QTimer::singleShot(0, this, SLOT(slotEmitBytesWritten()));
     return res;
 }
 
@@ -49,8 +49,12 @@ public:
     virtual void startDeflate();
     virtual bool isDead();
     virtual void close();
+    virtual qint64 bytesToWrite();
 
-    /** @short Return data written since the last call to this function */
+    /** @short Return data written since the last call to this function
+
+    The returned data are considered to be sent, i.e. they no longer count towards bytesToWrite().
+    */
     QByteArray writtenStuff();
 
 private slots:
@@ -58,6 +62,8 @@ private slots:
     void slotEmitConnected();
     /** @short Delayed informing about being encrypted */
     void slotEmitEncrypted();
+    /** @short Delayed informing about the written data having been sent */
+    void slotEmitBytesWritten();
 
 public slots:
     /** @short Simulate arrival of some data
@@ -39,6 +39,7 @@ IODeviceSocket::IODeviceSocket(QIODevice *device): d(device), m_compressor(0), m
 {
     connect(d, SIGNAL(readyRead()), this, SLOT(handleReadyRead()));
     connect(d, SIGNAL(readChannelFinished()), this, SLOT(handleStateChanged()));
+    connect(d, SIGNAL(bytesWritten(qint64)), this, SIGNAL(bytesWritten()));
     delayedDisconnect = new QTimer();
     delayedDisconnect->setSingleShot(true);
     connect(delayedDisconnect, SIGNAL(timeout()), this, SLOT(emitError()));
@@ -71,7 +72,9 @@ QByteArray IODeviceSocket::read(qint64 maxSize)
         return m_decompressor->read(maxSize);
     }
 #endif
-    return d->read(maxSize);
+    // QIODevice::read(qint64) allocates a buffer of maxSize bytes upfront. The Parser asks for the whole remaining size
+    // of a literal, which could be many megabytes while only a few kilobytes have actually arrived.
+    return d->read(qMin(maxSize, d->bytesAvailable()));
 }
 
 QByteArray IODeviceSocket::readLine(qint64 maxSize)
@@ -96,6 +99,11 @@ qint64 IODeviceSocket::write(const QByteArray &byteArray)
     return d->write(byteArray);
 }
 
+qint64 IODeviceSocket::bytesToWrite()
+{
+    return d->bytesToWrite();
+}
+
 void IODeviceSocket::startTls()
 {
     QSslSocket *sock = qobject_cast<QSslSocket *>(d);
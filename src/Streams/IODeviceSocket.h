@@ -50,6 +50,7 @@ public:
     virtual void startTls();
     virtual void startDeflate();
     virtual bool isDead() = 0;
+    virtual qint64 bytesToWrite();
 private slots:
     virtual void handleStateChanged() = 0;
     virtual void delayedStart() = 0;
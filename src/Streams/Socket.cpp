@@ -44,4 +44,9 @@ QList<QSslError> Socket::sslErrors() const
     return QList<QSslError>();
 }
 
+qint64 Socket::bytesToWrite()
+{
+    return 0;
+}
+
 }
@@ -77,6 +77,14 @@ public:
 
     /** @short Start the DEFLATE algorithm on both directions of this stream */
     virtual void startDeflate() = 0;
+
+    /** @short Return the number of bytes which were written, but which haven't been sent yet
+
+      This is used for throttling the producers of big chunks of data, so that they do not have to
+    keep everything in memory at once.  The default implementation returns zero, i.e. the data are
+    considered to be sent as soon as they are written.
+    */
+    virtual qint64 bytesToWrite();
 signals:
     /** @short The socket got disconnected */
     void disconnected(const QString);
@@ -89,6 +97,9 @@ signals:
 
     /** @short The socket is now encrypted */
     void encrypted();
+
+    /** @short Some of the previously written data have been sent */
+    void bytesWritten();
 };
 
 }
@@ -88,6 +88,11 @@ void XtCache::clearUidMapping( const QString& mailbox )
     _sqlCache->clearUidMapping( mailbox );
 }
 
+void XtCache::updateUidMapping( const QString& mailbox, const QList<uint>& expungedUids, const QList<uint>& newUids )
+{
+    _sqlCache->updateUidMapping( mailbox, expungedUids, newUids );
+}
+
 void XtCache::clearAllMessages( const QString& mailbox )
 {
     _sqlCache->clearAllMessages( mailbox );
@@ -71,6 +71,7 @@ public:
     virtual void setUidMapping( const QString& mailbox, const QList<uint>& seqToUid );
     virtual void clearUidMapping( const QString& mailbox );
     virtual QList<uint> uidMapping( const QString& mailbox ) const;
+    virtual void updateUidMapping( const QString& mailbox, const QList<uint>& expungedUids, const QList<uint>& newUids );
 
     virtual void clearAllMessages( const QString& mailbox );
     virtual void clearMessage( const QString mailbox, uint uid );
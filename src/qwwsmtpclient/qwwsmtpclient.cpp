@@ -10,6 +10,7 @@
 //
 //
 #include "qwwsmtpclient.h"
+#include "qwwsmtpclient_p.h"
 #include <QSslSocket>
 #include <QtDebug>
 #include <QQueue>
@@ -50,59 +51,6 @@ CONNECTION ESTABLISHMENT
       S: 221
 */
 
-struct SMTPCommand {
-    enum Type { Connect, Disconnect, StartTLS, Authenticate, Mail, MailBurl, RawCommand };
-    int id;
-    Type type;
-    QVariant data;
-    QVariant extra;
-};
-
-class QwwSmtpClientPrivate {
-public:
-    QwwSmtpClientPrivate(QwwSmtpClient *qq) {
-        q = qq;
-    }
-    QSslSocket *socket;
-
-    QwwSmtpClient::State state;
-    void setState(QwwSmtpClient::State s);
-    void parseOption(const QString &buffer);
-
-    void onConnected();
-    void onDisconnected();
-    void onError(QAbstractSocket::SocketError);
-    void _q_readFromSocket();
-    void _q_encrypted();
-    void processNextCommand(bool ok = true);
-    void abortDialog();
-
-    void sendAuthPlain(const QString &username, const QString &password);
-    void sendAuthLogin(const QString &username, const QString &password, int stage);
-
-    void sendEhlo();
-    void sendHelo();
-    void sendQuit();
-    void sendRcpt();
-
-    int lastId;
-    bool inProgress;
-    QString localName;
-    QString localNameEncrypted;
-    QString errorString;
-
-    // server caps:
-    QwwSmtpClient::Options options;
-    QwwSmtpClient::AuthModes authModes;
-
-    QQueue<SMTPCommand> commandqueue;
-private:
-    QwwSmtpClient *q;
-
-    QwwSmtpClientPrivate(const QwwSmtpClientPrivate&); // don't implement
-    QwwSmtpClientPrivate& operator=(const QwwSmtpClientPrivate&); // don't implement
-};
-
 // private slot triggered upon connection to the server
 // - clears options
 // - notifies the environment
@@ -117,6 +65,7 @@ void QwwSmtpClientPrivate::onConnected() {
 // - checks the cause of disconnection
 // - aborts or continues processing
 void QwwSmtpClientPrivate::onDisconnected() {
+    streamedContent = 0;
     setState(QwwSmtpClient::Disconnected);
     if (commandqueue.isEmpty()) {
         inProgress = false;
@@ -327,6 +276,15 @@ void QwwSmtpClientPrivate::_q_readFromSocket() {
                         socket->write("DATA\r\n");
                         cmd.extra=2;
                     }
+                } else if ((cmd.type == SMTPCommand::Mail && status==354 && stage==2 && cmd.content)) {
+                    // DATA command accepted, the data are read from the device as fast as the socket can send them
+                    errorString.clear();
+                    qDebug() << "SMTP >>> [message data]";
+                    streamedContent = cmd.content;
+                    atLineStart = true;
+                    lastWasCR = false;
+                    cmd.extra=3;
+                    _q_sendMessageData();
                 } else if ((cmd.type == SMTPCommand::Mail && status==354 && stage==2)) {
                     // DATA command accepted
                     errorString.clear();
@@ -445,6 +403,69 @@ void QwwSmtpClientPrivate::processNextCommand(bool ok) {
     emit q->commandStarted(cmd.id);
 }
 
+// private slot triggered whenever some data got sent
+// - writes another part of the message which is being streamed, unless there's enough data waiting in the socket already
+void QwwSmtpClientPrivate::_q_sendMessageData() {
+    while (streamedContent && socket->bytesToWrite() < 256 * 1024) {
+        if (streamedContent->atEnd()) {
+            QByteArray tail;
+            if (lastWasCR) {
+                tail += '\n';
+                atLineStart = true;
+            }
+            if (!atLineStart)
+                tail += "\r\n";
+            tail += ".\r\n"; // termination token - CRLF.CRLF
+            qDebug() << "SMTP >>> .";
+            socket->write(tail);
+            streamedContent = 0;
+            return;
+        }
+        QByteArray chunk = streamedContent->read(64 * 1024);
+        if (chunk.isEmpty()) {
+            // there's no way to finish the DATA phase without sending a truncated message
+            errorString = streamedContent->errorString();
+            streamedContent = 0;
+            socket->abort();
+            return;
+        }
+        socket->write(escapeMessageData(chunk));
+    }
+}
+
+// transparency procedure from RFC 5321, section 4.5.2, along with conversion of bare CRs and LFs to CRLF
+QByteArray QwwSmtpClientPrivate::escapeMessageData(const QByteArray &data) {
+    QByteArray res;
+    res.reserve(data.size() + data.size() / 64 + 2);
+    for (int i = 0; i < data.size(); ++i) {
+        const char c = data[i];
+        if (c == '\n') {
+            if (!lastWasCR)
+                res += '\r';
+            res += '\n';
+            lastWasCR = false;
+            atLineStart = true;
+            continue;
+        }
+        if (lastWasCR) {
+            // a bare CR
+            res += '\n';
+            atLineStart = true;
+        }
+        if (c == '\r') {
+            res += '\r';
+            lastWasCR = true;
+            continue;
+        }
+        lastWasCR = false;
+        if (atLineStart && c == '.')
+            res += '.';
+        atLineStart = false;
+        res += c;
+    }
+    return res;
+}
+
 void QwwSmtpClientPrivate::_q_encrypted() {
         options = QwwSmtpClient::NoOptions;
     // forget everything, restart ehlo
@@ -549,6 +570,8 @@ QwwSmtpClient::QwwSmtpClient(QObject *parent)
     d->state = Disconnected;
     d->lastId = 0;
     d->inProgress = false;
+    d->atLineStart = true;
+    d->lastWasCR = false;
     d->localName = "localhost";
     d->socket = new QSslSocket(this);
     connect(d->socket, SIGNAL(connected()), this, SLOT(onConnected()));
@@ -557,6 +580,7 @@ QwwSmtpClient::QwwSmtpClient(QObject *parent)
     connect(d->socket, SIGNAL(readyRead()), this, SLOT(_q_readFromSocket()));
     connect(d->socket, SIGNAL(sslErrors(const QList<QSslError> &)), this, SIGNAL(sslErrors(const QList<QSslError>&)));
     connect(d->socket, SIGNAL(encrypted()), this, SLOT(_q_encrypted()));
+    connect(d->socket, SIGNAL(bytesWritten(qint64)), this, SLOT(_q_sendMessageData()));
 }
 
 
@@ -663,6 +687,23 @@ int QwwSmtpClient::sendMail(const QByteArray &from, const QList<QByteArray> &to,
     return cmd.id;
 }
 
+int QwwSmtpClient::sendMail(const QByteArray &from, const QList<QByteArray> &to, QIODevice *content)
+{
+    QList<QVariant> rcpts;
+    for(QList<QByteArray>::const_iterator it = to.begin(); it != to.end(); it ++) {
+        rcpts.append(QVariant(*it));
+    }
+    SMTPCommand cmd;
+    cmd.type = SMTPCommand::Mail;
+    cmd.data = QVariantList() << from << QVariant(rcpts) << QVariant();
+    cmd.content = content;
+    cmd.id = ++d->lastId;
+    d->commandqueue.enqueue(cmd);
+    if (!d->inProgress)
+        d->processNextCommand();
+    return cmd.id;
+}
+
 int QwwSmtpClient::sendMailBurl(const QByteArray &from, const QList<QByteArray> &to, const QString &url)
 {
     QList<QVariant> rcpts;
@@ -17,6 +17,8 @@
 #include <QString>
 #include <QSslError>
 
+class QIODevice;
+
 class QwwSmtpClientPrivate;
 
 /*!
@@ -67,6 +69,7 @@ public:
     int authenticate(const QString &user, const QString &password, AuthMode mode = AuthAny);
     int sendMail(const QString &from, const QString &to, const QString &content);
     int sendMail(const QByteArray &from, const QList<QByteArray> &to, const QString &content);
+    int sendMail(const QByteArray &from, const QList<QByteArray> &to, QIODevice *content);
     int sendMailBurl(const QByteArray &from, const QList<QByteArray> &to, const QString &url);
     int rawCommand(const QString &cmd);
     AuthModes supportedAuthModes() const;
@@ -97,6 +100,7 @@ private:
     Q_PRIVATE_SLOT(d, void onError(QAbstractSocket::SocketError));
     Q_PRIVATE_SLOT(d, void _q_readFromSocket());
     Q_PRIVATE_SLOT(d, void _q_encrypted());
+    Q_PRIVATE_SLOT(d, void _q_sendMessageData());
     friend class QwwSmtpClientPrivate;
 
     QwwSmtpClient(const QwwSmtpClient&); // don't implement
@@ -0,0 +1,85 @@
+//
+// C++ Interface: qwwsmtpclient
+//
+// Description: private parts of the QwwSmtpClient, exposed for the unit tests
+//
+//
+// Author: Witold Wysota <wysota@wysota.eu.org>, (C) 2009
+//
+// Copyright: See COPYING file that comes with this distribution
+//
+//
+#ifndef QWWSMTPCLIENT_P_H
+#define QWWSMTPCLIENT_P_H
+
+#include <QAbstractSocket>
+#include <QIODevice>
+#include <QPointer>
+#include <QQueue>
+#include <QVariant>
+#include "qwwsmtpclient.h"
+
+class QSslSocket;
+
+struct SMTPCommand {
+    enum Type { Connect, Disconnect, StartTLS, Authenticate, Mail, MailBurl, RawCommand };
+    int id;
+    Type type;
+    QVariant data;
+    QVariant extra;
+    QPointer<QIODevice> content;
+};
+
+class QwwSmtpClientPrivate {
+public:
+    QwwSmtpClientPrivate(QwwSmtpClient *qq) {
+        q = qq;
+    }
+    QSslSocket *socket;
+
+    QwwSmtpClient::State state;
+    void setState(QwwSmtpClient::State s);
+    void parseOption(const QString &buffer);
+
+    void onConnected();
+    void onDisconnected();
+    void onError(QAbstractSocket::SocketError);
+    void _q_readFromSocket();
+    void _q_encrypted();
+    void _q_sendMessageData();
+    QByteArray escapeMessageData(const QByteArray &data);
+    void processNextCommand(bool ok = true);
+    void abortDialog();
+
+    void sendAuthPlain(const QString &username, const QString &password);
+    void sendAuthLogin(const QString &username, const QString &password, int stage);
+
+    void sendEhlo();
+    void sendHelo();
+    void sendQuit();
+    void sendRcpt();
+
+    int lastId;
+    bool inProgress;
+    QString localName;
+    QString localNameEncrypted;
+    QString errorString;
+
+    // server caps:
+    QwwSmtpClient::Options options;
+    QwwSmtpClient::AuthModes authModes;
+
+    QQueue<SMTPCommand> commandqueue;
+
+    // state of the message data which are being streamed during the DATA phase
+    QPointer<QIODevice> streamedContent;
+    bool atLineStart;
+    bool lastWasCR;
+private:
+    QwwSmtpClient *q;
+
+    QwwSmtpClientPrivate(const QwwSmtpClientPrivate&); // don't implement
+    QwwSmtpClientPrivate& operator=(const QwwSmtpClientPrivate&); // don't implement
+};
+
+#endif
@@ -648,4 +648,46 @@ void ComposerSubmissionTest::testReplyingToRemoved()
     cEmpty();
 }
 
+/** @short Check that the message produced on the fly has the announced size and that it can be produced again */
+void ComposerSubmissionTest::testStreamedRawMessage()
+{
+#ifdef Q_OS_OS2
+#if QT_VERSION >= QT_VERSION_CHECK(5, 0, 0)
+    QSKIP("Looks like QTemporaryFile is broken on OS/2");
+#else
+    QSKIP("Looks like QTemporaryFile is broken on OS/2", SkipSingle);
+#endif
+#endif
+    helperSetupProperHeaders();
+
+    QByteArray attachmentData;
+    for (int i = 0; i < 100000; ++i)
+        attachmentData += static_cast<char>(i % 251);
+    QTemporaryFile tempFile;
+    tempFile.open();
+    tempFile.write(attachmentData);
+    tempFile.flush();
+    QCOMPARE(m_submission->composer()->addFileAttachment(tempFile.fileName()), true);
+
+    QString errorMessage;
+    QSharedPointer<QIODevice> device = m_submission->composer()->rawMessageDevice(&errorMessage);
+    QVERIFY(device);
+    qint64 size = device->size();
+    QByteArray message = device->readAll();
+    QCOMPARE(static_cast<qint64>(message.size()), size);
+    QVERIFY(device->atEnd());
+    QVERIFY(message.contains("Sample message"));
+    QVERIFY(message.contains(attachmentData.left(57 * 3).toBase64()));
+
+    QVERIFY(device->reset());
+    QCOMPARE(device->readAll(), message);
+
+    // The old-style serialization produces the same data, except for the random MIME boundary
+    QByteArray serialized;
+    QBuffer buf(&serialized);
+    buf.open(QIODevice::WriteOnly);
+    QVERIFY(m_submission->composer()->asRawMessage(&buf, &errorMessage));
+    QCOMPARE(serialized.size(), message.size());
+}
+
 TROJITA_HEADLESS_TEST(ComposerSubmissionTest)
@@ -59,6 +59,7 @@ private slots:
     void testNoImapContinuation();
     void testReplyingNormal();
     void testReplyingToRemoved();
+    void testStreamedRawMessage();
     void init();
     void cleanup();
 
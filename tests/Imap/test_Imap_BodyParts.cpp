@@ -26,8 +26,11 @@
 #include "Utils/headless_test.h"
 #include "Utils/FakeCapabilitiesInjector.h"
 #include "Streams/FakeSocket.h"
+#include "Imap/Model/DiskPartCache.h"
 #include "Imap/Model/ItemRoles.h"
 #include "Imap/Model/MailboxTree.h"
+#include "Imap/Model/MemoryCache.h"
+#include "Imap/Model/Utils.h"
 
 struct Data {
     QString key;
@@ -51,6 +54,28 @@ struct Data {
 
 Q_DECLARE_METATYPE(QList<Data>)
 
+/** @short A MemoryCache which lets a DiskPartCache decode the parts into plain files, just like the CombinedCache does */
+class FileBackedMemoryCache: public Imap::Mailbox::MemoryCache
+{
+public:
+    FileBackedMemoryCache(QObject *parent, const QString &cacheDir): MemoryCache(parent), diskPartCache(0, cacheDir)
+    {
+    }
+
+    virtual bool setMsgPartEncoded(const QString &mailbox, const uint uid, const QString &partId,
+                                   const QByteArray &encodedData, const QByteArray &encoding)
+    {
+        return diskPartCache.setMsgPartEncoded(mailbox, uid, partId, encodedData, encoding);
+    }
+
+    virtual QString messagePartFileName(const QString &mailbox, const uint uid, const QString &partId) const
+    {
+        return diskPartCache.messagePartFileName(mailbox, uid, partId);
+    }
+
+    Imap::Mailbox::DiskPartCache diskPartCache;
+};
+
 namespace QTest {
 template <>
 char *toString(const QModelIndex &index)
@@ -490,6 +515,89 @@ void BodyPartsTest::testFetchingRawParts()
     cEmpty();
 }
 
+/** @short Make sure that parts which the cache stores in plain files are served from there and not kept in memory */
+void BodyPartsTest::testPartDataInFiles()
+{
+    const QString cacheDir = QDir::tempPath() + QString::fromUtf8("/trojita-test-bodyparts-%1/").arg(QCoreApplication::applicationPid());
+    FileBackedMemoryCache *cache = new FileBackedMemoryCache(model, cacheDir);
+    model->setCache(cache);
+    model->setProperty("trojita-imap-delayed-fetch-part", 0);
+    helperSyncBNoMessages();
+    cServer("* 1 EXISTS\r\n");
+    cClient(t.mk("UID FETCH 1:* (FLAGS)\r\n"));
+    cServer("* 1 FETCH (UID 333 FLAGS ())\r\n" + t.last("OK fetched\r\n"));
+    QCOMPARE(model->rowCount(msgListB), 1);
+    QModelIndex msg = msgListB.child(0, 0);
+    QVERIFY(msg.isValid());
+    QCOMPARE(model->rowCount(msg), 0);
+    cClient(t.mk("UID FETCH 333 (" FETCH_METADATA_ITEMS ")\r\n"));
+    cServer("* 1 FETCH (UID 333 BODYSTRUCTURE (" + bsManyPlaintexts + "))\r\n" + t.last("OK fetched\r\n"));
+    QCOMPARE(model->rowCount(msg), 1);
+    QModelIndex rootMultipart = msg.child(0, 0);
+    QVERIFY(rootMultipart.isValid());
+    QCOMPARE(model->rowCount(rootMultipart), 5);
+
+    QModelIndex part, rawPart;
+    QSharedPointer<QIODevice> io;
+    QByteArray fakePartData = "Canary 1";
+
+    // The CTE gets undone straight into a file
+    part = rootMultipart.child(0, 0);
+    QCOMPARE(part.data(RolePartDataFileName).toString(), QString());
+    cClient(t.mk("UID FETCH 333 (BODY.PEEK[1])\r\n"));
+    cServer("* 1 FETCH (UID 333 BODY[1] \"" + fakePartData.toBase64() + "\")\r\n" + t.last("OK fetched\r\n"));
+    QVERIFY(part.data(RoleIsFetched).toBool());
+    QVERIFY(!part.data(RolePartDataFileName).toString().isEmpty());
+    QVERIFY(model->cache()->messagePart("b", 333, "1").isNull());
+    io = partDataDevice(part);
+    QVERIFY(io);
+    QVERIFY(qobject_cast<QFile*>(io.data()));
+    QCOMPARE(io->readAll(), fakePartData);
+    io.clear();
+    QCOMPARE(part.data(RolePartData).toByteArray(), fakePartData);
+
+    // When the raw data get cached, the decoded form is not saved at all, so it has to stay in memory
+    fakePartData = "Canary 2";
+    part = rootMultipart.child(1, 0);
+    rawPart = part.child(0, TreeItem::OFFSET_RAW_CONTENTS);
+    QVERIFY(rawPart.isValid());
+    QCOMPARE(rawPart.data(RolePartData).toByteArray(), QByteArray());
+    QCOMPARE(part.data(RolePartData).toByteArray(), QByteArray());
+    cClient(t.mk("UID FETCH 333 (BODY.PEEK[2])\r\n"));
+    cServer("* 1 FETCH (UID 333 BODY[2] \"" + fakePartData.toBase64() + "\")\r\n" + t.last("OK fetched\r\n"));
+    QVERIFY(part.data(RoleIsFetched).toBool());
+    QCOMPARE(part.data(RolePartDataFileName).toString(), QString());
+    QCOMPARE(part.data(RolePartData).toByteArray(), fakePartData);
+    QCOMPARE(model->cache()->messagePart("b", 333, "2.X-RAW"), fakePartData.toBase64());
+    QVERIFY(cache->diskPartCache.messagePartFileName("b", 333, "2").isNull());
+    io = partDataDevice(part);
+    QVERIFY(io);
+    QVERIFY(qobject_cast<QBuffer*>(io.data()));
+    QCOMPARE(io->readAll(), fakePartData);
+    io.clear();
+
+    // Data which arrive through BINARY end up in a file, too
+    FakeCapabilitiesInjector injector(model);
+    injector.injectCapability("BINARY");
+    fakePartData = "Canary 3";
+    part = rootMultipart.child(2, 0);
+    QCOMPARE(part.data(RolePartDataFileName).toString(), QString());
+    cClient(t.mk("UID FETCH 333 (BINARY.PEEK[3])\r\n"));
+    cServer("* 1 FETCH (UID 333 BINARY[3] \"" + fakePartData + "\")\r\n" + t.last("OK fetched\r\n"));
+    QVERIFY(part.data(RoleIsFetched).toBool());
+    QVERIFY(!part.data(RolePartDataFileName).toString().isEmpty());
+    QVERIFY(model->cache()->messagePart("b", 333, "3").isNull());
+    io = partDataDevice(part);
+    QVERIFY(io);
+    QCOMPARE(io->readAll(), fakePartData);
+    io.clear();
+    cEmpty();
+
+    cache->diskPartCache.clearAllMessages(QLatin1String("b"));
+    QDir(cacheDir).rmdir(QString::fromUtf8(QByteArray("b").toBase64()));
+    QDir().rmdir(cacheDir);
+}
+
 void BodyPartsTest::testFilenameExtraction()
 {
     QFETCH(QByteArray, bodystructure);
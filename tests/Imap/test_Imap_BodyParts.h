@@ -38,6 +38,7 @@ private slots:
     void testInvalidPartFetch_data();
 
     void testFetchingRawParts();
+    void testPartDataInFiles();
 
     void testFilenameExtraction();
     void testFilenameExtraction_data();
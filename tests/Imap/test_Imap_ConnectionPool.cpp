@@ -0,0 +1,121 @@
+/* Copyright (C) 2006 - 2014 Jan Kundrát <jkt@flaska.net>
+
+   This file is part of the Trojita Qt IMAP e-mail client,
+   http://trojita.flaska.net/
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2 of
+   the License or (at your option) version 3 or any later version
+   accepted by the membership of KDE e.V. (or its successor approved
+   by the membership of KDE e.V.), which shall act as a proxy
+   defined in Section 14 of version 3 of the license.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <QtTest>
+#include "test_Imap_ConnectionPool.h"
+#include "Utils/headless_test.h"
+#include "Streams/FakeSocket.h"
+#include "Imap/Model/ItemRoles.h"
+#include "Imap/Model/MailboxTree.h"
+
+using namespace Imap::Mailbox;
+
+namespace
+{
+
+void processEvents()
+{
+    for (int i = 0; i < 5; ++i)
+        QCoreApplication::processEvents();
+}
+
+}
+
+/** @short Each mailbox shall be kept open over its own connection as long as the pool permits that */
+void ImapConnectionPoolTest::testMailboxesGetOwnConnections()
+{
+    model->setConnectionPoolSize(2);
+    Streams::FakeSocket *sock1 = SOCK;
+
+    // The first mailbox reuses the connection which was used for the initial LIST
+    uidValidityA = 666;
+    uidNextA = 3;
+    helperSyncANoMessagesCompleteState();
+    QCOMPARE(SOCK, sock1);
+
+    // Another mailbox gets a brand new connection while the first one remains selected
+    QCOMPARE(model->rowCount(msgListB), 0);
+    model->switchToMailbox(idxB);
+    processEvents();
+    Streams::FakeSocket *sock2 = SOCK;
+    QVERIFY(sock2 != sock1);
+    QCOMPARE(sock1->writtenStuff(), QByteArray());
+    QCOMPARE(sock2->writtenStuff(), QByteArray("y0 SELECT b\r\n"));
+    sock2->fakeReading("* 0 EXISTS\r\n* OK [UIDVALIDITY 333] .\r\n* OK [UIDNEXT 1] .\r\ny0 OK selected\r\n");
+    processEvents();
+    QVERIFY(static_cast<TreeItemMsgList *>(static_cast<TreeItem *>(msgListB.internalPointer()))->fetched());
+    QCOMPARE(sock1->writtenStuff(), QByteArray());
+    QCOMPARE(sock2->writtenStuff(), QByteArray());
+
+    // The pool is full now, so the third mailbox has to steal one of the existing connections
+    QCOMPARE(model->rowCount(msgListC), 0);
+    model->switchToMailbox(idxC);
+    processEvents();
+    QCOMPARE(SOCK, sock2);
+    QByteArray written1 = sock1->writtenStuff();
+    QByteArray written2 = sock2->writtenStuff();
+    const QByteArray selectC = "y1 SELECT c\r\n";
+    QVERIFY((written1 == selectC && written2.isEmpty()) || (written2 == selectC && written1.isEmpty()));
+    QVERIFY(errorSpy->isEmpty());
+}
+
+/** @short Commands which can run anywhere shall not wait for a busy connection when another one can be used */
+void ImapConnectionPoolTest::testStatusOnIdleConnection()
+{
+    model->setConnectionPoolSize(2);
+    Streams::FakeSocket *sock1 = SOCK;
+
+    // Start syncing a mailbox, but don't let it finish just yet
+    QCOMPARE(model->rowCount(msgListA), 0);
+    cClient(t.mk("SELECT a\r\n"));
+
+    // The STATUS goes to a new connection instead of waiting for the first one
+    QCOMPARE(idxB.data(RoleTotalMessageCount), QVariant());
+    processEvents();
+    Streams::FakeSocket *sock2 = SOCK;
+    QVERIFY(sock2 != sock1);
+    QCOMPARE(sock1->writtenStuff(), QByteArray());
+    QCOMPARE(sock2->writtenStuff(), QByteArray("y0 STATUS b (MESSAGES UNSEEN RECENT)\r\n"));
+    sock2->fakeReading("* STATUS b (MESSAGES 3 UNSEEN 1 RECENT 0)\r\ny0 OK status\r\n");
+    processEvents();
+    QCOMPARE(idxB.data(RoleTotalMessageCount).toInt(), 3);
+
+    // The pool is full, so the idle connection is reused now
+    QCOMPARE(idxC.data(RoleTotalMessageCount), QVariant());
+    processEvents();
+    QCOMPARE(SOCK, sock2);
+    QCOMPARE(sock1->writtenStuff(), QByteArray());
+    QCOMPARE(sock2->writtenStuff(), QByteArray("y1 STATUS c (MESSAGES UNSEEN RECENT)\r\n"));
+    sock2->fakeReading("* STATUS c (MESSAGES 5 UNSEEN 0 RECENT 0)\r\ny1 OK status\r\n");
+    processEvents();
+    QCOMPARE(idxC.data(RoleTotalMessageCount).toInt(), 5);
+
+    // Finally, let the first connection finish its sync
+    sock1->fakeReading("* 0 EXISTS\r\n* OK [UIDVALIDITY 666] .\r\n* OK [UIDNEXT 1] .\r\n" + t.last("OK selected\r\n"));
+    processEvents();
+    QVERIFY(static_cast<TreeItemMsgList *>(static_cast<TreeItem *>(msgListA.internalPointer()))->fetched());
+    QCOMPARE(sock1->writtenStuff(), QByteArray());
+    QCOMPARE(sock2->writtenStuff(), QByteArray());
+    QVERIFY(errorSpy->isEmpty());
+}
+
+TROJITA_HEADLESS_TEST(ImapConnectionPoolTest)
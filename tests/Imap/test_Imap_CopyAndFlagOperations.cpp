@@ -167,4 +167,27 @@ void CopyAndFlagTest::testUpdateAllFlags()
     justKeepTask();
 }
 
+/** @short Messages with the same flags share a single list, and the lists nobody uses anymore are forgotten */
+void CopyAndFlagTest::testFlagListsSharing()
+{
+    QStringList a = model->normalizeFlags(QStringList() << QLatin1String("\\SEEN") << QLatin1String("foo"));
+    QStringList b = model->normalizeFlags(QStringList() << QLatin1String("foo") << QLatin1String("\\Seen"));
+    QCOMPARE(a, QStringList() << QLatin1String("\\Seen") << QLatin1String("foo"));
+    QCOMPARE(a, b);
+    // Not just equal, but the very same data
+    QCOMPARE(&a.at(0), &b.at(0));
+    const int initialCount = internedFlagListsCount();
+
+    // Lots of distinct flag combinations which are thrown away immediately
+    for (int j = 0; j < 1000; ++j) {
+        model->normalizeFlags(QStringList() << QString::fromUtf8("flag%1").arg(j));
+    }
+    QVERIFY(internedFlagListsCount() < initialCount + 100);
+
+    // The list which is still in use has survived the pruning
+    QStringList c = model->normalizeFlags(QStringList() << QLatin1String("\\Seen") << QLatin1String("foo"));
+    QCOMPARE(&a.at(0), &c.at(0));
+    cEmpty();
+}
+
 TROJITA_HEADLESS_TEST(CopyAndFlagTest)
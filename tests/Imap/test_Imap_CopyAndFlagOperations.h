@@ -40,6 +40,8 @@ private slots:
     void testMoveRfcMove();
 
     void testUpdateAllFlags();
+
+    void testFlagListsSharing();
 };
 
 #endif
@@ -422,6 +422,45 @@ void ImapLowLevelParserTest::testGetAnything()
     QCOMPARE(pos, 3);
 }
 
+void ImapLowLevelParserTest::testGetSequenceSet()
+{
+    using namespace Imap::LowLevelParser;
+
+    QByteArray line = "1:3,5,7:10 x\r\n";
+    int pos = 0;
+    Imap::Sequence seq = getSequenceSet(line, pos);
+    QCOMPARE(seq.toByteArray(), QByteArray("1:3,5,7:10"));
+    QCOMPARE(pos, 10);
+
+    line = "300,1:4000000000,17\r\n";
+    pos = 0;
+    seq = getSequenceSet(line, pos);
+    QCOMPARE(seq.toByteArray(), QByteArray("1:4000000000"));
+    QCOMPARE(seq.ranges().size(), 1);
+    QCOMPARE(pos, line.size() - 2);
+
+    line = "8\r\n";
+    pos = 0;
+    seq = getSequenceSet(line, pos);
+    QCOMPARE(seq, Imap::Sequence(8));
+
+    try {
+        line = "1:2:3\r\n";
+        pos = 0;
+        getSequenceSet(line, pos);
+        QFAIL("exception not raised");
+    } catch (Imap::ParseError &) {
+    }
+
+    try {
+        line = "5:3\r\n";
+        pos = 0;
+        getSequenceSet(line, pos);
+        QFAIL("exception not raised");
+    } catch (Imap::ParseError &) {
+    }
+}
+
 void ImapLowLevelParserTest::testGetRFC2822DateTime()
 {
     QFETCH( QString, line );
@@ -43,6 +43,8 @@ private Q_SLOTS:
     void testGetAtom();
     /** @short test Imap::LowLevelParser::getAnything() */
     void testGetAnything();
+    /** @short test Imap::LowLevelParser::getSequenceSet() */
+    void testGetSequenceSet();
     /** @short Test Imap::LowLevelParser::getRFC2822DateTime() */
     void testGetRFC2822DateTime();
     void testGetRFC2822DateTime_data();
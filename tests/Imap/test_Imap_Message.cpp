@@ -20,11 +20,13 @@
    along with this program.  If not, see <http://www.gnu.org/licenses/>.
 */
 
+#include <QDataStream>
 #include <QTest>
 
 #include "test_Imap_Message.h"
 #include "Utils/headless_test.h"
 #include "Imap/Encoders.h"
+#include "Imap/Parser/LowLevelParser.h"
 
 Q_DECLARE_METATYPE(Imap::Message::MailAddress)
 Q_DECLARE_METATYPE(QVariantList)
@@ -291,6 +293,133 @@ void ImapMessageTest::testMessage_data()
 {
 }
 
+namespace
+{
+
+QSharedPointer<Imap::Message::AbstractMessage> parseBodyStructure(const QByteArray &data)
+{
+    int start = 0;
+    QVariantList list = Imap::LowLevelParser::parseList('(', ')', data, start);
+    return Imap::Message::AbstractMessage::fromList(list, data, 0);
+}
+
+QByteArray legacyCacheData(const QByteArray &data)
+{
+    int start = 0;
+    QVariantList list = Imap::LowLevelParser::parseList('(', ')', data, start);
+    QByteArray buf;
+    QDataStream stream(&buf, QIODevice::WriteOnly);
+    stream.setVersion(QDataStream::Qt_4_6);
+    stream << list;
+    return buf;
+}
+
+}
+
+void ImapMessageTest::testBodyStructureCacheData()
+{
+    using namespace Imap::Message;
+    QFETCH(QByteArray, bodyStructure);
+
+    QSharedPointer<AbstractMessage> msg = parseBodyStructure(bodyStructure);
+    QByteArray cached = msg->toCacheData();
+
+    bool legacy = true;
+    QSharedPointer<AbstractMessage> restored = AbstractMessage::fromCacheData(cached, &legacy);
+    QVERIFY(!legacy);
+    QVERIFY(restored);
+    QVERIFY(*restored == *msg);
+    // A null disposition means "no Content-Disposition at all" and it has to stay that way
+    QCOMPARE(restored->bodyFldDsp.first.isNull(), msg->bodyFldDsp.first.isNull());
+    QCOMPARE(restored->toCacheData(), cached);
+
+    // The old format shall be still supported
+    restored = AbstractMessage::fromCacheData(legacyCacheData(bodyStructure), &legacy);
+    QVERIFY(legacy);
+    QVERIFY(restored);
+    QVERIFY(*restored == *msg);
+
+    // Truncated data shall not crash
+    for (int i = 2; i < cached.size(); ++i) {
+        try {
+            AbstractMessage::fromCacheData(cached.left(i));
+            QFAIL("Truncated data were accepted");
+        } catch (const Imap::ParserException &) {
+            // that's expected
+        }
+    }
+}
+
+void ImapMessageTest::testBodyStructureCacheData_data()
+{
+    QTest::addColumn<QByteArray>("bodyStructure");
+
+    QTest::newRow("text-plain")
+            << QByteArray("(\"text\" \"plain\" (\"chaRset\" \"UTF-8\" \"format\" \"flowed\") NIL NIL \"8bit\" 362 15 NIL NIL NIL)");
+
+    QTest::newRow("basic-no-extension")
+            << QByteArray("(\"application\" \"octet-stream\" NIL NIL NIL \"base64\" 1234)");
+
+    QTest::newRow("signed")
+            << QByteArray("((\"text\" \"plain\" (\"charset\" \"US-ASCII\" \"delsp\" \"yes\" \"format\" \"flowed\") "
+                          "NIL NIL \"7bit\" 990 27 NIL NIL NIL)(\"application\" \"pgp-signature\" "
+                          "(\"x-mac-type\" \"70674453\" \"name\" \"PGP.sig\") NIL \"This is a digitally signed message part\" "
+                          "\"7bit\" 193 NIL (\"inline\" (\"filename\" \"PGP.sig\")) NIL) \"signed\" (\"protocol\" "
+                          "\"application/pgp-signature\" \"micalg\" \"pgp-sha1\" \"boundary\" \"Apple-Mail-10--856231115\") NIL NIL))");
+
+    QTest::newRow("message-rfc822")
+            << QByteArray("((\"text\" \"plain\" (\"charset\" \"utf-8\") NIL NIL \"7bit\" 12 1 NIL NIL NIL)"
+                          "(\"message\" \"rfc822\" (\"name\" \"fwd.eml\") NIL NIL \"7bit\" 1024 "
+                          "(\"Thu, 3 Nov 2005 14:19:49 EST\" \"=?utf-8?q?P=C5=99=C3=ADloha?=\" ((NIL NIL \"a\" \"example.org\")) "
+                          "NIL NIL ((\"Some Body\" NIL \"b\" \"example.org\")(NIL NIL \"c\" \"example.org\")) NIL NIL "
+                          "\"<parent@example.org>\" \"<child@example.org>\") "
+                          "(\"text\" \"plain\" (\"charset\" \"us-ascii\") NIL NIL \"7bit\" 500 10 NIL NIL NIL) 20 "
+                          "NIL (\"attachment\" (\"filename\" \"fwd.eml\")) NIL NIL) \"mixed\" "
+                          "(\"boundary\" \"xyz\") NIL NIL NIL)");
+
+    QTest::newRow("message-rfc822-nil-envelope")
+            << QByteArray("(\"message\" \"rfc822\" NIL NIL NIL \"7bit\" 1024 NIL "
+                          "(\"text\" \"plain\" NIL NIL NIL \"7bit\" 500 10) 20)");
+
+    QTest::newRow("extension-data")
+            << QByteArray("((\"text\" \"plain\" NIL \"<id@example.org>\" \"desc\" \"7bit\" 1 1 \"md5sum\" "
+                          "(\"inline\" NIL) (\"en\" \"cs\") \"http://example.org/\" \"ext1\" (\"ext2\" 3 (NIL)))"
+                          "(\"image\" \"png\" () NIL NIL \"base64\" 1000 NIL NIL \"en\" NIL 666) "
+                          "\"mixed\" (\"boundary\" \"abc\") (\"inline\" NIL) \"en\" NIL foo (bar baz))");
+
+    QTest::newRow("empty-strings")
+            << QByteArray("(\"text\" \"plain\" (\"charset\" \"\") \"\" \"\" \"\" 0 0 \"\" (\"\" NIL) \"\" \"\")");
+}
+
+/** @short Measure how long it takes to restore the MIME tree of a message from the cache */
+void ImapMessageTest::benchmarkBodyStructureCacheData()
+{
+    QFETCH(bool, legacy);
+
+    const QByteArray bodyStructure = "(((\"text\" \"plain\" (\"charset\" \"US-ASCII\" \"delsp\" \"yes\" \"format\" \"flowed\") "
+            "NIL NIL \"7bit\" 990 27 NIL NIL NIL)(\"text\" \"html\" (\"charset\" \"US-ASCII\") NIL NIL "
+            "\"quoted-printable\" 4860 100 NIL NIL NIL) \"alternative\" (\"boundary\" \"-----1131387468\") NIL NIL)"
+            "(\"application\" \"pgp-signature\" (\"name\" \"PGP.sig\") NIL "
+            "\"This is a digitally signed message part\" \"7bit\" 193 NIL (\"inline\" (\"filename\" \"PGP.sig\")) NIL) "
+            "(\"image\" \"png\" (\"name\" \"screenshot.png\") NIL NIL \"base64\" 123456 NIL "
+            "(\"attachment\" (\"filename\" \"screenshot.png\")) NIL NIL) "
+            "\"mixed\" (\"boundary\" \"Apple-Mail-10--856231115\") NIL NIL NIL)";
+    const QByteArray cached = legacy ? legacyCacheData(bodyStructure) : parseBodyStructure(bodyStructure)->toCacheData();
+
+    QBENCHMARK {
+        for (int i = 0; i < 1000; ++i) {
+            Imap::Message::AbstractMessage::fromCacheData(cached);
+        }
+    }
+}
+
+void ImapMessageTest::benchmarkBodyStructureCacheData_data()
+{
+    QTest::addColumn<bool>("legacy");
+    QTest::newRow("QVariantList") << true;
+    QTest::newRow("compact") << false;
+}
+
 
 TROJITA_HEADLESS_TEST( ImapMessageTest )
 
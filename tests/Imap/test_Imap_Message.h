@@ -47,6 +47,12 @@ private Q_SLOTS:
     void testMessage();
     void testMessage_data();
 
+    /** @short Check that the BODYSTRUCTURE survives a trip through the cache format */
+    void testBodyStructureCacheData();
+    void testBodyStructureCacheData_data();
+    void benchmarkBodyStructureCacheData();
+    void benchmarkBodyStructureCacheData_data();
+
     /** @short Test cases for operator==() */
 };
 
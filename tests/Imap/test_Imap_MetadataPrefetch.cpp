@@ -0,0 +1,109 @@
+/* Copyright (C) 2006 - 2014 Jan Kundrát <jkt@flaska.net>
+
+   This file is part of the Trojita Qt IMAP e-mail client,
+   http://trojita.flaska.net/
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2 of
+   the License or (at your option) version 3 or any later version
+   accepted by the membership of KDE e.V. (or its successor approved
+   by the membership of KDE e.V.), which shall act as a proxy
+   defined in Section 14 of version 3 of the license.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <QtTest>
+#include "test_Imap_MetadataPrefetch.h"
+#include "Utils/headless_test.h"
+#include "Streams/FakeSocket.h"
+#include "Imap/Model/ItemRoles.h"
+#include "Imap/Model/TaskPresentationModel.h"
+
+using namespace Imap::Mailbox;
+
+void ImapMetadataPrefetchTest::respondWithEnvelopes(const QList<uint> &uids)
+{
+    QByteArray response;
+    Q_FOREACH(const uint uid, uids) {
+        // there were no expunges, so the sequence numbers match the UIDs
+        response += helperCreateTrivialEnvelope(uid, uid, QString::fromUtf8("subject %1").arg(uid));
+    }
+    cServer(response + t.last("OK fetched\r\n"));
+}
+
+/** @short Requests for messages which somebody is looking at shall overtake the preloading */
+void ImapMetadataPrefetchTest::testVisibleMessagesFirst()
+{
+    model->setProperty("trojita-imap-preload-msg-metadata", 3);
+    model->setProperty("trojita-imap-limit-fetch-messages-per-group", 4);
+    model->setProperty("trojita-imap-limit-parallel-fetch-tasks", 1);
+    initialMessages(100);
+
+    // UID 11 is requested directly, the rest is the preload which fills up the batch
+    QCOMPARE(msgListA.child(10, 0).data(RoleMessageSubject).toString(), QString());
+    cClient(t.mk("UID FETCH 8:11 (" FETCH_METADATA_ITEMS ")\r\n"));
+
+    // Nothing else is sent while the first batch is in flight
+    QCOMPARE(msgListA.child(50, 0).data(RoleMessageSubject).toString(), QString());
+    cEmpty();
+
+    // UID 51 is more important than the preloading of UIDs 48-53 and even of the older 12 and 13
+    respondWithEnvelopes(QList<uint>() << 8 << 9 << 10 << 11);
+    cClient(t.mk("UID FETCH 12:13,48,51 (" FETCH_METADATA_ITEMS ")\r\n"));
+    QCOMPARE(msgListA.child(10, 0).data(RoleMessageSubject).toString(), QString::fromUtf8("subject 11"));
+    respondWithEnvelopes(QList<uint>() << 12 << 13 << 48 << 51);
+    cClient(t.mk("UID FETCH 49:50,52:53 (" FETCH_METADATA_ITEMS ")\r\n"));
+    QCOMPARE(msgListA.child(50, 0).data(RoleMessageSubject).toString(), QString::fromUtf8("subject 51"));
+    respondWithEnvelopes(QList<uint>() << 49 << 50 << 52 << 53);
+    cEmpty();
+    justKeepTask();
+    QVERIFY(errorSpy->isEmpty());
+}
+
+/** @short When the view jumps elsewhere, the preloading requests which were not sent yet shall be dropped */
+void ImapMetadataPrefetchTest::testWithdrawAfterJump()
+{
+    model->setProperty("trojita-imap-preload-msg-metadata", 3);
+    model->setProperty("trojita-imap-limit-fetch-messages-per-group", 4);
+    model->setProperty("trojita-imap-limit-parallel-fetch-tasks", 1);
+    initialMessages(100);
+
+    // The view shows the first ten messages, which means that UIDs 1-13 are requested
+    model->setMessageListViewport(msgListA.child(0, 0), msgListA.child(9, 0));
+    cClient(t.mk("UID FETCH 1:4 (" FETCH_METADATA_ITEMS ")\r\n"));
+
+    // Now jump to the other end of the list; UIDs 5-13 are not interesting anymore
+    model->setMessageListViewport(msgListA.child(80, 0), msgListA.child(89, 0));
+    cEmpty();
+    QModelIndex parserIndex = model->taskModel()->index(0, 0);
+    QVERIFY(parserIndex.data(RoleTaskIsParserState).toBool());
+    QCOMPARE(parserIndex.data(RoleTaskWithdrawnEnvelopeRequests).toUInt(), 9u);
+    QVERIFY(!msgListA.child(4, 0).data(RoleIsFetched).toBool());
+
+    // The messages around the new position are fetched next
+    respondWithEnvelopes(QList<uint>() << 1 << 2 << 3 << 4);
+    cClient(t.mk("UID FETCH 78:81 (" FETCH_METADATA_ITEMS ")\r\n"));
+    respondWithEnvelopes(QList<uint>() << 78 << 79 << 80 << 81);
+    cClient(t.mk("UID FETCH 82:85 (" FETCH_METADATA_ITEMS ")\r\n"));
+    respondWithEnvelopes(QList<uint>() << 82 << 83 << 84 << 85);
+    cClient(t.mk("UID FETCH 86:89 (" FETCH_METADATA_ITEMS ")\r\n"));
+    respondWithEnvelopes(QList<uint>() << 86 << 87 << 88 << 89);
+    cClient(t.mk("UID FETCH 90:93 (" FETCH_METADATA_ITEMS ")\r\n"));
+    respondWithEnvelopes(QList<uint>() << 90 << 91 << 92 << 93);
+    cEmpty();
+
+    // A withdrawn message can still be requested again
+    QCOMPARE(msgListA.child(4, 0).data(RoleMessageSubject).toString(), QString());
+    cClient(t.mk("UID FETCH 5:7 (" FETCH_METADATA_ITEMS ")\r\n"));
+    QVERIFY(errorSpy->isEmpty());
+}
+
+TROJITA_HEADLESS_TEST(ImapMetadataPrefetchTest)
@@ -0,0 +1,223 @@
+/* Copyright (C) 2006 - 2014 Jan Kundrát <jkt@flaska.net>
+
+   This file is part of the Trojita Qt IMAP e-mail client,
+   http://trojita.flaska.net/
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2 of
+   the License or (at your option) version 3 or any later version
+   accepted by the membership of KDE e.V. (or its successor approved
+   by the membership of KDE e.V.), which shall act as a proxy
+   defined in Section 14 of version 3 of the license.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <QtTest>
+#include "test_Imap_OfflineSync.h"
+#include "Utils/headless_test.h"
+#include "Streams/FakeSocket.h"
+#include "Imap/Model/ItemRoles.h"
+#include "Imap/Model/OfflineSyncScheduler.h"
+
+using namespace Imap::Mailbox;
+
+namespace
+{
+
+void processEvents()
+{
+    for (int i = 0; i < 5; ++i)
+        QCoreApplication::processEvents();
+}
+
+/** @short Find the timer which drives the scheduler */
+QTimer *schedulerTimer(OfflineSyncScheduler *scheduler)
+{
+    Q_FOREACH(QTimer *timer, scheduler->findChildren<QTimer *>()) {
+        if (timer->parent() == scheduler)
+            return timer;
+    }
+    return 0;
+}
+
+/** @short Perform one step of the scheduler without waiting for its timer */
+void tick(OfflineSyncScheduler *scheduler)
+{
+    QMetaObject::invokeMethod(scheduler, "processNextMessage");
+    processEvents();
+}
+
+}
+
+/** @short The metadata and the main part of each message shall be requested and stored in the cache */
+void ImapOfflineSyncTest::testMailboxGetsMirrored()
+{
+    initialMessages(2);
+    model->setProperty("trojita-imap-preload-msg-metadata", 0);
+
+    OfflineSyncScheduler scheduler(0, model);
+    scheduler.setMailboxes(QStringList() << QLatin1String("a"));
+    QSignalSpy syncedSpy(&scheduler, SIGNAL(mailboxSynced(QString)));
+    QSignalSpy finishedSpy(&scheduler, SIGNAL(finished()));
+    scheduler.start();
+    QVERIFY(scheduler.isActive());
+    // let the MailboxFinder do its job
+    processEvents();
+
+    for (uint uid = 1; uid <= 2; ++uid) {
+        tick(&scheduler);
+        cClient(t.mk(QString::fromUtf8("UID FETCH %1 (" FETCH_METADATA_ITEMS ")\r\n").arg(QString::number(uid)).toUtf8()));
+        cServer(helperCreateTrivialEnvelope(uid, uid, QLatin1String("subject")) + t.last("OK fetched\r\n"));
+        tick(&scheduler);
+        cClient(t.mk(QString::fromUtf8("UID FETCH %1 (BODY.PEEK[1])\r\n").arg(QString::number(uid)).toUtf8()));
+        cServer(QString::fromUtf8("* %1 FETCH (UID %1 BODY[1] \"body %1\")\r\n").arg(QString::number(uid)).toUtf8()
+                + t.last("OK fetched\r\n"));
+        QCOMPARE(model->cache()->messagePart(QLatin1String("a"), uid, "1"), QString::fromUtf8("body %1").arg(uid).toUtf8());
+    }
+    QCOMPARE(scheduler.bytesRequested(), Q_INT64_C(38));
+    QVERIFY(finishedSpy.isEmpty());
+
+    tick(&scheduler);
+    QCOMPARE(syncedSpy.size(), 1);
+    QCOMPARE(syncedSpy[0][0].toString(), QString::fromUtf8("a"));
+    QCOMPARE(finishedSpy.size(), 1);
+    QVERIFY(!scheduler.isActive());
+    cEmpty();
+    QVERIFY(errorSpy->isEmpty());
+}
+
+/** @short Message bodies shall not be requested once the byte budget is spent */
+void ImapOfflineSyncTest::testByteBudget()
+{
+    initialMessages(2);
+    model->setProperty("trojita-imap-preload-msg-metadata", 0);
+
+    OfflineSyncScheduler scheduler(0, model);
+    scheduler.setMailboxes(QStringList() << QLatin1String("a"));
+    scheduler.setByteBudget(30);
+    QSignalSpy syncedSpy(&scheduler, SIGNAL(mailboxSynced(QString)));
+    QSignalSpy finishedSpy(&scheduler, SIGNAL(finished()));
+    scheduler.start();
+    processEvents();
+
+    tick(&scheduler);
+    cClient(t.mk("UID FETCH 1 (" FETCH_METADATA_ITEMS ")\r\n"));
+    cServer(helperCreateTrivialEnvelope(1, 1, QLatin1String("subject")) + t.last("OK fetched\r\n"));
+    tick(&scheduler);
+    cClient(t.mk("UID FETCH 1 (BODY.PEEK[1])\r\n"));
+    cServer("* 1 FETCH (UID 1 BODY[1] \"body 1\")\r\n" + t.last("OK fetched\r\n"));
+    QCOMPARE(scheduler.bytesRequested(), Q_INT64_C(19));
+
+    // The metadata are still fetched, but the second body would not fit into the budget
+    tick(&scheduler);
+    cClient(t.mk("UID FETCH 2 (" FETCH_METADATA_ITEMS ")\r\n"));
+    cServer(helperCreateTrivialEnvelope(2, 2, QLatin1String("subject")) + t.last("OK fetched\r\n"));
+    tick(&scheduler);
+    cEmpty();
+    QCOMPARE(scheduler.bytesRequested(), Q_INT64_C(19));
+    QVERIFY(syncedSpy.isEmpty());
+    QCOMPARE(finishedSpy.size(), 1);
+    QVERIFY(!scheduler.isActive());
+    QVERIFY(model->cache()->messagePart(QLatin1String("a"), 2, "1").isNull());
+    QVERIFY(errorSpy->isEmpty());
+}
+
+/** @short The pace shall go down on an expensive network, and nothing shall happen while offline */
+void ImapOfflineSyncTest::testNetworkPolicy()
+{
+    initialMessages(2);
+    model->setProperty("trojita-imap-preload-msg-metadata", 0);
+
+    OfflineSyncScheduler scheduler(0, model);
+    scheduler.setMailboxes(QStringList() << QLatin1String("a"));
+    scheduler.setRateLimit(5);
+    QTimer *timer = schedulerTimer(&scheduler);
+    QVERIFY(timer);
+    QVERIFY(!timer->isActive());
+    scheduler.start();
+    processEvents();
+    QVERIFY(timer->isActive());
+    QCOMPARE(timer->interval(), 200);
+
+    // A metered network slows things down, but the work continues
+    LibMailboxSync::setModelNetworkPolicy(model, NETWORK_EXPENSIVE);
+    QVERIFY(timer->isActive());
+    QCOMPARE(timer->interval(), 2000);
+    tick(&scheduler);
+    cClient(t.mk("UID FETCH 1 (" FETCH_METADATA_ITEMS ")\r\n"));
+    cServer(helperCreateTrivialEnvelope(1, 1, QLatin1String("subject")) + t.last("OK fetched\r\n"));
+
+    // Going offline pauses the whole process
+    LibMailboxSync::setModelNetworkPolicy(model, NETWORK_OFFLINE);
+    cClient(t.mk("LOGOUT\r\n"));
+    QVERIFY(!timer->isActive());
+    tick(&scheduler);
+    tick(&scheduler);
+    cEmpty();
+    QVERIFY(scheduler.isActive());
+    QCOMPARE(scheduler.bytesRequested(), Q_INT64_C(0));
+
+    // ...and it resumes at the full pace once the network is back
+    LibMailboxSync::setModelNetworkPolicy(model, NETWORK_ONLINE);
+    QVERIFY(timer->isActive());
+    QCOMPARE(timer->interval(), 200);
+    QVERIFY(scheduler.isActive());
+    scheduler.stop();
+    QVERIFY(!timer->isActive());
+}
+
+/** @short The mirroring shall use a connection of its own and release it once done */
+void ImapOfflineSyncTest::testDedicatedConnection()
+{
+    model->setConnectionPoolSize(2);
+    Streams::FakeSocket *sock1 = SOCK;
+
+    // The GUI has a mailbox open
+    uidValidityA = 666;
+    uidNextA = 3;
+    helperSyncANoMessagesCompleteState();
+    QCOMPARE(SOCK, sock1);
+
+    OfflineSyncScheduler scheduler(0, model);
+    scheduler.setMailboxes(QStringList() << QLatin1String("b"));
+    QSignalSpy syncedSpy(&scheduler, SIGNAL(mailboxSynced(QString)));
+    QSignalSpy finishedSpy(&scheduler, SIGNAL(finished()));
+    scheduler.start();
+    processEvents();
+
+    // The mirrored mailbox gets a new connection, the GUI one is left alone
+    Streams::FakeSocket *sock2 = SOCK;
+    QVERIFY(sock2 != sock1);
+    QCOMPARE(sock1->writtenStuff(), QByteArray());
+    QCOMPARE(sock2->writtenStuff(), QByteArray("y0 SELECT b\r\n"));
+    sock2->fakeReading("* 0 EXISTS\r\n* OK [UIDVALIDITY 333] .\r\n* OK [UIDNEXT 1] .\r\ny0 OK selected\r\n");
+    processEvents();
+
+    // The pool is full, and the GUI's next mailbox must not take the reserved connection
+    QCOMPARE(model->rowCount(msgListC), 0);
+    model->switchToMailbox(idxC);
+    processEvents();
+    QCOMPARE(sock1->writtenStuff(), QByteArray("y1 SELECT c\r\n"));
+    QCOMPARE(sock2->writtenStuff(), QByteArray());
+    sock1->fakeReading("* 0 EXISTS\r\n* OK [UIDVALIDITY 444] .\r\n* OK [UIDNEXT 1] .\r\ny1 OK selected\r\n");
+    processEvents();
+
+    // The empty mailbox is done right away, and the background connection gets logged out
+    tick(&scheduler);
+    QCOMPARE(syncedSpy.size(), 1);
+    QCOMPARE(finishedSpy.size(), 1);
+    QVERIFY(!scheduler.isActive());
+    QCOMPARE(sock1->writtenStuff(), QByteArray());
+    QCOMPARE(sock2->writtenStuff(), QByteArray("y1 LOGOUT\r\n"));
+    QVERIFY(errorSpy->isEmpty());
+}
+
+TROJITA_HEADLESS_TEST(ImapOfflineSyncTest)
@@ -23,6 +23,8 @@
 #include <QBuffer>
 #include <QFile>
 #include <QTest>
+#include <QTime>
+#include "Imap/Parser/LowLevelParser.h"
 #include "Imap/Parser/Message.h"
 #include "Streams/FakeSocket.h"
 
@@ -889,15 +891,15 @@ void ImapParserParseTest::testParseUntagged_data()
 
     QTest::newRow("vanished-one")
             << QByteArray("* VANIShED 1\r\n")
-            << QSharedPointer<AbstractResponse>(new Vanished(Vanished::NOT_EARLIER, QList<uint>() << 1));
+            << QSharedPointer<AbstractResponse>(new Vanished(Vanished::NOT_EARLIER, Sequence(1)));
 
     QTest::newRow("vanished-earlier-one")
             << QByteArray("* VANIShED (EARlIER) 1\r\n")
-            << QSharedPointer<AbstractResponse>(new Vanished(Vanished::EARLIER, QList<uint>() << 1));
+            << QSharedPointer<AbstractResponse>(new Vanished(Vanished::EARLIER, Sequence(1)));
 
     QTest::newRow("vanished-earlier-set")
             << QByteArray("* VANISHED (EARLIER) 300:303,405,411\r\n")
-            << QSharedPointer<AbstractResponse>(new Vanished(Vanished::EARLIER, QList<uint>() << 300 << 301 << 302 << 303 << 405 << 411));
+            << QSharedPointer<AbstractResponse>(new Vanished(Vanished::EARLIER, Sequence(300, 303).add(405).add(411)));
 
     QTest::newRow("genurlauth-1")
             << QByteArray("* GENURLAUTH \"imap://joe@example.com/INBOX/;uid=20/;section=1.2;urlauth=submit+fred:internal:91354a473744909de610943775f92038\"\r\n")
@@ -1070,6 +1072,114 @@ void ImapParserParseTest::benchmarkInitialChat()
     }
 }
 
+/** @short Feed a synthetic stream of FETCH responses for 100k messages and measure how long the main thread gets blocked */
+void ImapParserParseTest::benchmarkFetchStream()
+{
+    QFETCH(bool, threaded);
+
+    const int numMessages = 100000;
+    const int chunkSize = 1000;
+    const QByteArray fetchData = " FLAGS (\\Seen $Forwarded) RFC822.SIZE 1234 ENVELOPE (\"Thu, 10 Feb 2011 12:34:56 +0100\" "
+            "\"IMAP4rev1 WG mtg summary and minutes\" ((\"Terry Gray\" NIL \"gray\" \"cac.washington.edu\")) "
+            "((\"Terry Gray\" NIL \"gray\" \"cac.washington.edu\")) ((\"Terry Gray\" NIL \"gray\" \"cac.washington.edu\")) "
+            "((NIL NIL \"imap\" \"cac.washington.edu\")) NIL NIL NIL \"<B27397-0100000@cac.washington.edu>\") "
+            "BODYSTRUCTURE ((\"text\" \"plain\" (\"charset\" \"US-ASCII\" \"delsp\" \"yes\" \"format\" \"flowed\") "
+            "NIL NIL \"7bit\" 990 27 NIL NIL NIL)(\"application\" \"pgp-signature\" (\"name\" \"PGP.sig\") NIL "
+            "\"This is a digitally signed message part\" \"7bit\" 193 NIL (\"inline\" (\"filename\" \"PGP.sig\")) NIL) "
+            "\"signed\" (\"protocol\" \"application/pgp-signature\" \"micalg\" \"pgp-sha1\" \"boundary\" "
+            "\"Apple-Mail-10--856231115\") NIL NIL))\r\n";
+
+    int longestStall = 0;
+
+    QBENCHMARK_ONCE {
+        Streams::FakeSocket *socket = new Streams::FakeSocket(Imap::CONN_STATE_AUTHENTICATED);
+        Imap::Parser *streamParser = new Imap::Parser(0, socket, 667);
+        if (threaded)
+            streamParser->enableParsingInThread();
+
+        int sent = 0;
+        int received = 0;
+        while (received < numMessages) {
+            if (sent < numMessages) {
+                QByteArray chunk;
+                for (int i = 0; i < chunkSize; ++i) {
+                    ++sent;
+                    chunk += "* " + QByteArray::number(sent) + " FETCH (UID " + QByteArray::number(sent) + fetchData;
+                }
+                socket->fakeReading(chunk);
+            }
+
+            // This is the time during which the GUI would not be able to react to user's input
+            QTime stall;
+            stall.start();
+            QCoreApplication::processEvents();
+            longestStall = qMax(longestStall, stall.elapsed());
+
+            while (streamParser->hasResponse()) {
+                QSharedPointer<Imap::Responses::AbstractResponse> resp = streamParser->getResponse();
+                QVERIFY(resp.dynamicCast<Imap::Responses::Fetch>());
+                ++received;
+            }
+        }
+
+        delete streamParser;
+        QCoreApplication::sendPostedEvents(0, QEvent::DeferredDelete);
+    }
+
+    qDebug() << "Longest main thread stall:" << longestStall << "ms";
+}
+
+void ImapParserParseTest::benchmarkFetchStream_data()
+{
+    QTest::addColumn<bool>("threaded");
+    QTest::newRow("main-thread") << false;
+    QTest::newRow("parser-thread") << true;
+}
+
+/** @short Measure the throughput of receiving a huge literal which arrives in small chunks */
+void ImapParserParseTest::benchmarkLiteral()
+{
+    QFETCH(int, size);
+
+    // Roughly what a TCP socket would deliver in one go
+    const int chunkSize = 16 * 1024;
+    const QByteArray chunk(chunkSize, 'x');
+    const QByteArray prefix = "* 1 FETCH (UID 1 BODY[] {" + QByteArray::number(size) + "}\r\n";
+
+    QBENCHMARK {
+        Streams::FakeSocket *socket = new Streams::FakeSocket(Imap::CONN_STATE_AUTHENTICATED);
+        Imap::Parser *literalParser = new Imap::Parser(0, socket, 668);
+        QCoreApplication::processEvents();
+
+        socket->fakeReading(prefix);
+        QCoreApplication::processEvents();
+        int remaining = size;
+        while (remaining > 0) {
+            socket->fakeReading(remaining >= chunkSize ? chunk : chunk.left(remaining));
+            remaining -= chunkSize;
+            QCoreApplication::processEvents();
+        }
+        socket->fakeReading(")\r\n");
+        QCoreApplication::processEvents();
+
+        QVERIFY(literalParser->hasResponse());
+        QSharedPointer<Imap::Responses::Fetch> fetch = literalParser->getResponse().dynamicCast<Imap::Responses::Fetch>();
+        QVERIFY(fetch);
+        QCOMPARE(static_cast<const Imap::Responses::RespData<QByteArray>&>(*(fetch->data["BODY[]"])).data.size(), size);
+
+        delete literalParser;
+        QCoreApplication::sendPostedEvents(0, QEvent::DeferredDelete);
+    }
+}
+
+void ImapParserParseTest::benchmarkLiteral_data()
+{
+    QTest::addColumn<int>("size");
+    QTest::newRow("1MB") << 1024 * 1024;
+    QTest::newRow("10MB") << 10 * 1024 * 1024;
+    QTest::newRow("50MB") << 50 * 1024 * 1024;
+}
+
 void ImapParserParseTest::testSequences()
 {
     QFETCH( Imap::Sequence, sequence );
@@ -1123,6 +1233,34 @@ void ImapParserParseTest::testSequences_data()
     QTest::newRow("sequence-from-list-1") <<
             Imap::Sequence::fromList( QList<uint>() << 2 << 3 << 4 << 6 << 7 << 1 << 100 << 101 << 102 << 99 << 666 << 333 << 666) <<
             QByteArray("1:4,6:7,99:102,333,666");
+
+    QTest::newRow("sequence-range-bridging") <<
+            Imap::Sequence( 1, 3 ).add( 7, 9 ).add( 20 ).add( 4, 6 ) << QByteArray("1:9,20");
+
+    QTest::newRow("sequence-range-overlapping") <<
+            Imap::Sequence( 10, 20 ).add( 30, 40 ).add( 15, 35 ).add( 5 ) << QByteArray("5,10:40");
+}
+
+/** @short Test the membership queries on sequences */
+void ImapParserParseTest::testSequenceQueries()
+{
+    Imap::Sequence seq(100, 200);
+    seq.add(300).add(1000, 1999);
+    QCOMPARE(seq.count(), 101u + 1u + 1000u);
+    QCOMPARE(seq.ranges().size(), 3);
+    QVERIFY(!seq.contains(99));
+    QVERIFY(seq.contains(100));
+    QVERIFY(seq.contains(200));
+    QVERIFY(!seq.contains(201));
+    QVERIFY(seq.contains(300));
+    QVERIFY(seq.contains(1500));
+    QVERIFY(!seq.contains(2000));
+
+    QList<uint> list = Imap::Sequence(5, 7).add(9).toList();
+    QCOMPARE(list, QList<uint>() << 5 << 6 << 7 << 9);
+
+    QVERIFY(Imap::Sequence::startingAt(5).isUnlimited());
+    QVERIFY(Imap::Sequence::startingAt(5).contains(4000000000u));
 }
 
 /** @short Test responses which fail to parse */
@@ -1165,6 +1303,290 @@ void ImapParserParseTest::testThrow_data()
             << QByteArray("* THREAD (ahoj)\r\n") << QString("UnexpectedHere") << QString("THREAD response: cannot parse \"ahoj\" as an unsigned integer");
 }
 
+/** @short Compare the direct BODYSTRUCTURE/ENVELOPE parsers with parseList() followed by fromList() */
+void ImapParserParseTest::testDirectBodyStructure()
+{
+    QFETCH(QByteArray, data);
+    QFETCH(bool, isEnvelope);
+    QFETCH(bool, direct);
+
+    int start = 0;
+    QVariantList list = Imap::LowLevelParser::parseList('(', ')', data, start);
+    const int end = start;
+
+    if (isEnvelope) {
+        Imap::Message::Envelope expected = Imap::Message::Envelope::fromList(list, data, 0);
+        start = 0;
+        try {
+            Imap::Message::Envelope envelope = Imap::Message::Envelope::fromLine(data, start);
+            QVERIFY2(direct, "the direct parser was expected to give up");
+            QVERIFY(envelope == expected);
+            QCOMPARE(start, end);
+        } catch (const Imap::ParserException &) {
+            QVERIFY2(!direct, "the direct parser was expected to handle this");
+        }
+        return;
+    }
+
+    QSharedPointer<Imap::Message::AbstractMessage> expected = Imap::Message::AbstractMessage::fromList(list, data, 0);
+
+    start = 0;
+    try {
+        QSharedPointer<Imap::Message::AbstractMessage> msg = Imap::Message::AbstractMessage::fromLine(data, start);
+        QVERIFY2(direct, "the direct parser was expected to give up");
+        QVERIFY(*msg == *expected);
+        QCOMPARE(start, end);
+    } catch (const Imap::ParserException &) {
+        QVERIFY2(!direct, "the direct parser was expected to handle this");
+    }
+}
+
+void ImapParserParseTest::testDirectBodyStructure_data()
+{
+    QTest::addColumn<QByteArray>("data");
+    QTest::addColumn<bool>("isEnvelope");
+    QTest::addColumn<bool>("direct");
+
+    QTest::newRow("text-plain")
+            << QByteArray("(\"text\" \"plain\" (\"chaRset\" \"UTF-8\" \"format\" \"flowed\") NIL NIL \"8bit\" 362 15 NIL NIL NIL)")
+            << false << true;
+
+    QTest::newRow("text-minimal")
+            << QByteArray("(\"TEXT\" \"HTML\" (\"CHARSET\" \"ISO-8859-1\") NIL NIL \"QUOTED-PRINTABLE\" 562 7)")
+            << false << true;
+
+    QTest::newRow("signed")
+            << QByteArray("((\"text\" \"plain\" (\"charset\" \"US-ASCII\" \"delsp\" \"yes\" \"format\" \"flowed\") "
+                          "NIL NIL \"7bit\" 990 27 NIL NIL NIL)(\"application\" \"pgp-signature\" "
+                          "(\"x-mac-type\" \"70674453\" \"name\" \"PGP.sig\") NIL \"This is a digitally signed message part\" "
+                          "\"7bit\" 193 NIL (\"inline\" (\"filename\" \"PGP.sig\")) NIL) \"signed\" (\"protocol\" "
+                          "\"application/pgp-signature\" \"micalg\" \"pgp-sha1\" \"boundary\" \"Apple-Mail-10--856231115\") NIL NIL))")
+            << false << true;
+
+    QTest::newRow("negative-octets")
+            << QByteArray("((\"text\" \"plain\" (\"charset\" \"us- ascii\") NIL NIL \"7bit\" -2 1 NIL NIL NIL)"
+                          "(\"application\" \"msword\" (\"name\" \"=?utf-8?B?NS1ob3Nwb2RhcnNreXZ5dm9qLmRvY2==?=\") NIL NIL "
+                          "\"base64\" 205984 NIL NIL NIL) \"mixed\" NIL NIL NIL)")
+            << false << true;
+
+    QTest::newRow("nil-octets")
+            << QByteArray("((\"TEXT\" \"HTML\" (\"CHARSET\" \"ISO-8859-1\") NIL NIL \"QUOTED-PRINTABLE\" 562 7)"
+                          "(\"APPLICATION\" \"OCTET-STREAM\" (\"NAME\" \"zzz.xml\") NIL "
+                          "\"ZZZ.XML\" \"BASE64\" NIL NIL) \"MIXED\")")
+            << false << true;
+
+    QTest::newRow("message-rfc822")
+            << QByteArray("((\"text\" \"plain\" (\"charset\" \"utf-8\") NIL NIL \"7bit\" 12 1 NIL NIL NIL)"
+                          "(\"message\" \"rfc822\" (\"name\" \"fwd.eml\") NIL NIL \"7bit\" 1024 "
+                          "(\"Thu, 3 Nov 2005 14:19:49 EST\" \"=?utf-8?q?P=C5=99=C3=ADloha?=\" ((NIL NIL \"a\" \"example.org\")) "
+                          "NIL NIL ((\"Some Body\" NIL \"b\" \"example.org\")(NIL NIL \"c\" \"example.org\")) NIL NIL "
+                          "\"<parent@example.org>\" \"<child@example.org>\") "
+                          "(\"text\" \"plain\" (\"charset\" \"us-ascii\") NIL NIL \"7bit\" 500 10 NIL NIL NIL) 20 "
+                          "NIL (\"attachment\" (\"filename\" \"fwd.eml\")) NIL NIL) \"mixed\" "
+                          "(\"boundary\" \"xyz\") NIL NIL NIL)")
+            << false << true;
+
+    QTest::newRow("extension-data")
+            << QByteArray("((\"text\" \"plain\" NIL \"<id@example.org>\" \"desc\" \"7bit\" 1 1 \"md5sum\" "
+                          "(\"inline\" NIL) (\"en\" \"cs\") \"http://example.org/\" \"ext1\" (\"ext2\" 3 (NIL)))"
+                          "(\"image\" \"png\" () NIL NIL \"base64\" 1000 NIL NIL \"en\" NIL 666) "
+                          "\"mixed\" (\"boundary\" \"abc\") (\"inline\" NIL) \"en\" NIL foo (bar baz))")
+            << false << true;
+
+    QTest::newRow("literals-and-atoms")
+            << QByteArray("(text \"plain\" (\"charset\" {5}\r\nutf-8) NIL NIL \"7bit\" 10 1 NIL NIL NIL)")
+            << false << true;
+
+    QTest::newRow("gmail-message-without-envelope")
+            << QByteArray("(((\"TEXT\" \"PLAIN\" (\"CHARSET\" \"iso-8859-2\") NIL NIL "
+                          "\"QUOTED-PRINTABLE\" 52 2 NIL NIL NIL)(\"TEXT\" \"HTML\" (\"CHARSET\" \"iso-8859-2\") "
+                          "NIL NIL \"QUOTED-PRINTABLE\" 1739 66 NIL NIL NIL) \"ALTERNATIVE\" "
+                          "(\"BOUNDARY\" \"----=_NextPart_001_0078_01CBB179.57530990\") NIL NIL)"
+                          "(\"MESSAGE\" \"RFC822\" NIL NIL NIL \"7BIT\" 836 NIL (\"ATTACHMENT\" NIL) NIL)"
+                          "\"MIXED\" (\"BOUNDARY\" \"----=_NextPart_000_0077_01CBB179.57530990\") NIL NIL)")
+            << false << false;
+
+    QTest::newRow("too-few-fields")
+            << QByteArray("(\"application\" \"octet-stream\")")
+            << false << false;
+
+    QTest::newRow("envelope")
+            << QByteArray("(\"Thu, 10 Feb 2011 12:34:56 +0100\" \"IMAP4rev1 WG mtg summary and minutes\" "
+                          "((\"Terry Gray\" NIL \"gray\" \"cac.washington.edu\")) "
+                          "((\"Terry Gray\" NIL \"gray\" \"cac.washington.edu\")) "
+                          "((\"Terry Gray\" NIL \"gray\" \"cac.washington.edu\")) "
+                          "((NIL NIL \"imap\" \"cac.washington.edu\")) "
+                          "((NIL NIL \"minutes\" \"CNRI.Reston.VA.US\") (\"John Klensin\" NIL \"KLENSIN\" \"MIT.EDU\")) "
+                          "NIL \"<parent@example.org>\" \"<B27397-0100000@cac.washington.edu>\")")
+            << true << true;
+
+    QTest::newRow("envelope-nil-everything")
+            << QByteArray("(NIL NIL NIL NIL NIL NIL NIL NIL NIL NIL)")
+            << true << true;
+
+    QTest::newRow("envelope-date-not-a-string")
+            << QByteArray("((foo) \"subject\" ((NIL NIL \"a\" \"example.org\")) NIL NIL NIL NIL NIL NIL NIL)")
+            << true << false;
+}
+
+namespace {
+
+/** @short A device which announces more data than it is able to deliver */
+class ShortReadDevice: public QBuffer
+{
+public:
+    ShortReadDevice(const QByteArray &data, const qint64 claimedSize): m_claimedSize(claimedSize)
+    {
+        setData(data);
+    }
+
+    virtual qint64 size() const
+    {
+        return m_claimedSize;
+    }
+
+private:
+    qint64 m_claimedSize;
+};
+
+/** @short Let the parser and the fake socket go through a couple of queued calls */
+void processSomeEvents()
+{
+    for (int i = 0; i < 5; ++i)
+        QCoreApplication::processEvents();
+}
+
+}
+
+/** @short Check that a streamed literal which is bigger than one chunk gets sent completely, paced by the socket */
+void ImapParserParseTest::testStreamedAppend()
+{
+    QFETCH(bool, literalPlus);
+
+    QByteArray data;
+    data.reserve(300 * 1024);
+    for (int i = 0; i < 300 * 1024; ++i)
+        data += static_cast<char>('a' + i % 26);
+    QBuffer *buf = new QBuffer();
+    buf->setData(data);
+    buf->open(QIODevice::ReadOnly);
+    QSharedPointer<QIODevice> device(buf);
+
+    Streams::FakeSocket *socket = new Streams::FakeSocket(Imap::CONN_STATE_AUTHENTICATED);
+    Imap::Parser *appendParser = new Imap::Parser(0, socket, 669);
+    appendParser->enableLiteralPlus(literalPlus);
+    processSomeEvents();
+
+    appendParser->append(QLatin1String("a"), device);
+    processSomeEvents();
+    const QByteArray prefix = "y0 APPEND a {" + QByteArray::number(data.size()) + (literalPlus ? "+}\r\n" : "}\r\n");
+    QByteArray sent = socket->writtenStuff();
+    QVERIFY(sent.startsWith(prefix));
+    sent = sent.mid(prefix.size());
+
+    if (!literalPlus) {
+        // Nothing shall be sent before the server asks for the literal data
+        QCOMPARE(sent, QByteArray());
+        processSomeEvents();
+        QCOMPARE(socket->writtenStuff(), QByteArray());
+        socket->fakeReading("+ go ahead\r\n");
+        processSomeEvents();
+        sent = socket->writtenStuff();
+    }
+
+    // The data are bigger than the socket's buffer, so they cannot have been written at once
+    QVERIFY(!sent.isEmpty());
+    QVERIFY(sent.size() < data.size());
+    int rounds = 1;
+    while (sent.size() < data.size() + 2 && rounds < 100) {
+        processSomeEvents();
+        sent += socket->writtenStuff();
+        ++rounds;
+    }
+    QVERIFY(rounds > 1);
+    QCOMPARE(sent, data + "\r\n");
+
+    socket->fakeReading("y0 OK appended\r\n");
+    processSomeEvents();
+    QVERIFY(appendParser->hasResponse());
+    QVERIFY(appendParser->getResponse().dynamicCast<Imap::Responses::State>());
+    QCOMPARE(socket->writtenStuff(), QByteArray());
+
+    delete appendParser;
+    QCoreApplication::sendPostedEvents(0, QEvent::DeferredDelete);
+}
+
+void ImapParserParseTest::testStreamedAppend_data()
+{
+    QTest::addColumn<bool>("literalPlus");
+    QTest::newRow("literal-plus") << true;
+    QTest::newRow("continuation") << false;
+}
+
+/** @short A device which cannot provide the announced amount of data shall lead to a disconnect */
+void ImapParserParseTest::testStreamedAppendShortRead()
+{
+    QByteArray data(100 * 1024, 'x');
+    ShortReadDevice *shortDevice = new ShortReadDevice(data, 200 * 1024);
+    shortDevice->open(QIODevice::ReadOnly);
+    QSharedPointer<QIODevice> device(shortDevice);
+
+    Streams::FakeSocket *socket = new Streams::FakeSocket(Imap::CONN_STATE_AUTHENTICATED);
+    Imap::Parser *appendParser = new Imap::Parser(0, socket, 670);
+    appendParser->enableLiteralPlus(true);
+    processSomeEvents();
+
+    appendParser->append(QLatin1String("a"), device);
+    appendParser->noop();
+    processSomeEvents();
+    QCOMPARE(socket->writtenStuff(), QByteArray("y0 APPEND a {204800+}\r\n") + data + QByteArray("[*** close ***]"));
+
+    QVERIFY(appendParser->hasResponse());
+    QSharedPointer<Imap::Responses::AbstractResponse> resp = appendParser->getResponse();
+    QVERIFY(resp.dynamicCast<Imap::Responses::SocketDisconnectedResponse>());
+    // The connection is gone, so the queued commands are not sent anywhere
+    processSomeEvents();
+    QCOMPARE(socket->writtenStuff(), QByteArray());
+
+    delete appendParser;
+    QCoreApplication::sendPostedEvents(0, QEvent::DeferredDelete);
+}
+
+
+/** @short Measure how long it takes to parse a BODYSTRUCTURE */
+void ImapParserParseTest::benchmarkBodyStructure()
+{
+    QFETCH(bool, direct);
+
+    const QByteArray data = "(((\"text\" \"plain\" (\"charset\" \"US-ASCII\" \"delsp\" \"yes\" \"format\" \"flowed\") "
+            "NIL NIL \"7bit\" 990 27 NIL NIL NIL)(\"text\" \"html\" (\"charset\" \"US-ASCII\") NIL NIL "
+            "\"quoted-printable\" 4860 100 NIL NIL NIL) \"alternative\" (\"boundary\" \"-----1131387468\") NIL NIL)"
+            "(\"application\" \"pgp-signature\" (\"name\" \"PGP.sig\") NIL "
+            "\"This is a digitally signed message part\" \"7bit\" 193 NIL (\"inline\" (\"filename\" \"PGP.sig\")) NIL) "
+            "(\"image\" \"png\" (\"name\" \"screenshot.png\") NIL NIL \"base64\" 123456 NIL "
+            "(\"attachment\" (\"filename\" \"screenshot.png\")) NIL NIL) "
+            "\"mixed\" (\"boundary\" \"Apple-Mail-10--856231115\") NIL NIL NIL)";
+
+    QBENCHMARK {
+        for (int i = 0; i < 1000; ++i) {
+            int start = 0;
+            if (direct) {
+                Imap::Message::AbstractMessage::fromLine(data, start);
+            } else {
+                QVariantList list = Imap::LowLevelParser::parseList('(', ')', data, start);
+                Imap::Message::AbstractMessage::fromList(list, data, start);
+            }
+        }
+    }
+}
+
+void ImapParserParseTest::benchmarkBodyStructure_data()
+{
+    QTest::addColumn<bool>("direct");
+    QTest::newRow("parseList") << false;
+    QTest::newRow("direct") << true;
+}
+
 TROJITA_HEADLESS_TEST( ImapParserParseTest )
 
 namespace QTest {
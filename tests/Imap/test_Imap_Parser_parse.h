@@ -49,15 +49,30 @@ private Q_SLOTS:
     /** @short Test sequence output */
     void testSequences();
     void testSequences_data();
+    /** @short Test the set operations on sequences */
+    void testSequenceQueries();
     /** @short Test for parsing errors */
     void testThrow();
     void testThrow_data();
+    /** @short Check that parsing BODYSTRUCTURE and ENVELOPE directly produces the same data as the generic code */
+    void testDirectBodyStructure();
+    void testDirectBodyStructure_data();
+    /** @short Test sending of a literal which is read from a QIODevice */
+    void testStreamedAppend();
+    void testStreamedAppend_data();
+    void testStreamedAppendShortRead();
 
     void initTestCase();
     void cleanupTestCase();
 
     void benchmark();
     void benchmarkInitialChat();
+    void benchmarkFetchStream();
+    void benchmarkFetchStream_data();
+    void benchmarkLiteral();
+    void benchmarkLiteral_data();
+    void benchmarkBodyStructure();
+    void benchmarkBodyStructure_data();
 };
 
 #endif
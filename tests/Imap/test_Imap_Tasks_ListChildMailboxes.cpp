@@ -25,6 +25,7 @@
 #include "Utils/headless_test.h"
 #include "Common/MetaTypes.h"
 #include "Streams/FakeSocket.h"
+#include "Utils/FakeCapabilitiesInjector.h"
 #include "Imap/Model/ItemRoles.h"
 #include "Imap/Model/MemoryCache.h"
 #include "Imap/Model/Model.h"
@@ -207,5 +208,79 @@ void ImapModelListChildMailboxesTest::testNoStatusForCachedItems()
     cEmpty();
 }
 
+/** @short Numbers requested at once are fetched through a single burst of STATUS commands */
+void ImapModelListChildMailboxesTest::testBatchedStatus()
+{
+    using namespace Imap::Mailbox;
+
+    QCOMPARE(model->rowCount(QModelIndex()), 1);
+    cClient(t.mk("LIST \"\" \"%\"\r\n"));
+    cServer("* LIST (\\HasNoChildren) \".\" a\r\n"
+            "* LIST (\\HasNoChildren) \".\" b\r\n"
+            "* LIST (\\HasNoChildren) \".\" c\r\n"
+            + t.last("OK listed\r\n"));
+    QCOMPARE(model->rowCount(QModelIndex()), 4);
+    idxA = model->index(1, 0, QModelIndex());
+    idxB = model->index(2, 0, QModelIndex());
+    idxC = model->index(3, 0, QModelIndex());
+    QCOMPARE(idxA.data(RoleMailboxName).toString(), QString::fromUtf8("a"));
+    QCOMPARE(idxB.data(RoleMailboxName).toString(), QString::fromUtf8("b"));
+    QCOMPARE(idxC.data(RoleMailboxName).toString(), QString::fromUtf8("c"));
+
+    // Just like a view showing the whole list, ask for all of them
+    QCOMPARE(idxA.data(RoleUnreadMessageCount), QVariant());
+    QCOMPARE(idxB.data(RoleUnreadMessageCount), QVariant());
+    QByteArray c1 = t.mk("STATUS a (MESSAGES UNSEEN RECENT)\r\n");
+    QByteArray r1 = t.last("OK status\r\n");
+    QByteArray c2 = t.mk("STATUS b (MESSAGES UNSEEN RECENT)\r\n");
+    QByteArray r2 = t.last("OK status\r\n");
+    cClient(c1 + c2);
+
+    // The first batch is on the wire already, so this one has to go through another one
+    QCOMPARE(idxC.data(RoleUnreadMessageCount), QVariant());
+    QByteArray c3 = t.mk("STATUS c (MESSAGES UNSEEN RECENT)\r\n");
+    QByteArray r3 = t.last("OK status\r\n");
+    cClient(c3);
+
+    // Tagged responses in a random order
+    cServer("* STATUS b (MESSAGES 20 RECENT 0 UNSEEN 2)\r\n" + r2 +
+            "* STATUS c (MESSAGES 30 RECENT 0 UNSEEN 3)\r\n" + r3);
+    QCOMPARE(idxB.data(RoleUnreadMessageCount).toInt(), 2);
+    QCOMPARE(idxC.data(RoleUnreadMessageCount).toInt(), 3);
+    QCOMPARE(idxA.data(RoleMailboxNumbersFetched).toBool(), false);
+    cServer("* STATUS a (MESSAGES 10 RECENT 1 UNSEEN 1)\r\n" + r1);
+    QCOMPARE(idxA.data(RoleUnreadMessageCount).toInt(), 1);
+    QCOMPARE(idxA.data(RoleMailboxNumbersFetched).toBool(), true);
+    cEmpty();
+    QVERIFY(errorSpy->isEmpty());
+}
+
+/** @short With LIST-STATUS, the numbers arrive along with the mailboxes and no STATUS is needed */
+void ImapModelListChildMailboxesTest::testListStatus()
+{
+    using namespace Imap::Mailbox;
+
+    QCOMPARE(model->rowCount(QModelIndex()), 1);
+    FakeCapabilitiesInjector injector(model);
+    injector.injectCapability(QLatin1String("LIST-STATUS"));
+    cClient(t.mk("LIST \"\" \"%\" RETURN (STATUS (MESSAGES UNSEEN RECENT))\r\n"));
+    cServer("* LIST (\\HasNoChildren) \".\" a\r\n"
+            "* STATUS a (MESSAGES 10 UNSEEN 1 RECENT 0)\r\n"
+            "* LIST (\\HasNoChildren) \".\" b\r\n"
+            "* STATUS b (MESSAGES 20 UNSEEN 2 RECENT 0)\r\n"
+            + t.last("OK listed\r\n"));
+    QCOMPARE(model->rowCount(QModelIndex()), 3);
+    idxA = model->index(1, 0, QModelIndex());
+    idxB = model->index(2, 0, QModelIndex());
+    QCOMPARE(idxA.data(RoleMailboxNumbersFetched).toBool(), true);
+    QCOMPARE(idxA.data(RoleTotalMessageCount).toInt(), 10);
+    QCOMPARE(idxA.data(RoleUnreadMessageCount).toInt(), 1);
+    QCOMPARE(idxB.data(RoleMailboxNumbersFetched).toBool(), true);
+    QCOMPARE(idxB.data(RoleTotalMessageCount).toInt(), 20);
+    QCOMPARE(idxB.data(RoleUnreadMessageCount).toInt(), 2);
+    cEmpty();
+    QVERIFY(errorSpy->isEmpty());
+}
+
 
 TROJITA_HEADLESS_TEST( ImapModelListChildMailboxesTest )
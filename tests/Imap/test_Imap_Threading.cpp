@@ -20,10 +20,15 @@
    along with this program.  If not, see <http://www.gnu.org/licenses/>.
 */
 
+#include <QTemporaryFile>
 #include <QtTest>
 #include "test_Imap_Threading.h"
 #include "Utils/headless_test.h"
+#include "Imap/Model/FullTextIndex.h"
+#include "Imap/Model/LocalSorting.h"
+#include "Imap/Model/LocalThreading.h"
 #include "Imap/Model/MsgListModel.h"
+#include "Imap/Model/PrettyMsgListModel.h"
 #include "Imap/Model/ThreadingMsgListModel.h"
 #include "Streams/FakeSocket.h"
 #include "Utils/FakeCapabilitiesInjector.h"
@@ -1083,6 +1088,112 @@ void ImapModelThreadingTest::testDynamicSearch()
     justKeepTask();
 }
 
+/** @short Quick search shall use the full-text index and only ask the server about messages which are not indexed */
+void ImapModelThreadingTest::testLocalSearch()
+{
+    FakeCapabilitiesInjector injector(model);
+    injector.injectCapability("QRESYNC");
+
+    threadingModel->setUserWantsThreading(false);
+
+    Imap::Mailbox::SyncState sync;
+    sync.setExists(3);
+    sync.setUidValidity(666);
+    sync.setUidNext(15);
+    sync.setHighestModSeq(33);
+    sync.setUnSeenCount(3);
+    sync.setRecent(0);
+    QList<uint> uidMap;
+    uidMap << 6 << 9 << 10;
+    model->cache()->setMailboxSyncState("a", sync);
+    model->cache()->setUidMapping("a", uidMap);
+    model->cache()->setMsgFlags("a", 6, QStringList() << "x");
+    model->cache()->setMsgFlags("a", 9, QStringList() << "y");
+    model->cache()->setMsgFlags("a", 10, QStringList() << "z");
+    msgListModel->setMailbox("a");
+    cClient(t.mk("SELECT a (QRESYNC (666 33 (2 9)))\r\n"));
+    cServer("* 3 EXISTS\r\n"
+            "* OK [UIDVALIDITY 666] .\r\n"
+            "* OK [UIDNEXT 15] .\r\n"
+            "* OK [HIGHESTMODSEQ 33] .\r\n"
+            );
+    cServer(t.last("OK selected\r\n"));
+    cEmpty();
+    checkUidMapFromThreading(uidMap);
+
+    QTemporaryFile indexFile;
+    QVERIFY(indexFile.open());
+    Imap::Mailbox::FullTextIndex *index = new Imap::Mailbox::FullTextIndex(0, QLatin1String("threading-fulltext"),
+                                                                           indexFile.fileName());
+    QVERIFY(index->open());
+    model->cache()->setFullTextIndex(index);
+    QList<uint> expected;
+    index->addMetadata(QLatin1String("a"), 6, Imap::Message::Envelope(
+                           QDateTime(), QLatin1String("foo bar"), QList<Imap::Message::MailAddress>(),
+                           QList<Imap::Message::MailAddress>(), QList<Imap::Message::MailAddress>(),
+                           QList<Imap::Message::MailAddress>(), QList<Imap::Message::MailAddress>(),
+                           QList<Imap::Message::MailAddress>(), QList<QByteArray>(), QByteArray()));
+    index->addMetadata(QLatin1String("a"), 9, Imap::Message::Envelope(
+                           QDateTime(), QLatin1String("something else"), QList<Imap::Message::MailAddress>(),
+                           QList<Imap::Message::MailAddress>(), QList<Imap::Message::MailAddress>(),
+                           QList<Imap::Message::MailAddress>(), QList<Imap::Message::MailAddress>(),
+                           QList<Imap::Message::MailAddress>(), QList<QByteArray>(), QByteArray()));
+    index->flush();
+
+    // The message with UID 10 is not indexed, so the server has to help
+    threadingModel->setUserSearchingSortingPreference(QStringList() << QLatin1String("SUBJECT") << QLatin1String("foo"),
+                                                      threadingModel->currentSortCriterium(), threadingModel->currentSortOrder());
+    // The local result is shown immediately
+    expected = QList<uint>() << 6;
+    checkUidMapFromThreading(expected);
+    cClient(t.mk("UID SEARCH CHARSET utf-8 UID 10 SUBJECT foo\r\n"));
+    cServer("* SEARCH 10\r\n" + t.last("OK searched\r\n"));
+    expected = QList<uint>() << 6 << 10;
+    checkUidMapFromThreading(expected);
+
+    // Once everything is indexed, the server is not asked at all
+    index->addMetadata(QLatin1String("a"), 10, Imap::Message::Envelope(
+                           QDateTime(), QLatin1String("Foobar"), QList<Imap::Message::MailAddress>(),
+                           QList<Imap::Message::MailAddress>(), QList<Imap::Message::MailAddress>(),
+                           QList<Imap::Message::MailAddress>(), QList<Imap::Message::MailAddress>(),
+                           QList<Imap::Message::MailAddress>(), QList<QByteArray>(), QByteArray()));
+    index->flush();
+    threadingModel->setUserSearchingSortingPreference(QStringList() << QLatin1String("SUBJECT") << QLatin1String("else"),
+                                                      threadingModel->currentSortCriterium(), threadingModel->currentSortOrder());
+    expected = QList<uint>() << 9;
+    checkUidMapFromThreading(expected);
+
+    // Searching in the body requires the bodies to be indexed as well
+    index->addBodyPart(QLatin1String("a"), 6, QLatin1String("1"), "nothing to see here", QByteArray());
+    index->addBodyPart(QLatin1String("a"), 9, QLatin1String("1"), "nothing to see here", QByteArray());
+    index->addBodyPart(QLatin1String("a"), 10, QLatin1String("1"), "or else", QByteArray());
+    index->flush();
+    threadingModel->setUserSearchingSortingPreference(QStringList() << QLatin1String("OR") << QLatin1String("SUBJECT")
+                                                      << QLatin1String("else") << QLatin1String("BODY") << QLatin1String("else"),
+                                                      threadingModel->currentSortCriterium(), threadingModel->currentSortOrder());
+    expected = QList<uint>() << 9 << 10;
+    checkUidMapFromThreading(expected);
+    threadingModel->setUserSearchingSortingPreference(QStringList() << QLatin1String("SUBJECT") << QLatin1String("foo"),
+                                                      threadingModel->currentSortCriterium(), threadingModel->currentSortOrder());
+    expected = QList<uint>() << 6 << 10;
+    checkUidMapFromThreading(expected);
+    cEmpty();
+
+    // Raw searches are always passed to the server
+    threadingModel->setUserSearchingSortingPreference(QStringList() << QLatin1String("LARGER") << QLatin1String("666"),
+                                                      threadingModel->currentSortCriterium(), threadingModel->currentSortOrder());
+    cClient(t.mk("UID SEARCH CHARSET utf-8 LARGER 666\r\n"));
+    cServer("* SEARCH 9\r\n" + t.last("OK searched\r\n"));
+    expected = QList<uint>() << 9;
+    checkUidMapFromThreading(expected);
+
+    model->cache()->setFullTextIndex(0);
+    QFile::remove(indexFile.fileName() + QLatin1String("-wal"));
+    QFile::remove(indexFile.fileName() + QLatin1String("-shm"));
+    cEmpty();
+    justKeepTask();
+}
+
 QByteArray ImapModelThreadingTest::prepareHugeUntaggedThread(const uint num)
 {
     QString sampleThread = QLatin1String("(%1 (%2 %3 (%4)(%5 %6 %7))(%8 %9 %10))");
@@ -1138,6 +1249,409 @@ void ImapModelThreadingTest::testThreadingPerformance()
     }
 }
 
+/** @short Test the client-side implementation of the REFERENCES threading */
+void ImapModelThreadingTest::testLocalThreading()
+{
+    using Imap::Responses::ThreadingNode;
+    typedef QVector<ThreadingNode> Nodes;
+    typedef QList<QByteArray> Refs;
+
+    Imap::Mailbox::LocalThreading engine;
+    engine.addMessage(1, "<a>", Refs());
+    engine.addMessage(2, "<b>", Refs() << "<a>");
+    // In-Reply-To is used when there are no References
+    engine.addMessage(3, "<c>", Refs(), Refs() << "<b>");
+    // The parent of these two is not in the mailbox; they are grouped under a placeholder
+    engine.addMessage(4, "<d>", Refs() << "<missing>");
+    engine.addMessage(5, "<e>", Refs() << "<missing>");
+    // A single child of a missing message gets promoted
+    engine.addMessage(6, "<f>", Refs() << "<gone>");
+    // Messages which do not reference anything are standalone
+    engine.addMessage(7, QByteArray(), Refs());
+
+    QCOMPARE(engine.size(), 7);
+    QVERIFY(engine.contains(5));
+    QVERIFY(!engine.contains(8));
+
+    Nodes expected;
+    expected << ThreadingNode(1, Nodes() << ThreadingNode(2, Nodes() << ThreadingNode(3)))
+             << ThreadingNode(0, Nodes() << ThreadingNode(4) << ThreadingNode(5))
+             << ThreadingNode(6)
+             << ThreadingNode(7);
+    QCOMPARE(engine.threading(), expected);
+
+    // New arrivals can be added incrementally, including the missing parents and messages without headers
+    engine.addMessage(8, "<missing>", Refs() << "<a>");
+    engine.addMessage(9, "<g>", Refs() << "<a>" << "<c>");
+    expected.clear();
+    expected << ThreadingNode(1, Nodes()
+                              << ThreadingNode(2, Nodes() << ThreadingNode(3, Nodes() << ThreadingNode(9)))
+                              << ThreadingNode(8, Nodes() << ThreadingNode(4) << ThreadingNode(5)))
+             << ThreadingNode(6)
+             << ThreadingNode(7)
+             << ThreadingNode(10);
+    QCOMPARE(engine.threading(QList<uint>() << 10 << 7), expected);
+
+    // Expunging the thread root leaves a placeholder behind, so that the replies still stay together
+    engine.removeMessage(1);
+    QVERIFY(!engine.contains(1));
+    QCOMPARE(engine.size(), 8);
+    expected.clear();
+    expected << ThreadingNode(0, Nodes()
+                              << ThreadingNode(2, Nodes() << ThreadingNode(3, Nodes() << ThreadingNode(9)))
+                              << ThreadingNode(8, Nodes() << ThreadingNode(4) << ThreadingNode(5)))
+             << ThreadingNode(6)
+             << ThreadingNode(7);
+    QCOMPARE(engine.threading(), expected);
+
+    // Once a placeholder is not at the top level, its children get promoted
+    engine.removeMessage(8);
+    engine.removeMessage(666);
+    QCOMPARE(engine.size(), 7);
+    expected.clear();
+    expected << ThreadingNode(0, Nodes()
+                              << ThreadingNode(2, Nodes() << ThreadingNode(3, Nodes() << ThreadingNode(9)))
+                              << ThreadingNode(4)
+                              << ThreadingNode(5))
+             << ThreadingNode(6)
+             << ThreadingNode(7);
+    QCOMPARE(engine.threading(), expected);
+
+    // The message can come back, e.g. when it's moved back from some other mailbox under a new UID
+    engine.addMessage(11, "<a>", Refs());
+    expected.clear();
+    expected << ThreadingNode(11, Nodes()
+                              << ThreadingNode(2, Nodes() << ThreadingNode(3, Nodes() << ThreadingNode(9)))
+                              << ThreadingNode(4)
+                              << ThreadingNode(5))
+             << ThreadingNode(6)
+             << ThreadingNode(7);
+    QCOMPARE(engine.threading(), expected);
+
+    // Loops in the References are not followed; the link which came first wins
+    Imap::Mailbox::LocalThreading loops;
+    loops.addMessage(1, "<x>", Refs() << "<y>");
+    loops.addMessage(2, "<y>", Refs() << "<x>");
+    loops.addMessage(3, "<z>", Refs() << "<z>");
+    expected.clear();
+    expected << ThreadingNode(2, Nodes() << ThreadingNode(1)) << ThreadingNode(3);
+    QCOMPARE(loops.threading(), expected);
+}
+
+/** @short Check that a new THREAD response is applied through moves and insertions instead of a layout change */
+void ImapModelThreadingTest::testIncrementalApplyThreading()
+{
+    using namespace Imap::Mailbox;
+
+    initialMessages(10);
+    Mapping mapping;
+    QByteArray response;
+    complexMapping(mapping, response);
+    cClient(t.mk("UID THREAD REFS utf-8 ALL\r\n"));
+    cServer(QByteArray("* THREAD ") + response + QByteArray("\r\n") + t.last("OK thread\r\n"));
+    QCOMPARE(treeToThreading(QModelIndex()), QByteArray("(1)(2 3)(4 (5)(6))(7 (8)(9 10))"));
+
+    PrettyMsgListModel pretty;
+    pretty.setSourceModel(threadingModel);
+    pretty.setHideRead(true);
+    QCOMPARE(pretty.rowCount(), 1);
+    QCOMPARE(pretty.index(0, 0).data(RoleMessageUid).toUInt(), 7u);
+
+    QPersistentModelIndex msg1 = findItem("0");
+    QPersistentModelIndex msg3 = findItem("1.0");
+    QPersistentModelIndex msg9 = findItem("3.1");
+    QPersistentModelIndex msg10 = findItem("3.1.0");
+    QCOMPARE(msg10.data(RoleMessageUid).toUInt(), 10u);
+
+    QSignalSpy layoutChanged(threadingModel, SIGNAL(layoutChanged()));
+    QSignalSpy moved(threadingModel, SIGNAL(rowsMoved(QModelIndex,int,int,QModelIndex,int)));
+    QSignalSpy removed(threadingModel, SIGNAL(rowsRemoved(QModelIndex,int,int)));
+
+    // Message #1 becomes a reply to #6, the unread #9 moves to the thread of #4 without its child, #3 disappears and the last
+    // thread is rooted at an empty node and a message which is not in the mailbox, so #7 has to be promoted twice
+    model->cache()->setMessageThreading("a", QVector<Imap::Responses::ThreadingNode>());
+    threadingModel->wantThreading();
+    cClient(t.mk("UID THREAD REFS utf-8 ALL\r\n"));
+    cServer(QByteArray("* THREAD (2)(4 (5)(6 1)(9))((666 7 8)(10))\r\n") + t.last("OK thread\r\n"));
+    QCOMPARE(treeToThreading(QModelIndex()), QByteArray("(2)(4 (5)(6 1)(9))(7 (8)(10))"));
+
+    QVERIFY(layoutChanged.isEmpty());
+    QVERIFY(!moved.isEmpty());
+    QCOMPARE(removed.size(), 1);
+    QVERIFY(msg1.isValid());
+    QCOMPARE(QModelIndex(msg1), findItem("1.1.0"));
+    QVERIFY(!msg3.isValid());
+    QVERIFY(msg9.isValid());
+    QCOMPARE(QModelIndex(msg9), findItem("1.2"));
+    QVERIFY(msg10.isValid());
+    QCOMPARE(QModelIndex(msg10), findItem("2.1"));
+
+    // The unread message has taken the visibility with it
+    QCOMPARE(pretty.rowCount(), 1);
+    QModelIndex thread4 = pretty.index(0, 0);
+    QCOMPARE(thread4.data(RoleMessageUid).toUInt(), 4u);
+    QCOMPARE(pretty.rowCount(thread4), 3);
+    QCOMPARE(pretty.index(2, 0, thread4).data(RoleMessageUid).toUInt(), 9u);
+    QCOMPARE(pretty.index(0, 0, pretty.index(1, 0, thread4)).data(RoleMessageUid).toUInt(), 1u);
+
+    // Switching the threading off and on again goes through the full rebuild, and it shall arrive at the very same tree
+    threadingModel->setUserWantsThreading(false);
+    QCOMPARE(threadingModel->rowCount(), 10);
+    threadingModel->setUserWantsThreading(true);
+    QCOMPARE(treeToThreading(QModelIndex()), QByteArray("(2)(4 (5)(6 1)(9))(7 (8)(10))"));
+    cEmpty();
+}
+
+/** @short Check that the THREAD response which follows a new arrival is applied without a layout change */
+void ImapModelThreadingTest::testIncrementalApplyThreadingArrival()
+{
+    initialMessages(10);
+    Mapping mapping;
+    QByteArray response;
+    complexMapping(mapping, response);
+    cClient(t.mk("UID THREAD REFS utf-8 ALL\r\n"));
+    cServer(QByteArray("* THREAD ") + response + QByteArray("\r\n") + t.last("OK thread\r\n"));
+    QCOMPARE(treeToThreading(QModelIndex()), QByteArray("(1)(2 3)(4 (5)(6))(7 (8)(9 10))"));
+    QPersistentModelIndex msg10 = findItem("3.1.0");
+    QCOMPARE(msg10.data(Imap::Mailbox::RoleMessageUid).toUInt(), 10u);
+
+    QSignalSpy layoutChanged(threadingModel, SIGNAL(layoutChanged()));
+    QSignalSpy moved(threadingModel, SIGNAL(rowsMoved(QModelIndex,int,int,QModelIndex,int)));
+
+    cServer("* 11 EXISTS\r\n");
+    cClient(t.mk("UID FETCH 11:* (FLAGS)\r\n"));
+    cServer("* 11 FETCH (UID 11 FLAGS ())\r\n" + t.last("OK fetch\r\n"));
+    QCOMPARE(threadingModel->rowCount(), 5);
+    QCOMPARE(threadingModel->index(4, 0).data(Imap::Mailbox::RoleMessageUid).toUInt(), 11u);
+    cClient(t.mk("UID THREAD REFS utf-8 ALL\r\n"));
+    cServer("* THREAD (1)(2 3)(4 (5)(6))(7 (8)(9 10 11))\r\n" + t.last("OK thread\r\n"));
+    QCOMPARE(treeToThreading(QModelIndex()), QByteArray("(1)(2 3)(4 (5)(6))(7 (8)(9 10 11))"));
+
+    QVERIFY(layoutChanged.isEmpty());
+    QCOMPARE(moved.size(), 1);
+    QVERIFY(msg10.isValid());
+    QCOMPARE(QModelIndex(msg10), findItem("3.1.0"));
+    QCOMPARE(findItem("3.1.0.0").data(Imap::Mailbox::RoleMessageUid).toUInt(), 11u);
+    cEmpty();
+}
+
+/** @short Measure how long it takes to apply a THREAD response which moves a single message of a huge mailbox */
+void ImapModelThreadingTest::testIncrementalApplyThreadingPerformance()
+{
+    const int num = 100000;
+    initialMessages(num);
+    cClient(t.mk("UID THREAD REFS utf-8 ALL\r\n"));
+    cServer(prepareHugeUntaggedThread(num) + t.last("OK thread\r\n"));
+
+    // The last thread becomes a part of the first one
+    QVector<Imap::Responses::ThreadingNode> original = model->cache()->messageThreading("a");
+    QVERIFY(original.size() > 1);
+    QVector<Imap::Responses::ThreadingNode> modified = original;
+    modified.front().children.append(modified.back());
+    modified.remove(modified.size() - 1);
+    const int rows = threadingModel->rowCount();
+
+    bool flip = false;
+    QBENCHMARK {
+        flip = !flip;
+        threadingModel->applyThreading(flip ? modified : original);
+        QCOMPARE(threadingModel->rowCount(), flip ? rows - 1 : rows);
+    }
+    cEmpty();
+}
+
+/** @short Measure how long it takes to thread a big mailbox locally */
+void ImapModelThreadingTest::testLocalThreadingPerformance()
+{
+    const uint num = 200000;
+    QVector<QByteArray> ids(num + 1);
+    QVector<QList<QByteArray> > references(num + 1);
+    for (uint i = 1; i <= num; ++i) {
+        ids[i] = "<" + QByteArray::number(i) + "@example.org>";
+        // Threads of ten messages, each replying to the previous one, with an occasional reference to an unknown message
+        if (i % 10 != 1) {
+            references[i] = references[i - 1];
+            references[i] << ids[i - 1];
+        } else if (i % 100 == 1) {
+            references[i] << "<" + QByteArray::number(i) + "@elsewhere.example.org>";
+        }
+    }
+
+    QBENCHMARK {
+        Imap::Mailbox::LocalThreading engine;
+        for (uint i = 1; i <= num; ++i) {
+            engine.addMessage(i, ids[i], references[i]);
+        }
+        QCOMPARE(engine.threading().size(), static_cast<int>(num / 10));
+    }
+}
+
+static Imap::Message::Envelope sortingEnvelope(const QDateTime &date, const QString &subject,
+                                               const QList<Imap::Message::MailAddress> &from = QList<Imap::Message::MailAddress>())
+{
+    return Imap::Message::Envelope(date, subject, from, QList<Imap::Message::MailAddress>(), QList<Imap::Message::MailAddress>(),
+                                   QList<Imap::Message::MailAddress>(), QList<Imap::Message::MailAddress>(),
+                                   QList<Imap::Message::MailAddress>(), QList<QByteArray>(), QByteArray());
+}
+
+/** @short Test the client-side implementation of SORT */
+void ImapModelThreadingTest::testLocalSorting()
+{
+    using Imap::Mailbox::LocalSorting;
+    using Imap::Message::MailAddress;
+    typedef QList<MailAddress> Addresses;
+
+    // Base subject extraction as per RFC 5256
+    QCOMPARE(LocalSorting::baseSubject(QLatin1String("Re: hello")), QString::fromUtf8("hello"));
+    QCOMPARE(LocalSorting::baseSubject(QLatin1String("RE: [list] Re: hello (fwd)")), QString::fromUtf8("hello"));
+    QCOMPARE(LocalSorting::baseSubject(QLatin1String("[Fwd: Re: hello]")), QString::fromUtf8("hello"));
+    QCOMPARE(LocalSorting::baseSubject(QLatin1String("  Fw[x]:  a \t b  ")), QString::fromUtf8("a b"));
+    QCOMPARE(LocalSorting::baseSubject(QLatin1String("[PATCH] fix")), QString::fromUtf8("fix"));
+    QCOMPARE(LocalSorting::baseSubject(QLatin1String("[PATCH]")), QString::fromUtf8("[PATCH]"));
+    QCOMPARE(LocalSorting::baseSubject(QLatin1String("Reply to everyone")), QString::fromUtf8("Reply to everyone"));
+    QCOMPARE(LocalSorting::baseSubject(QLatin1String("Re:")), QString());
+
+    // Subjects are compared without the prefixes and case-insensitively; ties are broken by the UID
+    LocalSorting engine;
+    engine.setCriterium(LocalSorting::SORT_SUBJECT);
+    engine.addMessage(1, sortingEnvelope(QDateTime(), QLatin1String("Zebra")), QDateTime(), 0);
+    engine.addMessage(2, sortingEnvelope(QDateTime(), QLatin1String("re: apple")), QDateTime(), 0);
+    engine.addMessage(3, sortingEnvelope(QDateTime(), QLatin1String("Apple")), QDateTime(), 0);
+    engine.addMessageWithoutData(4);
+    QCOMPARE(engine.size(), 4);
+    QVERIFY(engine.contains(4));
+    QVERIFY(!engine.hasKey(4));
+    QVERIFY(engine.hasKey(3));
+    QList<uint> expected;
+    expected << 4 << 2 << 3 << 1;
+    QCOMPARE(engine.sortedUids(), expected);
+
+    // New arrivals, late metadata and expunges are all handled incrementally
+    engine.addMessage(5, sortingEnvelope(QDateTime(), QLatin1String("banana")), QDateTime(), 0);
+    engine.addMessage(4, sortingEnvelope(QDateTime(), QLatin1String("Fwd: Cherry")), QDateTime(), 0);
+    engine.removeMessage(3);
+    QVERIFY(engine.hasKey(4));
+    QVERIFY(!engine.contains(3));
+    expected.clear();
+    expected << 2 << 5 << 4 << 1;
+    QCOMPARE(engine.sortedUids(), expected);
+
+    // The internal date is used when the Date header is missing
+    const QDateTime base(QDate(2014, 1, 1), QTime(12, 0), Qt::UTC);
+    LocalSorting byDate;
+    byDate.setCriterium(LocalSorting::SORT_DATE);
+    byDate.addMessage(1, sortingEnvelope(base.addSecs(60), QString()), base, 0);
+    byDate.addMessage(2, sortingEnvelope(QDateTime(), QString()), base.addSecs(30), 0);
+    byDate.addMessage(3, sortingEnvelope(base, QString()), base.addSecs(3600), 0);
+    expected.clear();
+    expected << 3 << 2 << 1;
+    QCOMPARE(byDate.sortedUids(), expected);
+
+    // Dates before the epoch are fine, too, and the messages without any date go first
+    byDate.addMessage(4, sortingEnvelope(QDateTime(QDate(1969, 7, 20), QTime(20, 17), Qt::UTC), QString()), QDateTime(), 0);
+    byDate.addMessage(5, sortingEnvelope(QDateTime(), QString()), QDateTime(), 0);
+    byDate.addMessageWithoutData(6);
+    expected.clear();
+    expected << 5 << 6 << 4 << 3 << 2 << 1;
+    QCOMPARE(byDate.sortedUids(), expected);
+
+    // Changing the criterium starts from scratch
+    byDate.setCriterium(LocalSorting::SORT_SIZE);
+    QCOMPARE(byDate.size(), 0);
+    byDate.addMessage(1, sortingEnvelope(QDateTime(), QString()), QDateTime(), 300);
+    byDate.addMessage(2, sortingEnvelope(QDateTime(), QString()), QDateTime(), 100);
+    expected.clear();
+    expected << 2 << 1;
+    QCOMPARE(byDate.sortedUids(), expected);
+
+    // The display name is preferred over the address, as in DISPLAYFROM from RFC 5957
+    LocalSorting byFrom;
+    byFrom.setCriterium(LocalSorting::SORT_FROM);
+    byFrom.addMessage(1, sortingEnvelope(QDateTime(), QString(), Addresses() << MailAddress(QLatin1String("Zed"), QString(),
+                                         QLatin1String("aaa"), QLatin1String("example.org"))), QDateTime(), 0);
+    byFrom.addMessage(2, sortingEnvelope(QDateTime(), QString(), Addresses() << MailAddress(QString(), QString(),
+                                         QLatin1String("bob"), QLatin1String("example.org"))), QDateTime(), 0);
+    byFrom.addMessage(3, sortingEnvelope(QDateTime(), QString(), Addresses() << MailAddress(QLatin1String("alice"), QString(),
+                                         QLatin1String("zzz"), QLatin1String("example.org"))), QDateTime(), 0);
+    expected.clear();
+    expected << 3 << 2 << 1;
+    QCOMPARE(byFrom.sortedUids(), expected);
+
+    // The ThreadingMsgListModel uses the local sorting when the server has no SORT
+    FakeCapabilitiesInjector injector(model);
+    injector.injectCapability("QRESYNC");
+    threadingModel->setUserWantsThreading(false);
+
+    Imap::Mailbox::SyncState sync;
+    sync.setExists(3);
+    sync.setUidValidity(666);
+    sync.setUidNext(15);
+    sync.setHighestModSeq(33);
+    sync.setUnSeenCount(3);
+    sync.setRecent(0);
+    QList<uint> uidMap;
+    uidMap << 6 << 9 << 10;
+    model->cache()->setMailboxSyncState("a", sync);
+    model->cache()->setUidMapping("a", uidMap);
+    // Two of these messages have their envelopes in the cache, but none of them has been loaded into the tree
+    Imap::Mailbox::AbstractCache::MessageDataBundle bundle;
+    bundle.uid = 6;
+    bundle.envelope = sortingEnvelope(QDateTime(), QLatin1String("Banana"));
+    model->cache()->setMessageMetadata("a", 6, bundle);
+    bundle.uid = 9;
+    bundle.envelope = sortingEnvelope(QDateTime(), QLatin1String("apple"));
+    model->cache()->setMessageMetadata("a", 9, bundle);
+    msgListModel->setMailbox("a");
+    cClient(t.mk("SELECT a (QRESYNC (666 33 (2 9)))\r\n"));
+    cServer("* 3 EXISTS\r\n"
+            "* OK [UIDVALIDITY 666] .\r\n"
+            "* OK [UIDNEXT 15] .\r\n"
+            "* OK [HIGHESTMODSEQ 33] .\r\n"
+            );
+    cServer(t.last("OK selected\r\n"));
+    cEmpty();
+    checkUidMapFromThreading(uidMap);
+
+    // The subjects come from the cached envelopes; nothing is known about #10, so it sorts as an empty subject
+    QVERIFY(threadingModel->setUserSearchingSortingPreference(QStringList(), Imap::Mailbox::ThreadingMsgListModel::SORT_SUBJECT,
+                                                              Qt::DescendingOrder));
+    expected.clear();
+    expected << 6 << 9 << 10;
+    checkUidMapFromThreading(expected);
+    QCOMPARE(threadingModel->currentSortCriterium(), Imap::Mailbox::ThreadingMsgListModel::SORT_SUBJECT);
+    cEmpty();
+
+    QVERIFY(threadingModel->setUserSearchingSortingPreference(QStringList(), Imap::Mailbox::ThreadingMsgListModel::SORT_NONE,
+                                                              Qt::AscendingOrder));
+    checkUidMapFromThreading(uidMap);
+    cEmpty();
+    justKeepTask();
+}
+
+/** @short Measure how long it takes to sort a big mailbox locally */
+void ImapModelThreadingTest::testLocalSortingPerformance()
+{
+    const uint num = 200000;
+    QVector<Imap::Message::Envelope> envelopes(num + 1);
+    for (uint i = 1; i <= num; ++i) {
+        // A few hundred distinct subjects with assorted reply prefixes
+        envelopes[i].subject = QString::fromUtf8("%1Subject %2").arg(i % 3 ? QLatin1String("Re: ") : QLatin1String(""),
+                                                                     QString::number((i * 7919) % 503));
+    }
+
+    QBENCHMARK {
+        Imap::Mailbox::LocalSorting engine;
+        engine.setCriterium(Imap::Mailbox::LocalSorting::SORT_SUBJECT);
+        for (uint i = 1; i <= num; ++i) {
+            engine.addMessage(i, envelopes[i], QDateTime(), 0);
+        }
+        QCOMPARE(engine.sortedUids().size(), static_cast<int>(num));
+        // A new arrival only has to be merged in
+        engine.addMessage(num + 1, envelopes[1], QDateTime(), 0);
+        QCOMPARE(engine.sortedUids().size(), static_cast<int>(num + 1));
+    }
+}
+
 void ImapModelThreadingTest::testSortingPerformance()
 {
     threadingModel->setUserWantsThreading(false);
@@ -1225,6 +1739,104 @@ void ImapModelThreadingTest::testSearchingPerformance()
     }
 }
 
+/** @short Check that the PrettyMsgListModel hides read threads and reacts to flag changes incrementally */
+void ImapModelThreadingTest::testPrettyHideRead()
+{
+    using namespace Imap::Mailbox;
+
+    initialMessages(10);
+    Mapping mapping;
+    QByteArray response;
+    complexMapping(mapping, response);
+    cClient(t.mk("UID THREAD REFS utf-8 ALL\r\n"));
+    cServer(QByteArray("* THREAD ") + response + QByteArray("\r\n") + t.last("OK thread\r\n"));
+    QCOMPARE(treeToThreading(QModelIndex()), QByteArray("(1)(2 3)(4 (5)(6))(7 (8)(9 10))"));
+
+    PrettyMsgListModel pretty;
+    pretty.setSourceModel(threadingModel);
+    QCOMPARE(pretty.rowCount(), 4);
+
+    // Nested messages are passed through
+    QModelIndex thread7 = pretty.index(3, 0);
+    QCOMPARE(thread7.data(RoleMessageUid).toUInt(), 7u);
+    QCOMPARE(pretty.rowCount(thread7), 2);
+    QModelIndex msg9 = pretty.index(1, 0, thread7);
+    QCOMPARE(msg9.data(RoleMessageUid).toUInt(), 9u);
+    QCOMPARE(msg9.parent(), thread7);
+    QCOMPARE(pretty.mapFromSource(pretty.mapToSource(msg9)), msg9);
+    QCOMPARE(pretty.index(0, 0, msg9).data(RoleMessageUid).toUInt(), 10u);
+    QPersistentModelIndex persistent9 = msg9;
+
+    QSignalSpy inserted(&pretty, SIGNAL(rowsInserted(QModelIndex,int,int)));
+    QSignalSpy removed(&pretty, SIGNAL(rowsRemoved(QModelIndex,int,int)));
+
+    // Message #9 is the only unread one; the three threads in front of its thread are removed at once
+    pretty.setHideRead(true);
+    QCOMPARE(pretty.rowCount(), 1);
+    QCOMPARE(removed.size(), 1);
+    QCOMPARE(removed[0][1].toInt(), 0);
+    QCOMPARE(removed[0][2].toInt(), 2);
+    QVERIFY(inserted.isEmpty());
+    QVERIFY(persistent9.isValid());
+    QCOMPARE(persistent9.data(RoleMessageUid).toUInt(), 9u);
+    QCOMPARE(persistent9.parent().row(), 0);
+    removed.clear();
+
+    // A nested message becomes unread, which makes its whole thread visible
+    cServer("* 3 FETCH (FLAGS ())\r\n");
+    QCOMPARE(pretty.rowCount(), 2);
+    QCOMPARE(inserted.size(), 1);
+    QCOMPARE(inserted[0][1].toInt(), 0);
+    QCOMPARE(inserted[0][2].toInt(), 0);
+    QCOMPARE(pretty.index(0, 0).data(RoleMessageUid).toUInt(), 2u);
+    QCOMPARE(pretty.index(0, 0, pretty.index(0, 0)).data(RoleMessageUid).toUInt(), 3u);
+    QCOMPARE(persistent9.parent().row(), 1);
+    inserted.clear();
+
+    // Marking it as read again does not hide anything
+    cServer("* 3 FETCH (FLAGS (\\Seen))\r\n");
+    QCOMPARE(pretty.rowCount(), 2);
+    QVERIFY(inserted.isEmpty());
+    QVERIFY(removed.isEmpty());
+
+    pretty.setHideRead(false);
+    QCOMPARE(pretty.rowCount(), 4);
+    QCOMPARE(inserted.size(), 2);
+    QCOMPARE(inserted[0][1].toInt(), 0);
+    QCOMPARE(inserted[1][1].toInt(), 2);
+    QVERIFY(removed.isEmpty());
+    for (int i = 0; i < 4; ++i) {
+        QCOMPARE(pretty.index(i, 0).data(RoleMessageUid), threadingModel->index(i, 0).data(RoleMessageUid));
+    }
+    QCOMPARE(persistent9.parent().row(), 3);
+    cEmpty();
+}
+
+/** @short Measure how long it takes to process a flag change in a huge mailbox with the read messages hidden */
+void ImapModelThreadingTest::testPrettyHideReadPerformance()
+{
+    using namespace Imap::Mailbox;
+
+    const int num = 100000;
+    initialMessages(num);
+    cClient(t.mk("UID THREAD REFS utf-8 ALL\r\n"));
+    cServer(prepareHugeUntaggedThread(num) + t.last("OK thread\r\n"));
+
+    PrettyMsgListModel pretty;
+    pretty.setSourceModel(threadingModel);
+    pretty.setHideRead(true);
+    QVERIFY(pretty.rowCount() > 0);
+
+    int counter = 0;
+    QBENCHMARK {
+        // Walk through the mailbox so that some of the changes make the thread visible and some of them don't
+        const int seq = (counter % num) * 7919 % num + 1;
+        QByteArray flags = ++counter % 2 ? QByteArray() : QByteArray("\\Seen");
+        cServer("* " + QByteArray::number(seq) + " FETCH (FLAGS (" + flags + "))\r\n");
+    }
+    cEmpty();
+}
+
 /** @short Test that the INCTHREAD extension works as advertized */
 void ImapModelThreadingTest::testIncrementalThreading()
 {
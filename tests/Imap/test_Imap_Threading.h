@@ -41,12 +41,22 @@ private slots:
     void testDynamicSorting();
     void testDynamicSortingContext();
     void testDynamicSearch();
+    void testLocalSearch();
     void testIncrementalThreading();
     void testRemovingRootWithThreadingInFlight();
     void testMultipleExpunges();
     void testThreadingPerformance();
+    void testIncrementalApplyThreading();
+    void testIncrementalApplyThreadingArrival();
+    void testIncrementalApplyThreadingPerformance();
+    void testLocalThreading();
+    void testLocalThreadingPerformance();
+    void testLocalSorting();
+    void testLocalSortingPerformance();
     void testSortingPerformance();
     void testSearchingPerformance();
+    void testPrettyHideRead();
+    void testPrettyHideReadPerformance();
 
     void helper_multipleExpunges();
 protected slots:
@@ -0,0 +1,236 @@
+/* Copyright (C) 2006 - 2014 Jan Kundrát <jkt@flaska.net>
+
+   This file is part of the Trojita Qt IMAP e-mail client,
+   http://trojita.flaska.net/
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2 of
+   the License or (at your option) version 3 or any later version
+   accepted by the membership of KDE e.V. (or its successor approved
+   by the membership of KDE e.V.), which shall act as a proxy
+   defined in Section 14 of version 3 of the license.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <QFile>
+#include <QTemporaryFile>
+#include <QTest>
+#include <QTime>
+#include "test_FullTextIndex.h"
+#include "Utils/headless_test.h"
+#include "Imap/Model/FullTextIndex.h"
+#include "Imap/Model/FullTextIndexWorker.h"
+#include "Imap/Parser/Message.h"
+
+using namespace Imap::Mailbox;
+
+namespace
+{
+
+Imap::Message::Envelope makeEnvelope(const QString &subject, const QString &fromName, const QString &fromMailbox,
+                                     const QString &toMailbox)
+{
+    QList<Imap::Message::MailAddress> from, to;
+    from << Imap::Message::MailAddress(fromName, QString(), fromMailbox, QLatin1String("example.org"));
+    to << Imap::Message::MailAddress(QString(), QString(), toMailbox, QLatin1String("example.net"));
+    return Imap::Message::Envelope(QDateTime(), subject, from, from, from, to, QList<Imap::Message::MailAddress>(),
+                                   QList<Imap::Message::MailAddress>(), QList<QByteArray>(), QByteArray());
+}
+
+/** @short A pseudo-random but deterministic word, so that each word occurs in a reasonable number of messages */
+QString word(const uint seed)
+{
+    static const char *syllables[] = {"ka", "lo", "mi", "ne", "po", "ru", "si", "ta", "vu", "ze"};
+    QString res;
+    uint n = seed % 5000;
+    do {
+        res += QLatin1String(syllables[n % 10]);
+        n /= 10;
+    } while (n);
+    return res;
+}
+
+}
+
+void FullTextIndexTest::init()
+{
+    m_file = new QTemporaryFile();
+    QVERIFY(m_file->open());
+    m_index = 0;
+    openIndex();
+}
+
+void FullTextIndexTest::cleanup()
+{
+    closeIndex();
+    QFile::remove(m_file->fileName() + QLatin1String("-wal"));
+    QFile::remove(m_file->fileName() + QLatin1String("-shm"));
+    delete m_file;
+    m_file = 0;
+}
+
+void FullTextIndexTest::openIndex()
+{
+    m_index = new FullTextIndex(0, QLatin1String("test-fulltext"), m_file->fileName());
+    QVERIFY(m_index->open());
+}
+
+void FullTextIndexTest::closeIndex()
+{
+    delete m_index;
+    m_index = 0;
+}
+
+/** @short Fill the index with @arg num messages in mailbox "a" with a short subject and a bit of body text */
+void FullTextIndexTest::populate(const uint num)
+{
+    for (uint uid = 1; uid <= num; ++uid) {
+        m_index->addMetadata(QLatin1String("a"), uid,
+                             makeEnvelope(QString::fromUtf8("Re: %1 %2").arg(word(uid), word(uid * 7)),
+                                          QLatin1String("Sender ") + word(uid % 100), word(uid % 100),
+                                          word(uid % 50)));
+        QStringList body;
+        for (uint i = 0; i < 10; ++i)
+            body << word(uid * 13 + i * 101);
+        m_index->addBodyPart(QLatin1String("a"), uid, QLatin1String("1"), body.join(QLatin1String(" ")).toUtf8(),
+                             QByteArray("utf-8"));
+    }
+    m_index->flush();
+}
+
+void FullTextIndexTest::testTokenize()
+{
+    QCOMPARE(FullTextIndex::tokenize(QString::fromUtf8("Hello, World! a hello Žluťoučký-kůň 42")),
+             QStringList() << QLatin1String("hello") << QLatin1String("world") << QString::fromUtf8("žluťoučký")
+             << QString::fromUtf8("kůň") << QLatin1String("42"));
+    QCOMPARE(FullTextIndex::tokenize(QLatin1String("jkt@flaska.net")),
+             QStringList() << QLatin1String("jkt") << QLatin1String("flaska") << QLatin1String("net"));
+    QCOMPARE(FullTextIndex::tokenize(QLatin1String(" . x ")), QStringList());
+    QCOMPARE(FullTextIndex::tokenize(QString(40, QLatin1Char('x'))), QStringList() << QString(32, QLatin1Char('x')));
+}
+
+void FullTextIndexTest::testBodyDecoding()
+{
+    QCOMPARE(FullTextIndexWorker::decodeBodyText(QByteArray("GIF89a\0\0\0", 9), QByteArray()), QString());
+    QCOMPARE(FullTextIndexWorker::decodeBodyText(QByteArray("k\xc5\xaf\xc5\x88"), QByteArray()), QString::fromUtf8("kůň"));
+    QCOMPARE(FullTextIndexWorker::decodeBodyText(QByteArray("k\xf9\xf2"), QByteArray("ISO-8859-2")), QString::fromUtf8("kůň"));
+    QCOMPARE(FullTextIndexWorker::decodeBodyText(QByteArray("caf\xe9"), QByteArray("iso-8859-1")), QString::fromUtf8("café"));
+    // No charset and not valid UTF-8, so we cannot tell what it is
+    QCOMPARE(FullTextIndexWorker::decodeBodyText(QByteArray("caf\xe9"), QByteArray()), QString());
+    QCOMPARE(FullTextIndexWorker::decodeBodyText(QByteArray("cafe"), QByteArray("x-no-such-charset")), QString());
+    // The NULs are fine when the charset says so
+    QCOMPARE(FullTextIndexWorker::decodeBodyText(QByteArray("\0c\0a\0f\0\xe9", 8), QByteArray("UTF-16BE")),
+             QString::fromUtf8("café"));
+    QCOMPARE(FullTextIndex::tokenize(FullTextIndexWorker::decodeBodyText(
+                                         QByteArray("<html><body><p class=\"x\">Hi&nbsp;there</p></body></html>"),
+                                         QByteArray("us-ascii"))),
+             QStringList() << QLatin1String("hi") << QLatin1String("there"));
+}
+
+void FullTextIndexTest::testSearch()
+{
+    m_index->addMetadata(QLatin1String("a"), 10, makeEnvelope(QLatin1String("Quarterly report"), QLatin1String("Alice"),
+                                                               QLatin1String("alice"), QLatin1String("bob")));
+    m_index->addMetadata(QLatin1String("a"), 11, makeEnvelope(QLatin1String("Lunch"), QLatin1String("Bob"),
+                                                               QLatin1String("bob"), QLatin1String("alice")));
+    m_index->addMetadata(QLatin1String("a"), 12, makeEnvelope(QLatin1String("Reports"), QLatin1String("Carol"),
+                                                               QLatin1String("carol"), QLatin1String("alice")));
+    m_index->addBodyPart(QLatin1String("a"), 11, QLatin1String("1"), "Shall we discuss the quarterly numbers over lunch?",
+                         QByteArray("us-ascii"));
+    // These are not real parts and shall be ignored
+    m_index->addBodyPart(QLatin1String("a"), 12, QLatin1String("HEADER"), "Subject: quarterly", QByteArray());
+    m_index->addBodyPart(QLatin1String("a"), 12, QLatin1String("1.X-RAW"), "quarterly", QByteArray());
+    // Another mailbox
+    m_index->addMetadata(QLatin1String("b"), 10, makeEnvelope(QLatin1String("Quarterly"), QLatin1String("Dave"),
+                                                               QLatin1String("dave"), QLatin1String("alice")));
+    m_index->flush();
+
+    const int all = FullTextIndex::FIELD_SUBJECT | FullTextIndex::FIELD_FROM | FullTextIndex::FIELD_RECIPIENTS |
+            FullTextIndex::FIELD_BODY;
+    QCOMPARE(m_index->search(QLatin1String("a"), QStringList() << QLatin1String("quarterly"), FullTextIndex::FIELD_SUBJECT),
+             QList<uint>() << 10);
+    QCOMPARE(m_index->search(QLatin1String("a"), QStringList() << QLatin1String("quarterly"), all), QList<uint>() << 10 << 11);
+    QCOMPARE(m_index->search(QLatin1String("a"), QStringList() << QLatin1String("report"), FullTextIndex::FIELD_SUBJECT),
+             QList<uint>() << 10 << 12);
+    QCOMPARE(m_index->search(QLatin1String("a"), QStringList() << QLatin1String("rep") << QLatin1String("car"), all),
+             QList<uint>() << 12);
+    QCOMPARE(m_index->search(QLatin1String("a"), QStringList() << QLatin1String("alice"), FullTextIndex::FIELD_FROM),
+             QList<uint>() << 10);
+    QCOMPARE(m_index->search(QLatin1String("a"), QStringList() << QLatin1String("alice"), FullTextIndex::FIELD_RECIPIENTS),
+             QList<uint>() << 11 << 12);
+    QCOMPARE(m_index->search(QLatin1String("a"), QStringList() << QLatin1String("example"), FullTextIndex::FIELD_FROM),
+             QList<uint>() << 10 << 11 << 12);
+    QCOMPARE(m_index->search(QLatin1String("a"), QStringList() << QLatin1String("nothing"), all), QList<uint>());
+    QCOMPARE(m_index->search(QLatin1String("b"), QStringList() << QLatin1String("quarterly"), all), QList<uint>() << 10);
+    QCOMPARE(m_index->search(QLatin1String("c"), QStringList() << QLatin1String("quarterly"), all), QList<uint>());
+
+    QCOMPARE(m_index->indexedMessages(QLatin1String("a"), FullTextIndex::FIELD_SUBJECT), QList<uint>() << 10 << 11 << 12);
+    QCOMPARE(m_index->indexedMessages(QLatin1String("a"), FullTextIndex::FIELD_BODY), QList<uint>() << 11);
+    QCOMPARE(m_index->indexedMessages(QLatin1String("a"), FullTextIndex::FIELD_SUBJECT | FullTextIndex::FIELD_BODY),
+             QList<uint>() << 11);
+}
+
+void FullTextIndexTest::testForget()
+{
+    populate(10);
+    const int all = FullTextIndex::FIELD_SUBJECT | FullTextIndex::FIELD_FROM | FullTextIndex::FIELD_RECIPIENTS |
+            FullTextIndex::FIELD_BODY;
+    QVERIFY(m_index->search(QLatin1String("a"), QStringList() << word(3), FullTextIndex::FIELD_SUBJECT).contains(3));
+    QCOMPARE(m_index->indexedMessages(QLatin1String("a"), all).size(), 10);
+
+    m_index->forgetMessage(QLatin1String("a"), 3);
+    m_index->flush();
+    QVERIFY(!m_index->search(QLatin1String("a"), QStringList() << word(3), FullTextIndex::FIELD_SUBJECT).contains(3));
+    QCOMPARE(m_index->indexedMessages(QLatin1String("a"), all).size(), 9);
+    QVERIFY(!m_index->indexedMessages(QLatin1String("a"), all).contains(3));
+
+    m_index->forgetMailbox(QLatin1String("a"));
+    m_index->flush();
+    QCOMPARE(m_index->indexedMessages(QLatin1String("a"), all), QList<uint>());
+
+    // The data survive reopening
+    populate(5);
+    closeIndex();
+    openIndex();
+    QCOMPARE(m_index->indexedMessages(QLatin1String("a"), all), QList<uint>() << 1 << 2 << 3 << 4 << 5);
+}
+
+/** @short How long does it take to index 100k messages? */
+void FullTextIndexTest::benchmarkIndexing()
+{
+    const uint num = 100000;
+    QBENCHMARK_ONCE {
+        populate(num);
+    }
+    QCOMPARE(static_cast<uint>(m_index->indexedMessages(QLatin1String("a"), FullTextIndex::FIELD_BODY).size()), num);
+}
+
+/** @short How long does it take to search among 100k messages? */
+void FullTextIndexTest::benchmarkQuery()
+{
+    const uint num = 100000;
+    populate(num);
+    const int all = FullTextIndex::FIELD_SUBJECT | FullTextIndex::FIELD_FROM | FullTextIndex::FIELD_RECIPIENTS |
+            FullTextIndex::FIELD_BODY;
+    QTime latency;
+    latency.start();
+    QList<uint> res = m_index->search(QLatin1String("a"), QStringList() << word(42), all);
+    qDebug() << "First query:" << latency.elapsed() << "ms," << res.size() << "matches";
+    QVERIFY(res.contains(42));
+
+    QBENCHMARK {
+        res = m_index->search(QLatin1String("a"), QStringList() << word(42) << word(42 * 7), all);
+        QVERIFY(res.contains(42));
+        QCOMPARE(m_index->indexedMessages(QLatin1String("a"), all).size(), static_cast<int>(num));
+    }
+}
+
+TROJITA_HEADLESS_TEST(FullTextIndexTest)
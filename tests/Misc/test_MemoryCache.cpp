@@ -0,0 +1,144 @@
+/* Copyright (C) 2006 - 2014 Jan Kundrát <jkt@flaska.net>
+
+   This file is part of the Trojita Qt IMAP e-mail client,
+   http://trojita.flaska.net/
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2 of
+   the License or (at your option) version 3 or any later version
+   accepted by the membership of KDE e.V. (or its successor approved
+   by the membership of KDE e.V.), which shall act as a proxy
+   defined in Section 14 of version 3 of the license.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <QTest>
+#include "test_MemoryCache.h"
+#include "Utils/headless_test.h"
+#include "Imap/Model/MemoryCache.h"
+
+using namespace Imap::Mailbox;
+
+/** @short Check the per-mailbox data, including mailboxes which the cache has never heard about */
+void TestMemoryCache::testMailboxData()
+{
+    MemoryCache cache(0);
+    QCOMPARE(cache.childMailboxesFresh(QString()), false);
+    QCOMPARE(cache.childMailboxes(QLatin1String("foo")), QList<MailboxMetadata>());
+    QVERIFY(cache.uidMapping(QLatin1String("foo")).isEmpty());
+    QVERIFY(!cache.mailboxSyncState(QLatin1String("foo")).isUsableForSyncing());
+
+    cache.setChildMailboxes(QString(), QList<MailboxMetadata>());
+    QCOMPARE(cache.childMailboxesFresh(QString()), true);
+    QCOMPARE(cache.childMailboxesFresh(QLatin1String("foo")), false);
+
+    QList<MailboxMetadata> children;
+    children << MailboxMetadata(QLatin1String("foo.bar"), QLatin1String("."), QStringList());
+    cache.setChildMailboxes(QLatin1String("foo"), children);
+    QCOMPARE(cache.childMailboxes(QLatin1String("foo")), children);
+
+    SyncState state;
+    state.setExists(3);
+    state.setUidNext(10);
+    state.setUidValidity(666);
+    cache.setMailboxSyncState(QLatin1String("foo"), state);
+    QCOMPARE(cache.mailboxSyncState(QLatin1String("foo")).uidValidity(), 666u);
+
+    cache.setUidMapping(QLatin1String("foo"), QList<uint>() << 1 << 5 << 9);
+    QCOMPARE(cache.uidMapping(QLatin1String("foo")), QList<uint>() << 1 << 5 << 9);
+    cache.clearUidMapping(QLatin1String("foo"));
+    QVERIFY(cache.uidMapping(QLatin1String("foo")).isEmpty());
+    QCOMPARE(cache.mailboxSyncState(QLatin1String("foo")).uidNext(), 10u);
+}
+
+/** @short Check that the per-message data are kept and removed as needed */
+void TestMemoryCache::testMessageData()
+{
+    MemoryCache cache(0);
+    const QString mbox = QLatin1String("INBOX");
+
+    AbstractCache::MessageDataBundle bundle;
+    bundle.uid = 5;
+    bundle.size = 123;
+    cache.setMessageMetadata(mbox, 5, bundle);
+    cache.setMsgFlags(mbox, 5, QStringList() << QLatin1String("\\Seen"));
+    cache.setMsgPart(mbox, 5, QLatin1String("1"), "part one");
+    cache.setMsgPart(mbox, 6, QLatin1String("1"), "other message");
+
+    QCOMPARE(cache.messageMetadata(mbox, 5), bundle);
+    QCOMPARE(cache.messageMetadata(mbox, 6), AbstractCache::MessageDataBundle());
+    QCOMPARE(cache.msgFlags(mbox, 5), QStringList() << QLatin1String("\\Seen"));
+    QCOMPARE(cache.messagePart(mbox, 5, QLatin1String("1")), QByteArray("part one"));
+    QCOMPARE(cache.messagePart(mbox, 5, QLatin1String("2")), QByteArray());
+    QCOMPARE(cache.messagePart(QLatin1String("foo"), 5, QLatin1String("1")), QByteArray());
+    QCOMPARE(cache.partDataSize(), qint64(8 + 13));
+
+    // Overwriting a part doesn't count twice
+    cache.setMsgPart(mbox, 5, QLatin1String("1"), "part 1");
+    QCOMPARE(cache.partDataSize(), qint64(6 + 13));
+
+    cache.forgetMessagePart(mbox, 6, QLatin1String("1"));
+    QCOMPARE(cache.messagePart(mbox, 6, QLatin1String("1")), QByteArray());
+    QCOMPARE(cache.partDataSize(), qint64(6));
+
+    cache.clearMessage(mbox, 5);
+    QCOMPARE(cache.messageMetadata(mbox, 5), AbstractCache::MessageDataBundle());
+    QVERIFY(cache.msgFlags(mbox, 5).isEmpty());
+    QCOMPARE(cache.messagePart(mbox, 5, QLatin1String("1")), QByteArray());
+    QCOMPARE(cache.partDataSize(), qint64(0));
+
+    cache.setMsgFlags(mbox, 7, QStringList() << QLatin1String("\\Answered"));
+    cache.setMsgPart(mbox, 7, QLatin1String("HEADER"), "header");
+    cache.clearAllMessages(mbox);
+    QVERIFY(cache.msgFlags(mbox, 7).isEmpty());
+    QCOMPARE(cache.partDataSize(), qint64(0));
+}
+
+/** @short Check that the least recently used parts are dropped when the budget is exceeded */
+void TestMemoryCache::testPartBudget()
+{
+    MemoryCache cache(0);
+    const QString mbox = QLatin1String("INBOX");
+    const QByteArray data(100, 'x');
+
+    cache.setPartDataBudget(350);
+    cache.setMsgPart(mbox, 1, QLatin1String("1"), data);
+    cache.setMsgPart(mbox, 2, QLatin1String("1"), data);
+    cache.setMsgPart(QLatin1String("a"), 3, QLatin1String("1"), data);
+    QCOMPARE(cache.partDataSize(), qint64(300));
+
+    // Touching the first one makes the second one the least recently used part
+    QCOMPARE(cache.messagePart(mbox, 1, QLatin1String("1")), data);
+    cache.setMsgPart(mbox, 4, QLatin1String("1"), data);
+    QCOMPARE(cache.partDataSize(), qint64(300));
+    QCOMPARE(cache.messagePart(mbox, 2, QLatin1String("1")), QByteArray());
+    QCOMPARE(cache.messagePart(mbox, 1, QLatin1String("1")), data);
+    QCOMPARE(cache.messagePart(QLatin1String("a"), 3, QLatin1String("1")), data);
+    QCOMPARE(cache.messagePart(mbox, 4, QLatin1String("1")), data);
+
+    // Other data are never evicted
+    cache.setMsgFlags(mbox, 2, QStringList() << QLatin1String("\\Seen"));
+    cache.setPartDataBudget(150);
+    QCOMPARE(cache.partDataSize(), qint64(100));
+    QCOMPARE(cache.messagePart(mbox, 4, QLatin1String("1")), data);
+    QCOMPARE(cache.msgFlags(mbox, 2), QStringList() << QLatin1String("\\Seen"));
+
+    // A part which doesn't fit at all is not kept
+    cache.setMsgPart(mbox, 5, QLatin1String("1"), QByteArray(200, 'y'));
+    QCOMPARE(cache.partDataSize(), qint64(0));
+    QCOMPARE(cache.messagePart(mbox, 5, QLatin1String("1")), QByteArray());
+
+    cache.setPartDataBudget(-1);
+    cache.setMsgPart(mbox, 5, QLatin1String("1"), QByteArray(200, 'y'));
+    QCOMPARE(cache.partDataSize(), qint64(200));
+}
+
+TROJITA_HEADLESS_TEST(TestMemoryCache)
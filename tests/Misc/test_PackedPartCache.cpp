@@ -0,0 +1,250 @@
+/* Copyright (C) 2006 - 2014 Jan Kundrát <jkt@flaska.net>
+
+   This file is part of the Trojita Qt IMAP e-mail client,
+   http://trojita.flaska.net/
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2 of
+   the License or (at your option) version 3 or any later version
+   accepted by the membership of KDE e.V. (or its successor approved
+   by the membership of KDE e.V.), which shall act as a proxy
+   defined in Section 14 of version 3 of the license.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <QCoreApplication>
+#include <QDir>
+#include <QFile>
+#include <QSignalSpy>
+#include <QTest>
+#include "test_PackedPartCache.h"
+#include "Utils/headless_test.h"
+#include "Imap/Model/PackedPartCache.h"
+
+using namespace Imap::Mailbox;
+
+void TestPackedPartCache::init()
+{
+    m_cacheDir = QDir::tempPath() + QString::fromUtf8("/trojita-test-packedpartcache-%1/").arg(QCoreApplication::applicationPid());
+    QVERIFY(QDir().mkpath(m_cacheDir));
+}
+
+void TestPackedPartCache::cleanup()
+{
+    QDir root(m_cacheDir);
+    Q_FOREACH(const QString &subdir, root.entryList(QDir::Dirs | QDir::NoDotAndDotDot)) {
+        QDir dir(root.filePath(subdir));
+        Q_FOREACH(const QString &fname, dir.entryList(QDir::Files))
+            dir.remove(fname);
+        root.rmdir(subdir);
+    }
+    QDir().rmdir(m_cacheDir);
+}
+
+QString TestPackedPartCache::mailboxDir(const QString &mailbox) const
+{
+    return m_cacheDir + QString::fromUtf8(mailbox.toUtf8().toBase64());
+}
+
+QString TestPackedPartCache::packFileName(const QString &mailbox) const
+{
+    return mailboxDir(mailbox) + QLatin1String("/parts.pack");
+}
+
+void TestPackedPartCache::testStoreAndRetrieve()
+{
+    const QString mbox = QLatin1String("INBOX");
+    {
+        PackedPartCache cache(0, m_cacheDir);
+        QSignalSpy errorSpy(&cache, SIGNAL(error(QString)));
+        QCOMPARE(cache.messagePart(mbox, 1, QLatin1String("1")), QByteArray());
+        cache.setMsgPart(mbox, 1, QLatin1String("1"), "first part");
+        cache.setMsgPart(mbox, 1, QLatin1String("2"), "second part");
+        cache.setMsgPart(mbox, 2, QLatin1String("1"), "another message");
+        cache.setMsgPart(mbox, 3, QLatin1String("1"), "yet another one");
+        QCOMPARE(cache.messagePart(mbox, 1, QLatin1String("1")), QByteArray("first part"));
+        QCOMPARE(cache.messagePart(mbox, 1, QLatin1String("2")), QByteArray("second part"));
+
+        // Overwriting
+        cache.setMsgPart(mbox, 1, QLatin1String("1"), "replaced");
+        QCOMPARE(cache.messagePart(mbox, 1, QLatin1String("1")), QByteArray("replaced"));
+
+        cache.forgetMessagePart(mbox, 1, QLatin1String("2"));
+        QCOMPARE(cache.messagePart(mbox, 1, QLatin1String("2")), QByteArray());
+        cache.clearMessage(mbox, 2);
+        QCOMPARE(cache.messagePart(mbox, 2, QLatin1String("1")), QByteArray());
+        QCOMPARE(cache.messagePart(mbox, 3, QLatin1String("1")), QByteArray("yet another one"));
+        QVERIFY(errorSpy.isEmpty());
+    }
+
+    // The index is rebuilt from the file
+    PackedPartCache cache(0, m_cacheDir);
+    QCOMPARE(cache.messagePart(mbox, 1, QLatin1String("1")), QByteArray("replaced"));
+    QCOMPARE(cache.messagePart(mbox, 1, QLatin1String("2")), QByteArray());
+    QCOMPARE(cache.messagePart(mbox, 2, QLatin1String("1")), QByteArray());
+    QCOMPARE(cache.messagePart(mbox, 3, QLatin1String("1")), QByteArray("yet another one"));
+
+    cache.clearAllMessages(mbox);
+    QVERIFY(!QFile::exists(packFileName(mbox)));
+    QCOMPARE(cache.messagePart(mbox, 1, QLatin1String("1")), QByteArray());
+}
+
+void TestPackedPartCache::testCompaction()
+{
+    const QString mbox = QLatin1String("INBOX");
+    // Something which doesn't compress well
+    QByteArray big;
+    big.reserve(3 * 1024 * 1024);
+    quint32 seed = 42;
+    while (big.size() < 3 * 1024 * 1024) {
+        seed = seed * 1103515245 + 12345;
+        big.append(static_cast<char>(seed >> 16));
+    }
+
+    PackedPartCache cache(0, m_cacheDir);
+    QSignalSpy errorSpy(&cache, SIGNAL(error(QString)));
+    cache.setMsgPart(mbox, 1, QLatin1String("1"), big);
+    cache.setMsgPart(mbox, 2, QLatin1String("1"), "small");
+    QCOMPARE(cache.messagePart(mbox, 1, QLatin1String("1")), big);
+    QVERIFY(QFile(packFileName(mbox)).size() > 3 * 1024 * 1024);
+
+    cache.forgetMessagePart(mbox, 1, QLatin1String("1"));
+    // The compaction is performed from the event loop
+    QTest::qWait(10);
+    QVERIFY(QFile(packFileName(mbox)).size() < 1024);
+    QCOMPARE(cache.messagePart(mbox, 1, QLatin1String("1")), QByteArray());
+    QCOMPARE(cache.messagePart(mbox, 2, QLatin1String("1")), QByteArray("small"));
+
+    // Further writes go into the compacted file
+    cache.setMsgPart(mbox, 3, QLatin1String("1"), "after compaction");
+    QCOMPARE(cache.messagePart(mbox, 3, QLatin1String("1")), QByteArray("after compaction"));
+    QVERIFY(errorSpy.isEmpty());
+
+    PackedPartCache reopened(0, m_cacheDir);
+    QCOMPARE(reopened.messagePart(mbox, 2, QLatin1String("1")), QByteArray("small"));
+    QCOMPARE(reopened.messagePart(mbox, 3, QLatin1String("1")), QByteArray("after compaction"));
+}
+
+/** @short A half-written record at the end of the pack shall be discarded */
+void TestPackedPartCache::testTruncatedRecord()
+{
+    const QString mbox = QLatin1String("INBOX");
+    {
+        PackedPartCache cache(0, m_cacheDir);
+        cache.setMsgPart(mbox, 1, QLatin1String("1"), "survivor");
+    }
+    {
+        QFile f(packFileName(mbox));
+        QVERIFY(f.open(QIODevice::Append));
+        // A record kind, an UID and the beginning of a part ID
+        f.write(QByteArray("\x01\x00\x00\x00\x02\x00\x00", 7));
+    }
+    const qint64 damagedSize = QFile(packFileName(mbox)).size();
+
+    PackedPartCache cache(0, m_cacheDir);
+    QCOMPARE(cache.messagePart(mbox, 1, QLatin1String("1")), QByteArray("survivor"));
+    QCOMPARE(cache.messagePart(mbox, 2, QLatin1String("1")), QByteArray());
+    QCOMPARE(QFile(packFileName(mbox)).size(), damagedSize - 7);
+    cache.setMsgPart(mbox, 2, QLatin1String("1"), "new one");
+    QCOMPARE(cache.messagePart(mbox, 2, QLatin1String("1")), QByteArray("new one"));
+}
+
+/** @short Looking up or removing data must not create any files */
+void TestPackedPartCache::testNoFilesOnLookup()
+{
+    const QString mbox = QLatin1String("INBOX");
+    PackedPartCache cache(0, m_cacheDir);
+    QSignalSpy errorSpy(&cache, SIGNAL(error(QString)));
+    QCOMPARE(cache.messagePart(mbox, 1, QLatin1String("1")), QByteArray());
+    QCOMPARE(cache.messagePartFileName(mbox, 1, QLatin1String("1")), QString());
+    cache.forgetMessagePart(mbox, 1, QLatin1String("1"));
+    cache.clearMessage(mbox, 1);
+    QVERIFY(!QFile::exists(mailboxDir(mbox)));
+    QVERIFY(errorSpy.isEmpty());
+
+    cache.setMsgPart(mbox, 1, QLatin1String("1"), "data");
+    QVERIFY(QFile::exists(packFileName(mbox)));
+}
+
+/** @short Parts stored by the DiskPartCache before switching to packs remain accessible and get removed */
+void TestPackedPartCache::testLegacyFiles()
+{
+    const QString mbox = QLatin1String("INBOX");
+    {
+        DiskPartCache legacy(0, m_cacheDir);
+        legacy.setMsgPart(mbox, 1, QLatin1String("1"), "compressed file");
+        legacy.setMsgPart(mbox, 1, QLatin1String("2"), "another compressed file");
+        QVERIFY(legacy.setMsgPartEncoded(mbox, 2, QLatin1String("1"), "cGxhaW4gZmlsZQ==", "base64"));
+        legacy.setMsgPart(mbox, 3, QLatin1String("1"), "to be replaced");
+    }
+    const QString legacyPlainFile = mailboxDir(mbox) + QLatin1String("/2_1.data");
+    QVERIFY(QFile::exists(legacyPlainFile));
+
+    PackedPartCache cache(0, m_cacheDir);
+    QSignalSpy errorSpy(&cache, SIGNAL(error(QString)));
+    QCOMPARE(cache.messagePart(mbox, 1, QLatin1String("1")), QByteArray("compressed file"));
+    QCOMPARE(cache.messagePart(mbox, 2, QLatin1String("1")), QByteArray("plain file"));
+    QCOMPARE(cache.messagePartFileName(mbox, 2, QLatin1String("1")), legacyPlainFile);
+
+    // New data go into the pack and take precedence
+    cache.setMsgPart(mbox, 3, QLatin1String("1"), "replaced");
+    QCOMPARE(cache.messagePart(mbox, 3, QLatin1String("1")), QByteArray("replaced"));
+    QVERIFY(!QFile::exists(mailboxDir(mbox) + QLatin1String("/3_1.cache")));
+
+    cache.forgetMessagePart(mbox, 1, QLatin1String("2"));
+    QVERIFY(!QFile::exists(mailboxDir(mbox) + QLatin1String("/1_2.cache")));
+    QCOMPARE(cache.messagePart(mbox, 1, QLatin1String("2")), QByteArray());
+    QCOMPARE(cache.messagePart(mbox, 1, QLatin1String("1")), QByteArray("compressed file"));
+
+    cache.clearMessage(mbox, 1);
+    QVERIFY(!QFile::exists(mailboxDir(mbox) + QLatin1String("/1_1.cache")));
+    QCOMPARE(cache.messagePart(mbox, 1, QLatin1String("1")), QByteArray());
+
+    cache.clearMessage(mbox, 2);
+    QVERIFY(!QFile::exists(legacyPlainFile));
+    QCOMPARE(cache.messagePartFileName(mbox, 2, QLatin1String("1")), QString());
+    QVERIFY(errorSpy.isEmpty());
+}
+
+/** @short Data remain accessible when the pack files get closed because too many mailboxes are in use */
+void TestPackedPartCache::testManyMailboxes()
+{
+    const int count = 20;
+    PackedPartCache cache(0, m_cacheDir);
+    QSignalSpy errorSpy(&cache, SIGNAL(error(QString)));
+    for (int i = 0; i < count; ++i) {
+        cache.setMsgPart(QString::fromUtf8("mbox%1").arg(i), 1, QLatin1String("1"), QString::number(i).toUtf8());
+    }
+    for (int round = 0; round < 2; ++round) {
+        for (int i = 0; i < count; ++i) {
+            const QString mbox = QString::fromUtf8("mbox%1").arg(i);
+            QCOMPARE(cache.messagePart(mbox, 1, QLatin1String("1")), QString::number(i).toUtf8());
+            // Writing into a pack which has been closed in the meanwhile
+            cache.setMsgPart(mbox, 2 + round, QLatin1String("1"), "more");
+        }
+    }
+    for (int i = 0; i < count; ++i) {
+        const QString mbox = QString::fromUtf8("mbox%1").arg(i);
+        cache.forgetMessagePart(mbox, 2, QLatin1String("1"));
+        QCOMPARE(cache.messagePart(mbox, 2, QLatin1String("1")), QByteArray());
+        QCOMPARE(cache.messagePart(mbox, 3, QLatin1String("1")), QByteArray("more"));
+    }
+    QVERIFY(errorSpy.isEmpty());
+
+    PackedPartCache reopened(0, m_cacheDir);
+    for (int i = 0; i < count; ++i) {
+        const QString mbox = QString::fromUtf8("mbox%1").arg(i);
+        QCOMPARE(reopened.messagePart(mbox, 1, QLatin1String("1")), QString::number(i).toUtf8());
+        QCOMPARE(reopened.messagePart(mbox, 2, QLatin1String("1")), QByteArray());
+    }
+}
+
+TROJITA_HEADLESS_TEST(TestPackedPartCache)
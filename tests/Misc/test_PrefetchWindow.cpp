@@ -0,0 +1,150 @@
+/* Copyright (C) 2006 - 2014 Jan Kundrát <jkt@flaska.net>
+
+   This file is part of the Trojita Qt IMAP e-mail client,
+   http://trojita.flaska.net/
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2 of
+   the License or (at your option) version 3 or any later version
+   accepted by the membership of KDE e.V. (or its successor approved
+   by the membership of KDE e.V.), which shall act as a proxy
+   defined in Section 14 of version 3 of the license.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <QTest>
+#include "test_PrefetchWindow.h"
+#include "Utils/headless_test.h"
+#include "Imap/Model/PrefetchWindow.h"
+
+using namespace Imap::Mailbox;
+
+/** @short Without any information about the viewport, the behavior is the same as with a fixed window */
+void PrefetchWindowTest::testDefaultIsSymmetric()
+{
+    PrefetchWindow w;
+    QCOMPARE(w.rowsBefore(0), 50);
+    QCOMPARE(w.rowsAfter(0), 50);
+    w.setBaseSize(10);
+    QCOMPARE(w.rowsBefore(1000), 10);
+    QCOMPARE(w.rowsAfter(1000), 10);
+
+    // A single report doesn't say anything about the direction
+    w.viewportChanged(100, 119, 0);
+    QVERIFY(w.hasViewport());
+    QCOMPARE(w.rowsBefore(10), 10);
+    QCOMPARE(w.rowsAfter(10), 10);
+}
+
+/** @short The window shall grow in the direction of scrolling and shrink behind it */
+void PrefetchWindowTest::testFollowsScrolling()
+{
+    PrefetchWindow w;
+    w.setBaseSize(50);
+    qint64 now = 0;
+    for (int first = 0; first < 200; first += 5) {
+        QVERIFY(!w.viewportChanged(first, first + 19, now));
+        now += 50;
+    }
+    QVERIFY(w.rowsAfter(now) > 50 + 20);
+    QCOMPARE(w.rowsBefore(now), 20);
+
+    // After a while, the window gets back to the default
+    QCOMPARE(w.rowsAfter(now + 5000), 50);
+    QCOMPARE(w.rowsBefore(now + 5000), 50);
+
+    // Scrolling up is just a mirror image
+    w.reset();
+    for (int first = 1000; first > 800; first -= 5) {
+        QVERIFY(!w.viewportChanged(first, first + 19, now));
+        now += 50;
+    }
+    QVERIFY(w.rowsBefore(now) > 50 + 20);
+    QCOMPARE(w.rowsAfter(now), 20);
+}
+
+/** @short Jumping to another place in the list shall be recognized and forget about the old velocity */
+void PrefetchWindowTest::testJump()
+{
+    PrefetchWindow w;
+    w.setBaseSize(50);
+    qint64 now = 0;
+    for (int first = 0; first < 100; first += 5) {
+        w.viewportChanged(first, first + 19, now);
+        now += 50;
+    }
+    QVERIFY(w.rowsAfter(now) > 50);
+    QVERIFY(w.viewportChanged(50000, 50019, now));
+    QCOMPARE(w.rowsBefore(now), 50);
+    QCOMPARE(w.rowsAfter(now), 50);
+    QCOMPARE(w.firstVisible(), 50000);
+    QCOMPARE(w.lastVisible(), 50019);
+}
+
+/** @short Slower round trips shall result in a longer look-ahead */
+void PrefetchWindowTest::testLatency()
+{
+    PrefetchWindow fast, slow;
+    for (int i = 0; i < 20; ++i) {
+        fast.fetchCompleted(50, 10);
+        slow.fetchCompleted(50, 2000);
+    }
+    QVERIFY(fast.latency() < 50);
+    QVERIFY(slow.latency() > 1500);
+
+    qint64 now = 0;
+    for (int first = 0; first < 200; first += 5) {
+        fast.viewportChanged(first, first + 19, now);
+        slow.viewportChanged(first, first + 19, now);
+        now += 50;
+    }
+    QVERIFY(slow.rowsAfter(now) > fast.rowsAfter(now));
+    // ...but there's an upper bound
+    QVERIFY(slow.rowsAfter(now) <= 50 * 20);
+}
+
+/** @short The transfer time of the messages shall be told apart from the round trip, and a slow link shall preload more */
+void PrefetchWindowTest::testThroughput()
+{
+    PrefetchWindow fastLink, slowLink;
+    QCOMPARE(fastLink.throughput(), 0);
+    for (int i = 0; i < 10; ++i) {
+        // 100ms of latency on both, but 1ms vs. 20ms per message
+        fastLink.fetchCompleted(10, 110);
+        fastLink.fetchCompleted(100, 200);
+        slowLink.fetchCompleted(10, 300);
+        slowLink.fetchCompleted(100, 2100);
+    }
+    QCOMPARE(fastLink.latency(), 100);
+    QCOMPARE(slowLink.latency(), 100);
+    QCOMPARE(fastLink.throughput(), 1000);
+    QCOMPARE(slowLink.throughput(), 50);
+
+    qint64 now = 0;
+    for (int first = 0; first < 200; first += 5) {
+        fastLink.viewportChanged(first, first + 19, now);
+        slowLink.viewportChanged(first, first + 19, now);
+        now += 50;
+    }
+    QVERIFY(fastLink.rowsAfter(now) > 50 + 20);
+    QVERIFY(slowLink.rowsAfter(now) > fastLink.rowsAfter(now));
+    // The slow link cannot keep up with this pace at all, so the whole window is used
+    QCOMPARE(slowLink.rowsAfter(now), 50 * 20);
+
+    // Fetches of a single size don't say anything about the throughput
+    PrefetchWindow sameSize;
+    for (int i = 0; i < 10; ++i)
+        sameSize.fetchCompleted(50, 300);
+    QCOMPARE(sameSize.throughput(), 0);
+    QCOMPARE(sameSize.latency(), 300);
+}
+
+TROJITA_HEADLESS_TEST( PrefetchWindowTest )
@@ -0,0 +1,145 @@
+/* Copyright (C) 2006 - 2014 Jan Kundrát <jkt@flaska.net>
+
+   This file is part of the Trojita Qt IMAP e-mail client,
+   http://trojita.flaska.net/
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2 of
+   the License or (at your option) version 3 or any later version
+   accepted by the membership of KDE e.V. (or its successor approved
+   by the membership of KDE e.V.), which shall act as a proxy
+   defined in Section 14 of version 3 of the license.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <cstring>
+#include <QDebug>
+#include <QSet>
+#include <QTest>
+#include "test_SlabAllocator.h"
+#include "Utils/headless_test.h"
+#include "Common/SlabAllocator.h"
+
+using namespace Common;
+
+/** @short Small slabs, so that the tests cross their boundaries quickly */
+typedef SlabAllocator<24, 256> SmallAllocator;
+
+void SlabAllocatorTest::testAllocation()
+{
+    QFETCH(int, count);
+    const int perSlab = SmallAllocator::ObjectsPerSlab;
+    SmallAllocator allocator;
+    QVector<void *> ptrs;
+    QSet<quintptr> seen;
+    for (int i = 0; i < count; ++i) {
+        void *ptr = allocator.allocate();
+        QVERIFY(ptr);
+        // All slots are aligned for any kind of object
+        QCOMPARE(reinterpret_cast<quintptr>(ptr) % sizeof(void *), quintptr(0));
+        QCOMPARE(SmallAllocator::owner(ptr), &allocator);
+        // The memory is writable and nobody else got the same slot
+        memset(ptr, i & 0xff, 24);
+        QVERIFY(!seen.contains(reinterpret_cast<quintptr>(ptr)));
+        seen.insert(reinterpret_cast<quintptr>(ptr));
+        ptrs << ptr;
+    }
+    QCOMPARE(allocator.liveCount(), static_cast<std::size_t>(count));
+    QCOMPARE(allocator.slabCount(), (count + perSlab - 1) / perSlab);
+
+    for (int i = 0; i < count; ++i) {
+        const unsigned char *data = static_cast<const unsigned char *>(ptrs[i]);
+        QCOMPARE(static_cast<int>(data[23]), i & 0xff);
+        allocator.deallocate(ptrs[i]);
+    }
+    QCOMPARE(allocator.liveCount(), static_cast<std::size_t>(0));
+    // The slabs are kept around until the allocator goes away, and they get reused
+    QCOMPARE(allocator.slabCount(), (count + perSlab - 1) / perSlab);
+    for (int i = 0; i < count; ++i)
+        QVERIFY(seen.contains(reinterpret_cast<quintptr>(allocator.allocate())));
+    QCOMPARE(allocator.slabCount(), (count + perSlab - 1) / perSlab);
+    QCOMPARE(allocator.liveCount(), static_cast<std::size_t>(count));
+    for (int i = 0; i < count; ++i)
+        SmallAllocator::release(ptrs[i]);
+    QCOMPARE(allocator.liveCount(), static_cast<std::size_t>(0));
+}
+
+void SlabAllocatorTest::testAllocation_data()
+{
+    QTest::addColumn<int>("count");
+    QTest::newRow("none") << 0;
+    QTest::newRow("one") << 1;
+    QTest::newRow("exactly-one-slab") << static_cast<int>(SmallAllocator::ObjectsPerSlab);
+    QTest::newRow("one-slab-and-a-bit") << static_cast<int>(SmallAllocator::ObjectsPerSlab) + 1;
+    QTest::newRow("many") << 10000;
+}
+
+void SlabAllocatorTest::testReuse()
+{
+    SmallAllocator allocator;
+    void *a = allocator.allocate();
+    void *b = allocator.allocate();
+    void *c = allocator.allocate();
+    allocator.deallocate(a);
+    allocator.deallocate(c);
+    // The most recently freed slot is handed out first
+    QCOMPARE(allocator.allocate(), c);
+    QCOMPARE(allocator.allocate(), a);
+    QCOMPARE(allocator.slabCount(), 1);
+    QCOMPARE(allocator.liveCount(), static_cast<std::size_t>(3));
+    SmallAllocator::release(a);
+    SmallAllocator::release(b);
+    SmallAllocator::release(c);
+    QCOMPARE(allocator.liveCount(), static_cast<std::size_t>(0));
+}
+
+/** @short Objects which outlive their allocator shall not crash when they are released later on */
+void SlabAllocatorTest::testOrphans()
+{
+    SmallAllocator *allocator = new SmallAllocator();
+    void *survivor = allocator->allocate();
+    void *other = allocator->allocate();
+    allocator->deallocate(other);
+    delete allocator;
+    // The slab has been leaked on purpose, so the memory is still there, but nobody owns it
+    QCOMPARE(SmallAllocator::owner(survivor), static_cast<SmallAllocator *>(0));
+    SmallAllocator::release(survivor);
+}
+
+/** @short Measure the memory used per object
+
+A TreeItemMessage is seven pointers big on 64-bit systems. The system allocator adds its own bookkeeping header to each
+separate allocation and rounds the result up to the next multiple of 16 bytes, which means 64 bytes per message with
+glibc. The slabs store them back to back; the only overhead is one pointer per slab and the partially filled last slab.
+The freed slots are chained through their own memory, so they cost nothing.
+*/
+void SlabAllocatorTest::testMemoryOverhead()
+{
+    const std::size_t objectSize = 7 * sizeof(void *);
+    const int count = 100000;
+    typedef SlabAllocator<objectSize> Allocator;
+    Allocator allocator;
+    QCOMPARE(static_cast<std::size_t>(Allocator::SlotSize), objectSize);
+    QVector<void *> ptrs;
+    for (int i = 0; i < count; ++i)
+        ptrs << allocator.allocate();
+    QVERIFY(allocator.bytesReserved() >= count * objectSize);
+    QVERIFY(allocator.bytesReserved() < count * objectSize + count * sizeof(void *) / Allocator::ObjectsPerSlab
+            + 64 * 1024);
+    qDebug() << "Bytes per object:" << double(allocator.bytesReserved()) / count << "with the object size" << objectSize;
+    Q_FOREACH(void *ptr, ptrs)
+        allocator.deallocate(ptr);
+
+    // Odd sizes are padded so that each slot is aligned like a pointer, but not any further
+    QCOMPARE(static_cast<std::size_t>(SlabAllocator<sizeof(void *) + 1>::SlotSize), 2 * sizeof(void *));
+}
+
+TROJITA_HEADLESS_TEST( SlabAllocatorTest )
@@ -0,0 +1,78 @@
+/* Copyright (C) 2006 - 2014 Jan Kundrát <jkt@flaska.net>
+
+   This file is part of the Trojita Qt IMAP e-mail client,
+   http://trojita.flaska.net/
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2 of
+   the License or (at your option) version 3 or any later version
+   accepted by the membership of KDE e.V. (or its successor approved
+   by the membership of KDE e.V.), which shall act as a proxy
+   defined in Section 14 of version 3 of the license.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <QTest>
+#include "test_SmtpClient.h"
+#include "Common/MetaTypes.h"
+#include "Utils/headless_test.h"
+#include "qwwsmtpclient/qwwsmtpclient_p.h"
+
+/** @short Feed the chunks one by one through the same escaper and check the concatenated result */
+void SmtpClientTest::testEscapeMessageData()
+{
+    QFETCH(QList<QByteArray>, chunks);
+    QFETCH(QByteArray, expected);
+
+    QwwSmtpClientPrivate d(0);
+    d.atLineStart = true;
+    d.lastWasCR = false;
+    QByteArray res;
+    Q_FOREACH(const QByteArray &chunk, chunks) {
+        res += d.escapeMessageData(chunk);
+    }
+    QCOMPARE(res, expected);
+}
+
+void SmtpClientTest::testEscapeMessageData_data()
+{
+    QTest::addColumn<QList<QByteArray> >("chunks");
+    QTest::addColumn<QByteArray>("expected");
+
+    QTest::newRow("plain") << (QList<QByteArray>() << "foo\r\nbar\r\n") << QByteArray("foo\r\nbar\r\n");
+    QTest::newRow("dot-in-line") << (QList<QByteArray>() << "a.b\r\n.\r\n") << QByteArray("a.b\r\n..\r\n");
+    QTest::newRow("dot-at-start") << (QList<QByteArray>() << ".foo") << QByteArray("..foo");
+    QTest::newRow("dot-split-after-lf") << (QList<QByteArray>() << "foo\r\n" << ".bar") << QByteArray("foo\r\n..bar");
+    QTest::newRow("dot-split-after-cr") << (QList<QByteArray>() << "foo\r" << "\n.bar\r\n")
+                                        << QByteArray("foo\r\n..bar\r\n");
+    QTest::newRow("dot-split-everywhere") << (QList<QByteArray>() << "foo" << "\r" << "\n" << "." << "bar")
+                                          << QByteArray("foo\r\n..bar");
+    QTest::newRow("bare-cr") << (QList<QByteArray>() << "a\rb") << QByteArray("a\r\nb");
+    QTest::newRow("bare-cr-then-dot") << (QList<QByteArray>() << "a\r" << ".b") << QByteArray("a\r\n..b");
+    QTest::newRow("double-cr") << (QList<QByteArray>() << "a\r\r\nb") << QByteArray("a\r\n\r\nb");
+    QTest::newRow("bare-lf") << (QList<QByteArray>() << "a\n.b") << QByteArray("a\r\n..b");
+}
+
+/** @short A CR at the very end of a chunk must not be completed until we know what follows */
+void SmtpClientTest::testEscapeTrailingCR()
+{
+    QwwSmtpClientPrivate d(0);
+    d.atLineStart = true;
+    d.lastWasCR = false;
+    QCOMPARE(d.escapeMessageData("foo\r"), QByteArray("foo\r"));
+    QVERIFY(d.lastWasCR);
+    QVERIFY(!d.atLineStart);
+    QCOMPARE(d.escapeMessageData("x"), QByteArray("\nx"));
+    QVERIFY(!d.lastWasCR);
+    QVERIFY(!d.atLineStart);
+}
+
+TROJITA_HEADLESS_TEST(SmtpClientTest)
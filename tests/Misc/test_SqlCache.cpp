@@ -21,8 +21,10 @@
 */
 
 #include <QTest>
+#include <QTime>
 #include "test_SqlCache.h"
 #include "Utils/headless_test.h"
+#include "Imap/Model/CacheCompression.h"
 #include "Imap/Model/SQLCache.h"
 
 Q_DECLARE_METATYPE(QList<Imap::Mailbox::MailboxMetadata>)
@@ -92,4 +94,311 @@ void TestSqlCache::testMailboxOperation()
     QVERIFY(errorSpy->isEmpty());
 }
 
+/** @short Check that storing flags in bulk is equivalent to storing them one by one */
+void TestSqlCache::testMessageFlagsBulk()
+{
+    using namespace Imap::Mailbox;
+
+    // Make sure that both the full bulk queries and the remainder are exercised
+    QVector<QPair<uint, QStringList> > flags;
+    for (uint uid = 1; uid <= 250; ++uid) {
+        QStringList msgFlags;
+        if (uid % 2)
+            msgFlags << QLatin1String("\\Seen");
+        if (uid % 3)
+            msgFlags << QString::fromUtf8("$Label%1").arg(uid % 7);
+        flags << qMakePair(uid, msgFlags);
+    }
+    cache->setMsgFlagsBulk(QLatin1String("bulk"), flags);
+    CHECK_CACHE_ERRORS;
+
+    for (int i = 0; i < flags.size(); ++i) {
+        QCOMPARE(cache->msgFlags(QLatin1String("bulk"), flags[i].first), flags[i].second);
+    }
+    CHECK_CACHE_ERRORS;
+
+    // Overwriting works as well
+    flags.resize(120);
+    for (int i = 0; i < flags.size(); ++i) {
+        flags[i].second = QStringList() << QLatin1String("\\Deleted");
+    }
+    cache->setMsgFlagsBulk(QLatin1String("bulk"), flags);
+    CHECK_CACHE_ERRORS;
+    QCOMPARE(cache->msgFlags(QLatin1String("bulk"), 1), QStringList() << QLatin1String("\\Deleted"));
+    QCOMPARE(cache->msgFlags(QLatin1String("bulk"), 120), QStringList() << QLatin1String("\\Deleted"));
+    QCOMPARE(cache->msgFlags(QLatin1String("bulk"), 121), QStringList() << QLatin1String("\\Seen") << QLatin1String("$Label2"));
+
+    QVERIFY(errorSpy->isEmpty());
+}
+
+/** @short Check that the incremental updates of the UID mapping are equivalent to storing the full mapping */
+void TestSqlCache::testUidMappingLog()
+{
+    const QString mailbox = QLatin1String("uid-log");
+    QList<uint> uids;
+    for (uint uid = 1; uid <= 1000; ++uid)
+        uids << uid;
+    cache->setUidMapping(mailbox, uids);
+    CHECK_CACHE_ERRORS;
+
+    // Enough updates to go past a few checkpoints
+    uint nextUid = 1001;
+    for (int i = 0; i < 150; ++i) {
+        QList<uint> expunged, arrived;
+        expunged << uids[i] << uids[i + 100];
+        arrived << nextUid << nextUid + 1;
+        nextUid += 2;
+        cache->updateUidMapping(mailbox, expunged, arrived);
+        CHECK_CACHE_ERRORS;
+        uids.removeOne(expunged[0]);
+        uids.removeOne(expunged[1]);
+        uids += arrived;
+        QCOMPARE(cache->uidMapping(mailbox), uids);
+        CHECK_CACHE_ERRORS;
+    }
+
+    // A full rewrite discards the log
+    uids = uids.mid(500);
+    cache->setUidMapping(mailbox, uids);
+    QCOMPARE(cache->uidMapping(mailbox), uids);
+
+    // Nothing is stored when there's no full mapping to apply the changes to
+    cache->clearUidMapping(mailbox);
+    cache->updateUidMapping(mailbox, QList<uint>(), QList<uint>() << 5000);
+    QCOMPARE(cache->uidMapping(mailbox), QList<uint>());
+    cache->updateUidMapping(QLatin1String("uid-log-missing"), QList<uint>(), QList<uint>() << 1);
+    QCOMPARE(cache->uidMapping(QLatin1String("uid-log-missing")), QList<uint>());
+
+    QVERIFY(errorSpy->isEmpty());
+}
+
+/** @short Measure how long it takes to record a single expunge in a huge mailbox */
+void TestSqlCache::benchmarkUidMappingUpdate()
+{
+    const QString mailbox = QLatin1String("uid-log-benchmark");
+    QList<uint> uids;
+    for (uint uid = 1; uid <= 300000; ++uid)
+        uids << uid;
+    cache->setUidMapping(mailbox, uids);
+    CHECK_CACHE_ERRORS;
+
+    uint expunged = 0;
+    QBENCHMARK {
+        cache->updateUidMapping(mailbox, QList<uint>() << ++expunged, QList<uint>());
+    }
+    CHECK_CACHE_ERRORS;
+    QCOMPARE(cache->uidMapping(mailbox).size(), uids.size() - static_cast<int>(expunged));
+}
+
+/** @short Measure how many rows per second can be written into the flags table */
+void TestSqlCache::benchmarkMessageFlags()
+{
+    QFETCH(bool, bulk);
+    const int count = 50000;
+    const QString mailbox = QLatin1String(bulk ? "benchmark-bulk" : "benchmark-single");
+
+    QVector<QPair<uint, QStringList> > flags;
+    flags.reserve(count);
+    for (int i = 0; i < count; ++i) {
+        flags << qMakePair(static_cast<uint>(i + 1), QStringList() << QLatin1String("\\Seen") << QLatin1String("$Forwarded"));
+    }
+
+    QTime timer;
+    timer.start();
+    if (bulk) {
+        cache->setMsgFlagsBulk(mailbox, flags);
+    } else {
+        for (int i = 0; i < flags.size(); ++i) {
+            cache->setMsgFlags(mailbox, flags[i].first, flags[i].second);
+        }
+    }
+    const int elapsed = qMax(timer.elapsed(), 1);
+    CHECK_CACHE_ERRORS;
+    qDebug() << (bulk ? "bulk:" : "one by one:") << count << "rows in" << elapsed << "ms,"
+             << static_cast<qint64>(count) * 1000 / elapsed << "rows/s";
+
+    QCOMPARE(cache->msgFlags(mailbox, count), flags.last().second);
+    QVERIFY(errorSpy->isEmpty());
+}
+
+void TestSqlCache::benchmarkMessageFlags_data()
+{
+    QTest::addColumn<bool>("bulk");
+    QTest::newRow("one-by-one") << false;
+    QTest::newRow("bulk") << true;
+}
+
+/** @short Check that data survive a round trip through each codec and that the legacy records remain readable */
+void TestSqlCache::testCompression()
+{
+    using namespace Imap::Mailbox;
+    QFETCH(int, codec);
+    QFETCH(QByteArray, data);
+
+    CacheCompression compression(static_cast<CacheCompression::Codec>(codec));
+    QByteArray compressed = compression.compress(data);
+    QCOMPARE(CacheCompression::decompress(compressed), data);
+    QCOMPARE(CacheCompression::decompress(reinterpret_cast<const uchar *>(compressed.constData()), compressed.size()), data);
+    if (data.size() >= 1024) {
+        // These are highly redundant, so they have to shrink
+        QVERIFY(compressed.size() < data.size() || codec == CacheCompression::CODEC_NONE);
+    }
+
+    // Whatever the current codec is, the data written by previous versions have to be readable
+    if (!data.isEmpty()) {
+        QCOMPARE(CacheCompression::decompress(qCompress(data)), data);
+    }
+
+    cache->setCompression(compression);
+    cache->setMsgPart(QLatin1String("compression"), 1, QLatin1String("1"), data);
+    CHECK_CACHE_ERRORS;
+    QCOMPARE(cache->messagePart(QLatin1String("compression"), 1, QLatin1String("1")), data);
+    cache->setCompression(CacheCompression());
+    QVERIFY(errorSpy->isEmpty());
+}
+
+/** @short A corrupted size in the header must not lead to allocating a huge buffer */
+void TestSqlCache::testCompressionBogusSize()
+{
+    using namespace Imap::Mailbox;
+    QByteArray data(1000, 'a');
+    QByteArray compressed = CacheCompression(CacheCompression::CODEC_LZ).compress(data);
+    QCOMPARE(static_cast<uchar>(compressed[0]), static_cast<uchar>(0x81));
+    QCOMPARE(CacheCompression::decompress(compressed), data);
+
+    // Claim that this decompresses to almost 2GB
+    compressed[1] = 0x7f;
+    compressed[2] = 0xff;
+    QCOMPARE(CacheCompression::decompress(compressed), QByteArray());
+    // ...or to slightly more than what the data can possibly expand to
+    const quint32 tooBig = (compressed.size() - 5 + 1) * 255 + 1;
+    compressed[1] = tooBig >> 24;
+    compressed[2] = tooBig >> 16;
+    compressed[3] = tooBig >> 8;
+    compressed[4] = tooBig;
+    QCOMPARE(CacheCompression::decompress(compressed), QByteArray());
+}
+
+/** @short Overly long extended lengths must be rejected instead of overflowing */
+void TestSqlCache::testCompressionBogusLength()
+{
+    using namespace Imap::Mailbox;
+    // The tag and a claimed size of 100 bytes
+    QByteArray header;
+    header.append(static_cast<char>(0x81));
+    header.append(QByteArray("\x00\x00\x00\x64", 4));
+
+    // Literals whose length is extended by enough 0xff bytes to overflow a 32bit signed integer
+    QByteArray compressed = header;
+    compressed.append(static_cast<char>(0xf0));
+    compressed.append(QByteArray(8500000, static_cast<char>(0xff)));
+    compressed.append('\0');
+    compressed.append(QByteArray(100, 'a'));
+    QCOMPARE(CacheCompression::decompress(compressed), QByteArray());
+
+    // The same for the length of a match
+    compressed = header;
+    compressed.append(static_cast<char>(0x1f));
+    compressed.append('a');
+    compressed.append(QByteArray("\x01\x00", 2));
+    compressed.append(QByteArray(8500000, static_cast<char>(0xff)));
+    compressed.append('\0');
+    QCOMPARE(CacheCompression::decompress(compressed), QByteArray());
+
+    // A length which only slightly exceeds the claimed size is not accepted either
+    compressed = header;
+    compressed.append(static_cast<char>(0x1f));
+    compressed.append('a');
+    compressed.append(QByteArray("\x01\x00", 2));
+    compressed.append(static_cast<char>(100 - 1 - 4 - 15 + 1));
+    compressed.append('\0');
+    QCOMPARE(CacheCompression::decompress(compressed), QByteArray());
+    // ...while the exact one is
+    compressed[compressed.size() - 2] = static_cast<char>(100 - 1 - 4 - 15);
+    QCOMPARE(CacheCompression::decompress(compressed), QByteArray(100, 'a'));
+}
+
+void TestSqlCache::testCompression_data()
+{
+    using namespace Imap::Mailbox;
+    QTest::addColumn<int>("codec");
+    QTest::addColumn<QByteArray>("data");
+
+    QByteArray text;
+    for (int i = 0; i < 200; ++i) {
+        text += QString::fromUtf8("Line %1 of a rather boring message body, please keep reading\r\n").arg(i).toUtf8();
+    }
+    QByteArray binary;
+    for (int i = 0; i < 5000; ++i) {
+        binary += static_cast<char>((i * 7919) % 251);
+    }
+    binary += binary;
+
+    const int codecs[] = {CacheCompression::CODEC_NONE, CacheCompression::CODEC_ZLIB, CacheCompression::CODEC_LZ};
+    const char *names[] = {"none", "zlib", "lz"};
+    for (int i = 0; i < 3; ++i) {
+        QTest::newRow(QByteArray(names[i]).append("-empty").constData()) << codecs[i] << QByteArray();
+        QTest::newRow(QByteArray(names[i]).append("-tiny").constData()) << codecs[i] << QByteArray("x");
+        QTest::newRow(QByteArray(names[i]).append("-high-byte").constData()) << codecs[i] << QByteArray("\x80\x81\x82\xff");
+        QTest::newRow(QByteArray(names[i]).append("-text").constData()) << codecs[i] << text;
+        QTest::newRow(QByteArray(names[i]).append("-binary").constData()) << codecs[i] << binary;
+    }
+}
+
+/** @short Measure how long it takes to load the UID map and the metadata of a mailbox from the cache */
+void TestSqlCache::benchmarkOpenMailbox()
+{
+    using namespace Imap::Mailbox;
+    QFETCH(QString, codecName);
+    const int count = 5000;
+    const QString mailbox = QLatin1String("open-") + codecName;
+
+    cache->setCompression(CacheCompression(CacheCompression::codecFromName(codecName)));
+
+    QList<uint> uids;
+    for (int i = 0; i < count; ++i) {
+        const uint uid = i + 1;
+        uids << uid;
+        AbstractCache::MessageDataBundle bundle;
+        bundle.uid = uid;
+        bundle.size = 1000 + i;
+        bundle.internalDate = QDateTime(QDate(2013, 1, 1), QTime(12, 0)).addSecs(i * 60);
+        bundle.envelope.date = bundle.internalDate;
+        bundle.envelope.subject = QString::fromUtf8("Re: [some-list] Discussion thread number %1").arg(i / 10);
+        bundle.envelope.from << Imap::Message::MailAddress(QString::fromUtf8("Sender %1").arg(i % 50), QString(),
+                                                           QString::fromUtf8("sender%1").arg(i % 50), QLatin1String("example.org"));
+        bundle.envelope.to << Imap::Message::MailAddress(QLatin1String("Mailing List"), QString(),
+                                                         QLatin1String("some-list"), QLatin1String("lists.example.org"));
+        bundle.envelope.messageId = QString::fromUtf8("<msg%1@example.org>").arg(i).toUtf8();
+        bundle.hdrReferences << QString::fromUtf8("<msg%1@example.org>").arg(i / 10 * 10).toUtf8();
+        bundle.serializedBodyStructure = QByteArray("text/plain; charset=utf-8; 7bit; ").repeated(4);
+        cache->setMessageMetadata(mailbox, uid, bundle);
+    }
+    cache->setUidMapping(mailbox, uids);
+    CHECK_CACHE_ERRORS;
+
+    QTime timer;
+    timer.start();
+    QList<uint> loaded = cache->uidMapping(mailbox);
+    Q_FOREACH(const uint uid, loaded) {
+        AbstractCache::MessageDataBundle bundle = cache->messageMetadata(mailbox, uid);
+        QCOMPARE(bundle.uid, uid);
+    }
+    const int elapsed = timer.elapsed();
+    CHECK_CACHE_ERRORS;
+    qDebug() << codecName << ":" << count << "messages loaded in" << elapsed << "ms";
+
+    QCOMPARE(loaded, uids);
+    cache->setCompression(CacheCompression());
+    QVERIFY(errorSpy->isEmpty());
+}
+
+void TestSqlCache::benchmarkOpenMailbox_data()
+{
+    QTest::addColumn<QString>("codecName");
+    QTest::newRow("none") << QString::fromUtf8("none");
+    QTest::newRow("zlib") << QString::fromUtf8("zlib");
+    QTest::newRow("lz") << QString::fromUtf8("lz");
+}
+
 TROJITA_HEADLESS_TEST(TestSqlCache)
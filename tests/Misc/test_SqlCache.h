@@ -39,6 +39,17 @@ private Q_SLOTS:
     void initTestCase();
     void cleanupTestCase();
     void testMailboxOperation();
+    void testMessageFlagsBulk();
+    void testUidMappingLog();
+    void benchmarkUidMappingUpdate();
+    void benchmarkMessageFlags();
+    void benchmarkMessageFlags_data();
+    void testCompression();
+    void testCompression_data();
+    void testCompressionBogusSize();
+    void testCompressionBogusLength();
+    void benchmarkOpenMailbox();
+    void benchmarkOpenMailbox_data();
 
 private:
     Imap::Mailbox::SQLCache *cache;
@@ -22,6 +22,8 @@
 #include <QTest>
 #include "test_rfccodecs.h"
 #include "Utils/headless_test.h"
+#include "Common/MimeCodecs.h"
+#include "Imap/Parser/3rdparty/kcodecs.h"
 #include "Imap/Parser/3rdparty/rfccodecs.h"
 #include "Imap/Encoders.h"
 
@@ -346,4 +348,160 @@ void RFCCodecsTest::testRfc2231Encoding_data()
     QTest::newRow("question-mark") << QString::fromUtf8("?") << QByteArray("x*=\"utf-8''%3F\"");
 }
 
+void RFCCodecsTest::testIncrementalCteDecoding()
+{
+    QFETCH(QByteArray, encoding);
+    QFETCH(QByteArray, encoded);
+
+    QByteArray expected;
+    Imap::decodeContentTransferEncoding(encoded, encoding, &expected);
+
+    for (int chunkSize = 1; chunkSize <= encoded.size(); ++chunkSize) {
+        Imap::ContentTransferDecoder decoder(encoding);
+        QByteArray decoded;
+        for (int offset = 0; offset < encoded.size(); offset += chunkSize) {
+            decoded += decoder.decode(encoded.mid(offset, chunkSize));
+        }
+        decoded += decoder.finish();
+        QCOMPARE(decoded, expected);
+    }
+}
+
+void RFCCodecsTest::testIncrementalCteDecoding_data()
+{
+    QTest::addColumn<QByteArray>("encoding");
+    QTest::addColumn<QByteArray>("encoded");
+
+    QTest::newRow("7bit") << QByteArray("7bit") << QByteArray("foo\r\nbar\r\n");
+    QTest::newRow("base64") << QByteArray("base64") << QByteArray("cGxhaW50ZXh0\r\nIHdpdGggYSBuZXdsaW5l\r\nYWI=");
+    QTest::newRow("base64-unaligned-lines") << QByteArray("base64") << QByteArray("cGxha\r\nW50ZXh0IHdp\r\ndGg=\r\n");
+    QTest::newRow("quoted-printable") << QByteArray("quoted-printable")
+                                      << QByteArray("=C4=9B=C5=A1=C4=8D foo=\r\nbar=3D\r\nlast line=20");
+}
+
+namespace
+{
+
+QByteArray randomBytes(const int size, const QByteArray &alphabet = QByteArray())
+{
+    QByteArray res;
+    res.reserve(size);
+    for (int i = 0; i < size; ++i)
+        res.append(alphabet.isEmpty() ? char(qrand() % 256) : alphabet[qrand() % alphabet.size()]);
+    return res;
+}
+
+/** @short The reference MIME base64 encoding, one line at a time */
+QByteArray referenceMimeBase64(const QByteArray &raw)
+{
+    QByteArray res;
+    for (int i = 0; i < raw.size(); i += 57)
+        res += raw.mid(i, 57).toBase64() + "\r\n";
+    return res;
+}
+
+/** @short Some data which look like a typical quoted-printable message body */
+QByteArray sampleQuotedPrintable(const int size)
+{
+    QByteArray res;
+    while (res.size() < size) {
+        res += "P=C5=99=C3=ADli=C5=A1 =C5=BElu=C5=A5ou=C4=8Dk=C3=BD k=C5=AF=C5=88 =C3=BAp=C4=9Bl ";
+        res += "=C4=8F=C3=A1belsk=C3=A9 =C3=B3dy, and some plain ASCII text which forms the majority of the line=\r\n";
+        res += "more text here =3D with an escape\r\n";
+    }
+    return res;
+}
+
+}
+
+void RFCCodecsTest::testBase64Equivalence()
+{
+    qsrand(0);
+    for (int i = 0; i < 2000; ++i) {
+        QByteArray raw = randomBytes(qrand() % 300);
+        QByteArray encoded = Common::base64Encode(raw);
+        QCOMPARE(encoded, raw.toBase64());
+        QByteArray mimeEncoded = Common::base64Encode(raw, Common::BASE64_MIME_LINES);
+        QCOMPARE(mimeEncoded, referenceMimeBase64(raw));
+        QCOMPARE(mimeEncoded.size(), Common::base64EncodedLength(raw.size(), Common::BASE64_MIME_LINES));
+
+        QCOMPARE(Common::base64Decode(encoded), raw);
+        QCOMPARE(Common::base64Decode(mimeEncoded), raw);
+
+        // Random junk, including the padding characters in the middle of the data, is skipped the same way
+        QByteArray garbled = i % 2 ? mimeEncoded : encoded;
+        for (int j = qrand() % 6; j > 0; --j)
+            garbled.insert(qrand() % (garbled.size() + 1), randomBytes(1, QByteArray(" \r\n\t=*-_\xff")));
+        QCOMPARE(Common::base64Decode(garbled), QByteArray::fromBase64(garbled));
+    }
+}
+
+void RFCCodecsTest::testQuotedPrintableEquivalence()
+{
+    qsrand(0);
+    // A small alphabet makes sure that all kinds of valid, truncated and malformed escape sequences are hit
+    const QByteArray alphabet("===\r\n09AFafGz \xc4");
+    for (int i = 0; i < 5000; ++i) {
+        QByteArray encoded = randomBytes(qrand() % 40, alphabet);
+        QCOMPARE(Common::quotedPrintableDecode(encoded), KCodecs::quotedPrintableDecode(encoded));
+    }
+    QByteArray sample = sampleQuotedPrintable(10000);
+    QCOMPARE(Common::quotedPrintableDecode(sample), KCodecs::quotedPrintableDecode(sample));
+}
+
+void RFCCodecsTest::benchmarkBase64Encode()
+{
+    QFETCH(bool, reference);
+    qsrand(0);
+    QByteArray raw = randomBytes(8 * 1024 * 1024);
+    QByteArray encoded;
+    QBENCHMARK {
+        encoded = reference ? referenceMimeBase64(raw) : Common::base64Encode(raw, Common::BASE64_MIME_LINES);
+    }
+    QCOMPARE(encoded.size(), Common::base64EncodedLength(raw.size(), Common::BASE64_MIME_LINES));
+}
+
+void RFCCodecsTest::benchmarkBase64Encode_data()
+{
+    QTest::addColumn<bool>("reference");
+    QTest::newRow("QByteArray") << true;
+    QTest::newRow("MimeCodecs") << false;
+}
+
+void RFCCodecsTest::benchmarkBase64Decode()
+{
+    QFETCH(bool, reference);
+    qsrand(0);
+    QByteArray raw = randomBytes(8 * 1024 * 1024);
+    QByteArray encoded = Common::base64Encode(raw, Common::BASE64_MIME_LINES);
+    QByteArray decoded;
+    QBENCHMARK {
+        decoded = reference ? QByteArray::fromBase64(encoded) : Common::base64Decode(encoded);
+    }
+    QCOMPARE(decoded, raw);
+}
+
+void RFCCodecsTest::benchmarkBase64Decode_data()
+{
+    benchmarkBase64Encode_data();
+}
+
+void RFCCodecsTest::benchmarkQuotedPrintableDecode()
+{
+    QFETCH(bool, reference);
+    QByteArray encoded = sampleQuotedPrintable(8 * 1024 * 1024);
+    QByteArray decoded;
+    QBENCHMARK {
+        decoded = reference ? KCodecs::quotedPrintableDecode(encoded) : Common::quotedPrintableDecode(encoded);
+    }
+    QVERIFY(!decoded.isEmpty());
+}
+
+void RFCCodecsTest::benchmarkQuotedPrintableDecode_data()
+{
+    QTest::addColumn<bool>("reference");
+    QTest::newRow("KCodecs") << true;
+    QTest::newRow("MimeCodecs") << false;
+}
+
 TROJITA_HEADLESS_TEST( RFCCodecsTest )
@@ -43,6 +43,22 @@ private Q_SLOTS:
 
   void testRfc2231Encoding();
   void testRfc2231Encoding_data();
+
+  /** @short Make sure that chunked decoding produces the same result as decoding everything at once */
+  void testIncrementalCteDecoding();
+  void testIncrementalCteDecoding_data();
+
+  /** @short Compare the base64 codec with QByteArray's implementation on random data */
+  void testBase64Equivalence();
+  /** @short Compare the quoted-printable decoder with the one from KCodecs on random data */
+  void testQuotedPrintableEquivalence();
+
+  void benchmarkBase64Encode();
+  void benchmarkBase64Encode_data();
+  void benchmarkBase64Decode();
+  void benchmarkBase64Decode_data();
+  void benchmarkQuotedPrintableDecode();
+  void benchmarkQuotedPrintableDecode_data();
 };
 
 #endif
@@ -552,6 +552,7 @@ void LibMailboxSync::justKeepTask()
     Imap::Mailbox::KeepMailboxOpenTask *keepTask = dynamic_cast<Imap::Mailbox::KeepMailboxOpenTask*>(static_cast<Imap::Mailbox::ImapTask*>(firstTask.internalPointer()));
     QVERIFY(keepTask);
     QVERIFY(keepTask->requestedEnvelopes.isEmpty());
+    QVERIFY(keepTask->requestedPreloadEnvelopes.isEmpty());
     QVERIFY(keepTask->requestedParts.isEmpty());
     QVERIFY(keepTask->newArrivalsFetch.isEmpty());
 }
@@ -565,6 +566,16 @@ void LibMailboxSync::checkNoTasks()
     QCOMPARE(model->taskModel()->rowCount(parser1), 0);
 }
 
+/** @short Return the number of distinct flag lists which the Model has interned */
+int LibMailboxSync::internedFlagListsCount() const
+{
+    int count = 0;
+    Q_FOREACH(const QList<QStringList> &bucket, model->m_flagLists) {
+        count += bucket.size();
+    }
+    return count;
+}
+
 /** @short Find an item within a tree identified by a "path"
 
 Based on a textual "path" like "1.2.3" or "6", find an index within the model which corresponds to that location.
@@ -94,6 +94,7 @@ protected:
     void initialMessages(const uint exists);
     void justKeepTask();
     void checkNoTasks();
+    int internedFlagListsCount() const;
 
     Imap::Mailbox::Model* model;
     Imap::Mailbox::MsgListModel *msgListModel;